@@ -0,0 +1,348 @@
+// Microbenchmarks for the extension's internal functions.
+//
+// Embeds the interpreter, imports _picologging as a builtin module and calls the C++
+// entry points directly, so a single stage (format string rendering, path lookup,
+// record creation, clocks, asctime) can be measured without the Python call overhead that
+// bench_logger.py and bench_handlers.py include.
+//
+// Usage: bench_internals [--filter SUBSTRING] [--min-time SECONDS] [--repeat N] [--json]
+
+#include <Python.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "picologging.hxx"
+#include "logrecord.hxx"
+#include "formatstyle.hxx"
+#include "formatter.hxx"
+#include "filepathcache.hxx"
+#include "clock.hxx"
+
+PyMODINIT_FUNC PyInit__picologging(void);
+
+// Allocation counting, both for the Python allocators and for operator new.
+static std::atomic<uint64_t> g_allocations{0};
+
+void* operator new(size_t size) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    void* p = malloc(size ? size : 1);
+    if (p == nullptr)
+        throw std::bad_alloc();
+    return p;
+}
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+
+static PyMemAllocatorEx g_rawAllocator, g_memAllocator, g_objAllocator;
+
+static void* countingMalloc(void* ctx, size_t size) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    PyMemAllocatorEx* inner = (PyMemAllocatorEx*)ctx;
+    return inner->malloc(inner->ctx, size);
+}
+
+static void* countingCalloc(void* ctx, size_t nelem, size_t elsize) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    PyMemAllocatorEx* inner = (PyMemAllocatorEx*)ctx;
+    return inner->calloc(inner->ctx, nelem, elsize);
+}
+
+static void* countingRealloc(void* ctx, void* ptr, size_t size) {
+    if (ptr == nullptr)
+        g_allocations.fetch_add(1, std::memory_order_relaxed);
+    PyMemAllocatorEx* inner = (PyMemAllocatorEx*)ctx;
+    return inner->realloc(inner->ctx, ptr, size);
+}
+
+static void countingFree(void* ctx, void* ptr) {
+    PyMemAllocatorEx* inner = (PyMemAllocatorEx*)ctx;
+    inner->free(inner->ctx, ptr);
+}
+
+static void hookAllocator(PyMemAllocatorDomain domain, PyMemAllocatorEx* inner) {
+    PyMem_GetAllocator(domain, inner);
+    PyMemAllocatorEx hook = {inner, countingMalloc, countingCalloc, countingRealloc, countingFree};
+    PyMem_SetAllocator(domain, &hook);
+}
+
+typedef struct {
+    std::string name;
+    uint64_t iterations;
+    double nsPerOp;
+    double allocationsPerOp;
+} BenchmarkResult;
+
+typedef struct {
+    std::string filter;
+    double minTime = 0.2;
+    int repeat = 5;
+    bool json = false;
+} BenchmarkOptions;
+
+static BenchmarkOptions g_options;
+static std::vector<BenchmarkResult> g_results;
+
+[[noreturn]] static void fail(const std::string& name) {
+    fprintf(stderr, "benchmark %s failed\n", name.c_str());
+    if (PyErr_Occurred())
+        PyErr_Print();
+    exit(1);
+}
+
+/**
+ * Run `op` in batches sized to take about --min-time seconds, report the median
+ * of --repeat batches. `op` returns false with a Python error set on failure.
+ */
+static void bench(const std::string& name, const std::function<bool()>& op) {
+    if (!g_options.filter.empty() && name.find(g_options.filter) == std::string::npos)
+        return;
+    typedef std::chrono::steady_clock clock;
+
+    // Warm up caches and estimate the cost of one call.
+    uint64_t iterations = 1;
+    for (;;) {
+        auto start = clock::now();
+        for (uint64_t i = 0; i < iterations; i++)
+            if (!op())
+                fail(name);
+        double elapsed = std::chrono::duration<double>(clock::now() - start).count();
+        if (elapsed >= g_options.minTime / 10 || iterations >= (1ull << 32)) {
+            iterations = std::max<uint64_t>(1, (uint64_t)(iterations * g_options.minTime / std::max(elapsed, 1e-9)));
+            break;
+        }
+        iterations *= 10;
+    }
+
+    std::vector<double> samples;
+    uint64_t allocations = 0;
+    for (int r = 0; r < g_options.repeat; r++) {
+        uint64_t allocationsBefore = g_allocations.load(std::memory_order_relaxed);
+        auto start = clock::now();
+        for (uint64_t i = 0; i < iterations; i++)
+            if (!op())
+                fail(name);
+        auto end = clock::now();
+        allocations = g_allocations.load(std::memory_order_relaxed) - allocationsBefore;
+        samples.push_back(std::chrono::duration<double, std::nano>(end - start).count() / iterations);
+    }
+    std::sort(samples.begin(), samples.end());
+    g_results.push_back({name, iterations, samples[samples.size() / 2], (double)allocations / iterations});
+    if (!g_options.json)
+        printf("%-48s %12.1f ns/op %8.2f allocs/op\n", name.c_str(), g_results.back().nsPerOp, g_results.back().allocationsPerOp);
+}
+
+static LogRecord* newRecord(PyObject* name, PyObject* msg, PyObject* args, PyObject* pathname, PyObject* funcName) {
+    LogRecord* record = (LogRecord*)LogRecordType.tp_alloc(&LogRecordType, 0);
+    if (record == nullptr)
+        return nullptr;
+    return LogRecord_create(record, name, msg, args, LOG_LEVEL_WARNING, pathname, 42, Py_None, funcName, Py_None);
+}
+
+static PyObject* newFormatStyle(const char* fmt, char style) {
+    PyObject* kwds = Py_BuildValue("{s:C}", "style", style);
+    PyObject* args = Py_BuildValue("(s)", fmt);
+    PyObject* result = nullptr;
+    if (args != nullptr && kwds != nullptr)
+        result = PyObject_Call((PyObject*)&FormatStyleType, args, kwds);
+    Py_XDECREF(args);
+    Py_XDECREF(kwds);
+    return result;
+}
+
+static void benchFormatStyle(LogRecord* record) {
+    static const struct { const char* name; const char* fmt; char style; } cases[] = {
+        {"message", "%(message)s", '%'},
+        {"default", "%(levelname)s:%(name)s:%(message)s", '%'},
+        {"asctime", "%(asctime)s %(levelname)s %(name)s %(message)s", '%'},
+        {"all_fields", "%(asctime)s %(created)f %(levelname)s %(levelno)d %(name)s %(module)s %(filename)s:%(lineno)d %(funcName)s %(process)d %(thread)d %(message)s", '%'},
+        {"brace_message", "{message}", '{'},
+        {"brace_default", "{levelname}:{name}:{message}", '{'},
+    };
+    if (LogRecord_writeMessage(record) < 0)
+        fail("formatstyle");
+    // Normally set by the Formatter before the style is rendered
+    Py_SETREF(record->asctime, PyUnicode_FromString("2024-05-01 12:30:45,123"));
+    for (auto& c : cases) {
+        PyObject* style = newFormatStyle(c.fmt, c.style);
+        if (style == nullptr)
+            fail(c.name);
+        bench(std::string("FormatStyle_format/") + c.name, [style, record] {
+            PyObject* result = FormatStyle_format((FormatStyle*)style, (PyObject*)record);
+            Py_XDECREF(result);
+            return result != nullptr;
+        });
+        Py_DECREF(style);
+    }
+}
+
+static void benchFilepathCache() {
+    for (int count : {1, 16, 256}) {
+        std::vector<PyObject*> paths;
+        for (int i = 0; i < count; i++)
+            paths.push_back(PyUnicode_FromFormat("/srv/app/package/module_%d.py", i));
+        FilepathCache cache;
+        size_t index = 0;
+        bench("FilepathCache_lookup/paths=" + std::to_string(count), [&] {
+            FilepathCacheEntry entry;
+            if (cache.lookup(paths[index++ % paths.size()], &entry) < 0)
+                return false;
+            Py_DECREF(entry.filename);
+            Py_DECREF(entry.module);
+            return true;
+        });
+        for (PyObject* path : paths)
+            Py_DECREF(path);
+    }
+}
+
+static void benchLogRecordCreate(PyObject* name, PyObject* pathname, PyObject* funcName) {
+    PyObject* cases[][2] = {
+        {PyUnicode_FromString("no_args"), PyTuple_New(0)},
+        {PyUnicode_FromString("int"), Py_BuildValue("(i)", 42)},
+        {PyUnicode_FromString("str"), Py_BuildValue("(s)", "value")},
+        {PyUnicode_FromString("float"), Py_BuildValue("(d)", 3.14)},
+        {PyUnicode_FromString("mixed"), Py_BuildValue("(isd)", 1, "two", 3.0)},
+        {PyUnicode_FromString("mapping"), Py_BuildValue("({s:i})", "key", 1)},
+    };
+    PyObject* msg = PyUnicode_FromString("message %s");
+    for (auto& c : cases) {
+        PyObject* args = c[1];
+        bench(std::string("LogRecord_create/") + PyUnicode_AsUTF8(c[0]), [=] {
+            LogRecord* record = newRecord(name, msg, args, pathname, funcName);
+            Py_XDECREF(record);
+            return record != nullptr;
+        });
+        Py_DECREF(c[0]);
+        Py_DECREF(c[1]);
+    }
+    Py_DECREF(msg);
+}
+
+static void benchClocks(PyObject* name, PyObject* pathname, PyObject* funcName) {
+    static const struct { const char* name; RecordClock clock; } cases[] = {
+        {"realtime", Clock_Realtime},
+        {"coarse", Clock_Coarse},
+        {"monotonic", Clock_Monotonic},
+    };
+    PyObject* msg = PyUnicode_FromString("message");
+    PyObject* args = PyTuple_New(0);
+    for (auto& c : cases) {
+        RecordClock clock = c.clock;
+        bench(std::string("Clock_now/") + c.name, [clock] {
+            return Clock_now(clock) > 0;
+        });
+        bench(std::string("LogRecord_create/clock=") + c.name, [=] {
+            LogRecord* record = (LogRecord*)LogRecordType.tp_alloc(&LogRecordType, 0);
+            if (record == nullptr)
+                return false;
+            record = LogRecord_create(record, name, msg, args, LOG_LEVEL_WARNING, pathname, 42, Py_None, funcName, Py_None, clock);
+            Py_XDECREF(record);
+            return record != nullptr;
+        });
+    }
+    Py_DECREF(args);
+    Py_DECREF(msg);
+}
+
+static void benchFormatter(LogRecord* record) {
+    static const struct { const char* name; const char* fmt; const char* datefmt; } cases[] = {
+        {"message", "%(message)s", nullptr},
+        {"asctime_default", "%(asctime)s %(levelname)s %(message)s", nullptr},
+        {"asctime_datefmt", "%(asctime)s %(levelname)s %(message)s", "%H:%M:%S"},
+        {"asctime_iso", "%(asctime)s %(levelname)s %(message)s", "%Y-%m-%dT%H:%M:%S%z"},
+        {"asctime_rfc3339_nano", "%(asctime)s %(levelname)s %(message)s", "rfc3339_nano"},
+        {"asctime_epoch_millis", "%(asctime)s %(levelname)s %(message)s", "epoch_millis"},
+    };
+    for (auto& c : cases) {
+        PyObject* formatter = c.datefmt == nullptr
+            ? PyObject_CallFunction((PyObject*)&FormatterType, "s", c.fmt)
+            : PyObject_CallFunction((PyObject*)&FormatterType, "ss", c.fmt, c.datefmt);
+        if (formatter == nullptr)
+            fail(c.name);
+        bench(std::string("Formatter_format/") + c.name, [formatter, record] {
+            PyObject* result = Formatter_format((Formatter*)formatter, (PyObject*)record);
+            Py_XDECREF(result);
+            return result != nullptr;
+        });
+        Py_DECREF(formatter);
+    }
+}
+
+static void printJson() {
+    printf("{\n  \"python\": \"%s\",\n  \"benchmarks\": [\n", PY_VERSION);
+    for (size_t i = 0; i < g_results.size(); i++) {
+        const BenchmarkResult& r = g_results[i];
+        printf("    {\"name\": \"%s\", \"iterations\": %llu, \"ns_per_op\": %.2f, \"allocs_per_op\": %.3f}%s\n",
+            r.name.c_str(), (unsigned long long)r.iterations, r.nsPerOp, r.allocationsPerOp,
+            i + 1 < g_results.size() ? "," : "");
+    }
+    printf("  ]\n}\n");
+}
+
+static void usage(const char* program) {
+    fprintf(stderr, "usage: %s [--filter SUBSTRING] [--min-time SECONDS] [--repeat N] [--json]\n", program);
+    exit(2);
+}
+
+int main(int argc, char** argv) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--json") == 0) {
+            g_options.json = true;
+        } else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            g_options.filter = argv[++i];
+        } else if (strcmp(argv[i], "--min-time") == 0 && i + 1 < argc) {
+            g_options.minTime = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--repeat") == 0 && i + 1 < argc) {
+            g_options.repeat = std::max(1, atoi(argv[++i]));
+        } else {
+            usage(argv[0]);
+        }
+    }
+
+    if (PyImport_AppendInittab("_picologging", PyInit__picologging) < 0)
+        return 1;
+    Py_Initialize();
+    PyObject* module = PyImport_ImportModule("_picologging");
+    if (module == nullptr) {
+        PyErr_Print();
+        return 1;
+    }
+    hookAllocator(PYMEM_DOMAIN_RAW, &g_rawAllocator);
+    hookAllocator(PYMEM_DOMAIN_MEM, &g_memAllocator);
+    hookAllocator(PYMEM_DOMAIN_OBJ, &g_objAllocator);
+
+    PyObject* name = PyUnicode_FromString("bench.logger");
+    PyObject* pathname = PyUnicode_FromString("/srv/app/package/module.py");
+    PyObject* funcName = PyUnicode_FromString("handler");
+    PyObject* msg = PyUnicode_FromString("request %s took %d ms");
+    PyObject* args = Py_BuildValue("(si)", "/index", 12);
+    LogRecord* record = newRecord(name, msg, args, pathname, funcName);
+    if (record == nullptr)
+        fail("setup");
+
+    benchFormatStyle(record);
+    benchFilepathCache();
+    benchLogRecordCreate(name, pathname, funcName);
+    benchClocks(name, pathname, funcName);
+    benchFormatter(record);
+
+    if (g_options.json)
+        printJson();
+
+    Py_DECREF(record);
+    Py_DECREF(args);
+    Py_DECREF(msg);
+    Py_DECREF(funcName);
+    Py_DECREF(pathname);
+    Py_DECREF(name);
+    Py_DECREF(module);
+    return Py_FinalizeEx() < 0 ? 120 : 0;
+}
@@ -21,6 +21,34 @@ def record_factory_picologging():
         )
 
 
+def record_factory_kwargs_logging():
+    for _ in range(10_000):
+        logging.LogRecord(
+            name="hello",
+            level=logging.INFO,
+            pathname="/serv/",
+            lineno=123,
+            msg="bork bork bork",
+            args=(),
+            exc_info=None,
+            func="bork",
+        )
+
+
+def record_factory_kwargs_picologging():
+    for _ in range(10_000):
+        picologging.LogRecord(
+            name="hello",
+            level=logging.INFO,
+            pathname="/serv/",
+            lineno=123,
+            msg="bork bork bork",
+            args=(),
+            exc_info=None,
+            func="bork",
+        )
+
+
 def format_record_logging():
     f = logging.Formatter()
     record = logging.LogRecord(
@@ -57,6 +85,28 @@ def format_record_with_date_picologging():
         f.format(record)
 
 
+def handle_record_logging():
+    handler = logging.StreamHandler(StringIO())
+    handler.setFormatter(logging.Formatter("%(name)s - %(levelname)s - %(message)s"))
+    record = logging.LogRecord(
+        "hello", logging.INFO, "/serv/", 123, "bork bork bork", (), None
+    )
+    for _ in range(10_000):
+        handler.handle(record)
+
+
+def handle_record_picologging():
+    handler = picologging.StreamHandler(StringIO())
+    handler.setFormatter(
+        picologging.Formatter("%(name)s - %(levelname)s - %(message)s")
+    )
+    record = picologging.LogRecord(
+        "hello", logging.INFO, "/serv/", 123, "bork bork bork", (), None
+    )
+    for _ in range(10_000):
+        handler.handle(record)
+
+
 def log_debug_logging(level=logging.DEBUG):
     logger = logging.Logger("test", level)
     tmp = StringIO()
@@ -113,6 +163,40 @@ def log_debug_picologging_with_args(level=logging.DEBUG):
         logger.debug("There has been a picologging issue %s %s %s", 1, 2, 3)
 
 
+def adapter_info_logging(level=logging.DEBUG):
+    logger = logging.Logger("test", level)
+    handler = logging.StreamHandler(StringIO())
+    handler.setFormatter(
+        logging.Formatter("%(request_id)s - %(levelname)s - %(message)s")
+    )
+    logger.handlers.append(handler)
+    adapter = logging.LoggerAdapter(logger, {"request_id": "1234"})
+
+    for _ in range(10_000):
+        adapter.info("There has been a logging issue %s", 1)
+
+
+def adapter_info_picologging(level=logging.DEBUG):
+    logger = picologging.Logger("test", level)
+    handler = picologging.StreamHandler(StringIO())
+    handler.setFormatter(
+        picologging.Formatter("%(request_id)s - %(levelname)s - %(message)s")
+    )
+    logger.handlers.append(handler)
+    adapter = picologging.LoggerAdapter(logger, {"request_id": "1234"})
+
+    for _ in range(10_000):
+        adapter.info("There has been a picologging issue %s", 1)
+
+
+def adapter_info_outofscope_logging():
+    adapter_info_logging(logging.WARNING)
+
+
+def adapter_info_outofscope_picologging():
+    adapter_info_picologging(logging.WARNING)
+
+
 def log_debug_outofscope_logging():
     log_debug_logging(logging.INFO)
 
@@ -131,12 +215,18 @@ def log_debug_outofscope_picologging_with_args():
 
 __benchmarks__ = [
     (record_factory_logging, record_factory_picologging, "LogRecord()"),
+    (
+        record_factory_kwargs_logging,
+        record_factory_kwargs_picologging,
+        "LogRecord() with keywords",
+    ),
     (format_record_logging, format_record_picologging, "Formatter().format()"),
     (
         format_record_with_date_logging,
         format_record_with_date_picologging,
         "Formatter().format() with date",
     ),
+    (handle_record_logging, handle_record_picologging, "StreamHandler().handle()"),
     (log_debug_logging, log_debug_picologging, "Logger(level=DEBUG).debug()"),
     (
         log_debug_logging_with_args,
@@ -153,4 +243,14 @@ __benchmarks__ = [
         log_debug_outofscope_picologging_with_args,
         "Logger(level=INFO).debug() with args",
     ),
+    (
+        adapter_info_logging,
+        adapter_info_picologging,
+        "LoggerAdapter(level=DEBUG).info()",
+    ),
+    (
+        adapter_info_outofscope_logging,
+        adapter_info_outofscope_picologging,
+        "LoggerAdapter(level=WARNING).info()",
+    ),
 ]
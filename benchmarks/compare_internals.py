@@ -0,0 +1,53 @@
+"""
+Compare two JSON reports from the bench_internals executable.
+
+    python benchmarks/compare_internals.py base.json new.json --threshold 10
+
+Exits with status 1 when a benchmark got slower by more than the threshold
+(in percent) or needs more allocations per operation.
+"""
+
+import argparse
+import json
+import sys
+
+
+def load(path):
+    with open(path, encoding="utf-8") as f:
+        return {b["name"]: b for b in json.load(f)["benchmarks"]}
+
+
+def main(argv=None):
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[1])
+    parser.add_argument("base")
+    parser.add_argument("new")
+    parser.add_argument("--threshold", type=float, default=10.0)
+    args = parser.parse_args(argv)
+
+    base, new = load(args.base), load(args.new)
+    regressed = False
+    print(
+        f"{'Benchmark':<48} {'Base ns':>10} {'New ns':>10} {'Change':>8} {'Allocs':>12}"
+    )
+    for name, result in new.items():
+        if name not in base:
+            continue
+        before, after = base[name], result
+        change = (after["ns_per_op"] / before["ns_per_op"] - 1) * 100
+        allocs = f"{before['allocs_per_op']:g} -> {after['allocs_per_op']:g}"
+        flag = ""
+        if (
+            change > args.threshold
+            or after["allocs_per_op"] > before["allocs_per_op"] + 0.01
+        ):
+            flag = "  REGRESSED"
+            regressed = True
+        print(
+            f"{name:<48} {before['ns_per_op']:>10.1f} {after['ns_per_op']:>10.1f} "
+            f"{change:>+7.1f}% {allocs:>12}{flag}"
+        )
+    return 1 if regressed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,261 @@
+"""
+Multi-threaded contention and scaling benchmark.
+
+Runs 1..N threads logging through the same handler and reports throughput,
+per-call latency percentiles and the time spent waiting on the handler lock,
+for picologging and the standard library side by side.
+
+    python benchmarks/scaling.py --threads 1,4,16,64 --handlers stream,file
+    python benchmarks/scaling.py --json results.json
+
+This is a standalone script rather than a richbench module because it
+needs per-call timings from every thread.
+"""
+
+import argparse
+import array
+import json
+import logging
+import logging.handlers
+import os
+import platform
+import queue
+import sys
+import tempfile
+import threading
+import time
+
+import picologging
+import picologging.handlers
+
+HANDLERS = ("stream", "file", "queue", "rotating", "timedrotating")
+LIBRARIES = {"picologging": picologging, "logging": logging}
+
+
+class TimedLock:
+    """
+    Wraps a standard library handler lock and adds up the time spent
+    acquiring it. The total is only updated while the lock is held.
+    """
+
+    def __init__(self, lock):
+        self._lock = lock
+        self.waitTime = 0
+
+    def acquire(self, blocking=True, timeout=-1):
+        start = time.perf_counter_ns()
+        acquired = self._lock.acquire(blocking, timeout)
+        if acquired:
+            self.waitTime += time.perf_counter_ns() - start
+        return acquired
+
+    def release(self):
+        self._lock.release()
+
+    def __enter__(self):
+        return self.acquire()
+
+    def __exit__(self, *exc_info):
+        self.release()
+
+    def __getattr__(self, name):
+        return getattr(self._lock, name)
+
+
+def make_handler(library, kind, directory):
+    """
+    Return (handler, cleanup) for the named handler kind.
+    """
+    module = LIBRARIES[library]
+    handlers = picologging.handlers if library == "picologging" else logging.handlers
+    path = os.path.join(directory, "%s-%s.log" % (library, kind))
+    if kind == "stream":
+        stream = open(os.devnull, "w")
+        handler = module.StreamHandler(stream)
+        return handler, lambda: (handler.close(), stream.close())
+    if kind == "file":
+        handler = module.FileHandler(path)
+        return handler, handler.close
+    if kind == "queue":
+        records = queue.SimpleQueue()
+        stream = open(os.devnull, "w")
+        target = module.StreamHandler(stream)
+        handler = handlers.QueueHandler(records)
+        listener = handlers.QueueListener(records, target)
+        listener.start()
+
+        def cleanup():
+            listener.stop()
+            handler.close()
+            target.close()
+            stream.close()
+
+        return handler, cleanup
+    if kind == "rotating":
+        handler = handlers.RotatingFileHandler(
+            path, maxBytes=1024 * 1024, backupCount=3
+        )
+        return handler, handler.close
+    if kind == "timedrotating":
+        handler = handlers.TimedRotatingFileHandler(path, when="S", backupCount=3)
+        return handler, handler.close
+    raise ValueError("Unknown handler %r" % kind)
+
+
+def lock_wait_time(handler):
+    """
+    Seconds spent waiting on the handler lock, or None when it isn't measured.
+    """
+    if isinstance(getattr(handler, "lock", None), TimedLock):
+        return handler.lock.waitTime / 1e9
+    stats = getattr(handler, "stats", None)
+    if callable(stats):
+        return stats().get("lockWaitTime")
+    return None
+
+
+def percentile(samples, fraction):
+    return samples[min(len(samples) - 1, int(len(samples) * fraction))]
+
+
+def run(library, kind, threads, calls, directory):
+    module = LIBRARIES[library]
+    handler, cleanup = make_handler(library, kind, directory)
+    handler.setFormatter(
+        module.Formatter("%(asctime)s %(levelname)s %(threadName)s %(message)s")
+    )
+    if library == "logging":
+        handler.lock = TimedLock(handler.lock)
+    logger = module.Logger("scaling", module.DEBUG)
+    logger.addHandler(handler)
+
+    barrier = threading.Barrier(threads + 1)
+    latencies = [array.array("q") for _ in range(threads)]
+
+    def worker(samples):
+        clock = time.perf_counter_ns
+        info = logger.info
+        barrier.wait()
+        for i in range(calls):
+            start = clock()
+            info("request %d handled in %s ms", i, 1.5)
+            samples.append(clock() - start)
+
+    workers = [
+        threading.Thread(target=worker, args=(latencies[i],)) for i in range(threads)
+    ]
+    for t in workers:
+        t.start()
+    barrier.wait()
+    start = time.perf_counter()
+    for t in workers:
+        t.join()
+    elapsed = time.perf_counter() - start
+    lock_wait = lock_wait_time(handler)
+    logger.removeHandler(handler)
+    cleanup()
+
+    samples = sorted(s for thread_samples in latencies for s in thread_samples)
+    return {
+        "library": library,
+        "handler": kind,
+        "threads": threads,
+        "records": len(samples),
+        "seconds": elapsed,
+        "throughput": len(samples) / elapsed,
+        "p50_us": percentile(samples, 0.50) / 1000,
+        "p99_us": percentile(samples, 0.99) / 1000,
+        "p999_us": percentile(samples, 0.999) / 1000,
+        "lock_wait_s": lock_wait,
+    }
+
+
+def gil_enabled():
+    is_gil_enabled = getattr(sys, "_is_gil_enabled", None)
+    return is_gil_enabled() if is_gil_enabled is not None else True
+
+
+def main(argv=None):
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[1])
+    parser.add_argument("--threads", default="1,2,4,8,16,32")
+    parser.add_argument("--calls", type=int, default=10_000, help="calls per thread")
+    parser.add_argument("--handlers", default=",".join(HANDLERS))
+    parser.add_argument("--libraries", default="picologging,logging")
+    parser.add_argument("--json", metavar="PATH", help="also write results to PATH")
+    args = parser.parse_args(argv)
+
+    thread_counts = [int(n) for n in args.threads.split(",")]
+    kinds = args.handlers.split(",")
+    libraries = args.libraries.split(",")
+    for kind in kinds:
+        if kind not in HANDLERS:
+            parser.error("unknown handler %r, choose from %s" % (kind, HANDLERS))
+
+    print(
+        "Python %s (%s), GIL %s"
+        % (
+            platform.python_version(),
+            platform.python_implementation(),
+            "enabled" if gil_enabled() else "disabled",
+        )
+    )
+    header = "%-14s %-12s %7s %12s %9s %9s %9s %12s %8s" % (
+        "handler",
+        "library",
+        "threads",
+        "records/s",
+        "p50 us",
+        "p99 us",
+        "p999 us",
+        "lock wait s",
+        "speedup",
+    )
+    print(header)
+    print("-" * len(header))
+
+    results = []
+    with tempfile.TemporaryDirectory() as directory:
+        for kind in kinds:
+            for threads in thread_counts:
+                row = {}
+                for library in libraries:
+                    row[library] = run(library, kind, threads, args.calls, directory)
+                    results.append(row[library])
+                for library, result in row.items():
+                    if library == "picologging" and "logging" in row:
+                        speedup = "%7.1fx" % (
+                            result["throughput"] / row["logging"]["throughput"]
+                        )
+                    else:
+                        speedup = ""
+                    lock_wait = result["lock_wait_s"]
+                    print(
+                        "%-14s %-12s %7d %12.0f %9.1f %9.1f %9.1f %12s %8s"
+                        % (
+                            kind,
+                            library,
+                            threads,
+                            result["throughput"],
+                            result["p50_us"],
+                            result["p99_us"],
+                            result["p999_us"],
+                            "n/a" if lock_wait is None else "%.3f" % lock_wait,
+                            speedup,
+                        )
+                    )
+
+    if args.json:
+        with open(args.json, "w", encoding="utf-8") as f:
+            json.dump(
+                {
+                    "python": platform.python_version(),
+                    "gil_enabled": gil_enabled(),
+                    "results": results,
+                },
+                f,
+                indent=2,
+            )
+
+
+if __name__ == "__main__":
+    main()
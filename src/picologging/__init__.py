@@ -10,9 +10,15 @@ from ._picologging import (  # NOQA
     FormatStyle,
     Formatter,
     Logger,
+    LoggerAdapter,
     LogRecord,
     StreamHandler,
+    enableStats,
+    getClock,
     getLevelName,
+    lazy,
+    setClock,
+    stats,
 )
 
 __version__ = "0.9.4"
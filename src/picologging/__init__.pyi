@@ -1,4 +1,5 @@
 import sys
+import time
 from collections.abc import Callable, Iterable, Mapping
 from io import TextIOWrapper
 from multiprocessing import Manager
@@ -87,7 +88,8 @@ class LogRecord:
         ...
 
 class Formatter:
-    datefmt: str
+    datefmt: str | None
+    converter: Callable[[float | None], time.struct_time]
     def __init__(
         self,
         fmt: str | None = ...,
@@ -133,6 +135,8 @@ class Handler(Filterer):
     def get_name(self) -> str: ...
     def set_name(self, name: str) -> None: ...
     def createLock(self) -> None: ...
+    def stats(self) -> dict[str, int | float]: ...
+    def resetStats(self) -> None: ...
 
 class Logger(Filterer):
     propagate: bool
@@ -142,6 +146,7 @@ class Logger(Filterer):
     handlers: list[Handler]
     disabled: bool
     manager: Optional[Manager]
+    clock: _Clock | None
     def __init__(self, name: str, level: _Level = ...) -> None: ...
     def setLevel(self, level: _Level) -> None: ...
     def getEffectiveLevel(self) -> int: ...
@@ -225,13 +230,111 @@ class Logger(Filterer):
     def removeHandler(self, hdlr: Handler) -> None: ...
     def handle(self, record: LogRecord) -> None: ...
 
+class LoggerAdapter:
+    logger: Logger
+    extra: Mapping[str, object] | None
+    merge_extra: bool
+    manager: Optional[Manager]
+    @property
+    def name(self) -> str: ...
+    def __init__(
+        self,
+        logger: Logger,
+        extra: Mapping[str, object] | None = ...,
+        merge_extra: bool = ...,
+    ) -> None: ...
+    def process(
+        self, msg: Any, kwargs: dict[str, Any]
+    ) -> tuple[Any, dict[str, Any]]: ...
+    def debug(
+        self,
+        msg: object,
+        *args: object,
+        exc_info: _ExcInfoType = ...,
+        stack_info: bool = ...,
+        stacklevel: int = ...,
+        extra: Mapping[str, object] | None = ...,
+    ) -> None: ...
+    def info(
+        self,
+        msg: object,
+        *args: object,
+        exc_info: _ExcInfoType = ...,
+        stack_info: bool = ...,
+        stacklevel: int = ...,
+        extra: Mapping[str, object] | None = ...,
+    ) -> None: ...
+    def warning(
+        self,
+        msg: object,
+        *args: object,
+        exc_info: _ExcInfoType = ...,
+        stack_info: bool = ...,
+        stacklevel: int = ...,
+        extra: Mapping[str, object] | None = ...,
+    ) -> None: ...
+    def error(
+        self,
+        msg: object,
+        *args: object,
+        exc_info: _ExcInfoType = ...,
+        stack_info: bool = ...,
+        stacklevel: int = ...,
+        extra: Mapping[str, object] | None = ...,
+    ) -> None: ...
+    def exception(
+        self,
+        msg: object,
+        *args: object,
+        exc_info: _ExcInfoType = ...,
+        stack_info: bool = ...,
+        stacklevel: int = ...,
+        extra: Mapping[str, object] | None = ...,
+    ) -> None: ...
+    def critical(
+        self,
+        msg: object,
+        *args: object,
+        exc_info: _ExcInfoType = ...,
+        stack_info: bool = ...,
+        stacklevel: int = ...,
+        extra: Mapping[str, object] | None = ...,
+    ) -> None: ...
+    def log(
+        self,
+        level: int,
+        msg: object,
+        *args: object,
+        exc_info: _ExcInfoType = ...,
+        stack_info: bool = ...,
+        stacklevel: int = ...,
+        extra: Mapping[str, object] | None = ...,
+    ) -> None: ...
+    def isEnabledFor(self, level: int) -> bool: ...
+    def getEffectiveLevel(self) -> int: ...
+    def setLevel(self, level: _Level) -> None: ...
+
 class Filter:
     name: str  # undocumented
     nlen: int  # undocumented
     def __init__(self, name: str = ...) -> None: ...
     def filter(self, record: LogRecord) -> bool: ...
 
+class lazy:
+    func: Callable[..., object]
+    args: tuple[object, ...]
+    def __init__(
+        self, func: Callable[..., object], /, *args: object, **kwargs: object
+    ) -> None: ...
+
 def getLogger(name: str | None = ...) -> Logger: ...
+def stats() -> dict[str, Any]: ...
+def enableStats(enabled: bool = ...) -> bool: ...
+
+_Clock: TypeAlias = Literal["realtime", "coarse", "monotonic"]
+
+def setClock(clock: _Clock) -> _Clock: ...
+def getClock() -> _Clock: ...
 def debug(
     msg: object,
     *args: object,
@@ -318,6 +421,7 @@ _StreamT = TypeVar("_StreamT", bound=SupportsWrite[str])
 
 class StreamHandler(Handler, Generic[_StreamT]):
     stream: _StreamT  # undocumented
+    directWrite: bool
     @overload
     def __init__(self: StreamHandler[TextIO], stream: None = ...) -> None: ...
     @overload
@@ -6,11 +6,24 @@
 #include <unordered_map>
 #include "picologging.hxx"
 #include "logrecord.hxx"
+#include "clock.hxx"
+#include "lazy.hxx"
 #include "formatter.hxx"
 #include "formatstyle.hxx"
 #include "logger.hxx"
+#include "loggeradapter.hxx"
 #include "handler.hxx"
 #include "streamhandler.hxx"
+#include "deduplicationhandler.hxx"
+#include "binaryhandler.hxx"
+#include "flightrecorder.hxx"
+#include "bufferinghandler.hxx"
+#include "contexthandler.hxx"
+#include "wireformat.hxx"
+#include "sysloghandler.hxx"
+#include "journalhandler.hxx"
+#include "compressor.hxx"
+#include "sharedmemoryhandler.hxx"
 
 const std::unordered_map<short, std::string> LEVELS_TO_NAMES = {
   {LOG_LEVEL_DEBUG, "DEBUG"},
@@ -36,6 +49,35 @@ static inline picologging_state* get_picologging_state(PyObject* module) {
   return (picologging_state*)state;
 }
 
+#if PY_VERSION_HEX < 0x03090000 // Python 3.9.0
+// Types don't know their module before 3.9, so exec records them here
+static std::unordered_map<PyTypeObject*, picologging_state*> g_typeStates;
+#endif
+
+picologging_state* picologging_findTypeState(PyTypeObject* type) {
+#if PY_VERSION_HEX >= 0x030b0000 // Python 3.11.0
+  return get_picologging_state(PyType_GetModuleByDef(type, &_picologging_module));
+#else
+  // Subclasses defined in Python have no module of their own, use the first base that does
+  PyObject* mro = type->tp_mro;
+  for (Py_ssize_t i = 0; i < PyTuple_GET_SIZE(mro); i++) {
+    PyTypeObject* base = (PyTypeObject*)PyTuple_GET_ITEM(mro, i);
+#if PY_VERSION_HEX >= 0x03090000 // Python 3.9.0
+    if (!(base->tp_flags & Py_TPFLAGS_HEAPTYPE))
+      continue;
+    PyObject* module = ((PyHeapTypeObject*)base)->ht_module;
+    if (module != NULL && PyModule_GetDef(module) == &_picologging_module)
+      return get_picologging_state(module);
+#else
+    auto it = g_typeStates.find(base);
+    if (it != g_typeStates.end())
+      return it->second;
+#endif
+  }
+  return NULL;
+#endif
+}
+
 std::string _getLevelName(short level) {
   std::unordered_map<short, std::string>::const_iterator it;
   it = LEVELS_TO_NAMES.find(level);
@@ -85,78 +127,144 @@ static PyObject *getLevelName(PyObject *self, PyObject *level) {
 //-----------------------------------------------------------------------------
 static PyMethodDef picologging_methods[] = {
   {"getLevelName", (PyCFunction)getLevelName, METH_O, "Get level name by level number."},
+  {"stats", (PyCFunction)picologging_stats, METH_NOARGS, "Return handler counters summed over every handler, with per-handler figures under \"handlers\"."},
+  {"enableStats", (PyCFunction)(void(*)(void))picologging_enableStats, METH_FASTCALL, "Turn handler statistics on or off, returns the previous setting."},
+  {"encodeRecord", (PyCFunction)encodeRecord, METH_VARARGS, "Append a record to a bytearray as a length-prefixed binary frame."},
+  {"decodeRecords", (PyCFunction)decodeRecords, METH_O, "Decode the complete frames in a buffer, returning the records and the number of bytes consumed."},
+  {"setClock", (PyCFunction)picologging_setClock, METH_O, "Set the clock records are timestamped with: 'realtime', 'coarse' or 'monotonic'. Returns the previous clock."},
+  {"getClock", (PyCFunction)picologging_getClock, METH_NOARGS, "Return the name of the clock records are timestamped with."},
   {NULL, NULL, 0, NULL}        /* Sentinel */
 };
 
 //-----------------------------------------------------------------------------
 
 static int
-picologging_clear(PyObject *module)
+picologging_traverse(PyObject *module, visitproc visit, void *arg)
 {
-    picologging_state *state = get_picologging_state(module);
-    if (state && state->g_filepathCache) {
-      delete state->g_filepathCache;
-      state->g_filepathCache = nullptr;
+  picologging_state *state = get_picologging_state(module);
+  Py_VISIT(state->g_print_exception);
+  Py_VISIT(state->g_format_list);
+  Py_VISIT(state->g_extract_tb);
+  Py_VISIT(state->g_checkcache);
+  Py_VISIT(state->g_StringIO);
+  Py_VISIT(state->LogRecordType);
+  Py_VISIT(state->LazyType);
+  Py_VISIT(state->FormatStyleType);
+  Py_VISIT(state->FormatterType);
+  Py_VISIT(state->FiltererType);
+  Py_VISIT(state->LoggerType);
+  Py_VISIT(state->LoggerAdapterType);
+  Py_VISIT(state->HandlerType);
+  Py_VISIT(state->StreamHandlerType);
+  Py_VISIT(state->DeduplicationHandlerType);
+  Py_VISIT(state->BinaryFileHandlerType);
+  Py_VISIT(state->FlightRecorderHandlerType);
+  Py_VISIT(state->BufferingHandlerType);
+  Py_VISIT(state->MemoryHandlerType);
+  Py_VISIT(state->ContextBufferingHandlerType);
+  Py_VISIT(state->ContextScopeType);
+  Py_VISIT(state->SysLogHandlerType);
+  Py_VISIT(state->JournalHandlerType);
+  Py_VISIT(state->CompressorType);
+  Py_VISIT(state->SharedMemoryHandlerType);
+  Py_VISIT(state->SharedMemoryCollectorType);
+  return 0;
+}
 
-      Py_DECREF(state->g_const_CRITICAL);
-      Py_DECREF(state->g_const_ERROR);
-      Py_DECREF(state->g_const_WARNING);
-      Py_DECREF(state->g_const_INFO);
-      Py_DECREF(state->g_const_DEBUG);
-      Py_DECREF(state->g_const_NOTSET);
-    }
-    return 0;
+static int
+picologging_clear(PyObject *module)
+{
+  picologging_state *state = get_picologging_state(module);
+  Py_CLEAR(state->g_const_CRITICAL);
+  Py_CLEAR(state->g_const_ERROR);
+  Py_CLEAR(state->g_const_WARNING);
+  Py_CLEAR(state->g_const_INFO);
+  Py_CLEAR(state->g_const_DEBUG);
+  Py_CLEAR(state->g_const_NOTSET);
+  Py_CLEAR(state->g_default_fmt);
+  Py_CLEAR(state->g_print_exception);
+  Py_CLEAR(state->g_format_list);
+  Py_CLEAR(state->g_extract_tb);
+  Py_CLEAR(state->g_checkcache);
+  Py_CLEAR(state->g_StringIO);
+  Py_CLEAR(state->LogRecordType);
+  Py_CLEAR(state->LazyType);
+  Py_CLEAR(state->FormatStyleType);
+  Py_CLEAR(state->FormatterType);
+  Py_CLEAR(state->FiltererType);
+  Py_CLEAR(state->LoggerType);
+  Py_CLEAR(state->LoggerAdapterType);
+  Py_CLEAR(state->HandlerType);
+  Py_CLEAR(state->StreamHandlerType);
+  Py_CLEAR(state->DeduplicationHandlerType);
+  Py_CLEAR(state->BinaryFileHandlerType);
+  Py_CLEAR(state->FlightRecorderHandlerType);
+  Py_CLEAR(state->BufferingHandlerType);
+  Py_CLEAR(state->MemoryHandlerType);
+  Py_CLEAR(state->ContextBufferingHandlerType);
+  Py_CLEAR(state->ContextScopeType);
+  Py_CLEAR(state->SysLogHandlerType);
+  Py_CLEAR(state->JournalHandlerType);
+  Py_CLEAR(state->CompressorType);
+  Py_CLEAR(state->SharedMemoryHandlerType);
+  Py_CLEAR(state->SharedMemoryCollectorType);
+  return 0;
 }
 
 static void
 picologging_free(void *module)
 {
-    picologging_clear((PyObject *)module);
+  picologging_clear((PyObject *)module);
+  // Instances hold their type and the types hold the module, so nothing uses these any more
+  picologging_state *state = get_picologging_state((PyObject *)module);
+  delete state->g_filepathCache;
+  state->g_filepathCache = nullptr;
+  delete state->g_frameCache;
+  state->g_frameCache = nullptr;
+  Handler_freeRegistry(state);
 }
 
-struct PyModuleDef _picologging_module = {
-  .m_base = PyModuleDef_HEAD_INIT,
-  .m_name = "_picologging",
-  .m_doc = "Internal \"_picologging\" module",
-  .m_size = sizeof(picologging_state),
-  .m_methods = picologging_methods,
-  .m_slots = nullptr, // slots
-  .m_traverse = nullptr, // traverse
-  .m_clear = picologging_clear, // clear
-  .m_free = (freefunc)picologging_free // free
-};
-
-/* LCOV_EXCL_START */
-PyMODINIT_FUNC PyInit__picologging(void)
+/**
+ * Create the type for spec, bound to module m, and add it to m under the last
+ * component of its name. Returns a new reference.
+ */
+static PyTypeObject*
+addType(PyObject *m, PyType_Spec *spec, PyTypeObject *base)
 {
-  if (PyType_Ready(&LogRecordType) < 0)
-    return NULL;
-  if (PyType_Ready(&FormatStyleType) < 0)
+  PyObject* bases = base != NULL ? PyTuple_Pack(1, base) : NULL;
+  if (base != NULL && bases == NULL)
     return NULL;
-  if (PyType_Ready(&FormatterType) < 0)
+#if PY_VERSION_HEX >= 0x03090000 // Python 3.9.0
+  PyObject* type = PyType_FromModuleAndSpec(m, spec, bases);
+#else
+  PyObject* type = PyType_FromSpecWithBases(spec, bases);
+#endif
+  Py_XDECREF(bases);
+  if (type == NULL)
     return NULL;
-  if (PyType_Ready(&FiltererType) < 0)
-    return NULL;
-
-  LoggerType.tp_base = &FiltererType;
-  if (PyType_Ready(&LoggerType) < 0)
-    return NULL;
-
-  HandlerType.tp_base = &FiltererType;
-  if (PyType_Ready(&HandlerType) < 0)
-    return NULL;
-  
-  StreamHandlerType.tp_base = &HandlerType;
-  if (PyType_Ready(&StreamHandlerType) < 0)
-    return NULL;
-  
-  PyObject* m = PyModule_Create(&_picologging_module);
-  if (m == NULL)
+  const char* name = strrchr(spec->name, '.') + 1;
+  if (PyModule_AddObjectRef(m, name, type) < 0){
+    Py_DECREF(type);
     return NULL;
+  }
+#if PY_VERSION_HEX < 0x03090000 // Python 3.9.0
+  g_typeStates[(PyTypeObject*)type] = get_picologging_state(m);
+#endif
+  return (PyTypeObject*)type;
+}
 
-  // Initialize module state
+/* LCOV_EXCL_START */
+static int
+picologging_exec(PyObject *m)
+{
   picologging_state *state = get_picologging_state(m);
+#if PY_VERSION_HEX < 0x03090000 // Python 3.9.0
+  // The types can't hold a reference to their module, so keep it for good
+  Py_INCREF(m);
+#endif
   state->g_filepathCache = new FilepathCache();
+  state->g_frameCache = new FrameCache(state);
+  state->g_handlers = new HandlerRegistry();
   state->g_const_CRITICAL = PyUnicode_FromString("CRITICAL");
   state->g_const_ERROR = PyUnicode_FromString("ERROR");
   state->g_const_WARNING = PyUnicode_FromString("WARNING");
@@ -164,96 +272,161 @@ PyMODINIT_FUNC PyInit__picologging(void)
   state->g_const_DEBUG = PyUnicode_FromString("DEBUG");
   state->g_const_NOTSET = PyUnicode_FromString("NOTSET");
 
-  Py_INCREF(&LogRecordType);
-  Py_INCREF(&FormatStyleType);
-  Py_INCREF(&FormatterType);
-  Py_INCREF(&FiltererType);
-  Py_INCREF(&LoggerType);
-  Py_INCREF(&HandlerType);
-  Py_INCREF(&StreamHandlerType);
-    
-  if (PyModule_AddObject(m, "LogRecord", (PyObject *)&LogRecordType) < 0){
-    Py_DECREF(&LogRecordType);
-    Py_DECREF(m);
-    return NULL;
-  }
-  if (PyModule_AddObject(m, "FormatStyle", (PyObject *)&FormatStyleType) < 0){
-    Py_DECREF(&FormatStyleType);
-    Py_DECREF(m);
-    return NULL;
-  }
-  if (PyModule_AddObject(m, "Formatter", (PyObject *)&FormatterType) < 0){
-    Py_DECREF(&FormatterType);
-    Py_DECREF(m);
-    return NULL;
-  }
-  if (PyModule_AddObject(m, "Filterer", (PyObject *)&FiltererType) < 0){
-    Py_DECREF(&FiltererType);
-    Py_DECREF(m);
-    return NULL;
-  }
-  if (PyModule_AddObject(m, "Logger", (PyObject *)&LoggerType) < 0){
-    Py_DECREF(&LoggerType);
-    Py_DECREF(m);
-    return NULL;
-  }
-  if (PyModule_AddObject(m, "Handler", (PyObject *)&HandlerType) < 0){
-    Py_DECREF(&HandlerType);
-    Py_DECREF(m);
-    return NULL;
-  }
-  if (PyModule_AddObject(m, "StreamHandler", (PyObject *)&StreamHandlerType) < 0){
-    Py_DECREF(&StreamHandlerType);
-    Py_DECREF(m);
-    return NULL;
-  }
-  if (PyModule_AddStringConstant(m, "default_fmt", "%(message)s") < 0){
-    Py_DECREF(m);
-    return NULL;
-  }
+  state->LogRecordType = addType(m, &LogRecordType_spec, NULL);
+  if (state->LogRecordType == NULL)
+    return -1;
+#if PY_VERSION_HEX < 0x03090000 // Python 3.9.0
+  // The __dictoffset__ and __weaklistoffset__ members are only read from 3.9
+  state->LogRecordType->tp_dictoffset = offsetof(LogRecord, dict);
+#endif
+  state->LazyType = addType(m, &LazyType_spec, NULL);
+  if (state->LazyType == NULL)
+    return -1;
+  state->FormatStyleType = addType(m, &FormatStyleType_spec, NULL);
+  if (state->FormatStyleType == NULL)
+    return -1;
+  state->FormatterType = addType(m, &FormatterType_spec, NULL);
+  if (state->FormatterType == NULL)
+    return -1;
+  state->FiltererType = addType(m, &FiltererType_spec, NULL);
+  if (state->FiltererType == NULL)
+    return -1;
+  state->LoggerType = addType(m, &LoggerType_spec, state->FiltererType);
+  if (state->LoggerType == NULL)
+    return -1;
+  state->LoggerAdapterType = addType(m, &LoggerAdapterType_spec, NULL);
+  if (state->LoggerAdapterType == NULL)
+    return -1;
+  state->HandlerType = addType(m, &HandlerType_spec, state->FiltererType);
+  if (state->HandlerType == NULL)
+    return -1;
+#if PY_VERSION_HEX < 0x03090000 // Python 3.9.0
+  state->HandlerType->tp_weaklistoffset = offsetof(Handler, weakreflist);
+#endif
+  state->StreamHandlerType = addType(m, &StreamHandlerType_spec, state->HandlerType);
+  if (state->StreamHandlerType == NULL)
+    return -1;
+  state->DeduplicationHandlerType = addType(m, &DeduplicationHandlerType_spec, state->HandlerType);
+  if (state->DeduplicationHandlerType == NULL)
+    return -1;
+  state->BinaryFileHandlerType = addType(m, &BinaryFileHandlerType_spec, state->HandlerType);
+  if (state->BinaryFileHandlerType == NULL)
+    return -1;
+  state->FlightRecorderHandlerType = addType(m, &FlightRecorderHandlerType_spec, state->HandlerType);
+  if (state->FlightRecorderHandlerType == NULL)
+    return -1;
+  state->BufferingHandlerType = addType(m, &BufferingHandlerType_spec, state->HandlerType);
+  if (state->BufferingHandlerType == NULL)
+    return -1;
+  state->MemoryHandlerType = addType(m, &MemoryHandlerType_spec, state->BufferingHandlerType);
+  if (state->MemoryHandlerType == NULL)
+    return -1;
+  state->ContextBufferingHandlerType = addType(m, &ContextBufferingHandlerType_spec, state->HandlerType);
+  if (state->ContextBufferingHandlerType == NULL)
+    return -1;
+  state->ContextScopeType = addType(m, &ContextScopeType_spec, NULL);
+  if (state->ContextScopeType == NULL)
+    return -1;
+  state->SysLogHandlerType = addType(m, &SysLogHandlerType_spec, state->HandlerType);
+  if (state->SysLogHandlerType == NULL)
+    return -1;
+  state->JournalHandlerType = addType(m, &JournalHandlerType_spec, state->HandlerType);
+  if (state->JournalHandlerType == NULL)
+    return -1;
+  state->CompressorType = addType(m, &CompressorType_spec, NULL);
+  if (state->CompressorType == NULL)
+    return -1;
+  state->SharedMemoryHandlerType = addType(m, &SharedMemoryHandlerType_spec, state->HandlerType);
+  if (state->SharedMemoryHandlerType == NULL)
+    return -1;
+  state->SharedMemoryCollectorType = addType(m, &SharedMemoryCollectorType_spec, NULL);
+  if (state->SharedMemoryCollectorType == NULL)
+    return -1;
+#if PY_VERSION_HEX >= 0x03090000 // Python 3.9.0
+  state->LogRecordType->tp_vectorcall = LogRecord_vectorcall;
+  state->LazyType->tp_vectorcall = Lazy_vectorcall;
+#endif
+#if PY_VERSION_HEX < 0x030a0000 // Python 3.10.0
+  // Types from a spec get object.__new__ without Py_TPFLAGS_DISALLOW_INSTANTIATION
+  state->ContextScopeType->tp_new = NULL;
+#endif
+  if (SysLogHandler_addConstants(state->SysLogHandlerType) < 0)
+    return -1;
+
+  state->g_default_fmt = PyUnicode_FromString("%(message)s");
+  if (state->g_default_fmt == NULL)
+    return -1;
+  if (PyModule_AddObjectRef(m, "default_fmt", state->g_default_fmt) < 0)
+    return -1;
   if (PyModule_AddStringConstant(m, "default_datefmt", "%Y-%m-%d %H:%M:%S") < 0){
-    Py_DECREF(m);
-    return NULL;
+    return -1;
   }
   if (PyModule_AddStringConstant(m, "default_style", "%") < 0){
-    Py_DECREF(m);
-    return NULL;
+    return -1;
   }
 
   PyObject* traceback = PyImport_ImportModule("traceback");
   if (traceback == NULL)
-    return NULL;
-  PyObject* print_exception = PyObject_GetAttrString(traceback, "print_exception");
-  if (print_exception == NULL)
-    return NULL;
-  PyObject* print_stack = PyObject_GetAttrString(traceback, "print_stack");
-  if (print_stack == NULL)
-    return NULL;
+    return -1;
+  state->g_print_exception = PyObject_GetAttrString(traceback, "print_exception");
+  state->g_format_list = PyObject_GetAttrString(traceback, "format_list");
+  state->g_extract_tb = PyObject_GetAttrString(traceback, "extract_tb");
   Py_DECREF(traceback);
-  if (PyModule_AddObject(m, "print_exception", print_exception) < 0){
-    Py_DECREF(print_exception);
-    Py_DECREF(m);
-    return NULL;
-  }
-  if (PyModule_AddObject(m, "print_stack", print_stack) < 0){
-    Py_DECREF(print_stack);
-    Py_DECREF(m);
-    return NULL;
-  }
+  if (state->g_print_exception == NULL || state->g_format_list == NULL || state->g_extract_tb == NULL)
+    return -1;
+  if (PyModule_AddObjectRef(m, "print_exception", state->g_print_exception) < 0)
+    return -1;
+  if (PyModule_AddObjectRef(m, "format_list", state->g_format_list) < 0)
+    return -1;
+  if (PyModule_AddObjectRef(m, "extract_tb", state->g_extract_tb) < 0)
+    return -1;
+
+  PyObject* linecache = PyImport_ImportModule("linecache");
+  if (linecache == NULL)
+    return -1;
+  state->g_checkcache = PyObject_GetAttrString(linecache, "checkcache");
+  Py_DECREF(linecache);
+  if (state->g_checkcache == NULL)
+    return -1;
 
   PyObject* io = PyImport_ImportModule("io");
   if (io == NULL)
-    return NULL;
-  PyObject* stringio = PyObject_GetAttrString(io, "StringIO");
-  if (stringio == NULL)
-    return NULL;
+    return -1;
+  state->g_StringIO = PyObject_GetAttrString(io, "StringIO");
   Py_DECREF(io);
-  if (PyModule_AddObject(m, "StringIO", stringio) < 0){
-    Py_DECREF(stringio);
-    Py_DECREF(m);
-    return NULL;
-  }
+  if (state->g_StringIO == NULL)
+    return -1;
+  if (PyModule_AddObjectRef(m, "StringIO", state->g_StringIO) < 0)
+    return -1;
 
-  return m;
+  return 0;
 }
 /* LCOV_EXCL_STOP */
+
+static PyModuleDef_Slot picologging_slots[] = {
+  {Py_mod_exec, (void*)picologging_exec},
+#if PY_VERSION_HEX >= 0x030c0000 // Python 3.12.0
+  {Py_mod_multiple_interpreters, Py_MOD_PER_INTERPRETER_GIL_SUPPORTED},
+#endif
+#if PY_VERSION_HEX >= 0x030d0000 // Python 3.13.0
+  {Py_mod_gil, Py_MOD_GIL_NOT_USED},
+#endif
+  {0, NULL}
+};
+
+struct PyModuleDef _picologging_module = {
+  .m_base = PyModuleDef_HEAD_INIT,
+  .m_name = "_picologging",
+  .m_doc = "Internal \"_picologging\" module",
+  .m_size = sizeof(picologging_state),
+  .m_methods = picologging_methods,
+  .m_slots = picologging_slots, // slots
+  .m_traverse = picologging_traverse, // traverse
+  .m_clear = picologging_clear, // clear
+  .m_free = (freefunc)picologging_free // free
+};
+
+PyMODINIT_FUNC PyInit__picologging(void)
+{
+  return PyModuleDef_Init(&_picologging_module);
+}
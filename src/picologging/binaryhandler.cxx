@@ -0,0 +1,508 @@
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <mutex>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "binaryhandler.hxx"
+#include "handler.hxx"
+#include "logrecord.hxx"
+#include "tracebackformat.hxx"
+#include "compat.hxx"
+#include "picologging.hxx"
+
+static inline long long wallclock_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+static inline void putVarint(std::string& buffer, unsigned long long value) {
+    while (value >= 0x80) {
+        buffer.push_back((char)(value | 0x80));
+        value >>= 7;
+    }
+    buffer.push_back((char)value);
+}
+
+static inline void putZigzag(std::string& buffer, long long value) {
+    putVarint(buffer, ((unsigned long long)value << 1) ^ (unsigned long long)(value >> 63));
+}
+
+static inline void putFixed64(std::string& buffer, unsigned long long value) {
+    for (int i = 0; i < 8; i++) {
+        buffer.push_back((char)(value & 0xff));
+        value >>= 8;
+    }
+}
+
+/**
+ * Write a length-prefixed UTF-8 string. Lone surrogates are kept with
+ * "surrogatepass" so the decoder can restore the original string.
+ */
+static int putText(std::string& buffer, PyObject* text) {
+    PyObject* str = PyUnicode_Check(text) ? Py_NewRef(text) : PyObject_Str(text);
+    if (str == nullptr)
+        return -1;
+    Py_ssize_t size;
+    const char* data = PyUnicode_AsUTF8AndSize(str, &size);
+    if (data != nullptr) {
+        putVarint(buffer, (unsigned long long)size);
+        buffer.append(data, size);
+        Py_DECREF(str);
+        return 0;
+    }
+    PyErr_Clear();
+    PyObject* encoded = PyUnicode_AsEncodedString(str, "utf-8", "surrogatepass");
+    Py_DECREF(str);
+    if (encoded == nullptr)
+        return -1;
+    putVarint(buffer, (unsigned long long)PyBytes_GET_SIZE(encoded));
+    buffer.append(PyBytes_AS_STRING(encoded), PyBytes_GET_SIZE(encoded));
+    Py_DECREF(encoded);
+    return 0;
+}
+
+/**
+ * Encode a positional argument with its type tag. Returns 1 for types that
+ * can't be restored exactly by the decoder, so the caller falls back to text.
+ */
+static int putArg(std::string& buffer, PyObject* arg) {
+    if (arg == Py_None) {
+        buffer.push_back(BINARYLOG_ARG_NONE);
+    } else if (arg == Py_False) {
+        buffer.push_back(BINARYLOG_ARG_FALSE);
+    } else if (arg == Py_True) {
+        buffer.push_back(BINARYLOG_ARG_TRUE);
+    } else if (PyLong_CheckExact(arg)) {
+        int overflow;
+        long long value = PyLong_AsLongLongAndOverflow(arg, &overflow);
+        if (overflow != 0)
+            return 1;
+        if (value == -1 && PyErr_Occurred())
+            return -1;
+        buffer.push_back(BINARYLOG_ARG_INT);
+        putZigzag(buffer, value);
+    } else if (PyFloat_CheckExact(arg)) {
+        double value = PyFloat_AS_DOUBLE(arg);
+        unsigned long long bits;
+        memcpy(&bits, &value, sizeof(bits));
+        buffer.push_back(BINARYLOG_ARG_FLOAT);
+        putFixed64(buffer, bits);
+    } else if (PyUnicode_CheckExact(arg)) {
+        buffer.push_back(BINARYLOG_ARG_STR);
+        if (putText(buffer, arg) < 0)
+            return -1;
+    } else {
+        return 1;
+    }
+    return 0;
+}
+
+static void writeHeader(BinaryFileHandler* self) {
+    self->buffer->append(BINARYLOG_MAGIC, BINARYLOG_MAGIC_SIZE);
+    self->lastTime = wallclock_ns();
+    putFixed64(*self->buffer, (unsigned long long)self->lastTime);
+    putFixed64(*self->buffer, (unsigned long long)LogRecord_startTime());
+}
+
+static void clearDictionaries(BinaryFileHandler* self) {
+    for (auto obj : *self->keepAlive)
+        Py_DECREF(obj);
+    self->keepAlive->clear();
+    self->templates->clear();
+    self->sites->clear();
+}
+
+/**
+ * Cut the file back to `size` after a failed write, so a partly written
+ * entry doesn't misalign the ones written after it.
+ */
+static void truncateFile(FILE* file, long long size) {
+    clearerr(file);
+#ifdef _WIN32
+    _chsize_s(_fileno(file), size);
+    _fseeki64(file, size, SEEK_SET);
+#else
+    if (ftruncate(fileno(file), (off_t)size) == 0)
+        fseeko(file, (off_t)size, SEEK_SET);
+#endif
+}
+
+static long long fileSize(FILE* file) {
+#ifdef _WIN32
+    struct _stat64 st;
+    return _fstat64(_fileno(file), &st) == 0 ? (long long)st.st_size : -1;
+#else
+    struct stat st;
+    return fstat(fileno(file), &st) == 0 ? (long long)st.st_size : -1;
+#endif
+}
+
+/**
+ * Write out the pending entries. The bytes are moved out of the handler's
+ * buffer first so the write can run without the GIL. When the write fails
+ * the batch is lost, and the templates and call sites it defined with it,
+ * so the next batch starts a new self-contained session.
+ */
+static int writeBuffer(BinaryFileHandler* self) {
+    if (self->file == nullptr || self->buffer->empty())
+        return 0;
+    std::string pending;
+    pending.swap(*self->buffer);
+    FILE* file = self->file;
+    size_t written;
+    int error = 0;
+    Py_BEGIN_ALLOW_THREADS
+    long long start = fileSize(file);
+    errno = 0;
+    written = fwrite(pending.data(), 1, pending.size(), file);
+    if (written != pending.size()) {
+        error = errno != 0 ? errno : EIO;
+        if (written > 0 && start >= 0)
+            truncateFile(file, start);
+    }
+    Py_END_ALLOW_THREADS
+    // Hand the allocation back for the next batch.
+    pending.clear();
+    if (self->buffer->empty())
+        self->buffer->swap(pending);
+    if (error != 0) {
+        self->buffer->clear();
+        clearDictionaries(self);
+        writeHeader(self);
+        errno = error;
+        PyErr_SetFromErrno(PyExc_OSError);
+        return -1;
+    }
+    Handler_addBytesWritten(&self->handler, written);
+    return 0;
+}
+
+static size_t siteId(BinaryFileHandler* self, LogRecord* record) {
+    BinaryCallSite site = {record->name, record->pathname, record->funcName, record->lineno};
+    auto it = self->sites->find(site);
+    if (it != self->sites->end())
+        return it->second;
+    size_t id = self->sites->size();
+    std::string& buffer = *self->buffer;
+    size_t mark = buffer.size();
+    buffer.push_back(BINARYLOG_SITE);
+    putVarint(buffer, id);
+    if (putText(buffer, record->name) < 0 ||
+        putText(buffer, record->pathname) < 0) {
+        buffer.resize(mark);
+        return (size_t)-1;
+    }
+    // A missing function name is written as an empty string.
+    if (record->funcName == Py_None) {
+        putVarint(buffer, 0);
+    } else if (putText(buffer, record->funcName) < 0) {
+        buffer.resize(mark);
+        return (size_t)-1;
+    }
+    putZigzag(buffer, record->lineno);
+    self->sites->emplace(site, id);
+    self->keepAlive->push_back(Py_NewRef(record->name));
+    self->keepAlive->push_back(Py_NewRef(record->pathname));
+    self->keepAlive->push_back(Py_NewRef(record->funcName));
+    return id;
+}
+
+static size_t templateId(BinaryFileHandler* self, PyObject* msg) {
+    auto it = self->templates->find(msg);
+    if (it != self->templates->end())
+        return it->second;
+    size_t id = self->templates->size();
+    std::string& buffer = *self->buffer;
+    size_t mark = buffer.size();
+    buffer.push_back(BINARYLOG_TEMPLATE);
+    putVarint(buffer, id);
+    if (putText(buffer, msg) < 0) {
+        buffer.resize(mark);
+        return (size_t)-1;
+    }
+    self->templates->emplace(msg, id);
+    self->keepAlive->push_back(Py_NewRef(msg));
+    return id;
+}
+
+/**
+ * Write the optional exception and stack texts that follow a record.
+ */
+static int putTrailer(std::string& buffer, LogRecord* record, unsigned char flags) {
+    if ((flags & BINARYLOG_HAS_EXC_TEXT) && putText(buffer, record->excText) < 0)
+        return -1;
+    if ((flags & BINARYLOG_HAS_STACK_INFO) && putText(buffer, record->stackInfo) < 0)
+        return -1;
+    return 0;
+}
+
+static int trailerFlags(LogRecord* record, unsigned char* flags) {
+    *flags = 0;
+    if (record->excInfo != Py_None && record->excInfo != Py_False) {
+        if (record->excText == Py_None) {
+            PyObject* excText = formatException(GET_PICOLOGGING_STATE(record), record->excInfo);
+            if (excText == nullptr)
+                return -1;
+            Py_SETREF(record->excText, excText);
+        }
+    }
+    if (record->excText != Py_None)
+        *flags |= BINARYLOG_HAS_EXC_TEXT;
+    if (LogRecord_writeStackInfo(record) == -1)
+        return -1;
+    if (record->stackInfo != Py_None && record->stackInfo != Py_False &&
+        !(PyUnicode_Check(record->stackInfo) && PyUnicode_GET_LENGTH(record->stackInfo) == 0))
+        *flags |= BINARYLOG_HAS_STACK_INFO;
+    return 0;
+}
+
+PyObject* BinaryFileHandler_new(PyTypeObject* type, PyObject* args, PyObject* kwds)
+{
+    BinaryFileHandler* self = (BinaryFileHandler*)Handler_new(type, args, kwds);
+    if (self != NULL)
+    {
+        self->filename = Py_NewRef(Py_None);
+        self->mode = Py_NewRef(Py_None);
+        self->file = nullptr;
+        self->buffer = new std::string();
+        self->bufferSize = 0;
+        self->lastTime = 0;
+        self->templates = new std::unordered_map<PyObject*, size_t>();
+        self->sites = new std::unordered_map<BinaryCallSite, size_t, BinaryCallSiteHash, BinaryCallSiteEqual>();
+        self->keepAlive = new std::vector<PyObject*>();
+    }
+    return (PyObject*)self;
+}
+
+int BinaryFileHandler_init(BinaryFileHandler *self, PyObject *args, PyObject *kwds){
+    PyObject* noArgs = PyTuple_New(0);
+    int ret = Handler_init((Handler*)self, noArgs, nullptr);
+    Py_DECREF(noArgs);
+    if (ret < 0)
+        return -1;
+    PyObject *filename = nullptr;
+    const char *mode = "a";
+    Py_ssize_t bufferSize = 65536;
+    static const char *kwlist[] = {"filename", "mode", "buffer_size", NULL};
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|sn", const_cast<char**>(kwlist), &filename, &mode, &bufferSize)){
+        return -1;
+    }
+    const char* fileMode;
+    if (strcmp(mode, "a") == 0 || strcmp(mode, "ab") == 0) {
+        fileMode = "ab";
+    } else if (strcmp(mode, "w") == 0 || strcmp(mode, "wb") == 0) {
+        fileMode = "wb";
+    } else {
+        PyErr_Format(PyExc_ValueError, "mode must be 'a' or 'w', not '%s'", mode);
+        return -1;
+    }
+    if (bufferSize < 0) {
+        PyErr_SetString(PyExc_ValueError, "buffer_size must not be negative");
+        return -1;
+    }
+    PyObject* path = PyOS_FSPath(filename);
+    if (path == nullptr)
+        return -1;
+    PyObject* encodedPath = nullptr;
+    if (!PyUnicode_FSConverter(path, &encodedPath)) {
+        Py_DECREF(path);
+        return -1;
+    }
+    FILE* file = fopen(PyBytes_AS_STRING(encodedPath), fileMode);
+    if (file == nullptr) {
+        PyErr_SetFromErrnoWithFilenameObject(PyExc_OSError, path);
+        Py_DECREF(encodedPath);
+        Py_DECREF(path);
+        return -1;
+    }
+    Py_DECREF(encodedPath);
+    // Records are already batched in the handler's buffer.
+    setvbuf(file, nullptr, _IONBF, 0);
+
+    if (self->file != nullptr) {
+        writeBuffer(self);
+        fclose(self->file);
+    }
+    self->file = file;
+    Py_SETREF(self->filename, path);
+    Py_SETREF(self->mode, PyUnicode_FromString(mode));
+    self->bufferSize = (size_t)bufferSize;
+    self->buffer->clear();
+    clearDictionaries(self);
+    writeHeader(self);
+    return 0;
+}
+
+PyObject* BinaryFileHandler_dealloc(BinaryFileHandler *self) {
+    if (self->file != nullptr) {
+        if (writeBuffer(self) < 0)
+            PyErr_Clear();
+        fclose(self->file);
+        self->file = nullptr;
+    }
+    clearDictionaries(self);
+    delete self->keepAlive;
+    delete self->templates;
+    delete self->sites;
+    delete self->buffer;
+    Py_CLEAR(self->filename);
+    Py_CLEAR(self->mode);
+    Handler_dealloc((Handler*)self);
+    return nullptr;
+}
+
+PyObject* BinaryFileHandler_emit(BinaryFileHandler* self, PyObject* record){
+    if (!LogRecord_Check(GET_PICOLOGGING_STATE(self), record)) {
+        PyErr_SetString(PyExc_TypeError, "BinaryFileHandler only supports picologging.LogRecord");
+        return nullptr;
+    }
+    if (self->file == nullptr) {
+        PyErr_SetString(PyExc_ValueError, "I/O operation on closed file.");
+        return nullptr;
+    }
+    LogRecord* logRecord = (LogRecord*)record;
+    unsigned char flags;
+    if (trailerFlags(logRecord, &flags) < 0)
+        return nullptr;
+
+    // A full dictionary starts a new session, which the decoder follows.
+    if (self->templates->size() >= BINARYLOG_MAX_TEMPLATES || self->sites->size() >= BINARYLOG_MAX_SITES) {
+        clearDictionaries(self);
+        writeHeader(self);
+    }
+
+    std::string& buffer = *self->buffer;
+    size_t site = siteId(self, logRecord);
+    if (site == (size_t)-1)
+        return nullptr;
+
+    // Records can arrive out of creation order, e.g. through a queue, so the delta is signed.
+    long long delta = logRecord->createdNanos - self->lastTime;
+    self->lastTime = logRecord->createdNanos;
+
+    if (LogRecord_resolveArgs(logRecord) == -1)
+        return nullptr;
+    bool written = false;
+    if (logRecord->hasArgs && PyUnicode_CheckExact(logRecord->msg) && PyTuple_CheckExact(logRecord->args)) {
+        size_t id = templateId(self, logRecord->msg);
+        if (id == (size_t)-1)
+            return nullptr;
+        size_t mark = buffer.size();
+        buffer.push_back(BINARYLOG_RECORD);
+        putVarint(buffer, id);
+        putZigzag(buffer, logRecord->levelno);
+        putZigzag(buffer, delta);
+        putVarint(buffer, site);
+        buffer.push_back((char)flags);
+        Py_ssize_t argc = PyTuple_GET_SIZE(logRecord->args);
+        putVarint(buffer, (unsigned long long)argc);
+        written = true;
+        for (Py_ssize_t i = 0; i < argc; i++) {
+            int ret = putArg(buffer, PyTuple_GET_ITEM(logRecord->args, i));
+            if (ret < 0) {
+                buffer.resize(mark);
+                return nullptr;
+            }
+            if (ret > 0) {
+                buffer.resize(mark);
+                written = false;
+                break;
+            }
+        }
+    }
+    if (!written) {
+        // Messages without arguments are written as is, anything else is formatted.
+        PyObject* message = logRecord->msg;
+        if (logRecord->hasArgs || !PyUnicode_Check(message)) {
+            if (LogRecord_writeMessage(logRecord) == -1)
+                return nullptr;
+            message = logRecord->message;
+        }
+        size_t mark = buffer.size();
+        buffer.push_back(BINARYLOG_MESSAGE);
+        if (putText(buffer, message) < 0) {
+            buffer.resize(mark);
+            return nullptr;
+        }
+        putZigzag(buffer, logRecord->levelno);
+        putZigzag(buffer, delta);
+        putVarint(buffer, site);
+        buffer.push_back((char)flags);
+    }
+    if (putTrailer(buffer, logRecord, flags) < 0)
+        return nullptr;
+
+    if (buffer.size() >= self->bufferSize && writeBuffer(self) < 0)
+        return nullptr;
+    Py_RETURN_NONE;
+}
+
+PyObject* BinaryFileHandler_flush(BinaryFileHandler* self){
+    HandlerLockGuard guard(&self->handler);
+    if (writeBuffer(self) < 0)
+        return nullptr;
+    if (self->file != nullptr && fflush(self->file) != 0)
+        return PyErr_SetFromErrno(PyExc_OSError);
+    Py_RETURN_NONE;
+}
+
+PyObject* BinaryFileHandler_close(BinaryFileHandler* self){
+    HandlerLockGuard guard(&self->handler);
+    if (self->file == nullptr)
+        Py_RETURN_NONE;
+    int ret = writeBuffer(self);
+    fclose(self->file);
+    self->file = nullptr;
+    clearDictionaries(self);
+    if (ret < 0)
+        return nullptr;
+    Py_RETURN_NONE;
+}
+
+PyObject* BinaryFileHandler_repr(BinaryFileHandler *self)
+{
+    std::string level = _getLevelName(self->handler.level);
+    return PyUnicode_FromFormat("<%s %S (%s)>",
+        _PyType_Name(Py_TYPE(self)),
+        self->filename,
+        level.c_str());
+}
+
+static PyMethodDef BinaryFileHandler_methods[] = {
+    {"emit", (PyCFunction)BinaryFileHandler_emit, METH_O, "Append a record to the buffer, writing it out once full."},
+    {"flush", (PyCFunction)BinaryFileHandler_flush, METH_NOARGS, "Write the buffered records to the file."},
+    {"close", (PyCFunction)BinaryFileHandler_close, METH_NOARGS, "Flush and close the file."},
+    {NULL}
+};
+
+static PyMemberDef BinaryFileHandler_members[] = {
+    {"baseFilename", T_OBJECT_EX, offsetof(BinaryFileHandler, filename), READONLY, "Path of the log file"},
+    {"mode", T_OBJECT_EX, offsetof(BinaryFileHandler, mode), READONLY, "File mode"},
+    {NULL}
+};
+
+static PyType_Slot BinaryFileHandler_slots[] = {
+    {Py_tp_dealloc, (void*)BinaryFileHandler_dealloc},
+    {Py_tp_repr, (void*)BinaryFileHandler_repr},
+    {Py_tp_doc, (void*)PyDoc_STR("Handler which writes records in a compact binary format, see picologging.decode.")},
+    {Py_tp_methods, BinaryFileHandler_methods},
+    {Py_tp_members, BinaryFileHandler_members},
+    {Py_tp_init, (void*)BinaryFileHandler_init},
+    {Py_tp_new, (void*)BinaryFileHandler_new},
+    {Py_tp_free, (void*)PyObject_Del},
+    {0, NULL}
+};
+
+PyType_Spec BinaryFileHandlerType_spec = {
+    "picologging.handlers.BinaryFileHandler",
+    sizeof(BinaryFileHandler),
+    0,
+    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE | Py_TPFLAGS_IMMUTABLETYPE,
+    BinaryFileHandler_slots,
+};
@@ -0,0 +1,82 @@
+#include <Python.h>
+#include <cstdio>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "handler.hxx"
+
+#ifndef PICOLOGGING_BINARYHANDLER_H
+#define PICOLOGGING_BINARYHANDLER_H
+
+// Session header, followed by the wall clock when the session started and the
+// base of relativeCreated, both in nanoseconds. Records store the signed
+// difference between their creation time and the previous record's, or the
+// session start for the first one.
+#define BINARYLOG_MAGIC "PLOGBIN\x02"
+#define BINARYLOG_MAGIC_SIZE 8
+
+// Entry tags
+#define BINARYLOG_TEMPLATE 'T'
+#define BINARYLOG_SITE 'S'
+#define BINARYLOG_RECORD 'L'
+#define BINARYLOG_MESSAGE 'M'
+
+// Record flags
+#define BINARYLOG_HAS_EXC_TEXT 0x01
+#define BINARYLOG_HAS_STACK_INFO 0x02
+
+// Argument type tags
+#define BINARYLOG_ARG_NONE 0
+#define BINARYLOG_ARG_FALSE 1
+#define BINARYLOG_ARG_TRUE 2
+#define BINARYLOG_ARG_INT 3
+#define BINARYLOG_ARG_FLOAT 4
+#define BINARYLOG_ARG_STR 5
+
+// Upper bound of the template and call site dictionaries of a session.
+#define BINARYLOG_MAX_TEMPLATES 65536
+#define BINARYLOG_MAX_SITES 65536
+
+typedef struct {
+    PyObject* name;
+    PyObject* pathname;
+    PyObject* funcName;
+    int lineno;
+} BinaryCallSite;
+
+struct BinaryCallSiteHash {
+    size_t operator()(const BinaryCallSite& site) const {
+        size_t h = (size_t)site.pathname;
+        h ^= ((size_t)site.name >> 4) + 0x9e3779b9 + (h << 6) + (h >> 2);
+        h ^= ((size_t)site.funcName >> 4) + 0x9e3779b9 + (h << 6) + (h >> 2);
+        h ^= (size_t)site.lineno + 0x9e3779b9 + (h << 6) + (h >> 2);
+        return h;
+    }
+};
+
+struct BinaryCallSiteEqual {
+    bool operator()(const BinaryCallSite& a, const BinaryCallSite& b) const {
+        return a.name == b.name && a.pathname == b.pathname && a.funcName == b.funcName && a.lineno == b.lineno;
+    }
+};
+
+typedef struct {
+    Handler handler;
+    PyObject* filename;
+    PyObject* mode;
+    FILE* file;
+    std::string* buffer;
+    size_t bufferSize;
+    long long lastTime; // Creation time of the previous record
+    // Keys are held by strong references, so their addresses stay unique.
+    std::unordered_map<PyObject*, size_t>* templates;
+    std::unordered_map<BinaryCallSite, size_t, BinaryCallSiteHash, BinaryCallSiteEqual>* sites;
+    std::vector<PyObject*>* keepAlive;
+} BinaryFileHandler;
+
+PyObject* BinaryFileHandler_emit(BinaryFileHandler* self, PyObject* record);
+
+extern PyType_Spec BinaryFileHandlerType_spec;
+#define BinaryFileHandler_CheckExact(state, op) Py_IS_TYPE(op, (state)->BinaryFileHandlerType)
+
+#endif // PICOLOGGING_BINARYHANDLER_H
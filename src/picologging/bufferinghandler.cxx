@@ -0,0 +1,500 @@
+#include <mutex>
+#include <utility>
+
+#include "bufferinghandler.hxx"
+#include "handler.hxx"
+#include "logrecord.hxx"
+#include "compat.hxx"
+#include "picologging.hxx"
+
+static inline size_t textSize(PyObject* text) {
+    if (!PyUnicode_Check(text))
+        return 0;
+    return (size_t)PyUnicode_GET_LENGTH(text) * PyUnicode_KIND(text);
+}
+
+/**
+ * Message templates are shared between records, so only the per-record data
+ * is counted.
+ */
+size_t BufferedRecord_size(picologging_state* state, PyObject* record) {
+    size_t size = (size_t)Py_TYPE(record)->tp_basicsize;
+    if (!LogRecord_Check(state, record))
+        return size;
+    LogRecord* logRecord = (LogRecord*)record;
+    if (PyTuple_Check(logRecord->args)) {
+        Py_ssize_t argc = PyTuple_GET_SIZE(logRecord->args);
+        size += sizeof(PyTupleObject) + argc * sizeof(PyObject*);
+        for (Py_ssize_t i = 0; i < argc; i++)
+            size += textSize(PyTuple_GET_ITEM(logRecord->args, i));
+    }
+    size += textSize(logRecord->message);
+    size += textSize(logRecord->excText);
+    return size;
+}
+
+RecordRing::~RecordRing() {
+    clear();
+}
+
+void RecordRing::reset(size_t preallocated) {
+    clear();
+    slots.assign(preallocated > 0 ? preallocated : 1, BufferedRecord{nullptr, 0});
+}
+
+void RecordRing::push(picologging_state* state, PyObject* record, size_t capacity) {
+    if (slots.empty())
+        slots.assign(1, BufferedRecord{nullptr, 0});
+    if (count == slots.size()) {
+        if (slots.size() < capacity) {
+            // Grow and unwrap the ring, the oldest record moves to the front.
+            size_t size = slots.size() * 2 < capacity ? slots.size() * 2 : capacity;
+            std::vector<BufferedRecord> grown(size, BufferedRecord{nullptr, 0});
+            for (size_t i = 0; i < count; i++)
+                grown[i] = slots[(head + i) % slots.size()];
+            slots.swap(grown);
+            head = 0;
+        } else {
+            dropOldest();
+        }
+    }
+    size_t size = BufferedRecord_size(state, record);
+    slots[(head + count) % slots.size()] = BufferedRecord{Py_NewRef(record), size};
+    count++;
+    bytes += size;
+}
+
+PyObject* RecordRing::pop() {
+    BufferedRecord& oldest = slots[head];
+    PyObject* record = oldest.record;
+    oldest.record = nullptr;
+    bytes -= oldest.size;
+    head = (head + 1) % slots.size();
+    count--;
+    return record;
+}
+
+void RecordRing::dropOldest() {
+    PyObject* record = pop();
+    Py_DECREF(record);
+}
+
+void RecordRing::clear() {
+    while (count > 0)
+        dropOldest();
+    head = 0;
+}
+
+void RecordRing::swap(RecordRing& other) {
+    slots.swap(other.slots);
+    std::swap(head, other.head);
+    std::swap(count, other.count);
+    std::swap(bytes, other.bytes);
+}
+
+PyObject* RecordRing::toList() const {
+    PyObject* list = PyList_New(count);
+    if (list == nullptr)
+        return nullptr;
+    for (size_t i = 0; i < count; i++)
+        PyList_SET_ITEM(list, i, Py_NewRef(slots[(head + i) % slots.size()].record));
+    return list;
+}
+
+int RecordRing::drainTo(picologging_state* state, PyObject* target, PyObject* handleName) {
+    if (target == Py_None || count == 0)
+        return 0;
+    Py_INCREF(target);
+    bool native = Handler_Check(state, target);
+    if (native)
+        Handler_lock((Handler*)target);
+    int ret = 0;
+    while (count > 0) {
+        PyObject* record = pop();
+        PyObject* result;
+        if (native)
+            result = Handler_handle((Handler*)target, record);
+        else
+            result = PyObject_CallMethod_ONEARG(target, handleName, record);
+        Py_XDECREF(result);
+        Py_DECREF(record);
+        if (result == nullptr) {
+            ret = -1;
+            break;
+        }
+    }
+    if (native)
+        ((Handler*)target)->lock->unlock();
+    Py_DECREF(target);
+    return ret;
+}
+
+static inline size_t bufferedCount(BufferingHandler* self) {
+    return self->list != nullptr ? (size_t)PyList_GET_SIZE(self->list) : self->ring->count;
+}
+
+static inline size_t bufferedBytes(BufferingHandler* self) {
+    return self->list != nullptr ? self->listBytes : self->ring->bytes;
+}
+
+static int shouldFlush(BufferingHandler* self, PyObject* record) {
+    picologging_state* state = GET_PICOLOGGING_STATE(self);
+    if (bufferedCount(self) >= (size_t)self->capacity)
+        return 1;
+    if (self->maxBytes > 0 && bufferedBytes(self) >= (size_t)self->maxBytes)
+        return 1;
+    if (!PyObject_TypeCheck((PyObject*)self, state->MemoryHandlerType))
+        return 0;
+    int flushLevel = ((MemoryHandler*)self)->flushLevel;
+    if (LogRecord_Check(state, record))
+        return ((LogRecord*)record)->levelno >= flushLevel;
+    PyObject* levelno = PyObject_GetAttrString(record, "levelno");
+    if (levelno == nullptr)
+        return -1;
+    long level = PyLong_AsLong(levelno);
+    Py_DECREF(levelno);
+    if (level == -1 && PyErr_Occurred())
+        return -1;
+    return level >= flushLevel;
+}
+
+static void clearList(BufferingHandler* self) {
+    PyList_SetSlice(self->list, 0, PyList_GET_SIZE(self->list), nullptr);
+    self->listBytes = 0;
+}
+
+/**
+ * Flush a subclass's list like the logging module does: without a target the
+ * records are kept, and they are only removed once the target handled them.
+ */
+static int flushList(BufferingHandler* self) {
+    picologging_state* state = GET_PICOLOGGING_STATE(self);
+    if (!PyObject_TypeCheck((PyObject*)self, state->MemoryHandlerType)) {
+        clearList(self);
+        return 0;
+    }
+    MemoryHandler* memoryHandler = (MemoryHandler*)self;
+    if (memoryHandler->target == Py_None)
+        return 0;
+    PyObject* records = PyList_GetSlice(self->list, 0, PyList_GET_SIZE(self->list));
+    if (records == nullptr)
+        return -1;
+    PyObject* target = Py_NewRef(memoryHandler->target);
+    bool native = Handler_Check(state, target);
+    if (native)
+        Handler_lock((Handler*)target);
+    int ret = 0;
+    for (Py_ssize_t i = 0; i < PyList_GET_SIZE(records); i++) {
+        PyObject* record = PyList_GET_ITEM(records, i);
+        PyObject* result;
+        if (native)
+            result = Handler_handle((Handler*)target, record);
+        else
+            result = PyObject_CallMethod_ONEARG(target, memoryHandler->_const_handle, record);
+        if (result == nullptr) {
+            ret = -1;
+            break;
+        }
+        Py_DECREF(result);
+    }
+    if (native)
+        ((Handler*)target)->lock->unlock();
+    Py_DECREF(target);
+    if (ret == 0) {
+        // Records added while handling (e.g. by the target) stay buffered.
+        if (PyList_SetSlice(self->list, 0, PyList_GET_SIZE(records), nullptr) < 0)
+            ret = -1;
+        if (PyList_GET_SIZE(self->list) == 0)
+            self->listBytes = 0;
+    }
+    Py_DECREF(records);
+    return ret;
+}
+
+static int flushNative(BufferingHandler* self) {
+    if (self->list != nullptr)
+        return flushList(self);
+    picologging_state* state = GET_PICOLOGGING_STATE(self);
+    if (PyObject_TypeCheck((PyObject*)self, state->MemoryHandlerType))
+        return self->ring->drainTo(state, ((MemoryHandler*)self)->target, ((MemoryHandler*)self)->_const_handle);
+    self->ring->clear();
+    return 0;
+}
+
+/**
+ * Flush through the flush() method when a subclass may have overridden it.
+ */
+static int flush(BufferingHandler* self) {
+    picologging_state* state = GET_PICOLOGGING_STATE(self);
+    if (BufferingHandler_CheckExact(state, (PyObject*)self) || MemoryHandler_CheckExact(state, (PyObject*)self))
+        return flushNative(self);
+    PyObject* result = PyObject_CallMethod_NOARGS((PyObject*)self, self->_const_flush);
+    if (result == nullptr)
+        return -1;
+    Py_DECREF(result);
+    return 0;
+}
+
+static int setup(BufferingHandler* self, Py_ssize_t capacity, Py_ssize_t maxBytes) {
+    if (capacity < 0) {
+        PyErr_SetString(PyExc_ValueError, "capacity must not be negative");
+        return -1;
+    }
+    if (maxBytes < 0) {
+        PyErr_SetString(PyExc_ValueError, "maxBytes must not be negative");
+        return -1;
+    }
+    self->capacity = capacity;
+    self->maxBytes = maxBytes;
+    self->ring->reset(capacity < BUFFERING_PREALLOCATED_SLOTS ? (size_t)capacity : BUFFERING_PREALLOCATED_SLOTS);
+    return 0;
+}
+
+PyObject* BufferingHandler_new(PyTypeObject* type, PyObject* args, PyObject* kwds)
+{
+    BufferingHandler* self = (BufferingHandler*)Handler_new(type, args, kwds);
+    if (self != NULL)
+    {
+        self->capacity = 0;
+        self->maxBytes = 0;
+        self->ring = new RecordRing();
+        picologging_state* state = picologging_typeState(type);
+        if (type == state->BufferingHandlerType || type == state->MemoryHandlerType)
+            self->list = nullptr;
+        else
+            self->list = PyList_New(0);
+        self->listBytes = 0;
+        self->_const_flush = PyUnicode_FromString("flush");
+    }
+    return (PyObject*)self;
+}
+
+int BufferingHandler_init(BufferingHandler *self, PyObject *args, PyObject *kwds){
+    PyObject* noArgs = PyTuple_New(0);
+    int ret = Handler_init((Handler*)self, noArgs, nullptr);
+    Py_DECREF(noArgs);
+    if (ret < 0)
+        return -1;
+    Py_ssize_t capacity = 0;
+    Py_ssize_t maxBytes = 0;
+    static const char *kwlist[] = {"capacity", "maxBytes", NULL};
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "n|n", const_cast<char**>(kwlist), &capacity, &maxBytes)){
+        return -1;
+    }
+    return setup(self, capacity, maxBytes);
+}
+
+PyObject* BufferingHandler_dealloc(BufferingHandler *self) {
+    delete self->ring;
+    Py_CLEAR(self->list);
+    Py_CLEAR(self->_const_flush);
+    Handler_dealloc((Handler*)self);
+    return nullptr;
+}
+
+PyObject* BufferingHandler_emit(BufferingHandler* self, PyObject* record){
+    picologging_state* state = GET_PICOLOGGING_STATE(self);
+    if (self->list != nullptr) {
+        // An overridden flush() may have emptied the list behind our back.
+        if (PyList_GET_SIZE(self->list) == 0)
+            self->listBytes = 0;
+        if (PyList_Append(self->list, record) < 0)
+            return nullptr;
+        self->listBytes += BufferedRecord_size(state, record);
+    } else {
+        self->ring->push(state, record, (size_t)self->capacity);
+    }
+    int ret = shouldFlush(self, record);
+    if (ret < 0 || (ret > 0 && flush(self) < 0))
+        return nullptr;
+    Py_RETURN_NONE;
+}
+
+PyObject* BufferingHandler_shouldFlush(BufferingHandler* self, PyObject* record){
+    int ret = shouldFlush(self, record);
+    if (ret < 0)
+        return nullptr;
+    return PyBool_FromLong(ret);
+}
+
+PyObject* BufferingHandler_flush(BufferingHandler* self){
+    HandlerLockGuard guard(&self->handler);
+    if (flushNative(self) < 0)
+        return nullptr;
+    Py_RETURN_NONE;
+}
+
+PyObject* BufferingHandler_close(BufferingHandler* self){
+    HandlerLockGuard guard(&self->handler);
+    if (flush(self) < 0)
+        return nullptr;
+    Py_RETURN_NONE;
+}
+
+PyObject* BufferingHandler_getBuffer(BufferingHandler* self, void* closure){
+    if (self->list != nullptr)
+        return Py_NewRef(self->list);
+    return self->ring->toList();
+}
+
+int BufferingHandler_setBuffer(BufferingHandler* self, PyObject* value, void* closure){
+    if (value == nullptr) {
+        PyErr_SetString(PyExc_AttributeError, "cannot delete buffer");
+        return -1;
+    }
+    picologging_state* state = GET_PICOLOGGING_STATE(self);
+    if (self->list != nullptr) {
+        PyObject* list = PyList_Check(value) ? Py_NewRef(value) : PySequence_List(value);
+        if (list == nullptr)
+            return -1;
+        HandlerLockGuard guard(&self->handler);
+        Py_SETREF(self->list, list);
+        self->listBytes = 0;
+        for (Py_ssize_t i = 0; i < PyList_GET_SIZE(list); i++)
+            self->listBytes += BufferedRecord_size(state, PyList_GET_ITEM(list, i));
+        return 0;
+    }
+    PyObject* records = PySequence_Fast(value, "buffer must be a sequence of records");
+    if (records == nullptr)
+        return -1;
+    HandlerLockGuard guard(&self->handler);
+    self->ring->clear();
+    for (Py_ssize_t i = 0; i < PySequence_Fast_GET_SIZE(records); i++)
+        self->ring->push(state, PySequence_Fast_GET_ITEM(records, i), (size_t)self->capacity);
+    Py_DECREF(records);
+    return 0;
+}
+
+static PyMethodDef BufferingHandler_methods[] = {
+    {"emit", (PyCFunction)BufferingHandler_emit, METH_O, "Append the record and flush if the buffer is full."},
+    {"shouldFlush", (PyCFunction)BufferingHandler_shouldFlush, METH_O, "Return True if the buffer should be flushed."},
+    {"flush", (PyCFunction)BufferingHandler_flush, METH_NOARGS, "Discard the buffered records."},
+    {"close", (PyCFunction)BufferingHandler_close, METH_NOARGS, "Flush the buffer."},
+    {NULL}
+};
+
+static PyMemberDef BufferingHandler_members[] = {
+    {"capacity", T_PYSSIZET, offsetof(BufferingHandler, capacity), 0, "Maximum number of buffered records"},
+    {"maxBytes", T_PYSSIZET, offsetof(BufferingHandler, maxBytes), 0, "Approximate maximum size of the buffered records, 0 for no limit"},
+    {NULL}
+};
+
+static PyGetSetDef BufferingHandler_getset[] = {
+    {"buffer", (getter)BufferingHandler_getBuffer, (setter)BufferingHandler_setBuffer, "Buffered records, oldest first. A copy for the built-in handlers, the list itself for subclasses"},
+    {NULL}
+};
+
+static PyType_Slot BufferingHandler_slots[] = {
+    {Py_tp_dealloc, (void*)BufferingHandler_dealloc},
+    {Py_tp_doc, (void*)PyDoc_STR("Handler which buffers records in memory until the buffer is full.")},
+    {Py_tp_methods, BufferingHandler_methods},
+    {Py_tp_members, BufferingHandler_members},
+    {Py_tp_getset, BufferingHandler_getset},
+    {Py_tp_init, (void*)BufferingHandler_init},
+    {Py_tp_new, (void*)BufferingHandler_new},
+    {Py_tp_free, (void*)PyObject_Del},
+    {0, NULL}
+};
+
+PyType_Spec BufferingHandlerType_spec = {
+    "picologging.handlers.BufferingHandler",
+    sizeof(BufferingHandler),
+    0,
+    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE | Py_TPFLAGS_IMMUTABLETYPE,
+    BufferingHandler_slots,
+};
+
+PyObject* MemoryHandler_new(PyTypeObject* type, PyObject* args, PyObject* kwds)
+{
+    MemoryHandler* self = (MemoryHandler*)BufferingHandler_new(type, args, kwds);
+    if (self != NULL)
+    {
+        self->flushLevel = 40; // ERROR
+        self->target = Py_NewRef(Py_None);
+        self->flushOnClose = 1;
+        self->_const_handle = PyUnicode_FromString("handle");
+    }
+    return (PyObject*)self;
+}
+
+int MemoryHandler_init(MemoryHandler *self, PyObject *args, PyObject *kwds){
+    PyObject* noArgs = PyTuple_New(0);
+    int ret = Handler_init((Handler*)self, noArgs, nullptr);
+    Py_DECREF(noArgs);
+    if (ret < 0)
+        return -1;
+    Py_ssize_t capacity = 0;
+    int flushLevel = 40;
+    PyObject *target = Py_None;
+    int flushOnClose = 1;
+    Py_ssize_t maxBytes = 0;
+    static const char *kwlist[] = {"capacity", "flushLevel", "target", "flushOnClose", "maxBytes", NULL};
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "n|iOpn", const_cast<char**>(kwlist),
+                                     &capacity, &flushLevel, &target, &flushOnClose, &maxBytes)){
+        return -1;
+    }
+    if (setup(&self->buffering, capacity, maxBytes) < 0)
+        return -1;
+    self->flushLevel = flushLevel;
+    Py_SETREF(self->target, Py_NewRef(target));
+    self->flushOnClose = (char)flushOnClose;
+    return 0;
+}
+
+PyObject* MemoryHandler_dealloc(MemoryHandler *self) {
+    Py_CLEAR(self->target);
+    Py_CLEAR(self->_const_handle);
+    BufferingHandler_dealloc(&self->buffering);
+    return nullptr;
+}
+
+PyObject* MemoryHandler_setTarget(MemoryHandler* self, PyObject* target){
+    HandlerLockGuard guard(&self->buffering.handler);
+    Py_SETREF(self->target, Py_NewRef(target));
+    Py_RETURN_NONE;
+}
+
+PyObject* MemoryHandler_close(MemoryHandler* self){
+    HandlerLockGuard guard(&self->buffering.handler);
+    int ret = self->flushOnClose ? flush(&self->buffering) : 0;
+    Py_SETREF(self->target, Py_NewRef(Py_None));
+    self->buffering.ring->clear();
+    if (self->buffering.list != nullptr)
+        clearList(&self->buffering);
+    if (ret < 0)
+        return nullptr;
+    Py_RETURN_NONE;
+}
+
+static PyMethodDef MemoryHandler_methods[] = {
+    {"flush", (PyCFunction)BufferingHandler_flush, METH_NOARGS, "Send the buffered records to the target."},
+    {"close", (PyCFunction)MemoryHandler_close, METH_NOARGS, "Flush if configured to, then drop the target and the buffer."},
+    {"setTarget", (PyCFunction)MemoryHandler_setTarget, METH_O, "Set the target handler."},
+    {NULL}
+};
+
+static PyMemberDef MemoryHandler_members[] = {
+    {"flushLevel", T_INT, offsetof(MemoryHandler, flushLevel), 0, "Level at which the buffer is flushed"},
+    {"target", T_OBJECT_EX, offsetof(MemoryHandler, target), 0, "Target handler"},
+    {"flushOnClose", T_BOOL, offsetof(MemoryHandler, flushOnClose), 0, "Flush the buffer when the handler is closed"},
+    {NULL}
+};
+
+static PyType_Slot MemoryHandler_slots[] = {
+    {Py_tp_dealloc, (void*)MemoryHandler_dealloc},
+    {Py_tp_doc, (void*)PyDoc_STR("Handler which buffers records in memory and passes them to a target when full or on a severe record.")},
+    {Py_tp_methods, MemoryHandler_methods},
+    {Py_tp_members, MemoryHandler_members},
+    {Py_tp_init, (void*)MemoryHandler_init},
+    {Py_tp_new, (void*)MemoryHandler_new},
+    {Py_tp_free, (void*)PyObject_Del},
+    {0, NULL}
+};
+
+PyType_Spec MemoryHandlerType_spec = {
+    "picologging.handlers.MemoryHandler",
+    sizeof(MemoryHandler),
+    0,
+    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE | Py_TPFLAGS_IMMUTABLETYPE,
+    MemoryHandler_slots,
+};
@@ -0,0 +1,78 @@
+#include <Python.h>
+#include <vector>
+#include "handler.hxx"
+
+#ifndef PICOLOGGING_BUFFERINGHANDLER_H
+#define PICOLOGGING_BUFFERINGHANDLER_H
+
+// Slots allocated up front, larger capacities grow the ring on demand.
+#define BUFFERING_PREALLOCATED_SLOTS 1024
+
+typedef struct {
+    PyObject* record;
+    size_t size; // Approximate memory held by the record
+} BufferedRecord;
+
+/**
+ * Bounded FIFO of records. Once `capacity` records are held, pushing a
+ * record drops the oldest one.
+ */
+class RecordRing {
+    std::vector<BufferedRecord> slots;
+    size_t head = 0; // Index of the oldest record
+public:
+    size_t count = 0;
+    size_t bytes = 0;
+
+    RecordRing() = default;
+    RecordRing(const RecordRing&) = delete;
+    RecordRing& operator=(const RecordRing&) = delete;
+    ~RecordRing();
+
+    void reset(size_t preallocated);
+    void push(picologging_state* state, PyObject* record, size_t capacity);
+    PyObject* pop(); // New reference to the oldest record
+    void dropOldest();
+    void clear();
+    void swap(RecordRing& other);
+    PyObject* toList() const;
+    /**
+     * Pass the records to `target` oldest first, holding the target's lock
+     * for the whole batch when it is a picologging handler.
+     */
+    int drainTo(picologging_state* state, PyObject* target, PyObject* handleName);
+};
+
+/**
+ * Approximate the memory a buffered record keeps alive.
+ */
+size_t BufferedRecord_size(picologging_state* state, PyObject* record);
+
+typedef struct {
+    Handler handler;
+    Py_ssize_t capacity;
+    Py_ssize_t maxBytes;
+    RecordRing* ring;
+    // Subclasses get a plain list instead of the ring, so an overridden
+    // flush() can mutate `buffer` in place like with the logging module.
+    PyObject* list;
+    size_t listBytes;
+    PyObject* _const_flush;
+} BufferingHandler;
+
+typedef struct {
+    BufferingHandler buffering;
+    int flushLevel;
+    PyObject* target;
+    char flushOnClose;
+    PyObject* _const_handle;
+} MemoryHandler;
+
+PyObject* BufferingHandler_emit(BufferingHandler* self, PyObject* record);
+
+extern PyType_Spec BufferingHandlerType_spec;
+extern PyType_Spec MemoryHandlerType_spec;
+#define BufferingHandler_CheckExact(state, op) Py_IS_TYPE(op, (state)->BufferingHandlerType)
+#define MemoryHandler_CheckExact(state, op) Py_IS_TYPE(op, (state)->MemoryHandlerType)
+
+#endif // PICOLOGGING_BUFFERINGHANDLER_H
@@ -0,0 +1,77 @@
+#include <atomic>
+#include <chrono>
+#include <ctime>
+#include "clock.hxx"
+
+static const char* const clock_names[] = {nullptr, "realtime", "coarse", "monotonic"};
+
+static std::atomic<int> g_defaultClock{Clock_Realtime};
+
+static long long realtimeNow() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+static long long monotonicNow() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Taken once, so monotonic timestamps keep their order when the wall clock is changed afterwards.
+static const long long g_monotonicOffset = realtimeNow() - monotonicNow();
+
+long long Clock_now(RecordClock clock) {
+    if (clock == Clock_Default)
+        clock = (RecordClock)g_defaultClock.load(std::memory_order_relaxed);
+    switch (clock) {
+        case Clock_Coarse: {
+#ifdef CLOCK_REALTIME_COARSE
+            struct timespec ts;
+            if (clock_gettime(CLOCK_REALTIME_COARSE, &ts) == 0)
+                return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+#endif
+            return realtimeNow();
+        }
+        case Clock_Monotonic:
+            return monotonicNow() + g_monotonicOffset;
+        default:
+            return realtimeNow();
+    }
+}
+
+PyObject* Clock_name(RecordClock clock) {
+    if (clock == Clock_Default)
+        Py_RETURN_NONE;
+    return PyUnicode_FromString(clock_names[clock]);
+}
+
+int Clock_fromName(PyObject* name, RecordClock* clock) {
+    if (name == Py_None) {
+        *clock = Clock_Default;
+        return 0;
+    }
+    if (PyUnicode_Check(name)) {
+        for (int i = Clock_Realtime; i <= Clock_Monotonic; i++) {
+            if (PyUnicode_CompareWithASCIIString(name, clock_names[i]) == 0) {
+                *clock = (RecordClock)i;
+                return 0;
+            }
+        }
+    }
+    PyErr_Format(PyExc_ValueError, "Unknown clock %R, expected 'realtime', 'coarse' or 'monotonic'", name);
+    return -1;
+}
+
+PyObject* picologging_setClock(PyObject *module, PyObject *name) {
+    RecordClock clock;
+    if (Clock_fromName(name, &clock) < 0)
+        return nullptr;
+    if (clock == Clock_Default)
+        clock = Clock_Realtime;
+    int previous = g_defaultClock.exchange(clock, std::memory_order_relaxed);
+    return Clock_name((RecordClock)previous);
+}
+
+PyObject* picologging_getClock(PyObject *module, PyObject *Py_UNUSED(ignored)) {
+    return Clock_name((RecordClock)g_defaultClock.load(std::memory_order_relaxed));
+}
@@ -0,0 +1,24 @@
+#include <Python.h>
+
+#ifndef PICOLOGGING_CLOCK_H
+#define PICOLOGGING_CLOCK_H
+
+// Clocks a record's creation time can be read from.
+enum RecordClock {
+    Clock_Default,      // the clock set with picologging.setClock()
+    Clock_Realtime,     // the wall clock, as time.time()
+    Clock_Coarse,       // CLOCK_REALTIME_COARSE where available, only advances once per tick
+    Clock_Monotonic,    // the monotonic clock plus the wall clock offset taken at import, never goes backwards
+};
+
+// Nanoseconds since the epoch read from clock, Clock_Default reads the global clock.
+long long Clock_now(RecordClock clock);
+// Name of clock as used by setClock(), None for Clock_Default.
+PyObject* Clock_name(RecordClock clock);
+// Parse a clock name, None gives Clock_Default. Raises ValueError for unknown names.
+int Clock_fromName(PyObject* name, RecordClock* clock);
+
+PyObject* picologging_setClock(PyObject *module, PyObject *name);
+PyObject* picologging_getClock(PyObject *module, PyObject *Py_UNUSED(ignored));
+
+#endif // PICOLOGGING_CLOCK_H
@@ -62,6 +62,15 @@ static inline void _Py_SET_SIZE(PyVarObject *ob, Py_ssize_t size) {
 #define PyFrame_GETLINENO(f) f->f_lineno
 #endif
 
+// Offset in bytes of the last instruction, as expected by PyCode_Addr2Line
+#if PY_VERSION_HEX >= 0x030b0000 // Python 3.11.0
+#define PyFrame_GETLASTI(f) PyFrame_GetLasti(f)
+#elif PY_VERSION_HEX >= 0x030a0000 // Python 3.10.0
+#define PyFrame_GETLASTI(f) (f->f_lasti * (int)sizeof(_Py_CODEUNIT))
+#else
+#define PyFrame_GETLASTI(f) f->f_lasti
+#endif
+
 #if PY_VERSION_HEX < 0x03080000 // Python 3.7 and below
 #define PY_VECTORCALL_ARGUMENTS_OFFSET ((size_t)1 << (8 * sizeof(size_t) - 1))
 
@@ -72,6 +81,86 @@ PyVectorcall_NARGS(size_t n)
 }
 #endif
 
+// The private time API was removed in 3.13 in favour of a public one
+#if PY_VERSION_HEX >= 0x030d0000 // Python 3.13.0
+typedef PyTime_t _PyTime_t;
+#define _PyTime_ROUND_CEILING 1
+#define _PyTime_AsSecondsDouble(t) PyTime_AsSecondsDouble(t)
+#define _PyTime_GetSystemClockWithInfo(t, info) PyTime_Time(t)
+
+static inline _PyTime_t _PyTime_AsMilliseconds(_PyTime_t t, int round)
+{
+    // Only rounding towards +inf is used
+    _PyTime_t ms = t / 1000000;
+    if (t % 1000000 > 0)
+        ms++;
+    return ms;
+}
+#endif
+
+// Strong reference to a list item, or NULL if the index is out of range. On
+// free-threaded builds this is safe while other threads change the list.
+#if PY_VERSION_HEX >= 0x030d0000 // Python 3.13.0
+#define PyList_GETITEMREF(list, i) PyList_GetItemRef(list, i)
+#else
+#define PyList_GETITEMREF(list, i) ((i) < PyList_GET_SIZE(list) ? Py_NewRef(PyList_GET_ITEM(list, i)) : NULL)
+#endif
+
+#if PY_VERSION_HEX < 0x030d0000 // Python 3.13.0
+// Strong reference to the referent, NULL once it is being deallocated
+static inline int PyWeakref_GetRef(PyObject *ref, PyObject **pobj)
+{
+    PyObject *obj = PyWeakref_GetObject(ref);
+    if (obj == NULL) {
+        *pobj = NULL;
+        return -1;
+    }
+    if (obj == Py_None) {
+        *pobj = NULL;
+        return 0;
+    }
+    Py_INCREF(obj);
+    *pobj = obj;
+    return 1;
+}
+#endif
+
+#if PY_VERSION_HEX < 0x03090000 // Python 3.9.0
+#define PyInterpreterState_Get() _PyInterpreterState_Get()
+#endif
+
+#if PY_VERSION_HEX < 0x030a0000 // Python 3.10.0
+static inline int PyModule_AddObjectRef(PyObject *mod, const char *name, PyObject *value)
+{
+    Py_XINCREF(value);
+    int ret = PyModule_AddObject(mod, name, value);
+    if (ret < 0)
+        Py_XDECREF(value);
+    return ret;
+}
+#endif
+
+#ifndef Py_TPFLAGS_IMMUTABLETYPE // Python 3.10.0
+#define Py_TPFLAGS_IMMUTABLETYPE 0
+#endif
+
+#ifndef Py_TPFLAGS_DISALLOW_INSTANTIATION // Python 3.10.0
+#define Py_TPFLAGS_DISALLOW_INSTANTIATION 0
+#endif
+
+// Instances of heap types only own a reference to their type from 3.8
+#if PY_VERSION_HEX >= 0x03080000 // Python 3.8.0
+#define Py_DECREF_HEAPTYPE(tp) Py_DECREF(tp)
+#else
+#define Py_DECREF_HEAPTYPE(tp)
+#endif
+
+// Per-object locks of the free-threaded build, no-ops with the GIL
+#ifndef Py_BEGIN_CRITICAL_SECTION
+#define Py_BEGIN_CRITICAL_SECTION(op) {
+#define Py_END_CRITICAL_SECTION() }
+#endif
+
 #ifndef Py_NewRef
 #  define Py_NewRef(obj) _Py_NewRef((PyObject*)obj)
 #  define Py_XNewRef(obj) _Py_XNewRef(PyObject*)(obj))
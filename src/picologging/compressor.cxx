@@ -0,0 +1,595 @@
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <io.h>
+#include <process.h>
+#else
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+#ifdef PICOLOGGING_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef PICOLOGGING_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "compressor.hxx"
+#include "compat.hxx"
+
+namespace fs = std::filesystem;
+
+static long currentPid() {
+#ifdef _WIN32
+    return (long)_getpid();
+#else
+    return (long)getpid();
+#endif
+}
+
+/**
+ * Move the calling worker thread to idle I/O and CPU priority so compression
+ * doesn't compete with the threads that are logging.
+ */
+static void lowerThreadPriority() {
+#if defined(__linux__)
+#ifdef SYS_ioprio_set
+    // IOPRIO_WHO_PROCESS with id 0 targets the calling thread, IOPRIO_CLASS_IDLE is 3.
+    syscall(SYS_ioprio_set, 1, 0, 3 << 13);
+#endif
+    // Linux applies nice values to the thread id rather than the whole process.
+    setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), 19);
+#elif defined(_WIN32)
+    SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN);
+#elif defined(__APPLE__)
+    setiopolicy_np(IOPOL_TYPE_DISK, IOPOL_SCOPE_THREAD, IOPOL_THROTTLE);
+#endif
+}
+
+static FILE* openPath(const fs::path& path, bool write) {
+#ifdef _WIN32
+    return _wfopen(path.c_str(), write ? L"wb" : L"rb");
+#else
+    return fopen(path.c_str(), write ? "wb" : "rb");
+#endif
+}
+
+static bool syncFile(FILE* file) {
+    if (fflush(file) != 0)
+        return false;
+#ifdef _WIN32
+    return _commit(_fileno(file)) == 0;
+#else
+    return fsync(fileno(file)) == 0;
+#endif
+}
+
+#ifdef PICOLOGGING_HAVE_ZLIB
+static bool gzipStream(FILE* in, FILE* out, int level, std::string& error) {
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    // 16 + MAX_WBITS asks zlib for a gzip header and trailer rather than a raw zlib stream.
+    if (deflateInit2(&stream, level, Z_DEFLATED, 16 + MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        error = "cannot initialize zlib";
+        return false;
+    }
+    std::vector<unsigned char> input(COMPRESSION_CHUNK_SIZE), output(COMPRESSION_CHUNK_SIZE);
+    int flush;
+    do {
+        size_t read = fread(input.data(), 1, input.size(), in);
+        if (ferror(in)) {
+            error = strerror(errno);
+            deflateEnd(&stream);
+            return false;
+        }
+        flush = feof(in) ? Z_FINISH : Z_NO_FLUSH;
+        stream.next_in = input.data();
+        stream.avail_in = (uInt)read;
+        do {
+            stream.next_out = output.data();
+            stream.avail_out = (uInt)output.size();
+            deflate(&stream, flush);
+            size_t produced = output.size() - stream.avail_out;
+            if (produced > 0 && fwrite(output.data(), 1, produced, out) != produced) {
+                error = strerror(errno);
+                deflateEnd(&stream);
+                return false;
+            }
+        } while (stream.avail_out == 0);
+    } while (flush != Z_FINISH);
+    deflateEnd(&stream);
+    return true;
+}
+#endif
+
+#ifdef PICOLOGGING_HAVE_ZSTD
+static bool zstdStream(FILE* in, FILE* out, int level, std::string& error) {
+    ZSTD_CCtx* context = ZSTD_createCCtx();
+    if (context == nullptr) {
+        error = "cannot initialize zstd";
+        return false;
+    }
+    ZSTD_CCtx_setParameter(context, ZSTD_c_compressionLevel, level);
+    std::vector<char> input(ZSTD_CStreamInSize()), output(ZSTD_CStreamOutSize());
+    bool last;
+    do {
+        size_t read = fread(input.data(), 1, input.size(), in);
+        if (ferror(in)) {
+            error = strerror(errno);
+            ZSTD_freeCCtx(context);
+            return false;
+        }
+        last = feof(in) != 0;
+        ZSTD_EndDirective mode = last ? ZSTD_e_end : ZSTD_e_continue;
+        ZSTD_inBuffer inBuffer = {input.data(), read, 0};
+        bool finished;
+        do {
+            ZSTD_outBuffer outBuffer = {output.data(), output.size(), 0};
+            size_t remaining = ZSTD_compressStream2(context, &outBuffer, &inBuffer, mode);
+            if (ZSTD_isError(remaining)) {
+                error = ZSTD_getErrorName(remaining);
+                ZSTD_freeCCtx(context);
+                return false;
+            }
+            if (outBuffer.pos > 0 && fwrite(output.data(), 1, outBuffer.pos, out) != outBuffer.pos) {
+                error = strerror(errno);
+                ZSTD_freeCCtx(context);
+                return false;
+            }
+            finished = last ? remaining == 0 : inBuffer.pos == inBuffer.size;
+        } while (!finished);
+    } while (!last);
+    ZSTD_freeCCtx(context);
+    return true;
+}
+#endif
+
+/**
+ * Compress job.source into a temporary file next to job.dest, then rename it into
+ * place and remove the source. Readers never see a partially written destination,
+ * and a failed job leaves the uncompressed source where it was.
+ */
+static bool runJob(const CompressionJob& job, std::string& error) {
+    fs::path temporary = job.dest.parent_path() / fs::path(".");
+    temporary += job.dest.filename();
+    temporary += ".tmp";
+
+    FILE* in = openPath(job.source, false);
+    if (in == nullptr) {
+        error = strerror(errno);
+        return false;
+    }
+    FILE* out = openPath(temporary, true);
+    if (out == nullptr) {
+        error = strerror(errno);
+        fclose(in);
+        return false;
+    }
+
+    bool ok = false;
+    switch (job.method) {
+#ifdef PICOLOGGING_HAVE_ZLIB
+        case COMPRESSION_GZIP:
+            ok = gzipStream(in, out, job.level, error);
+            break;
+#endif
+#ifdef PICOLOGGING_HAVE_ZSTD
+        case COMPRESSION_ZSTD:
+            ok = zstdStream(in, out, job.level, error);
+            break;
+#endif
+        default:
+            error = "unsupported compression method";
+    }
+    fclose(in);
+    if (ok && !syncFile(out)) {
+        error = strerror(errno);
+        ok = false;
+    }
+    if (fclose(out) != 0 && ok) {
+        error = strerror(errno);
+        ok = false;
+    }
+
+    std::error_code ec;
+    if (ok) {
+        fs::rename(temporary, job.dest, ec);
+        if (ec) {
+            error = ec.message();
+            ok = false;
+        }
+    }
+    if (!ok) {
+        fs::remove(temporary, ec);
+        return false;
+    }
+    fs::remove(job.source, ec);
+    return true;
+}
+
+static void workerMain(std::shared_ptr<CompressionState> state) {
+    if (state->lowPriority)
+        lowerThreadPriority();
+    std::unique_lock<std::mutex> lock(state->mutex);
+    for (;;) {
+        state->wake.wait(lock, [&state] { return state->stopping || !state->queue.empty(); });
+        // Jobs queued before close() still run, so no rotated file is left behind uncompressed.
+        if (state->queue.empty())
+            break;
+        CompressionJob job = std::move(state->queue.front());
+        state->queue.pop_front();
+        state->running++;
+        lock.unlock();
+
+        std::string error;
+        bool ok = runJob(job, error);
+
+        lock.lock();
+        state->running--;
+        if (ok) {
+            state->completed++;
+        } else {
+            state->lastError = error;
+            state->lastErrorPath = job.source;
+        }
+        auto pending = state->pending.find(job.source);
+        if (pending != state->pending.end() && --pending->second == 0)
+            state->pending.erase(pending);
+        state->idle.notify_all();
+    }
+    state->workers--;
+}
+
+static int parseMethod(PyObject* method, int* result) {
+    if (PyUnicode_CompareWithASCIIString(method, "gzip") == 0) {
+#ifdef PICOLOGGING_HAVE_ZLIB
+        *result = COMPRESSION_GZIP;
+        return 0;
+#endif
+    } else if (PyUnicode_CompareWithASCIIString(method, "zstd") == 0) {
+#ifdef PICOLOGGING_HAVE_ZSTD
+        *result = COMPRESSION_ZSTD;
+        return 0;
+#endif
+    } else {
+        PyErr_Format(PyExc_ValueError, "unknown compression method %R", method);
+        return -1;
+    }
+    PyErr_Format(PyExc_ValueError, "compression method %R is not available in this build", method);
+    return -1;
+}
+
+static int toPath(PyObject* obj, fs::path& path) {
+#ifdef _WIN32
+    PyObject* decoded = nullptr;
+    if (!PyUnicode_FSDecoder(obj, &decoded))
+        return -1;
+    wchar_t* wide = PyUnicode_AsWideCharString(decoded, nullptr);
+    Py_DECREF(decoded);
+    if (wide == nullptr)
+        return -1;
+    path = wide;
+    PyMem_Free(wide);
+#else
+    PyObject* encoded = nullptr;
+    if (!PyUnicode_FSConverter(obj, &encoded))
+        return -1;
+    path = std::string(PyBytes_AS_STRING(encoded), PyBytes_GET_SIZE(encoded));
+    Py_DECREF(encoded);
+#endif
+    return 0;
+}
+
+static PyObject* fromPath(const fs::path& path) {
+#ifdef _WIN32
+    return PyUnicode_FromWideChar(path.c_str(), -1);
+#else
+    return PyUnicode_DecodeFSDefaultAndSize(path.c_str(), path.native().size());
+#endif
+}
+
+/**
+ * The pool is per process: worker threads aren't copied into a forked child, so
+ * the child drops the inherited state, whose mutex may have been held at fork time.
+ */
+static CompressionState& currentState(Compressor* self) {
+    std::shared_ptr<CompressionState>& state = *self->state;
+    long pid = currentPid();
+    if (state->pid != pid) {
+        auto fresh = std::make_shared<CompressionState>();
+        fresh->maxWorkers = state->maxWorkers;
+        fresh->lowPriority = state->lowPriority;
+        fresh->pid = pid;
+        // Deliberately leaked, destroying a mutex that may be locked is undefined.
+        new std::shared_ptr<CompressionState>(std::move(state));
+        state = fresh;
+    }
+    return *state;
+}
+
+PyObject* Compressor_new(PyTypeObject* type, PyObject* args, PyObject* kwds)
+{
+    Compressor* self = (Compressor*)type->tp_alloc(type, 0);
+    if (self != NULL)
+    {
+        self->state = new std::shared_ptr<CompressionState>(std::make_shared<CompressionState>());
+        (*self->state)->pid = currentPid();
+        self->method = 0;
+        self->level = 0;
+        self->methodName = Py_NewRef(Py_None);
+    }
+    return (PyObject*)self;
+}
+
+int Compressor_init(Compressor *self, PyObject *args, PyObject *kwds){
+    PyObject *method = nullptr;
+    int level = -1;
+    Py_ssize_t maxWorkers = 1;
+    int lowPriority = 1;
+    static const char *kwlist[] = {"method", "level", "maxWorkers", "lowPriority", NULL};
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|Uinp", const_cast<char**>(kwlist), &method, &level, &maxWorkers, &lowPriority)){
+        return -1;
+    }
+    if (method == nullptr) {
+        method = PyUnicode_FromString("gzip");
+        if (method == nullptr)
+            return -1;
+    } else {
+        Py_INCREF(method);
+    }
+    if (parseMethod(method, &self->method) < 0) {
+        Py_DECREF(method);
+        return -1;
+    }
+    Py_SETREF(self->methodName, method);
+    if (maxWorkers < 1) {
+        PyErr_SetString(PyExc_ValueError, "maxWorkers must be at least 1");
+        return -1;
+    }
+    if (level == -1) {
+        self->level = self->method == COMPRESSION_GZIP ? 6 : 3;
+    } else if ((self->method == COMPRESSION_GZIP && (level < 0 || level > 9)) ||
+               (self->method == COMPRESSION_ZSTD && (level < 1 || level > 22))) {
+        PyErr_Format(PyExc_ValueError, "invalid compression level %d for %R", level, method);
+        return -1;
+    } else {
+        self->level = level;
+    }
+    CompressionState& state = currentState(self);
+    std::lock_guard<std::mutex> guard(state.mutex);
+    state.maxWorkers = (size_t)maxWorkers;
+    state.lowPriority = lowPriority != 0;
+    return 0;
+}
+
+PyObject* Compressor_dealloc(Compressor *self) {
+    {
+        CompressionState& state = **self->state;
+        std::lock_guard<std::mutex> guard(state.mutex);
+        state.stopping = true;
+        state.wake.notify_all();
+    }
+    delete self->state;
+    Py_CLEAR(self->methodName);
+    PyTypeObject* type = Py_TYPE(self);
+    type->tp_free((PyObject*)self);
+    Py_DECREF_HEAPTYPE(type);
+    return nullptr;
+}
+
+PyObject* Compressor_submit(Compressor *self, PyObject *args, PyObject *kwds){
+    PyObject *source = nullptr, *dest = nullptr;
+    static const char *kwlist[] = {"source", "dest", NULL};
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "OO", const_cast<char**>(kwlist), &source, &dest)){
+        return nullptr;
+    }
+    if (self->method == 0) {
+        PyErr_SetString(PyExc_ValueError, "Compressor is not initialized");
+        return nullptr;
+    }
+    CompressionJob job;
+    if (toPath(source, job.source) < 0 || toPath(dest, job.dest) < 0)
+        return nullptr;
+    job.method = self->method;
+    job.level = self->level;
+
+    currentState(self);
+    std::shared_ptr<CompressionState> state = *self->state;
+    std::lock_guard<std::mutex> guard(state->mutex);
+    if (state->stopping) {
+        PyErr_SetString(PyExc_ValueError, "Compressor is closed");
+        return nullptr;
+    }
+    fs::path queuedSource = job.source;
+    state->queue.push_back(std::move(job));
+    state->pending[queuedSource]++;
+    // Workers start lazily and stay parked until close(), at most maxWorkers of them.
+    if (state->workers < state->maxWorkers && state->workers < state->queue.size() + state->running) {
+        try {
+            std::thread(workerMain, state).detach();
+            state->workers++;
+        } catch (const std::system_error& e) {
+            if (state->workers == 0) {
+                state->queue.pop_back();
+                if (--state->pending[queuedSource] == 0)
+                    state->pending.erase(queuedSource);
+                PyErr_Format(PyExc_RuntimeError, "cannot start compression thread: %s", e.what());
+                return nullptr;
+            }
+        }
+    }
+    state->wake.notify_one();
+    Py_RETURN_NONE;
+}
+
+PyObject* Compressor_wait(Compressor *self, PyObject *args, PyObject *kwds){
+    PyObject *timeout = Py_None, *sources = Py_None;
+    static const char *kwlist[] = {"timeout", "sources", NULL};
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|OO", const_cast<char**>(kwlist), &timeout, &sources)){
+        return nullptr;
+    }
+    double seconds = -1;
+    if (timeout != Py_None) {
+        seconds = PyFloat_AsDouble(timeout);
+        if (seconds == -1 && PyErr_Occurred())
+            return nullptr;
+        if (seconds < 0) {
+            PyErr_SetString(PyExc_ValueError, "timeout must be non-negative");
+            return nullptr;
+        }
+    }
+    // With sources, only jobs compressing one of those files are waited for,
+    // so a handler doesn't wait on the backlog of others sharing the pool.
+    std::vector<fs::path> paths;
+    if (sources != Py_None) {
+        PyObject* iterator = PyObject_GetIter(sources);
+        if (iterator == nullptr)
+            return nullptr;
+        PyObject* source;
+        while ((source = PyIter_Next(iterator)) != nullptr) {
+            fs::path path;
+            int ret = toPath(source, path);
+            Py_DECREF(source);
+            if (ret < 0) {
+                Py_DECREF(iterator);
+                return nullptr;
+            }
+            paths.push_back(std::move(path));
+        }
+        Py_DECREF(iterator);
+        if (PyErr_Occurred())
+            return nullptr;
+    }
+    // Handler locks are waited on without the GIL, so a rotating handler can
+    // release it here even though it holds its own lock.
+    currentState(self);
+    std::shared_ptr<CompressionState> state = *self->state;
+    bool all = sources == Py_None;
+    auto drained = [&state, &paths, all] {
+        if (all)
+            return state->queue.empty() && state->running == 0;
+        for (const fs::path& path : paths) {
+            if (state->pending.count(path) > 0)
+                return false;
+        }
+        return true;
+    };
+    bool done;
+    Py_BEGIN_ALLOW_THREADS
+    std::unique_lock<std::mutex> lock(state->mutex);
+    if (seconds < 0) {
+        state->idle.wait(lock, drained);
+        done = true;
+    } else {
+        done = state->idle.wait_for(lock, std::chrono::duration<double>(seconds), drained);
+    }
+    Py_END_ALLOW_THREADS
+    return PyBool_FromLong(done);
+}
+
+PyObject* Compressor_close(Compressor *self){
+    CompressionState& state = currentState(self);
+    std::lock_guard<std::mutex> guard(state.mutex);
+    state.stopping = true;
+    state.wake.notify_all();
+    Py_RETURN_NONE;
+}
+
+PyObject* Compressor_getPending(Compressor *self, void* closure){
+    CompressionState& state = currentState(self);
+    std::lock_guard<std::mutex> guard(state.mutex);
+    return PyLong_FromSize_t(state.queue.size() + state.running);
+}
+
+PyObject* Compressor_getCompleted(Compressor *self, void* closure){
+    CompressionState& state = currentState(self);
+    std::lock_guard<std::mutex> guard(state.mutex);
+    return PyLong_FromUnsignedLongLong(state.completed);
+}
+
+PyObject* Compressor_getLastError(Compressor *self, void* closure){
+    CompressionState& state = currentState(self);
+    std::string error;
+    fs::path path;
+    {
+        std::lock_guard<std::mutex> guard(state.mutex);
+        if (state.lastError.empty())
+            Py_RETURN_NONE;
+        error = state.lastError;
+        path = state.lastErrorPath;
+    }
+    PyObject* pathObj = fromPath(path);
+    if (pathObj == nullptr)
+        return nullptr;
+    PyObject* result = PyUnicode_FromFormat("%U: %s", pathObj, error.c_str());
+    Py_DECREF(pathObj);
+    return result;
+}
+
+PyObject* Compressor_getMaxWorkers(Compressor *self, void* closure){
+    CompressionState& state = currentState(self);
+    std::lock_guard<std::mutex> guard(state.mutex);
+    return PyLong_FromSize_t(state.maxWorkers);
+}
+
+PyObject* Compressor_repr(Compressor *self)
+{
+    return PyUnicode_FromFormat("<%s %R level=%d>",
+        _PyType_Name(Py_TYPE(self)),
+        self->methodName,
+        self->level);
+}
+
+static PyMethodDef Compressor_methods[] = {
+    {"submit", (PyCFunction)(void(*)(void))Compressor_submit, METH_VARARGS | METH_KEYWORDS, "Queue source to be compressed into dest, source is removed once dest is in place."},
+    {"wait", (PyCFunction)(void(*)(void))Compressor_wait, METH_VARARGS | METH_KEYWORDS, "Wait for queued jobs to finish, or only those compressing one of sources, returns False if the timeout expired first."},
+    {"close", (PyCFunction)Compressor_close, METH_NOARGS, "Stop the workers once the queued jobs are done."},
+    {NULL}
+};
+
+static PyMemberDef Compressor_members[] = {
+    {"method", T_OBJECT_EX, offsetof(Compressor, methodName), READONLY, "Compression method"},
+    {"level", T_INT, offsetof(Compressor, level), READONLY, "Compression level"},
+    {NULL}
+};
+
+static PyGetSetDef Compressor_getset[] = {
+    {"pending", (getter)Compressor_getPending, nullptr, "Number of queued or running jobs"},
+    {"completed", (getter)Compressor_getCompleted, nullptr, "Number of files compressed"},
+    {"lastError", (getter)Compressor_getLastError, nullptr, "Description of the most recent failed job, or None"},
+    {"maxWorkers", (getter)Compressor_getMaxWorkers, nullptr, "Maximum number of worker threads"},
+    {NULL}
+};
+
+static PyType_Slot Compressor_slots[] = {
+    {Py_tp_dealloc, (void*)Compressor_dealloc},
+    {Py_tp_repr, (void*)Compressor_repr},
+    {Py_tp_doc, (void*)PyDoc_STR("Compresses files on background threads with idle I/O priority.")},
+    {Py_tp_methods, Compressor_methods},
+    {Py_tp_members, Compressor_members},
+    {Py_tp_getset, Compressor_getset},
+    {Py_tp_init, (void*)Compressor_init},
+    {Py_tp_new, (void*)Compressor_new},
+    {Py_tp_free, (void*)PyObject_Del},
+    {0, NULL}
+};
+
+PyType_Spec CompressorType_spec = {
+    "picologging.handlers.Compressor",
+    sizeof(Compressor),
+    0,
+    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_IMMUTABLETYPE,
+    Compressor_slots,
+};
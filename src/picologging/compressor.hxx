@@ -0,0 +1,57 @@
+#include <Python.h>
+#include <structmember.h>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#ifndef PICOLOGGING_COMPRESSOR_H
+#define PICOLOGGING_COMPRESSOR_H
+
+#define COMPRESSION_GZIP 1
+#define COMPRESSION_ZSTD 2
+#define COMPRESSION_CHUNK_SIZE (128 * 1024)
+
+typedef struct {
+    std::filesystem::path source;
+    std::filesystem::path dest;
+    int method;
+    int level;
+} CompressionJob;
+
+/**
+ * Shared between the Python object and its worker threads, so workers
+ * finish the queued jobs even if the object is collected first.
+ */
+typedef struct {
+    std::mutex mutex;
+    std::condition_variable wake; // Signalled when a job is queued or on shutdown
+    std::condition_variable idle; // Signalled when a job finishes
+    std::deque<CompressionJob> queue;
+    std::map<std::filesystem::path, size_t> pending; // Queued or running jobs per source
+    size_t running = 0;
+    size_t workers = 0;
+    size_t maxWorkers = 1;
+    bool lowPriority = true;
+    bool stopping = false;
+    unsigned long long completed = 0;
+    std::string lastError;
+    std::filesystem::path lastErrorPath;
+    long pid = 0; // Worker threads don't survive fork, children start a new pool
+} CompressionState;
+
+typedef struct {
+    PyObject_HEAD
+    std::shared_ptr<CompressionState>* state;
+    int method;
+    int level;
+    PyObject* methodName;
+} Compressor;
+
+extern PyType_Spec CompressorType_spec;
+#define Compressor_CheckExact(state, op) Py_IS_TYPE(op, (state)->CompressorType)
+
+#endif // PICOLOGGING_COMPRESSOR_H
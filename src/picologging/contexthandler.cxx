@@ -0,0 +1,510 @@
+#include <mutex>
+
+#include "contexthandler.hxx"
+#include "handler.hxx"
+#include "logrecord.hxx"
+#include "compat.hxx"
+#include "picologging.hxx"
+
+static int levelOf(picologging_state* state, PyObject* record, long* level) {
+    if (LogRecord_Check(state, record)) {
+        *level = ((LogRecord*)record)->levelno;
+        return 0;
+    }
+    PyObject* levelno = PyObject_GetAttrString(record, "levelno");
+    if (levelno == nullptr)
+        return -1;
+    *level = PyLong_AsLong(levelno);
+    Py_DECREF(levelno);
+    return (*level == -1 && PyErr_Occurred()) ? -1 : 0;
+}
+
+static int forward(ContextBufferingHandler* self, PyObject* record) {
+    if (self->target == Py_None)
+        return 0;
+    // The target may replace itself while handling the record
+    PyObject* target = Py_NewRef(self->target);
+    PyObject* result;
+    if (Handler_Check(GET_PICOLOGGING_STATE(self), target))
+        result = Handler_handle((Handler*)target, record);
+    else
+        result = PyObject_CallMethod_ONEARG(target, self->_const_handle, record);
+    Py_DECREF(target);
+    if (result == nullptr)
+        return -1;
+    Py_DECREF(result);
+    return 0;
+}
+
+static void registerScope(ContextBufferingHandler* self, ContextScope* scope) {
+    if (scope->registered)
+        return;
+    scope->prev = self->newest;
+    scope->next = nullptr;
+    if (self->newest != nullptr)
+        self->newest->next = scope;
+    else
+        self->oldest = scope;
+    self->newest = scope;
+    scope->registered = true;
+}
+
+/**
+ * Take the records out of a scope and forget it. Keyed scopes are dropped
+ * from the handler, so the caller must hold a reference to the scope. The
+ * scope list, byte count and dict are shared by every context, the caller
+ * must hold the handler lock.
+ */
+static void releaseScope(ContextBufferingHandler* self, ContextScope* scope, RecordRing& records) {
+    records.swap(*scope->ring);
+    self->bufferedBytes -= records.bytes;
+    if (scope->registered) {
+        if (scope->prev != nullptr)
+            scope->prev->next = scope->next;
+        else
+            self->oldest = scope->next;
+        if (scope->next != nullptr)
+            scope->next->prev = scope->prev;
+        else
+            self->newest = scope->prev;
+        scope->prev = scope->next = nullptr;
+        scope->registered = false;
+    }
+    if (scope->key != nullptr && self->scopes != nullptr) {
+        if (PyDict_DelItem(self->scopes, scope->key) < 0)
+            PyErr_Clear();
+    }
+}
+
+static void discardScope(ContextBufferingHandler* self, ContextScope* scope) {
+    RecordRing records;
+    Py_INCREF(scope);
+    {
+        HandlerLockGuard guard(&self->handler);
+        releaseScope(self, scope, records);
+    }
+    Py_DECREF(scope);
+}
+
+static int flushScope(ContextBufferingHandler* self, ContextScope* scope) {
+    RecordRing records;
+    PyObject* target;
+    Py_INCREF(scope);
+    {
+        HandlerLockGuard guard(&self->handler);
+        releaseScope(self, scope, records);
+        target = Py_NewRef(self->target);
+    }
+    Py_DECREF(scope);
+    // The records are detached first, so the target may log back into this scope.
+    int ret = records.drainTo(GET_PICOLOGGING_STATE(self), target, self->_const_handle);
+    Py_DECREF(target);
+    return ret;
+}
+
+/**
+ * Evict the oldest scopes until the buffered records fit in maxBytes. The
+ * scope being written to is trimmed last.
+ */
+static void enforceMaxBytes(ContextBufferingHandler* self, ContextScope* current) {
+    if (self->maxBytes <= 0)
+        return;
+    while (self->bufferedBytes > (size_t)self->maxBytes) {
+        ContextScope* victim = self->oldest != current ? self->oldest : current->next;
+        if (victim == nullptr)
+            break;
+        discardScope(self, victim);
+    }
+    while (self->bufferedBytes > (size_t)self->maxBytes && current->ring->count > 1) {
+        size_t before = current->ring->bytes;
+        current->ring->dropOldest();
+        self->bufferedBytes -= before - current->ring->bytes;
+    }
+}
+
+static ContextScope* newScope(ContextBufferingHandler* handler, PyObject* key) {
+    ContextScope* scope = PyObject_New(ContextScope, GET_PICOLOGGING_STATE(handler)->ContextScopeType);
+    if (scope == nullptr)
+        return nullptr;
+    scope->handler = key == nullptr ? Py_NewRef((PyObject*)handler) : (PyObject*)handler;
+    scope->key = key == nullptr ? nullptr : Py_NewRef(key);
+    scope->token = nullptr;
+    scope->ring = new RecordRing();
+    scope->prev = scope->next = nullptr;
+    scope->registered = false;
+    return scope;
+}
+
+/**
+ * Return the scope of the current context as a new reference, Py_None
+ * outside of a scope. Keyed scopes are only created when `create` is set.
+ */
+static PyObject* currentScope(ContextBufferingHandler* self, bool create) {
+    PyObject* value = nullptr;
+    if (self->contextVar == nullptr)
+        Py_RETURN_NONE;
+    if (PyContextVar_Get(self->contextVar, nullptr, &value) < 0)
+        return nullptr;
+    if (value == nullptr)
+        Py_RETURN_NONE;
+    if (value == Py_None || (ContextScope_CheckExact(GET_PICOLOGGING_STATE(self), value) && ((ContextScope*)value)->handler == (PyObject*)self))
+        return value;
+    PyObject* scope = PyDict_GetItemWithError(self->scopes, value); // borrowed reference
+    if (scope != nullptr || PyErr_Occurred() || !create) {
+        Py_DECREF(value);
+        return scope != nullptr ? Py_NewRef(scope) : (PyErr_Occurred() ? nullptr : Py_NewRef(Py_None));
+    }
+    scope = (PyObject*)newScope(self, value);
+    Py_DECREF(value);
+    if (scope == nullptr)
+        return nullptr;
+    if (PyDict_SetItem(self->scopes, ((ContextScope*)scope)->key, scope) < 0) {
+        Py_DECREF(scope);
+        return nullptr;
+    }
+    return scope;
+}
+
+PyObject* ContextBufferingHandler_new(PyTypeObject* type, PyObject* args, PyObject* kwds)
+{
+    ContextBufferingHandler* self = (ContextBufferingHandler*)Handler_new(type, args, kwds);
+    if (self != NULL)
+    {
+        self->target = Py_NewRef(Py_None);
+        self->flushLevel = 40; // ERROR
+        self->passLevel = 40;
+        self->capacity = 0;
+        self->maxBytes = 0;
+        self->bufferedBytes = 0;
+        self->contextVar = nullptr;
+        self->scopes = PyDict_New();
+        self->oldest = nullptr;
+        self->newest = nullptr;
+        self->_const_handle = PyUnicode_FromString("handle");
+    }
+    return (PyObject*)self;
+}
+
+int ContextBufferingHandler_init(ContextBufferingHandler *self, PyObject *args, PyObject *kwds){
+    PyObject* noArgs = PyTuple_New(0);
+    int ret = Handler_init((Handler*)self, noArgs, nullptr);
+    Py_DECREF(noArgs);
+    if (ret < 0)
+        return -1;
+    PyObject *target = Py_None;
+    int flushLevel = 40;
+    PyObject *passLevel = Py_None;
+    Py_ssize_t capacity = 256;
+    Py_ssize_t maxBytes = 16 * 1024 * 1024;
+    PyObject *contextVar = Py_None;
+    static const char *kwlist[] = {"target", "flushLevel", "passLevel", "capacity", "maxBytes", "contextvar", NULL};
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|OiOnnO", const_cast<char**>(kwlist),
+                                     &target, &flushLevel, &passLevel, &capacity, &maxBytes, &contextVar)){
+        return -1;
+    }
+    if (capacity < 1) {
+        PyErr_SetString(PyExc_ValueError, "capacity must be at least 1");
+        return -1;
+    }
+    if (maxBytes < 0) {
+        PyErr_SetString(PyExc_ValueError, "maxBytes must not be negative");
+        return -1;
+    }
+    int pass = flushLevel;
+    if (passLevel != Py_None) {
+        pass = (int)PyLong_AsLong(passLevel);
+        if (pass == -1 && PyErr_Occurred())
+            return -1;
+    }
+    if (contextVar == Py_None) {
+        contextVar = PyContextVar_New("picologging_scope", nullptr);
+        if (contextVar == nullptr)
+            return -1;
+    } else if (PyContextVar_CheckExact(contextVar)) {
+        Py_INCREF(contextVar);
+    } else {
+        PyErr_SetString(PyExc_TypeError, "contextvar must be a contextvars.ContextVar");
+        return -1;
+    }
+    if (Handler_checkTarget(GET_PICOLOGGING_STATE(self), target) < 0) {
+        Py_DECREF(contextVar);
+        return -1;
+    }
+    while (self->oldest != nullptr)
+        discardScope(self, self->oldest);
+    Py_XSETREF(self->contextVar, contextVar);
+    Py_SETREF(self->target, Py_NewRef(target));
+    self->flushLevel = flushLevel;
+    self->passLevel = pass;
+    self->capacity = capacity;
+    self->maxBytes = maxBytes;
+    return 0;
+}
+
+PyObject* ContextBufferingHandler_dealloc(ContextBufferingHandler *self) {
+    while (self->oldest != nullptr)
+        discardScope(self, self->oldest);
+    Py_CLEAR(self->scopes);
+    Py_CLEAR(self->contextVar);
+    Py_CLEAR(self->target);
+    Py_CLEAR(self->_const_handle);
+    Handler_dealloc((Handler*)self);
+    return nullptr;
+}
+
+/**
+ * Called by Handler_handle with the handler lock held, buffering a record
+ * updates the scope list and byte count shared with every other context.
+ */
+PyObject* ContextBufferingHandler_emit(ContextBufferingHandler* self, PyObject* record){
+    picologging_state* state = GET_PICOLOGGING_STATE(self);
+    long level;
+    if (levelOf(state, record, &level) < 0)
+        return nullptr;
+    bool buffered = level < self->passLevel && level < self->flushLevel;
+    PyObject* scope = currentScope(self, buffered);
+    if (scope == nullptr)
+        return nullptr;
+    int ret = 0;
+    if (scope == Py_None) {
+        ret = forward(self, record);
+    } else if (buffered) {
+        ContextScope* contextScope = (ContextScope*)scope;
+        size_t before = contextScope->ring->bytes;
+        contextScope->ring->push(state, record, (size_t)self->capacity);
+        self->bufferedBytes = self->bufferedBytes - before + contextScope->ring->bytes;
+        registerScope(self, contextScope);
+        enforceMaxBytes(self, contextScope);
+    } else {
+        if (level >= self->flushLevel)
+            ret = flushScope(self, (ContextScope*)scope);
+        if (ret == 0)
+            ret = forward(self, record);
+    }
+    Py_DECREF(scope);
+    if (ret < 0)
+        return nullptr;
+    Py_RETURN_NONE;
+}
+
+PyObject* ContextBufferingHandler_scope(ContextBufferingHandler* self, PyObject* Py_UNUSED(ignored)){
+    return (PyObject*)newScope(self, nullptr);
+}
+
+PyObject* ContextBufferingHandler_discard(ContextBufferingHandler* self, PyObject* key){
+    HandlerLockGuard guard(&self->handler);
+    PyObject* scope = PyDict_GetItemWithError(self->scopes, key); // borrowed reference
+    if (scope == nullptr) {
+        if (PyErr_Occurred())
+            return nullptr;
+        Py_RETURN_NONE;
+    }
+    discardScope(self, (ContextScope*)scope);
+    Py_RETURN_NONE;
+}
+
+PyObject* ContextBufferingHandler_flushContext(ContextBufferingHandler* self, PyObject* Py_UNUSED(ignored)){
+    PyObject* scope;
+    {
+        HandlerLockGuard guard(&self->handler);
+        scope = currentScope(self, false);
+    }
+    if (scope == nullptr)
+        return nullptr;
+    int ret = scope == Py_None ? 0 : flushScope(self, (ContextScope*)scope);
+    Py_DECREF(scope);
+    if (ret < 0)
+        return nullptr;
+    Py_RETURN_NONE;
+}
+
+PyObject* ContextBufferingHandler_close(ContextBufferingHandler* self){
+    HandlerLockGuard guard(&self->handler);
+    while (self->oldest != nullptr)
+        discardScope(self, self->oldest);
+    PyDict_Clear(self->scopes);
+    Py_RETURN_NONE;
+}
+
+PyObject* ContextBufferingHandler_getTarget(ContextBufferingHandler* self, void* closure){
+    HandlerLockGuard guard(&self->handler);
+    return Py_NewRef(self->target);
+}
+
+int ContextBufferingHandler_setTargetAttr(ContextBufferingHandler* self, PyObject* target, void* closure){
+    if (target == nullptr) {
+        PyErr_SetString(PyExc_AttributeError, "Cannot delete target, set it to None instead");
+        return -1;
+    }
+    if (Handler_checkTarget(GET_PICOLOGGING_STATE(self), target) < 0)
+        return -1;
+    HandlerLockGuard guard(&self->handler);
+    Py_SETREF(self->target, Py_NewRef(target));
+    return 0;
+}
+
+PyObject* ContextBufferingHandler_setTarget(ContextBufferingHandler* self, PyObject* target){
+    if (ContextBufferingHandler_setTargetAttr(self, target, nullptr) < 0)
+        return nullptr;
+    Py_RETURN_NONE;
+}
+
+PyObject* ContextBufferingHandler_getBufferedBytes(ContextBufferingHandler* self, void* closure){
+    HandlerLockGuard guard(&self->handler);
+    return PyLong_FromSize_t(self->bufferedBytes);
+}
+
+PyObject* ContextBufferingHandler_repr(ContextBufferingHandler *self)
+{
+    std::string level = _getLevelName(self->handler.level);
+    return PyUnicode_FromFormat("<%s %R (%s)>",
+        _PyType_Name(Py_TYPE(self)),
+        self->target,
+        level.c_str());
+}
+
+static PyMethodDef ContextBufferingHandler_methods[] = {
+    {"emit", (PyCFunction)ContextBufferingHandler_emit, METH_O, "Buffer the record in the current scope, or flush the scope on a severe record."},
+    {"scope", (PyCFunction)ContextBufferingHandler_scope, METH_NOARGS, "Create a scope, to be used as a context manager."},
+    {"discard", (PyCFunction)ContextBufferingHandler_discard, METH_O, "Discard the records buffered for a context variable value."},
+    {"flushContext", (PyCFunction)ContextBufferingHandler_flushContext, METH_NOARGS, "Send the records of the current scope to the target."},
+    {"close", (PyCFunction)ContextBufferingHandler_close, METH_NOARGS, "Discard all buffered records."},
+    {"setTarget", (PyCFunction)ContextBufferingHandler_setTarget, METH_O, "Set the target handler."},
+    {NULL}
+};
+
+static PyMemberDef ContextBufferingHandler_members[] = {
+    {"flushLevel", T_INT, offsetof(ContextBufferingHandler, flushLevel), 0, "Level at which the scope's records are sent to the target"},
+    {"passLevel", T_INT, offsetof(ContextBufferingHandler, passLevel), 0, "Level at which records are sent to the target without buffering"},
+    {"capacity", T_PYSSIZET, offsetof(ContextBufferingHandler, capacity), 0, "Maximum number of records buffered per scope"},
+    {"maxBytes", T_PYSSIZET, offsetof(ContextBufferingHandler, maxBytes), 0, "Approximate maximum size of the records buffered across scopes"},
+    {"contextvar", T_OBJECT_EX, offsetof(ContextBufferingHandler, contextVar), READONLY, "Context variable identifying the scope"},
+    {NULL}
+};
+
+static PyGetSetDef ContextBufferingHandler_getset[] = {
+    {"target", (getter)ContextBufferingHandler_getTarget, (setter)ContextBufferingHandler_setTargetAttr, "Target handler"},
+    {"bufferedBytes", (getter)ContextBufferingHandler_getBufferedBytes, nullptr, "Approximate size of the buffered records"},
+    {NULL}
+};
+
+static PyType_Slot ContextBufferingHandler_slots[] = {
+    {Py_tp_dealloc, (void*)ContextBufferingHandler_dealloc},
+    {Py_tp_repr, (void*)ContextBufferingHandler_repr},
+    {Py_tp_doc, (void*)PyDoc_STR("Handler which buffers records per context and only writes them out when the context sees an error.")},
+    {Py_tp_methods, ContextBufferingHandler_methods},
+    {Py_tp_members, ContextBufferingHandler_members},
+    {Py_tp_getset, ContextBufferingHandler_getset},
+    {Py_tp_init, (void*)ContextBufferingHandler_init},
+    {Py_tp_new, (void*)ContextBufferingHandler_new},
+    {Py_tp_free, (void*)PyObject_Del},
+    {0, NULL}
+};
+
+PyType_Spec ContextBufferingHandlerType_spec = {
+    "picologging.handlers.ContextBufferingHandler",
+    sizeof(ContextBufferingHandler),
+    0,
+    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE | Py_TPFLAGS_IMMUTABLETYPE,
+    ContextBufferingHandler_slots,
+};
+
+PyObject* ContextScope_dealloc(ContextScope *self) {
+    if (self->registered) {
+        // Keyed scopes are only deallocated once the handler has dropped them.
+        RecordRing records;
+        PyObject* key = self->key;
+        self->key = nullptr;
+        {
+            HandlerLockGuard guard(&((ContextBufferingHandler*)self->handler)->handler);
+            releaseScope((ContextBufferingHandler*)self->handler, self, records);
+        }
+        self->key = key;
+    }
+    delete self->ring;
+    Py_CLEAR(self->token);
+    if (self->key != nullptr)
+        Py_CLEAR(self->key);
+    else
+        Py_CLEAR(self->handler);
+    PyTypeObject* type = Py_TYPE(self);
+    type->tp_free((PyObject*)self);
+    Py_DECREF_HEAPTYPE(type);
+    return nullptr;
+}
+
+PyObject* ContextScope_enter(ContextScope* self, PyObject* Py_UNUSED(ignored)){
+    if (self->token != nullptr) {
+        PyErr_SetString(PyExc_RuntimeError, "scope is already entered");
+        return nullptr;
+    }
+    ContextBufferingHandler* handler = (ContextBufferingHandler*)self->handler;
+    self->token = PyContextVar_Set(handler->contextVar, (PyObject*)self);
+    if (self->token == nullptr)
+        return nullptr;
+    return Py_NewRef((PyObject*)self);
+}
+
+PyObject* ContextScope_exit(ContextScope* self, PyObject* const* args, Py_ssize_t nargs){
+    if (self->token == nullptr) {
+        PyErr_SetString(PyExc_RuntimeError, "scope is not entered");
+        return nullptr;
+    }
+    ContextBufferingHandler* handler = (ContextBufferingHandler*)self->handler;
+    int ret = PyContextVar_Reset(handler->contextVar, self->token);
+    Py_CLEAR(self->token);
+    if (ret < 0)
+        return nullptr;
+    // An exception escaping the scope counts as a failure.
+    if (nargs > 0 && args[0] != Py_None) {
+        if (flushScope(handler, self) < 0)
+            return nullptr;
+    } else {
+        discardScope(handler, self);
+    }
+    Py_RETURN_FALSE;
+}
+
+PyObject* ContextScope_flush(ContextScope* self, PyObject* Py_UNUSED(ignored)){
+    if (flushScope((ContextBufferingHandler*)self->handler, self) < 0)
+        return nullptr;
+    Py_RETURN_NONE;
+}
+
+PyObject* ContextScope_discard(ContextScope* self, PyObject* Py_UNUSED(ignored)){
+    discardScope((ContextBufferingHandler*)self->handler, self);
+    Py_RETURN_NONE;
+}
+
+PyObject* ContextScope_getBuffer(ContextScope* self, void* closure){
+    return self->ring->toList();
+}
+
+static PyMethodDef ContextScope_methods[] = {
+    {"__enter__", (PyCFunction)ContextScope_enter, METH_NOARGS, "Make this the scope of the current context."},
+    {"__exit__", (PyCFunction)ContextScope_exit, METH_FASTCALL, "Restore the previous scope, flushing the records if an exception is raised."},
+    {"flush", (PyCFunction)ContextScope_flush, METH_NOARGS, "Send the buffered records to the target."},
+    {"discard", (PyCFunction)ContextScope_discard, METH_NOARGS, "Discard the buffered records."},
+    {NULL}
+};
+
+static PyGetSetDef ContextScope_getset[] = {
+    {"buffer", (getter)ContextScope_getBuffer, nullptr, "Copy of the buffered records, oldest first"},
+    {NULL}
+};
+
+static PyType_Slot ContextScope_slots[] = {
+    {Py_tp_dealloc, (void*)ContextScope_dealloc},
+    {Py_tp_doc, (void*)PyDoc_STR("Buffer of the records logged in a context, see ContextBufferingHandler.scope().")},
+    {Py_tp_methods, ContextScope_methods},
+    {Py_tp_getset, ContextScope_getset},
+    {0, NULL}
+};
+
+PyType_Spec ContextScopeType_spec = {
+    "picologging.handlers.ContextScope",
+    sizeof(ContextScope),
+    0,
+    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_IMMUTABLETYPE | Py_TPFLAGS_DISALLOW_INSTANTIATION,
+    ContextScope_slots,
+};
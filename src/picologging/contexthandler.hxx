@@ -0,0 +1,42 @@
+#include <Python.h>
+#include "handler.hxx"
+#include "bufferinghandler.hxx"
+
+#ifndef PICOLOGGING_CONTEXTHANDLER_H
+#define PICOLOGGING_CONTEXTHANDLER_H
+
+typedef struct ContextScope {
+    PyObject_HEAD
+    PyObject* handler; // Strong reference for token scopes, borrowed for keyed scopes
+    PyObject* key;     // Context variable value of keyed scopes, nullptr for token scopes
+    PyObject* token;   // contextvars.Token while the scope is entered
+    RecordRing* ring;
+    // Scopes holding records, oldest first, for eviction under the memory cap.
+    struct ContextScope* prev;
+    struct ContextScope* next;
+    bool registered;
+} ContextScope;
+
+typedef struct {
+    Handler handler;
+    PyObject* target;
+    int flushLevel;
+    int passLevel;
+    Py_ssize_t capacity;
+    Py_ssize_t maxBytes;
+    size_t bufferedBytes;
+    PyObject* contextVar;
+    PyObject* scopes; // Keyed scopes holding records
+    ContextScope* oldest;
+    ContextScope* newest;
+    PyObject* _const_handle;
+} ContextBufferingHandler;
+
+PyObject* ContextBufferingHandler_emit(ContextBufferingHandler* self, PyObject* record);
+
+extern PyType_Spec ContextBufferingHandlerType_spec;
+extern PyType_Spec ContextScopeType_spec;
+#define ContextBufferingHandler_CheckExact(state, op) Py_IS_TYPE(op, (state)->ContextBufferingHandlerType)
+#define ContextScope_CheckExact(state, op) Py_IS_TYPE(op, (state)->ContextScopeType)
+
+#endif // PICOLOGGING_CONTEXTHANDLER_H
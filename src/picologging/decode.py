@@ -0,0 +1,232 @@
+"""
+Decoder for the binary log files written by
+:class:`picologging.handlers.BinaryFileHandler`.
+
+Usage::
+
+    python -m picologging.decode [--format FORMAT] [--datefmt DATEFMT] FILE [FILE ...]
+
+A file is a sequence of sessions. Each session starts with a header holding
+the wall clock time the session started and the base of ``relativeCreated``,
+followed by entries:
+
+* ``T`` defines a message template (id, text).
+* ``S`` defines a call site (id, logger name, pathname, function name, line).
+* ``L`` is a record referencing a template, with type-tagged arguments.
+* ``M`` is a record carrying its already formatted message.
+
+Record times are the signed difference from the previous record's creation
+time, or from the session start for the first record. Files written by
+earlier versions (``PLOGBIN\x01``) stored unsigned deltas of the time the
+records were written, they are still decoded.
+
+Integers are LEB128 varints (zigzag encoded when signed), strings are
+varint length-prefixed UTF-8.
+"""
+import argparse
+import logging
+import struct
+import sys
+
+MAGIC = b"PLOGBIN\x02"
+MAGIC_V1 = b"PLOGBIN\x01"
+
+_TEMPLATE = ord("T")
+_SITE = ord("S")
+_RECORD = ord("L")
+_MESSAGE = ord("M")
+
+_HAS_EXC_TEXT = 0x01
+_HAS_STACK_INFO = 0x02
+
+_ARG_NONE = 0
+_ARG_FALSE = 1
+_ARG_TRUE = 2
+_ARG_INT = 3
+_ARG_FLOAT = 4
+_ARG_STR = 5
+
+DEFAULT_FORMAT = "%(asctime)s %(levelname)s %(name)s %(message)s"
+
+
+class DecodeError(ValueError):
+    pass
+
+
+class _Reader:
+    def __init__(self, data):
+        self.data = data
+        self.pos = 0
+
+    def at_end(self):
+        return self.pos >= len(self.data)
+
+    def byte(self):
+        if self.pos >= len(self.data):
+            raise DecodeError("Truncated log file")
+        value = self.data[self.pos]
+        self.pos += 1
+        return value
+
+    def bytes(self, size):
+        if self.pos + size > len(self.data):
+            raise DecodeError("Truncated log file")
+        value = self.data[self.pos : self.pos + size]
+        self.pos += size
+        return value
+
+    def varint(self):
+        result = 0
+        shift = 0
+        while True:
+            b = self.byte()
+            result |= (b & 0x7F) << shift
+            if b < 0x80:
+                return result
+            shift += 7
+
+    def zigzag(self):
+        value = self.varint()
+        return (value >> 1) ^ -(value & 1)
+
+    def fixed64(self):
+        return struct.unpack("<Q", self.bytes(8))[0]
+
+    def double(self):
+        return struct.unpack("<d", self.bytes(8))[0]
+
+    def text(self):
+        return self.bytes(self.varint()).decode("utf-8", "surrogatepass")
+
+    def arg(self):
+        tag = self.byte()
+        if tag == _ARG_NONE:
+            return None
+        if tag == _ARG_FALSE:
+            return False
+        if tag == _ARG_TRUE:
+            return True
+        if tag == _ARG_INT:
+            return self.zigzag()
+        if tag == _ARG_FLOAT:
+            return self.double()
+        if tag == _ARG_STR:
+            return self.text()
+        raise DecodeError(f"Unknown argument type {tag} at offset {self.pos - 1}")
+
+
+def _make_record(site, level, msg, args, created_ns, start_ns, flags, reader):
+    name, pathname, func, lineno = site
+    exc_text = reader.text() if flags & _HAS_EXC_TEXT else None
+    stack_info = reader.text() if flags & _HAS_STACK_INFO else None
+    record = logging.LogRecord(
+        name, level, pathname, lineno, msg, args, None, func or None, stack_info
+    )
+    record.created = created_ns / 1e9
+    record.msecs = (created_ns % 1_000_000_000) // 1_000_000 + 0.0
+    record.relativeCreated = (created_ns - start_ns) / 1e6
+    record.exc_text = exc_text
+    return record
+
+
+def _lookup(table, kind, reader):
+    offset = reader.pos
+    key = reader.varint()
+    try:
+        return table[key]
+    except KeyError:
+        raise DecodeError(f"Unknown {kind} {key} at offset {offset}") from None
+
+
+def iter_records(data):
+    """
+    Decode the content of a binary log file into :class:`logging.LogRecord`
+    objects. Only the fields stored by the handler are meaningful; thread
+    and process details are those of the decoding process.
+    """
+    reader = _Reader(bytes(data))
+    templates = {}
+    sites = {}
+    wall_ns = start_ns = None
+    delta = reader.zigzag
+    while not reader.at_end():
+        magic = reader.data[reader.pos : reader.pos + len(MAGIC)]
+        if magic in (MAGIC, MAGIC_V1):
+            reader.pos += len(MAGIC)
+            wall_ns = reader.fixed64()
+            if magic == MAGIC:
+                start_ns = reader.fixed64()
+                delta = reader.zigzag
+            else:
+                # The monotonic clock base isn't needed to rebuild wall clock times.
+                reader.fixed64()
+                start_ns = wall_ns
+                delta = reader.varint
+            templates.clear()
+            sites.clear()
+            continue
+        if wall_ns is None:
+            raise DecodeError("Missing session header, not a picologging binary log")
+        tag = reader.byte()
+        if tag == _TEMPLATE:
+            template_id = reader.varint()
+            templates[template_id] = reader.text()
+        elif tag == _SITE:
+            site_id = reader.varint()
+            name = reader.text()
+            pathname = reader.text()
+            func = reader.text()
+            lineno = reader.zigzag()
+            sites[site_id] = (name, pathname, func, lineno)
+        elif tag == _RECORD:
+            msg = _lookup(templates, "template", reader)
+            level = reader.zigzag()
+            wall_ns += delta()
+            site = _lookup(sites, "call site", reader)
+            flags = reader.byte()
+            args = tuple(reader.arg() for _ in range(reader.varint()))
+            yield _make_record(site, level, msg, args, wall_ns, start_ns, flags, reader)
+        elif tag == _MESSAGE:
+            msg = reader.text()
+            level = reader.zigzag()
+            wall_ns += delta()
+            site = _lookup(sites, "call site", reader)
+            flags = reader.byte()
+            yield _make_record(site, level, msg, None, wall_ns, start_ns, flags, reader)
+        else:
+            raise DecodeError(f"Unknown entry {tag!r} at offset {reader.pos - 1}")
+
+
+def decode(path, fmt=DEFAULT_FORMAT, datefmt=None):
+    """
+    Yield the formatted lines of the binary log file at ``path``.
+    """
+    formatter = logging.Formatter(fmt, datefmt)
+    with open(path, "rb") as f:
+        data = f.read()
+    for record in iter_records(data):
+        yield formatter.format(record)
+
+
+def main(argv=None):
+    parser = argparse.ArgumentParser(
+        prog="python -m picologging.decode",
+        description="Convert picologging binary log files to text.",
+    )
+    parser.add_argument("files", nargs="+", help="binary log files")
+    parser.add_argument(
+        "--format", default=DEFAULT_FORMAT, help="logging format string"
+    )
+    parser.add_argument("--datefmt", default=None, help="date format string")
+    options = parser.parse_args(argv)
+    try:
+        for path in options.files:
+            for line in decode(path, options.format, options.datefmt):
+                sys.stdout.write(line + "\n")
+    except (OSError, DecodeError) as e:
+        parser.exit(1, f"{parser.prog}: error: {e}\n")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,312 @@
+#include <chrono>
+#include <climits>
+#include <mutex>
+
+#include "deduplicationhandler.hxx"
+#include "handler.hxx"
+#include "logrecord.hxx"
+#include "compat.hxx"
+#include "picologging.hxx"
+
+// Number of neighbouring slots inspected before the table is considered full.
+#define DEDUPLICATION_MAX_PROBE 8
+
+static inline long long monotonic_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * Records are fingerprinted by identity of the logger name, message template
+ * and call site, so repeated calls from the same line are cheap to compare.
+ */
+static inline Py_hash_t fingerprint(LogRecord* record) {
+    size_t h = (size_t)record->msg;
+    h ^= ((size_t)record->name >> 4) + 0x9e3779b9 + (h << 6) + (h >> 2);
+    h ^= ((size_t)record->pathname >> 4) + 0x9e3779b9 + (h << 6) + (h >> 2);
+    h ^= (size_t)record->lineno + 0x9e3779b9 + (h << 6) + (h >> 2);
+    h ^= (size_t)record->levelno + 0x9e3779b9 + (h << 6) + (h >> 2);
+    return (Py_hash_t)h;
+}
+
+static inline bool sameCallSite(LogRecord* a, LogRecord* b) {
+    return a->msg == b->msg &&
+           a->name == b->name &&
+           a->pathname == b->pathname &&
+           a->lineno == b->lineno &&
+           a->levelno == b->levelno;
+}
+
+static int forward(DeduplicationHandler* self, PyObject* record) {
+    if (self->target == Py_None)
+        return 0;
+    // The target may replace itself while handling the record
+    PyObject* target = Py_NewRef(self->target);
+    PyObject* result;
+    if (Handler_Check(GET_PICOLOGGING_STATE(self), target))
+        result = Handler_handle((Handler*)target, record);
+    else
+        result = PyObject_CallMethod_ONEARG(target, self->_const_handle, record);
+    Py_DECREF(target);
+    if (result == nullptr)
+        return -1;
+    Py_DECREF(result);
+    return 0;
+}
+
+static int emitSummary(DeduplicationHandler* self, DeduplicationEntry& entry) {
+    LogRecord* first = (LogRecord*)entry.record;
+    if (LogRecord_writeMessage(first) == -1)
+        return -1;
+    PyObject* msg = PyUnicode_FromFormat("%S (repeated %zd times)", first->message, entry.suppressed);
+    if (msg == nullptr)
+        return -1;
+    entry.suppressed = 0;
+
+    PyTypeObject* recordType = GET_PICOLOGGING_STATE(self)->LogRecordType;
+    LogRecord* summary = (LogRecord*) recordType->tp_alloc(recordType, 0);
+    if (summary == nullptr) {
+        Py_DECREF(msg);
+        PyErr_NoMemory();
+        return -1;
+    }
+    summary = LogRecord_create(
+        summary,
+        first->name,
+        msg,
+        Py_None,
+        first->levelno,
+        first->pathname,
+        first->lineno,
+        Py_None,
+        first->funcName,
+        Py_None
+    );
+    Py_DECREF(msg);
+    if (summary == nullptr)
+        return -1;
+    int ret = forward(self, (PyObject*)summary);
+    Py_DECREF(summary);
+    return ret;
+}
+
+/**
+ * Emit the summary of every burst whose window has closed (or all pending
+ * summaries if `all` is set) and recompute the next deadline.
+ */
+static int flushPending(DeduplicationHandler* self, long long now, bool all) {
+    long long next = LLONG_MAX;
+    for (auto& entry : *self->table) {
+        if (entry.record == nullptr)
+            continue;
+        bool expired = now - entry.windowStart >= self->window;
+        if (entry.suppressed > 0 && (expired || all)) {
+            if (emitSummary(self, entry) < 0)
+                return -1;
+        }
+        if (expired) {
+            Py_CLEAR(entry.record);
+        } else if (entry.suppressed > 0 && entry.windowStart + self->window < next) {
+            next = entry.windowStart + self->window;
+        }
+    }
+    self->nextExpiry = next;
+    return 0;
+}
+
+PyObject* DeduplicationHandler_new(PyTypeObject* type, PyObject* args, PyObject* kwds)
+{
+    DeduplicationHandler* self = (DeduplicationHandler*)Handler_new(type, args, kwds);
+    if (self != NULL)
+    {
+        self->target = Py_NewRef(Py_None);
+        self->window = 0;
+        self->nextExpiry = LLONG_MAX;
+        self->table = new std::vector<DeduplicationEntry>();
+        self->mask = 0;
+        self->_const_handle = PyUnicode_FromString("handle");
+    }
+    return (PyObject*)self;
+}
+
+int DeduplicationHandler_init(DeduplicationHandler *self, PyObject *args, PyObject *kwds){
+    PyObject* noArgs = PyTuple_New(0);
+    int ret = Handler_init((Handler*)self, noArgs, nullptr);
+    Py_DECREF(noArgs);
+    if (ret < 0)
+        return -1;
+    PyObject *target = Py_None;
+    double window = 1.0;
+    Py_ssize_t capacity = 256;
+    static const char *kwlist[] = {"target", "window", "capacity", NULL};
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|Odn", const_cast<char**>(kwlist), &target, &window, &capacity)){
+        return -1;
+    }
+    if (!(window > 0)) {
+        PyErr_SetString(PyExc_ValueError, "window must be a positive number of seconds");
+        return -1;
+    }
+    if (capacity < 1) {
+        PyErr_SetString(PyExc_ValueError, "capacity must be at least 1");
+        return -1;
+    }
+    if (Handler_checkTarget(GET_PICOLOGGING_STATE(self), target) < 0)
+        return -1;
+    Py_SETREF(self->target, Py_NewRef(target));
+    self->window = (long long)(window * 1e9);
+
+    size_t size = 1;
+    while (size < (size_t)capacity)
+        size <<= 1;
+    for (auto& entry : *self->table)
+        Py_CLEAR(entry.record);
+    self->table->assign(size, DeduplicationEntry{nullptr, 0, 0, 0});
+    self->mask = size - 1;
+    self->nextExpiry = LLONG_MAX;
+    return 0;
+}
+
+PyObject* DeduplicationHandler_dealloc(DeduplicationHandler *self) {
+    for (auto& entry : *self->table)
+        Py_CLEAR(entry.record);
+    delete self->table;
+    Py_CLEAR(self->target);
+    Py_CLEAR(self->_const_handle);
+    Handler_dealloc((Handler*)self);
+    return nullptr;
+}
+
+PyObject* DeduplicationHandler_emit(DeduplicationHandler* self, PyObject* record){
+    if (self->table->empty() || !LogRecord_Check(GET_PICOLOGGING_STATE(self), record)) {
+        if (forward(self, record) < 0)
+            return nullptr;
+        Py_RETURN_NONE;
+    }
+    long long now = monotonic_ns();
+    if (now >= self->nextExpiry && flushPending(self, now, false) < 0)
+        return nullptr;
+
+    LogRecord* logRecord = (LogRecord*)record;
+    Py_hash_t fp = fingerprint(logRecord);
+    DeduplicationEntry* slot = nullptr;
+    for (size_t probe = 0; probe < DEDUPLICATION_MAX_PROBE && probe <= self->mask; probe++) {
+        DeduplicationEntry& entry = (*self->table)[((size_t)fp + probe) & self->mask];
+        if (entry.record == nullptr) {
+            if (slot == nullptr)
+                slot = &entry;
+            continue;
+        }
+        bool expired = now - entry.windowStart >= self->window;
+        if (entry.fingerprint == fp && sameCallSite((LogRecord*)entry.record, logRecord)) {
+            if (!expired) {
+                if (entry.suppressed++ == 0 && entry.windowStart + self->window < self->nextExpiry)
+                    self->nextExpiry = entry.windowStart + self->window;
+                Py_RETURN_NONE;
+            }
+            if (entry.suppressed > 0 && emitSummary(self, entry) < 0)
+                return nullptr;
+            slot = &entry;
+            break;
+        }
+        if (slot == nullptr && expired && entry.suppressed == 0)
+            slot = &entry;
+    }
+
+    // A full neighbourhood fails open: the record is passed through untracked.
+    if (slot != nullptr) {
+        Py_XSETREF(slot->record, Py_NewRef(record));
+        slot->fingerprint = fp;
+        slot->windowStart = now;
+        slot->suppressed = 0;
+    }
+    if (forward(self, record) < 0)
+        return nullptr;
+    Py_RETURN_NONE;
+}
+
+PyObject* DeduplicationHandler_flush(DeduplicationHandler* self){
+    HandlerLockGuard guard(&self->handler);
+    if (flushPending(self, monotonic_ns(), true) < 0)
+        return nullptr;
+    Py_RETURN_NONE;
+}
+
+PyObject* DeduplicationHandler_close(DeduplicationHandler* self){
+    HandlerLockGuard guard(&self->handler);
+    if (flushPending(self, monotonic_ns(), true) < 0)
+        return nullptr;
+    for (auto& entry : *self->table)
+        Py_CLEAR(entry.record);
+    self->nextExpiry = LLONG_MAX;
+    Py_RETURN_NONE;
+}
+
+PyObject* DeduplicationHandler_getTarget(DeduplicationHandler* self, void* closure){
+    HandlerLockGuard guard(&self->handler);
+    return Py_NewRef(self->target);
+}
+
+int DeduplicationHandler_setTargetAttr(DeduplicationHandler* self, PyObject* target, void* closure){
+    if (target == nullptr) {
+        PyErr_SetString(PyExc_AttributeError, "Cannot delete target, set it to None instead");
+        return -1;
+    }
+    if (Handler_checkTarget(GET_PICOLOGGING_STATE(self), target) < 0)
+        return -1;
+    HandlerLockGuard guard(&self->handler);
+    Py_SETREF(self->target, Py_NewRef(target));
+    return 0;
+}
+
+PyObject* DeduplicationHandler_setTarget(DeduplicationHandler* self, PyObject* target){
+    if (DeduplicationHandler_setTargetAttr(self, target, nullptr) < 0)
+        return nullptr;
+    Py_RETURN_NONE;
+}
+
+PyObject* DeduplicationHandler_getWindow(DeduplicationHandler* self, void* closure){
+    return PyFloat_FromDouble(self->window / 1e9);
+}
+
+PyObject* DeduplicationHandler_repr(DeduplicationHandler *self)
+{
+    std::string level = _getLevelName(self->handler.level);
+    return PyUnicode_FromFormat("<%s %R (%s)>",
+        _PyType_Name(Py_TYPE(self)),
+        self->target,
+        level.c_str());
+}
+
+static PyMethodDef DeduplicationHandler_methods[] = {
+    {"emit", (PyCFunction)DeduplicationHandler_emit, METH_O, "Emit a record, suppressing repeats within the window."},
+    {"flush", (PyCFunction)DeduplicationHandler_flush, METH_NOARGS, "Emit the summary of all pending repeats."},
+    {"close", (PyCFunction)DeduplicationHandler_close, METH_NOARGS, "Flush pending summaries and forget all fingerprints."},
+    {"setTarget", (PyCFunction)DeduplicationHandler_setTarget, METH_O, "Set the target handler."},
+    {NULL}
+};
+
+static PyGetSetDef DeduplicationHandler_getset[] = {
+    {"target", (getter)DeduplicationHandler_getTarget, (setter)DeduplicationHandler_setTargetAttr, "Target handler"},
+    {"window", (getter)DeduplicationHandler_getWindow, nullptr, "Suppression window in seconds"},
+    {NULL}
+};
+
+static PyType_Slot DeduplicationHandler_slots[] = {
+    {Py_tp_dealloc, (void*)DeduplicationHandler_dealloc},
+    {Py_tp_repr, (void*)DeduplicationHandler_repr},
+    {Py_tp_doc, (void*)PyDoc_STR("Handler which collapses bursts of duplicate records before passing them to a target handler.")},
+    {Py_tp_methods, DeduplicationHandler_methods},
+    {Py_tp_getset, DeduplicationHandler_getset},
+    {Py_tp_init, (void*)DeduplicationHandler_init},
+    {Py_tp_new, (void*)DeduplicationHandler_new},
+    {Py_tp_free, (void*)PyObject_Del},
+    {0, NULL}
+};
+
+PyType_Spec DeduplicationHandlerType_spec = {
+    "picologging.handlers.DeduplicationHandler",
+    sizeof(DeduplicationHandler),
+    0,
+    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE | Py_TPFLAGS_IMMUTABLETYPE,
+    DeduplicationHandler_slots,
+};
@@ -0,0 +1,30 @@
+#include <Python.h>
+#include <vector>
+#include "handler.hxx"
+
+#ifndef PICOLOGGING_DEDUPLICATIONHANDLER_H
+#define PICOLOGGING_DEDUPLICATIONHANDLER_H
+
+typedef struct {
+    PyObject* record; // First record of the burst, owns the fingerprint fields
+    Py_hash_t fingerprint;
+    long long windowStart;
+    Py_ssize_t suppressed;
+} DeduplicationEntry;
+
+typedef struct {
+    Handler handler;
+    PyObject* target;
+    long long window;
+    long long nextExpiry;
+    std::vector<DeduplicationEntry>* table;
+    size_t mask;
+    PyObject* _const_handle;
+} DeduplicationHandler;
+
+PyObject* DeduplicationHandler_emit(DeduplicationHandler* self, PyObject* record);
+
+extern PyType_Spec DeduplicationHandlerType_spec;
+#define DeduplicationHandler_CheckExact(state, op) Py_IS_TYPE(op, (state)->DeduplicationHandlerType)
+
+#endif // PICOLOGGING_DEDUPLICATIONHANDLER_H
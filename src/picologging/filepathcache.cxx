@@ -1,22 +1,14 @@
 #include <filesystem>
 #include "filepathcache.hxx"
+#include "compat.hxx"
 
 namespace fs = std::filesystem;
 
-const FilepathCacheEntry& FilepathCache::lookup(PyObject* pathname){
-    /*
-     * Notes: A vector ended up being significantly faster than an unordered_map,
-     * even though an unordered_map should probably be used.
-     * TODO #3 : Cap vector size or decide on a better map type.
-     */
-    Py_hash_t hash = PyObject_Hash(pathname);
-    for (auto& entry : cache){
-        if (entry.first == hash){
-            return entry.second;
-        }
-    }
-    FilepathCacheEntry* entry = new FilepathCacheEntry();
-    fs::path fs_path = fs::path(PyUnicode_AsUTF8(pathname));
+static int splitPath(PyObject* pathname, FilepathCacheEntry* entry){
+    const char* path = PyUnicode_AsUTF8(pathname);
+    if (path == nullptr)
+        return -1;
+    fs::path fs_path = fs::path(path);
 #ifdef WIN32
     const wchar_t* filename_wchar = fs_path.filename().c_str();
     const wchar_t* modulename = fs_path.stem().c_str();
@@ -26,13 +18,73 @@ const FilepathCacheEntry& FilepathCache::lookup(PyObject* pathname){
     entry->filename = PyUnicode_FromString(fs_path.filename().c_str());
     entry->module = PyUnicode_FromString(fs_path.stem().c_str());
 #endif
-    cache.push_back({hash, *entry});
-    return *entry;
+    if (entry->filename == nullptr || entry->module == nullptr){
+        Py_CLEAR(entry->filename);
+        Py_CLEAR(entry->module);
+        return -1;
+    }
+    return 0;
+}
+
+FilepathCache::FilepathCache(){
+    for (auto& slot : slots){
+        slot.store(nullptr, std::memory_order_relaxed);
+    }
+}
+
+int FilepathCache::lookup(PyObject* pathname, FilepathCacheEntry* entry){
+    Py_hash_t hash = PyObject_Hash(pathname);
+    if (hash == -1)
+        return -1;
+    Slot* created = nullptr;
+    for (size_t probe = 0; probe < FILEPATHCACHE_PROBES; probe++){
+        std::atomic<Slot*>& slot = slots[((size_t)hash + probe) & (FILEPATHCACHE_SIZE - 1)];
+        Slot* current = slot.load(std::memory_order_acquire);
+        if (current == nullptr){
+            if (created == nullptr){
+                created = new Slot{hash, Py_NewRef(pathname), {nullptr, nullptr}};
+                if (splitPath(pathname, &created->entry) < 0){
+                    Py_DECREF(created->pathname);
+                    delete created;
+                    return -1;
+                }
+            }
+            if (slot.compare_exchange_strong(current, created, std::memory_order_acq_rel)){
+                *entry = {Py_NewRef(created->entry.filename), Py_NewRef(created->entry.module)};
+                return 0;
+            }
+            // Another thread filled the slot first, it may be for this path.
+        }
+        if (current->hash == hash &&
+            (current->pathname == pathname || PyUnicode_Compare(current->pathname, pathname) == 0)){
+            if (created != nullptr){
+                Py_DECREF(created->pathname);
+                Py_DECREF(created->entry.filename);
+                Py_DECREF(created->entry.module);
+                delete created;
+            }
+            *entry = {Py_NewRef(current->entry.filename), Py_NewRef(current->entry.module)};
+            return 0;
+        }
+    }
+    // Too many paths share these slots, don't cache this one.
+    if (created != nullptr){
+        *entry = created->entry;
+        Py_DECREF(created->pathname);
+        delete created;
+        return 0;
+    }
+    return splitPath(pathname, entry);
 }
 
 FilepathCache::~FilepathCache(){
-    for (auto& entry : cache){
-        Py_CLEAR(entry.second.filename);
-        Py_CLEAR(entry.second.module);
+    for (auto& slot : slots){
+        Slot* current = slot.exchange(nullptr);
+        if (current == nullptr)
+            continue;
+        Py_CLEAR(current->pathname);
+        Py_CLEAR(current->entry.filename);
+        Py_CLEAR(current->entry.module);
+        delete current;
     }
-}
\ No newline at end of file
+}
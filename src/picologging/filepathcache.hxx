@@ -1,21 +1,41 @@
 #include <Python.h>
 #include <structmember.h>
+#include <atomic>
 #include <cstddef>
-#include <vector>
 
 #ifndef PICOLOGGING_FILEPATHCACHE_H
 #define PICOLOGGING_FILEPATHCACHE_H
 
+// Number of paths kept, must be a power of two.
+#define FILEPATHCACHE_SIZE 1024
+// Slots probed for a path before it's computed without being cached.
+#define FILEPATHCACHE_PROBES 8
+
 typedef struct {
     PyObject* filename;
     PyObject* module;
 } FilepathCacheEntry;
 
+/**
+ * Open addressing table of the file and module names of source paths.
+ * Slots are filled once and never replaced until the cache is destroyed,
+ * so lookups don't take a lock, even without the GIL.
+ */
 class FilepathCache {
-    std::vector<std::pair<Py_hash_t, FilepathCacheEntry>> cache;
+    typedef struct {
+        Py_hash_t hash;
+        PyObject* pathname;
+        FilepathCacheEntry entry;
+    } Slot;
+    std::atomic<Slot*> slots[FILEPATHCACHE_SIZE];
 public:
-    const FilepathCacheEntry& lookup(PyObject* filepath);
+    FilepathCache();
+    /**
+     * Fill `entry` with new references to the file name and module name of
+     * `filepath`. Returns -1 with an exception set on failure.
+     */
+    int lookup(PyObject* filepath, FilepathCacheEntry* entry);
     ~FilepathCache();
 };
 
-#endif // PICOLOGGING_FILEPATHCACHE_H
\ No newline at end of file
+#endif // PICOLOGGING_FILEPATHCACHE_H
@@ -10,7 +10,6 @@ PyObject* Filterer_new(PyTypeObject* type, PyObject* args, PyObject* kwds)
         if (self->filters == NULL)
             return nullptr;
         self->_const_filter = PyUnicode_FromString("filter");
-        self->_const_remove = PyUnicode_FromString("remove");
     }
     return (PyObject*)self;
 }
@@ -21,33 +20,56 @@ int Filterer_init(Filterer *self, PyObject *args, PyObject *kwds)
 }
 
 PyObject* Filterer_addFilter(Filterer* self, PyObject *filter) {
+    int ret = 0;
     // Equivalent to `if not (filter in self.filters):`
-    if (PySequence_Contains(self->filters, filter) == 0){
-        PyList_Append(self->filters, filter);
-    }
+    Py_BEGIN_CRITICAL_SECTION(self);
+    ret = PySequence_Contains(self->filters, filter);
+    if (ret == 0)
+        ret = PyList_Append(self->filters, filter);
+    Py_END_CRITICAL_SECTION();
+    if (ret < 0)
+        return nullptr;
     Py_RETURN_NONE;
 }
 
 PyObject* Filterer_removeFilter(Filterer* self, PyObject *filter) {
-    if (PySequence_Contains(self->filters, filter) == 1){
-        return PyObject_CallMethod_ONEARG(self->filters, self->_const_remove, filter);
+    int ret = 0;
+    Py_BEGIN_CRITICAL_SECTION(self);
+    Py_ssize_t index = PySequence_Index(self->filters, filter);
+    if (index >= 0) {
+        ret = PySequence_DelItem(self->filters, index);
+    } else if (PyErr_ExceptionMatches(PyExc_ValueError)) {
+        PyErr_Clear();
+    } else {
+        ret = -1;
     }
+    Py_END_CRITICAL_SECTION();
+    if (ret < 0)
+        return nullptr;
     Py_RETURN_NONE;
 }
 
 PyObject* Filterer_filter(Filterer* self, PyObject *record) {
     bool ret = true;
-    for (int i = 0; i < PyList_GET_SIZE(self->filters); i++) {
-        PyObject *result = Py_None;
-        PyObject *filter = PyList_GET_ITEM(self->filters, i); // borrowed ref
+    for (Py_ssize_t i = 0; i < PyList_GET_SIZE(self->filters); i++) {
+        // A strong reference, the list may be changed while the filter runs
+        PyObject *filter = PyList_GETITEMREF(self->filters, i);
+        if (filter == nullptr) { // Removed by another thread
+            PyErr_Clear();
+            break;
+        }
+        PyObject *result;
         if (PyObject_HasAttr(filter, self->_const_filter)) {
             result = PyObject_CallMethod_ONEARG(filter, self->_const_filter, record);
-            if (result == nullptr)
-                return nullptr;
         } else {
             result = PyObject_CallFunctionObjArgs(filter, record, NULL);
         }
-        if (result == Py_False || result == Py_None) {
+        Py_DECREF(filter);
+        if (result == nullptr)
+            return nullptr;
+        bool rejected = result == Py_False || result == Py_None;
+        Py_DECREF(result);
+        if (rejected) {
             ret = false;
             break;
         }
@@ -57,11 +79,28 @@ PyObject* Filterer_filter(Filterer* self, PyObject *record) {
     Py_RETURN_FALSE;
 }
 
+/**
+ * The list object itself is kept for the lifetime of the filterer and only its
+ * items are replaced, so a thread iterating over it never sees it freed.
+ */
+PyObject* Filterer_getFilters(Filterer* self, void* closure) {
+    return Py_NewRef(self->filters);
+}
+
+int Filterer_setFilters(Filterer* self, PyObject* value, void* closure) {
+    if (value == nullptr) {
+        PyErr_SetString(PyExc_AttributeError, "cannot delete filters");
+        return -1;
+    }
+    return PyList_SetSlice(self->filters, 0, PY_SSIZE_T_MAX, value);
+}
+
 PyObject* Filterer_dealloc(Filterer *self) {
     Py_CLEAR(self->filters);
     Py_CLEAR(self->_const_filter);
-    Py_CLEAR(self->_const_remove);
-    Py_TYPE(self)->tp_free((PyObject*)self);
+    PyTypeObject* type = Py_TYPE(self);
+    type->tp_free((PyObject*)self);
+    Py_DECREF_HEAPTYPE(type);
     return NULL;
 }
 
@@ -72,49 +111,26 @@ static PyMethodDef Filterer_methods[] = {
     NULL
 };
 
-static PyMemberDef Filterer_members[] = {
-    {"filters", T_OBJECT_EX, offsetof(Filterer, filters), 0, "Filters"},
+static PyGetSetDef Filterer_getset[] = {
+    {"filters", (getter)Filterer_getFilters, (setter)Filterer_setFilters, "Filters", NULL},
     {NULL}
 };
 
-PyTypeObject FiltererType = {
-    PyObject_HEAD_INIT(NULL)
-    "picologging.Filterer",                    /* tp_name */
-    sizeof(Filterer),                          /* tp_basicsize */
-    0,                                          /* tp_itemsize */
-    (destructor)Filterer_dealloc,                /* tp_dealloc */
-    0,                                          /* tp_vectorcall_offset */
-    0,                                          /* tp_getattr */
-    0,                                          /* tp_setattr */
-    0,                                          /* tp_as_async */
-    0,                      /* tp_repr */
-    0,                                          /* tp_as_number */
-    0,                                          /* tp_as_sequence */
-    0,                                          /* tp_as_mapping */
-    0,                                          /* tp_hash */
-    0,                                          /* tp_call */
-    0,                                          /* tp_str */
-    PyObject_GenericGetAttr,                    /* tp_getattro */
-    PyObject_GenericSetAttr,                    /* tp_setattro */
-    0,                                          /* tp_as_buffer */
-    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE ,  /* tp_flags */
-    PyDoc_STR("Filterer interface."),    /* tp_doc */
-    0,                                          /* tp_traverse */
-    0,                                          /* tp_clear */
-    0,                                          /* tp_richcompare */
-    0,                                          /* tp_weaklistoffset */
-    0,                                          /* tp_iter */
-    0,                                          /* tp_iternext */
-    Filterer_methods,                          /* tp_methods */
-    Filterer_members,                          /* tp_members */
-    0,                                          /* tp_getset */
-    0,                                          /* tp_base */
-    0,                                          /* tp_dict */
-    0,                                          /* tp_descr_get */
-    0,                                          /* tp_descr_set */
-    0,                                          /* tp_dictoffset */
-    (initproc)Filterer_init,                   /* tp_init */
-    0,                                          /* tp_alloc */
-    Filterer_new,                          /* tp_new */
-    PyObject_Del,                               /* tp_free */
+static PyType_Slot Filterer_slots[] = {
+    {Py_tp_dealloc, (void*)Filterer_dealloc},
+    {Py_tp_doc, (void*)PyDoc_STR("Filterer interface.")},
+    {Py_tp_methods, Filterer_methods},
+    {Py_tp_getset, Filterer_getset},
+    {Py_tp_init, (void*)Filterer_init},
+    {Py_tp_new, (void*)Filterer_new},
+    {Py_tp_free, (void*)PyObject_Del},
+    {0, NULL}
+};
+
+PyType_Spec FiltererType_spec = {
+    "picologging.Filterer",
+    sizeof(Filterer),
+    0,
+    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE | Py_TPFLAGS_IMMUTABLETYPE,
+    Filterer_slots,
 };
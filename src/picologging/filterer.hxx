@@ -8,14 +8,14 @@ typedef struct {
     PyObject_HEAD
     PyObject *filters;
     PyObject *_const_filter;
-    PyObject *_const_remove;
 } Filterer;
 
+PyObject* Filterer_new(PyTypeObject* type, PyObject* args, PyObject* kwds);
 int Filterer_init(Filterer *self, PyObject *args, PyObject *kwds);
 PyObject* Filterer_filter(Filterer* self, PyObject *record);
 PyObject* Filterer_dealloc(Filterer *self);
 
-extern PyTypeObject FiltererType;
-#define Filterer_CheckExact(op) Py_IS_TYPE(op, &FiltererType)
+extern PyType_Spec FiltererType_spec;
+#define Filterer_CheckExact(state, op) Py_IS_TYPE(op, (state)->FiltererType)
 
 #endif
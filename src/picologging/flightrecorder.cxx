@@ -0,0 +1,383 @@
+#include <cstring>
+#include <mutex>
+#include <string>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "flightrecorder.hxx"
+#include "handler.hxx"
+#include "compat.hxx"
+#include "picologging.hxx"
+
+// The cursor and frame positions are shared with other processes through the mapping.
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "Flight recorder needs lock-free 64-bit atomics");
+
+static inline uint64_t alignFrame(uint64_t size) {
+    return (size + FLIGHTRECORDER_ALIGNMENT - 1) & ~(uint64_t)(FLIGHTRECORDER_ALIGNMENT - 1);
+}
+
+/**
+ * Copy `size` bytes to the absolute position `pos`, wrapping around the end of the ring.
+ */
+static inline void ringWrite(FlightRecorderHandler* self, uint64_t pos, const char* data, uint64_t size) {
+    uint64_t offset = pos % self->capacity;
+    uint64_t first = self->capacity - offset < size ? self->capacity - offset : size;
+    memcpy(self->ring + offset, data, first);
+    if (first < size)
+        memcpy(self->ring, data + first, size - first);
+}
+
+static bool isMapped(FlightRecorderHandler* self) {
+    return self->header != nullptr;
+}
+
+static void unmap(FlightRecorderHandler* self) {
+    if (!isMapped(self))
+        return;
+#ifdef _WIN32
+    UnmapViewOfFile(self->header);
+    CloseHandle((HANDLE)self->mappingHandle);
+    CloseHandle((HANDLE)self->fileHandle);
+    self->mappingHandle = nullptr;
+    self->fileHandle = nullptr;
+#else
+    munmap(self->header, self->mappingSize);
+    close(self->fd);
+    self->fd = -1;
+#endif
+    self->header = nullptr;
+    self->ring = nullptr;
+}
+
+#ifndef _WIN32
+/**
+ * Replace `path` with a new zero-filled file of `size` bytes and return it
+ * opened, or -1 with errno set. Other processes may have the old file mapped,
+ * truncating it in place would make their next write fault with SIGBUS. They
+ * keep writing to the old file until they map `path` again.
+ */
+static int replaceFile(const char* path, size_t size) {
+    std::string tmpPath = std::string(path) + "." + std::to_string(getpid()) + ".tmp";
+    int fd = open(tmpPath.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return -1;
+    if (ftruncate(fd, (off_t)size) != 0 || rename(tmpPath.c_str(), path) != 0) {
+        int error = errno;
+        close(fd);
+        unlink(tmpPath.c_str());
+        errno = error;
+        return -1;
+    }
+    return fd;
+}
+#endif
+
+/**
+ * Map `path` with room for the header and `capacity` bytes of ring. Existing
+ * recordings with the same capacity are kept, so a restarted process appends
+ * to the history left by the previous one.
+ */
+static int map(FlightRecorderHandler* self, PyObject* path, uint64_t capacity) {
+    size_t mappingSize = FLIGHTRECORDER_HEADER_SIZE + capacity;
+    void* view = nullptr;
+#ifdef _WIN32
+    wchar_t* widePath = PyUnicode_AsWideCharString(path, nullptr);
+    if (widePath == nullptr)
+        return -1;
+    HANDLE file = CreateFileW(widePath, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE,
+                              nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    PyMem_Free(widePath);
+    if (file == INVALID_HANDLE_VALUE) {
+        PyErr_SetExcFromWindowsErrWithFilenameObject(PyExc_OSError, 0, path);
+        return -1;
+    }
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize)) {
+        PyErr_SetExcFromWindowsErrWithFilenameObject(PyExc_OSError, 0, path);
+        CloseHandle(file);
+        return -1;
+    }
+    bool reset = (uint64_t)fileSize.QuadPart != mappingSize;
+    if (reset) {
+        // Truncating first discards stale frames, the new space reads as zeros.
+        LARGE_INTEGER size;
+        size.QuadPart = 0;
+        bool ok = SetFilePointerEx(file, size, nullptr, FILE_BEGIN) && SetEndOfFile(file);
+        size.QuadPart = (LONGLONG)mappingSize;
+        ok = ok && SetFilePointerEx(file, size, nullptr, FILE_BEGIN) && SetEndOfFile(file);
+        if (!ok) {
+            PyErr_SetExcFromWindowsErrWithFilenameObject(PyExc_OSError, 0, path);
+            CloseHandle(file);
+            return -1;
+        }
+    }
+    HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READWRITE,
+                                        (DWORD)((uint64_t)mappingSize >> 32), (DWORD)(mappingSize & 0xffffffff), nullptr);
+    if (mapping != nullptr)
+        view = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, mappingSize);
+    if (view == nullptr) {
+        PyErr_SetExcFromWindowsErrWithFilenameObject(PyExc_OSError, 0, path);
+        if (mapping != nullptr)
+            CloseHandle(mapping);
+        CloseHandle(file);
+        return -1;
+    }
+    self->fileHandle = file;
+    self->mappingHandle = mapping;
+#else
+    PyObject* encodedPath = nullptr;
+    if (!PyUnicode_FSConverter(path, &encodedPath))
+        return -1;
+    int fd = open(PyBytes_AS_STRING(encodedPath), O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        Py_DECREF(encodedPath);
+        PyErr_SetFromErrnoWithFilenameObject(PyExc_OSError, path);
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        Py_DECREF(encodedPath);
+        PyErr_SetFromErrnoWithFilenameObject(PyExc_OSError, path);
+        close(fd);
+        return -1;
+    }
+    bool reset = (uint64_t)st.st_size != mappingSize;
+    if (reset) {
+        close(fd);
+        fd = replaceFile(PyBytes_AS_STRING(encodedPath), mappingSize);
+    }
+    Py_DECREF(encodedPath);
+    if (fd < 0) {
+        PyErr_SetFromErrnoWithFilenameObject(PyExc_OSError, path);
+        return -1;
+    }
+    view = mmap(nullptr, mappingSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (view == MAP_FAILED) {
+        PyErr_SetFromErrnoWithFilenameObject(PyExc_OSError, path);
+        close(fd);
+        return -1;
+    }
+    self->fd = fd;
+#endif
+    self->header = (FlightRecorderHeader*)view;
+    self->ring = (char*)view + FLIGHTRECORDER_HEADER_SIZE;
+    self->capacity = capacity;
+    self->mappingSize = mappingSize;
+
+    FlightRecorderHeader* header = self->header;
+    if (reset || memcmp(header->magic, FLIGHTRECORDER_MAGIC, FLIGHTRECORDER_MAGIC_SIZE) != 0 ||
+        header->headerSize != FLIGHTRECORDER_HEADER_SIZE || header->capacity != capacity) {
+        if (!reset)
+            memset(self->ring, 0, capacity);
+        header->headerSize = FLIGHTRECORDER_HEADER_SIZE;
+        header->reserved = 0;
+        header->capacity = capacity;
+        header->cursor.store(0, std::memory_order_relaxed);
+        header->wraps.store(0, std::memory_order_relaxed);
+        // The magic goes last so readers never see a half-initialised header.
+        std::atomic_thread_fence(std::memory_order_release);
+        memcpy(header->magic, FLIGHTRECORDER_MAGIC, FLIGHTRECORDER_MAGIC_SIZE);
+    }
+    return 0;
+}
+
+PyObject* FlightRecorderHandler_new(PyTypeObject* type, PyObject* args, PyObject* kwds)
+{
+    FlightRecorderHandler* self = (FlightRecorderHandler*)Handler_new(type, args, kwds);
+    if (self != NULL)
+    {
+        self->filename = Py_NewRef(Py_None);
+        self->header = nullptr;
+        self->ring = nullptr;
+        self->capacity = 0;
+        self->mappingSize = 0;
+#ifdef _WIN32
+        self->fileHandle = nullptr;
+        self->mappingHandle = nullptr;
+#else
+        self->fd = -1;
+#endif
+    }
+    return (PyObject*)self;
+}
+
+int FlightRecorderHandler_init(FlightRecorderHandler *self, PyObject *args, PyObject *kwds){
+    PyObject* noArgs = PyTuple_New(0);
+    int ret = Handler_init((Handler*)self, noArgs, nullptr);
+    Py_DECREF(noArgs);
+    if (ret < 0)
+        return -1;
+    PyObject *filename = nullptr;
+    long long size = 8 * 1024 * 1024;
+    static const char *kwlist[] = {"filename", "size", NULL};
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|L", const_cast<char**>(kwlist), &filename, &size)){
+        return -1;
+    }
+    if (size < FLIGHTRECORDER_MIN_CAPACITY || size > (long long)PY_SSIZE_T_MAX - FLIGHTRECORDER_HEADER_SIZE) {
+        PyErr_Format(PyExc_ValueError, "size must be between %d and %zd bytes",
+                     FLIGHTRECORDER_MIN_CAPACITY, PY_SSIZE_T_MAX - FLIGHTRECORDER_HEADER_SIZE);
+        return -1;
+    }
+    uint64_t capacity = (uint64_t)size & ~(uint64_t)(FLIGHTRECORDER_ALIGNMENT - 1);
+    PyObject* path = PyOS_FSPath(filename);
+    if (path == nullptr)
+        return -1;
+    if (!PyUnicode_Check(path)) {
+        PyObject* decoded = nullptr;
+        if (!PyUnicode_FSDecoder(path, &decoded)) {
+            Py_DECREF(path);
+            return -1;
+        }
+        Py_SETREF(path, decoded);
+    }
+    unmap(self);
+    if (map(self, path, capacity) < 0) {
+        Py_DECREF(path);
+        return -1;
+    }
+    Py_SETREF(self->filename, path);
+    return 0;
+}
+
+PyObject* FlightRecorderHandler_dealloc(FlightRecorderHandler *self) {
+    unmap(self);
+    Py_CLEAR(self->filename);
+    Handler_dealloc((Handler*)self);
+    return nullptr;
+}
+
+PyObject* FlightRecorderHandler_emit(FlightRecorderHandler* self, PyObject* record){
+    if (!isMapped(self)) {
+        PyErr_SetString(PyExc_ValueError, "I/O operation on closed file.");
+        return nullptr;
+    }
+    PyObject* msg = Handler_format(&self->handler, record);
+    if (msg == nullptr)
+        return nullptr;
+    if (!PyUnicode_Check(msg)) {
+        PyErr_SetString(PyExc_TypeError, "Result of self.handler.format() must be a string");
+        Py_DECREF(msg);
+        return nullptr;
+    }
+    PyObject* encoded = PyUnicode_AsEncodedString(msg, "utf-8", "backslashreplace");
+    Py_DECREF(msg);
+    if (encoded == nullptr)
+        return nullptr;
+
+    // Oversized records are truncated so a frame never overwrites itself.
+    uint64_t length = (uint64_t)PyBytes_GET_SIZE(encoded);
+    uint64_t maxLength = self->capacity / 2 - FLIGHTRECORDER_FRAME_HEADER_SIZE;
+    if (length > maxLength)
+        length = maxLength;
+    uint64_t frameSize = alignFrame(FLIGHTRECORDER_FRAME_HEADER_SIZE + length);
+
+    // Reserve the frame; concurrent writers (threads or processes) get disjoint ranges.
+    FlightRecorderHeader* header = self->header;
+    uint64_t pos = header->cursor.fetch_add(frameSize, std::memory_order_relaxed);
+    if ((pos + frameSize) / self->capacity != pos / self->capacity)
+        header->wraps.fetch_add(1, std::memory_order_relaxed);
+
+    uint32_t length32 = (uint32_t)length;
+    ringWrite(self, pos + sizeof(uint64_t), (const char*)&length32, sizeof(length32));
+    ringWrite(self, pos + FLIGHTRECORDER_FRAME_HEADER_SIZE, PyBytes_AS_STRING(encoded), length);
+    Py_DECREF(encoded);
+
+    // Publishing the position last commits the frame, so a crash mid-copy leaves it unreadable.
+    std::atomic<uint64_t>* marker = (std::atomic<uint64_t>*)(self->ring + pos % self->capacity);
+    marker->store(pos, std::memory_order_release);
+    Py_RETURN_NONE;
+}
+
+PyObject* FlightRecorderHandler_flush(FlightRecorderHandler* self){
+    HandlerLockGuard guard(&self->handler);
+    if (!isMapped(self))
+        Py_RETURN_NONE;
+    // The page cache already survives a process crash, flushing guards against power loss.
+#ifdef _WIN32
+    if (!FlushViewOfFile(self->header, self->mappingSize) || !FlushFileBuffers((HANDLE)self->fileHandle))
+        return PyErr_SetExcFromWindowsErrWithFilenameObject(PyExc_OSError, 0, self->filename);
+#else
+    if (msync(self->header, self->mappingSize, MS_SYNC) != 0)
+        return PyErr_SetFromErrnoWithFilenameObject(PyExc_OSError, self->filename);
+#endif
+    Py_RETURN_NONE;
+}
+
+PyObject* FlightRecorderHandler_close(FlightRecorderHandler* self){
+    HandlerLockGuard guard(&self->handler);
+    unmap(self);
+    Py_RETURN_NONE;
+}
+
+PyObject* FlightRecorderHandler_getCapacity(FlightRecorderHandler* self, void* closure){
+    return PyLong_FromUnsignedLongLong(self->capacity);
+}
+
+PyObject* FlightRecorderHandler_getCursor(FlightRecorderHandler* self, void* closure){
+    if (!isMapped(self))
+        Py_RETURN_NONE;
+    return PyLong_FromUnsignedLongLong(self->header->cursor.load(std::memory_order_relaxed));
+}
+
+PyObject* FlightRecorderHandler_getWraps(FlightRecorderHandler* self, void* closure){
+    if (!isMapped(self))
+        Py_RETURN_NONE;
+    return PyLong_FromUnsignedLongLong(self->header->wraps.load(std::memory_order_relaxed));
+}
+
+PyObject* FlightRecorderHandler_repr(FlightRecorderHandler *self)
+{
+    std::string level = _getLevelName(self->handler.level);
+    return PyUnicode_FromFormat("<%s %S (%s)>",
+        _PyType_Name(Py_TYPE(self)),
+        self->filename,
+        level.c_str());
+}
+
+static PyMethodDef FlightRecorderHandler_methods[] = {
+    {"emit", (PyCFunction)FlightRecorderHandler_emit, METH_O, "Copy a formatted record into the ring buffer."},
+    {"flush", (PyCFunction)FlightRecorderHandler_flush, METH_NOARGS, "Write the mapped pages to disk."},
+    {"close", (PyCFunction)FlightRecorderHandler_close, METH_NOARGS, "Unmap and close the file."},
+    {NULL}
+};
+
+static PyMemberDef FlightRecorderHandler_members[] = {
+    {"baseFilename", T_OBJECT_EX, offsetof(FlightRecorderHandler, filename), READONLY, "Path of the recording"},
+    {NULL}
+};
+
+static PyGetSetDef FlightRecorderHandler_getset[] = {
+    {"capacity", (getter)FlightRecorderHandler_getCapacity, nullptr, "Size of the ring buffer in bytes", nullptr},
+    {"cursor", (getter)FlightRecorderHandler_getCursor, nullptr, "Total number of bytes written", nullptr},
+    {"wraps", (getter)FlightRecorderHandler_getWraps, nullptr, "Number of times the ring buffer wrapped around", nullptr},
+    {NULL}
+};
+
+static PyType_Slot FlightRecorderHandler_slots[] = {
+    {Py_tp_dealloc, (void*)FlightRecorderHandler_dealloc},
+    {Py_tp_repr, (void*)FlightRecorderHandler_repr},
+    {Py_tp_doc, (void*)PyDoc_STR("Handler which keeps the most recent records in a memory-mapped ring buffer, see picologging.flightrecorder.")},
+    {Py_tp_methods, FlightRecorderHandler_methods},
+    {Py_tp_members, FlightRecorderHandler_members},
+    {Py_tp_getset, FlightRecorderHandler_getset},
+    {Py_tp_init, (void*)FlightRecorderHandler_init},
+    {Py_tp_new, (void*)FlightRecorderHandler_new},
+    {Py_tp_free, (void*)PyObject_Del},
+    {0, NULL}
+};
+
+PyType_Spec FlightRecorderHandlerType_spec = {
+    "picologging.handlers.FlightRecorderHandler",
+    sizeof(FlightRecorderHandler),
+    0,
+    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE | Py_TPFLAGS_IMMUTABLETYPE,
+    FlightRecorderHandler_slots,
+};
@@ -0,0 +1,53 @@
+#include <Python.h>
+#include <atomic>
+#include <cstdint>
+#include "handler.hxx"
+
+#ifndef PICOLOGGING_FLIGHTRECORDER_H
+#define PICOLOGGING_FLIGHTRECORDER_H
+
+#define FLIGHTRECORDER_MAGIC "PLOGFR\x00\x01"
+#define FLIGHTRECORDER_MAGIC_SIZE 8
+#define FLIGHTRECORDER_HEADER_SIZE 64
+// Every frame starts with its absolute position (u64) and payload length (u32).
+#define FLIGHTRECORDER_FRAME_HEADER_SIZE 12
+#define FLIGHTRECORDER_ALIGNMENT 8
+#define FLIGHTRECORDER_MIN_CAPACITY 4096
+
+/**
+ * Layout of the start of the mapped file, followed by `capacity` bytes of
+ * ring buffer. `cursor` is the total number of bytes ever reserved, the
+ * position of a frame in the ring is its absolute position modulo capacity.
+ */
+typedef struct {
+    char magic[FLIGHTRECORDER_MAGIC_SIZE];
+    uint32_t headerSize;
+    uint32_t reserved;
+    uint64_t capacity;
+    std::atomic<uint64_t> cursor;
+    std::atomic<uint64_t> wraps;
+} FlightRecorderHeader;
+
+static_assert(sizeof(FlightRecorderHeader) <= FLIGHTRECORDER_HEADER_SIZE, "Flight recorder header too large");
+
+typedef struct {
+    Handler handler;
+    PyObject* filename;
+    FlightRecorderHeader* header;
+    char* ring;
+    uint64_t capacity;
+    size_t mappingSize;
+#ifdef _WIN32
+    void* fileHandle;
+    void* mappingHandle;
+#else
+    int fd;
+#endif
+} FlightRecorderHandler;
+
+PyObject* FlightRecorderHandler_emit(FlightRecorderHandler* self, PyObject* record);
+
+extern PyType_Spec FlightRecorderHandlerType_spec;
+#define FlightRecorderHandler_CheckExact(state, op) Py_IS_TYPE(op, (state)->FlightRecorderHandlerType)
+
+#endif // PICOLOGGING_FLIGHTRECORDER_H
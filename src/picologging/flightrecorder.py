@@ -0,0 +1,98 @@
+"""
+Reader for the ring buffer files written by
+:class:`picologging.handlers.FlightRecorderHandler`.
+
+Usage::
+
+    python -m picologging.flightrecorder FILE
+
+The file starts with a 64 byte header (magic, header size, capacity, write
+cursor and wrap count) followed by the ring. Each frame is 8-byte aligned and
+starts with its absolute position (u64) and payload length (u32), followed by
+the UTF-8 encoded record. The position is written last, so frames that were
+being written when the process died, or that have been partly overwritten,
+are skipped.
+"""
+import argparse
+import struct
+import sys
+
+MAGIC = b"PLOGFR\x00\x01"
+
+_HEADER = struct.Struct("<8sIIQQQ")
+_FRAME_HEADER_SIZE = 12
+_ALIGNMENT = 8
+
+
+class FlightRecorderError(ValueError):
+    pass
+
+
+def _parse(data):
+    if len(data) < _HEADER.size:
+        raise FlightRecorderError("File too small for a flight recorder header")
+    magic, header_size, _, capacity, cursor, wraps = _HEADER.unpack_from(data)
+    if magic != MAGIC:
+        raise FlightRecorderError("Not a picologging flight recorder file")
+    ring = data[header_size : header_size + capacity]
+    if len(ring) != capacity:
+        raise FlightRecorderError("Truncated flight recorder file")
+    return ring, capacity, cursor, wraps
+
+
+def _read(ring, capacity, pos, size):
+    offset = pos % capacity
+    chunk = ring[offset : offset + size]
+    if len(chunk) < size:
+        chunk += ring[: size - len(chunk)]
+    return chunk
+
+
+def iter_records(data):
+    """
+    Yield the records still held by a flight recorder, oldest first.
+    """
+    ring, capacity, cursor, _ = _parse(data)
+    pos = max(0, cursor - capacity)
+    pos += -pos % _ALIGNMENT
+    while pos + _FRAME_HEADER_SIZE <= cursor:
+        (marker,) = struct.unpack_from("<Q", ring, pos % capacity)
+        if marker == pos:
+            (length,) = struct.unpack("<I", _read(ring, capacity, pos + 8, 4))
+            end = pos + _FRAME_HEADER_SIZE + length
+            if end <= cursor:
+                yield _read(ring, capacity, pos + _FRAME_HEADER_SIZE, length).decode(
+                    "utf-8", "replace"
+                )
+                pos = end + (-end % _ALIGNMENT)
+                continue
+        # Not a committed frame, resynchronise on the next aligned position.
+        pos += _ALIGNMENT
+
+
+def read(path):
+    """
+    Return the records held by the flight recorder file at ``path``, oldest first.
+    """
+    with open(path, "rb") as f:
+        data = f.read()
+    return list(iter_records(data))
+
+
+def main(argv=None):
+    parser = argparse.ArgumentParser(
+        prog="python -m picologging.flightrecorder",
+        description="Print the records held by a picologging flight recorder file.",
+    )
+    parser.add_argument("file", help="flight recorder file")
+    options = parser.parse_args(argv)
+    try:
+        for record in read(options.file):
+            sys.stdout.write(record + "\n")
+    except (OSError, FlightRecorderError) as e:
+        parser.exit(1, f"{parser.prog}: error: {e}\n")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
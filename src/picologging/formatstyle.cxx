@@ -3,6 +3,8 @@
 #include "picologging.hxx"
 #include <regex>
 #include <cstdarg>
+#include <cstring>
+#include <vector>
 
 std::regex const fragment_search_percent("\\%\\(\\w+\\)[diouxefgcrsa%]");
 std::regex const fragment_search_string_format("\\{\\w+\\}");
@@ -59,6 +61,113 @@ if (PyUnicode_Check(log_record->field )) { \
     Py_DECREF(field); }\
 
 
+/**
+ * Join strings with a single allocation, the pieces are measured first
+ * and copied with memcpy when their kind matches the result.
+ * Returns nullptr without an exception when a piece isn't a str.
+ */
+static PyObject* joinStrings(PyObject* const* pieces, size_t count) {
+    Py_ssize_t length = 0;
+    Py_UCS4 maxchar = 127;
+    for (size_t i = 0; i < count; i++) {
+        if (!PyUnicode_CheckExact(pieces[i]))
+            return nullptr;
+        length += PyUnicode_GET_LENGTH(pieces[i]);
+        Py_UCS4 pieceMax = PyUnicode_MAX_CHAR_VALUE(pieces[i]);
+        if (pieceMax > maxchar)
+            maxchar = pieceMax;
+    }
+    PyObject* result = PyUnicode_New(length, maxchar);
+    if (result == nullptr)
+        return nullptr;
+    int kind = PyUnicode_KIND(result);
+    char* data = (char*)PyUnicode_DATA(result);
+    Py_ssize_t position = 0;
+    for (size_t i = 0; i < count; i++) {
+        Py_ssize_t pieceLength = PyUnicode_GET_LENGTH(pieces[i]);
+        if (PyUnicode_KIND(pieces[i]) == kind) {
+            memcpy(data + position * kind, PyUnicode_DATA(pieces[i]), pieceLength * kind);
+        } else if (PyUnicode_CopyCharacters(result, position, pieces[i], 0, pieceLength) < 0) {
+            Py_DECREF(result);
+            return nullptr;
+        }
+        position += pieceLength;
+    }
+    return result;
+}
+
+template <FragmentType Field>
+static inline PyObject* fragmentValue(const FormatFragment& fragment, LogRecord* record) {
+    if constexpr (Field == LiteralFragment)
+        return fragment.fragment;
+    else if constexpr (Field == Field_Name)
+        return record->name;
+    else if constexpr (Field == Field_LevelName)
+        return record->levelname;
+    else if constexpr (Field == Field_Message)
+        return record->message;
+    else if constexpr (Field == Field_Asctime)
+        return record->asctime;
+    else if constexpr (Field == Field_Module)
+        return record->module;
+    else if constexpr (Field == Field_Filename)
+        return record->filename;
+    else if constexpr (Field == Field_Pathname)
+        return record->pathname;
+    else
+        static_assert(Field == LiteralFragment, "Only str fields can be rendered by renderShape");
+}
+
+template <FragmentType... Fields>
+static PyObject* renderShape(FormatStyle* self, PyObject* record) {
+    PyObject* pieces[sizeof...(Fields)];
+    size_t i = 0;
+    ((pieces[i] = fragmentValue<Fields>(self->fragments[i], (LogRecord*)record), i++), ...);
+    return joinStrings(pieces, sizeof...(Fields));
+}
+
+// %(message)s, the message is already the result
+static PyObject* renderMessage(FormatStyle* self, PyObject* record) {
+    PyObject* message = ((LogRecord*)record)->message;
+    return PyUnicode_CheckExact(message) ? Py_NewRef(message) : nullptr;
+}
+
+typedef struct {
+    std::vector<FragmentType> fields;
+    FormatStyleRenderer renderer;
+} KnownShape;
+
+template <FragmentType... Fields>
+static KnownShape shape() {
+    return {{Fields...}, renderShape<Fields...>};
+}
+
+// The formats most deployments use, literals can be any text, e.g. "%(levelname)s:%(name)s:%(message)s"
+static const KnownShape known_shapes[] = {
+    {{Field_Message}, renderMessage},
+    shape<Field_LevelName, LiteralFragment, Field_Message>(),
+    shape<Field_LevelName, LiteralFragment, Field_Name, LiteralFragment, Field_Message>(),
+    shape<Field_Name, LiteralFragment, Field_LevelName, LiteralFragment, Field_Message>(),
+    shape<Field_Asctime, LiteralFragment, Field_Message>(),
+    shape<Field_Asctime, LiteralFragment, Field_LevelName, LiteralFragment, Field_Message>(),
+    shape<Field_Asctime, LiteralFragment, Field_LevelName, LiteralFragment, Field_Name, LiteralFragment, Field_Message>(),
+    shape<Field_Asctime, LiteralFragment, Field_Name, LiteralFragment, Field_LevelName, LiteralFragment, Field_Message>(),
+    shape<Field_Asctime, LiteralFragment, Field_Name, LiteralFragment, Field_LevelName, LiteralFragment, Field_Module, LiteralFragment, Field_Message>(),
+};
+
+static FormatStyleRenderer findRenderer(FormatStyle* self, int count) {
+    for (const KnownShape& known : known_shapes) {
+        if ((int)known.fields.size() != count)
+            continue;
+        bool matches = true;
+        for (int i = 0; i < count && matches; i++)
+            matches = self->fragments[i].field == known.fields[i];
+        if (matches)
+            return known.renderer;
+    }
+    return nullptr;
+}
+
 int FormatStyle_init(FormatStyle *self, PyObject *args, PyObject *kwds){
     PyObject *fmt = nullptr, *defaults = Py_None;
     int style = '%';
@@ -67,12 +176,12 @@ int FormatStyle_init(FormatStyle *self, PyObject *args, PyObject *kwds){
         return -1;
 
     if (fmt == Py_None) {
-        PyObject* mod = PICOLOGGING_MODULE(); // borrowed reference
-        if (mod == nullptr){
+        picologging_state* state = GET_PICOLOGGING_STATE(self);
+        if (state == nullptr){
             PyErr_SetString(PyExc_TypeError, "Could not find _picologging module");
             return -1;
         }
-        fmt = PyDict_GetItemString(PyModule_GetDict(mod), "default_fmt"); // borrowed reference
+        fmt = state->g_default_fmt; // borrowed reference
         self->usesDefaultFmt = true;
     } else {
         if (!PyUnicode_Check(fmt)) {
@@ -138,6 +247,7 @@ int FormatStyle_init(FormatStyle *self, PyObject *args, PyObject *kwds){
         self->fragments[idx].fragment = PyUnicode_FromString(format_string.substr(cursor, format_string.size() - cursor).c_str());
         idx ++;
     }
+    self->renderer = findRenderer(self, idx);
     self->defaults = Py_NewRef(defaults);
     self->_const_format = PyUnicode_FromString("format");
     self->_const__dict__ = PyUnicode_FromString("__dict__");
@@ -180,8 +290,14 @@ PyObject* FormatStyle_validate(FormatStyle *self){
 }
 
 PyObject* FormatStyle_format(FormatStyle *self, PyObject *record){
+    picologging_state* state = GET_PICOLOGGING_STATE(self);
     if (self->defaults == Py_None){
-        if (LogRecord_CheckExact(record) || LogRecord_Check(record)){
+        if (LogRecord_CheckExact(state, record) || LogRecord_Check(state, record)){
+            if (self->renderer != nullptr) {
+                PyObject* result = self->renderer(self, record);
+                if (result != nullptr || PyErr_Occurred())
+                    return result;
+            }
             _PyUnicodeWriter writer;
             _PyUnicodeWriter_Init(&writer);
             LogRecord* log_record = reinterpret_cast<LogRecord*>(record);
@@ -224,7 +340,7 @@ PyObject* FormatStyle_format(FormatStyle *self, PyObject *record){
                         APPEND_STRING(funcName)
                         break;
                     case Field_Created: {
-                        PyObject *asDouble = PyFloat_FromDouble(log_record->created);
+                        PyObject *asDouble = PyFloat_FromDouble(LogRecord_created(log_record));
                         PyObject *created = PyUnicode_FromFormat("%S", asDouble);
                         Py_DECREF(asDouble);
                         if (_PyUnicodeWriter_WriteStr(&writer, created) != 0) {
@@ -235,10 +351,21 @@ PyObject* FormatStyle_format(FormatStyle *self, PyObject *record){
                         Py_DECREF(created);
                     }   
                         break;
-                    case Field_Msecs:
-                        APPEND_INT(msecs)
+                    case Field_Msecs: {
+                        PyObject* msecs = PyUnicode_FromFormat("%ld", LogRecord_msecs(log_record));
+                        if (msecs == nullptr || _PyUnicodeWriter_WriteStr(&writer, msecs) != 0) {
+                            _PyUnicodeWriter_Dealloc(&writer);
+                            Py_XDECREF(msecs);
+                            return nullptr;
+                        }
+                        Py_DECREF(msecs);
+                    }
                         break;
                     case Field_RelativeCreated:
+                        if (LogRecord_relativeCreated(log_record) == nullptr) {
+                            _PyUnicodeWriter_Dealloc(&writer);
+                            return nullptr;
+                        }
                         APPEND_STRING(relativeCreated)
                         break;
                     case Field_Thread:
@@ -267,6 +394,10 @@ PyObject* FormatStyle_format(FormatStyle *self, PyObject *record){
                         APPEND_STRING(excText)
                         break;
                     case Field_StackInfo:
+                        if (LogRecord_writeStackInfo(log_record) == -1) {
+                            _PyUnicodeWriter_Dealloc(&writer);
+                            return nullptr;
+                        }
                         APPEND_STRING(stackInfo)
                         break;
                     case Field_Message:
@@ -408,7 +539,9 @@ PyObject* FormatStyle_dealloc(FormatStyle *self){
     for (int i = 0 ; i < self->ob_base.ob_size; i++){
         Py_CLEAR(self->fragments[i].fragment);
     }
-    Py_TYPE(self)->tp_free((PyObject*)self);
+    PyTypeObject* type = Py_TYPE(self);
+    type->tp_free((PyObject*)self);
+    Py_DECREF_HEAPTYPE(type);
     return NULL;
 }
 
@@ -423,44 +556,21 @@ static PyMethodDef FormatStyle_methods[] = {
     {NULL}
 };
 
-PyTypeObject FormatStyleType = {
-    PyVarObject_HEAD_INIT(NULL, 0)
-    "picologging.FormatStyle",                 /* tp_name */
-    offsetof(FormatStyle, fragments),          /* tp_basicsize */
-    sizeof(FormatFragment),                     /* tp_itemsize */
-    (destructor)FormatStyle_dealloc,           /* tp_dealloc */
-    0,                                          /* tp_vectorcall_offset */
-    0,                                          /* tp_getattr */
-    0,                                          /* tp_setattr */
-    0,                                          /* tp_as_async */
-    (reprfunc)FormatStyle_repr,                /* tp_repr */
-    0,                                          /* tp_as_number */
-    0,                                          /* tp_as_sequence */
-    0,                                          /* tp_as_mapping */
-    0,                                          /* tp_hash */
-    0,                                          /* tp_call */
-    0,                                          /* tp_str */
-    PyObject_GenericGetAttr,                    /* tp_getattro */
-    PyObject_GenericSetAttr,                    /* tp_setattro */
-    0,                                          /* tp_as_buffer */
-    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE ,  /* tp_flags */
-    PyDoc_STR("Formatter for log records."),    /* tp_doc */
-    0,                                          /* tp_traverse */
-    0,                                          /* tp_clear */
-    0,                                          /* tp_richcompare */
-    0,                                          /* tp_weaklistoffset */
-    0,                                          /* tp_iter */
-    0,                                          /* tp_iternext */
-    FormatStyle_methods,                       /* tp_methods */
-    0,                       /* tp_members */
-    0,                                          /* tp_getset */
-    0,                                          /* tp_base */
-    0,                                          /* tp_dict */
-    0,                                          /* tp_descr_get */
-    0,                                          /* tp_descr_set */
-    0,                                          /* tp_dictoffset */
-    (initproc)FormatStyle_init,                /* tp_init */
-    0,                                          /* tp_alloc */
-    FormatStyle_new,                           /* tp_new */
-    PyObject_Del,                               /* tp_free */
+static PyType_Slot FormatStyle_slots[] = {
+    {Py_tp_dealloc, (void*)FormatStyle_dealloc},
+    {Py_tp_repr, (void*)FormatStyle_repr},
+    {Py_tp_doc, (void*)PyDoc_STR("Formatter for log records.")},
+    {Py_tp_methods, FormatStyle_methods},
+    {Py_tp_init, (void*)FormatStyle_init},
+    {Py_tp_new, (void*)FormatStyle_new},
+    {Py_tp_free, (void*)PyObject_Del},
+    {0, NULL}
+};
+
+PyType_Spec FormatStyleType_spec = {
+    "picologging.FormatStyle",
+    offsetof(FormatStyle, fragments),
+    sizeof(FormatFragment),
+    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE | Py_TPFLAGS_IMMUTABLETYPE,
+    FormatStyle_slots,
 };
\ No newline at end of file
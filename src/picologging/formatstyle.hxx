@@ -42,7 +42,12 @@ typedef struct {
     PyObject *fragment;
 } FormatFragment;
 
-typedef struct {
+struct FormatStyleT;
+// Renders a record for one known fragment shape, returns nullptr without an
+// exception set when a field isn't a str so the general loop can take over.
+typedef PyObject* (*FormatStyleRenderer)(struct FormatStyleT* self, PyObject* record);
+
+typedef struct FormatStyleT {
     PyObject_VAR_HEAD
     PyObject *fmt;
     PyObject *defaults;
@@ -50,6 +55,7 @@ typedef struct {
     int style;
     PyObject* _const_format;
     PyObject* _const__dict__;
+    FormatStyleRenderer renderer;
     FormatFragment fragments[1];
 } FormatStyle;
 
@@ -60,8 +66,8 @@ PyObject* FormatStyle_format(FormatStyle *self, PyObject *record);
 PyObject* FormatStyle_dealloc(FormatStyle *self);
 PyObject* FormatStyle_new(PyTypeObject *type, PyObject *args, PyObject *kwds);
 
-extern PyTypeObject FormatStyleType;
-#define FormatStyle_CheckExact(op) Py_IS_TYPE(op, &FormatStyleType)
+extern PyType_Spec FormatStyleType_spec;
+#define FormatStyle_CheckExact(state, op) Py_IS_TYPE(op, (state)->FormatStyleType)
 
 typedef std::unordered_map<std::string, FragmentType> FieldMap;
 #endif // PICOLOGGING_FORMATSTYLE_H
\ No newline at end of file
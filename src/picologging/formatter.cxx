@@ -1,9 +1,346 @@
 #include <ctime>
 #include <charconv>
+#include <climits>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
 #include "picologging.hxx"
 #include "formatter.hxx"
 #include "formatstyle.hxx"
 #include "logrecord.hxx"
+#include "tracebackformat.hxx"
+
+#define NANOS_PER_SECOND 1000000000LL
+
+static const struct {
+    const char* name;
+    DateFormat format;
+    bool utc;
+} named_date_formats[] = {
+    {"iso8601", DateFormat_Iso8601, false},
+    {"iso8601_utc", DateFormat_Iso8601, true},
+    {"rfc3339_micro", DateFormat_Rfc3339Micro, false},
+    {"rfc3339_micro_utc", DateFormat_Rfc3339Micro, true},
+    {"rfc3339_nano", DateFormat_Rfc3339Nano, false},
+    {"rfc3339_nano_utc", DateFormat_Rfc3339Nano, true},
+    {"epoch", DateFormat_EpochSeconds, false},
+    {"epoch_millis", DateFormat_EpochMillis, false},
+    {"epoch_nanos", DateFormat_EpochNanos, false},
+};
+
+static long long floorDiv(long long value, long long divisor) {
+    long long quotient = value / divisor;
+    return (value % divisor < 0) ? quotient - 1 : quotient;
+}
+
+static char* writeDigits(char* p, long long value, int width) {
+    for (int i = width - 1; i >= 0; i--) {
+        p[i] = (char)('0' + value % 10);
+        value /= 10;
+    }
+    return p + width;
+}
+
+static PyObject* asciiString(const char* buf, size_t len) {
+    PyObject* str = PyUnicode_New(len, 127);
+    if (str == nullptr)
+        return nullptr;
+    memcpy(PyUnicode_DATA(str), buf, len);
+    return str;
+}
+
+static void Formatter_resetTimeCache(Formatter* self) {
+    PyObject* asctime;
+    {
+        std::lock_guard<std::mutex> guard(*self->cacheLock);
+        self->cache.second = LLONG_MIN;
+        asctime = self->cache.asctime;
+        self->cache.asctime = nullptr;
+    }
+    Py_XDECREF(asctime);
+}
+
+/**
+ * Fill tm from the time.struct_time returned by a custom converter,
+ * offset is its tm_gmtoff, or 0 when it doesn't have one.
+ */
+static int structTimeToTm(PyObject* value, std::tm* tm, long* offset) {
+    if (!PyTuple_Check(value) || PyTuple_GET_SIZE(value) < 9) {
+        PyErr_Format(PyExc_TypeError, "Formatter.converter must return a time.struct_time, not %.200s", Py_TYPE(value)->tp_name);
+        return -1;
+    }
+    long fields[9];
+    for (Py_ssize_t i = 0; i < 9; i++) {
+        fields[i] = PyLong_AsLong(PyTuple_GET_ITEM(value, i));
+        if (fields[i] == -1 && PyErr_Occurred())
+            return -1;
+    }
+    tm->tm_year = (int)fields[0] - 1900;
+    tm->tm_mon = (int)fields[1] - 1;
+    tm->tm_mday = (int)fields[2];
+    tm->tm_hour = (int)fields[3];
+    tm->tm_min = (int)fields[4];
+    tm->tm_sec = (int)fields[5];
+    tm->tm_wday = ((int)fields[6] + 1) % 7;
+    tm->tm_yday = (int)fields[7] - 1;
+    tm->tm_isdst = (int)fields[8];
+
+    *offset = 0;
+    PyObject* gmtoff = PyObject_GetAttrString(value, "tm_gmtoff");
+    if (gmtoff == nullptr) {
+        PyErr_Clear();
+    } else {
+        if (gmtoff != Py_None)
+            *offset = PyLong_AsLong(gmtoff);
+        Py_DECREF(gmtoff);
+        if (*offset == -1 && PyErr_Occurred())
+            return -1;
+    }
+#ifndef _WIN32
+    tm->tm_gmtoff = *offset;
+#endif
+    return 0;
+}
+
+/**
+ * Break down second into tm with the formatter's converter, offset is
+ * the distance from UTC in seconds.
+ */
+static int Formatter_convertTime(Formatter* self, LogRecord* record, long long second, std::tm* tm, long* offset) {
+    std::time_t t = static_cast<std::time_t>(second);
+    if (self->utc || self->converterKind == Converter_Gmtime) {
+        *offset = 0;
+#ifdef _WIN32
+        if (gmtime_s(tm, &t) == 0)
+            return 0;
+#else
+        if (gmtime_r(&t, tm) != nullptr)
+            return 0;
+#endif
+    } else if (self->converterKind == Converter_Localtime) {
+#ifdef _WIN32
+        if (localtime_s(tm, &t) == 0) {
+            *offset = (long)(_mkgmtime(tm) - t);
+            return 0;
+        }
+#else
+        if (localtime_r(&t, tm) != nullptr) {
+            *offset = tm->tm_gmtoff;
+            return 0;
+        }
+#endif
+    } else {
+        PyObject* created = PyFloat_FromDouble(LogRecord_created(record));
+        if (created == nullptr)
+            return -1;
+        PyObject* result = PyObject_CallFunctionObjArgs(self->converter, created, NULL);
+        Py_DECREF(created);
+        if (result == nullptr)
+            return -1;
+        int ret = structTimeToTm(result, tm, offset);
+        Py_DECREF(result);
+        return ret;
+    }
+    PyErr_SetString(PyExc_OverflowError, "timestamp out of range for platform time_t");
+    return -1;
+}
+
+/**
+ * Render the parts of asctime that only depend on the second: the whole
+ * string for strftime formats, the date, time and UTC offset otherwise.
+ */
+static int Formatter_renderSecond(Formatter* self, LogRecord* record, long long second, AsctimeCache* out) {
+    std::tm tm = {};
+    long offset = 0;
+    if (Formatter_convertTime(self, record, second, &tm, &offset) < 0)
+        return -1;
+
+    if (self->dateFormat == DateFormat_Strftime) {
+        char buf[256];
+        size_t len = strftime(buf, sizeof(buf), self->dateFmtStr, &tm);
+        out->asctime = PyUnicode_FromStringAndSize(buf, len);
+        if (out->asctime == nullptr)
+            return -1;
+    } else {
+        int len = snprintf(out->prefix, sizeof(out->prefix), "%04d-%02d-%02d%c%02d:%02d:%02d",
+            tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, self->dateFormat == DateFormat_Default ? ' ' : 'T',
+            tm.tm_hour, tm.tm_min, tm.tm_sec);
+        out->prefixLen = (len < 0) ? 0 : std::min((size_t)len, sizeof(out->prefix) - 1);
+
+        char* p = out->offset;
+        if (self->utc || self->converterKind == Converter_Gmtime) {
+            *p++ = 'Z';
+        } else {
+            long minutes = offset / 60;
+            *p++ = minutes < 0 ? '-' : '+';
+            minutes = std::labs(minutes);
+            p = writeDigits(p, (minutes / 60) % 100, 2);
+            *p++ = ':';
+            p = writeDigits(p, minutes % 60, 2);
+        }
+        out->offsetLen = p - out->offset;
+    }
+    out->second = second;
+    return 0;
+}
+
+/**
+ * Copy the cached rendering of `second` into `out`, rendering and caching it
+ * first on a miss. `out->asctime` is a new reference for strftime formats.
+ */
+static int Formatter_lookupSecond(Formatter* self, LogRecord* record, long long second, AsctimeCache* out) {
+    {
+        std::lock_guard<std::mutex> guard(*self->cacheLock);
+        if (self->cache.second == second) {
+            *out = self->cache;
+            Py_XINCREF(out->asctime);
+            return 0;
+        }
+    }
+    out->asctime = nullptr;
+    if (Formatter_renderSecond(self, record, second, out) < 0)
+        return -1;
+    PyObject* previous;
+    {
+        std::lock_guard<std::mutex> guard(*self->cacheLock);
+        previous = self->cache.asctime;
+        self->cache = *out;
+        Py_XINCREF(self->cache.asctime);
+    }
+    Py_XDECREF(previous);
+    return 0;
+}
+
+/**
+ * Render record.asctime, the sub-second digits and epoch formats come
+ * straight from the record's nanoseconds with integer arithmetic.
+ */
+static PyObject* Formatter_asctime(Formatter* self, LogRecord* record) {
+    long long nanos = record->createdNanos;
+    char buf[64];
+    char* p = buf;
+    switch (self->dateFormat) {
+        case DateFormat_EpochSeconds:
+            p = std::to_chars(buf, buf + sizeof(buf), floorDiv(nanos, NANOS_PER_SECOND)).ptr;
+            return asciiString(buf, p - buf);
+        case DateFormat_EpochMillis:
+            p = std::to_chars(buf, buf + sizeof(buf), floorDiv(nanos, 1000000)).ptr;
+            return asciiString(buf, p - buf);
+        case DateFormat_EpochNanos:
+            p = std::to_chars(buf, buf + sizeof(buf), nanos).ptr;
+            return asciiString(buf, p - buf);
+        default:
+            break;
+    }
+
+    long long second = floorDiv(nanos, NANOS_PER_SECOND);
+    long long fraction = nanos - second * NANOS_PER_SECOND;
+    AsctimeCache cached;
+    if (Formatter_lookupSecond(self, record, second, &cached) < 0)
+        return nullptr;
+    if (cached.asctime != nullptr)
+        return cached.asctime;
+
+    memcpy(p, cached.prefix, cached.prefixLen);
+    p += cached.prefixLen;
+    switch (self->dateFormat) {
+        case DateFormat_Default:
+            *p++ = ',';
+            return asciiString(buf, writeDigits(p, fraction / 1000000, 3) - buf);
+        case DateFormat_Iso8601:
+            *p++ = '.';
+            p = writeDigits(p, fraction / 1000000, 3);
+            break;
+        case DateFormat_Rfc3339Micro:
+            *p++ = '.';
+            p = writeDigits(p, fraction / 1000, 6);
+            break;
+        default:
+            *p++ = '.';
+            p = writeDigits(p, fraction, 9);
+            break;
+    }
+    memcpy(p, cached.offset, cached.offsetLen);
+    p += cached.offsetLen;
+    return asciiString(buf, p - buf);
+}
+
+PyObject* Formatter_getDateFmt(Formatter *self, void *closure) {
+    return Py_NewRef(self->dateFmt != nullptr ? self->dateFmt : Py_None);
+}
+
+int Formatter_setDateFmt(Formatter *self, PyObject *value, void *closure) {
+    if (value == nullptr) {
+        PyErr_SetString(PyExc_AttributeError, "can't delete datefmt");
+        return -1;
+    }
+    const char* dateFmtStr = nullptr;
+    DateFormat dateFormat = DateFormat_Default;
+    bool utc = false;
+    if (value != Py_None) {
+        dateFmtStr = PyUnicode_AsUTF8(value);
+        if (dateFmtStr == nullptr)
+            return -1;
+        dateFormat = DateFormat_Strftime;
+        for (auto &named : named_date_formats) {
+            if (strcmp(dateFmtStr, named.name) == 0) {
+                dateFormat = named.format;
+                utc = named.utc;
+                break;
+            }
+        }
+    }
+    Py_XSETREF(self->dateFmt, Py_NewRef(value));
+    self->dateFmtStr = dateFmtStr;
+    self->dateFormat = dateFormat;
+    self->utc = utc;
+    Formatter_resetTimeCache(self);
+    return 0;
+}
+
+PyObject* Formatter_getConverter(Formatter *self, void *closure) {
+    if (self->converter != nullptr)
+        return Py_NewRef(self->converter);
+    PyObject* time = PyImport_ImportModule("time");
+    if (time == nullptr)
+        return nullptr;
+    PyObject* localtime = PyObject_GetAttrString(time, "localtime");
+    Py_DECREF(time);
+    return localtime;
+}
+
+int Formatter_setConverter(Formatter *self, PyObject *value, void *closure) {
+    if (value == nullptr) {
+        PyErr_SetString(PyExc_AttributeError, "can't delete converter");
+        return -1;
+    }
+    if (!PyCallable_Check(value)) {
+        PyErr_SetString(PyExc_TypeError, "converter must be callable");
+        return -1;
+    }
+    PyObject* time = PyImport_ImportModule("time");
+    if (time == nullptr)
+        return -1;
+    PyObject* gmtime = PyObject_GetAttrString(time, "gmtime");
+    PyObject* localtime = PyObject_GetAttrString(time, "localtime");
+    Py_DECREF(time);
+    if (gmtime == nullptr || localtime == nullptr) {
+        Py_XDECREF(gmtime);
+        Py_XDECREF(localtime);
+        return -1;
+    }
+    if (value == gmtime)
+        self->converterKind = Converter_Gmtime;
+    else if (value == localtime)
+        self->converterKind = Converter_Localtime;
+    else
+        self->converterKind = Converter_Custom;
+    Py_DECREF(gmtime);
+    Py_DECREF(localtime);
+    Py_XSETREF(self->converter, Py_NewRef(value));
+    Formatter_resetTimeCache(self);
+    return 0;
+}
 
 PyObject* Formatter_new(PyTypeObject* type, PyObject* args, PyObject* kwds)
 {
@@ -11,13 +348,20 @@ PyObject* Formatter_new(PyTypeObject* type, PyObject* args, PyObject* kwds)
     if (self != NULL)
     {
         self->fmt = Py_None;
-        self->dateFmt = Py_None;
+        self->dateFmt = Py_NewRef(Py_None);
         self->style = Py_None;
+        self->dateFmtStr = nullptr;
+        self->dateFormat = DateFormat_Default;
+        self->utc = false;
+        self->converter = nullptr;
+        self->converterKind = Converter_Localtime;
+        self->cache.second = LLONG_MIN;
+        self->cache.asctime = nullptr;
+        self->cacheLock = new std::mutex();
         self->_const_line_break = PyUnicode_FromString("\n");
-        self->_const_close = PyUnicode_FromString("close");
-        self->_const_getvalue = PyUnicode_FromString("getvalue");
         self->_const_usesTime = PyUnicode_FromString("usesTime");
         self->_const_format = PyUnicode_FromString("format");
+        self->_const_converter = PyUnicode_FromString("converter");
     }
     return (PyObject*)self;
 }
@@ -37,7 +381,7 @@ int Formatter_init(Formatter *self, PyObject *args, PyObject *kwds){
         case '%':
         case '{':
             /* Call the class object. */
-            styleType = (PyObject*)&FormatStyleType;
+            styleType = (PyObject*)GET_PICOLOGGING_STATE(self)->FormatStyleType;
             break;
         case '$':
             PyErr_Format(PyExc_NotImplementedError, "String Templates are not supported in picologging.");
@@ -61,15 +405,18 @@ int Formatter_init(Formatter *self, PyObject *args, PyObject *kwds){
     self->style = styleCls;
     self->fmt = Py_NewRef(((FormatStyle*)(self->style))->fmt);
     self->usesTime = (FormatStyle_usesTime((FormatStyle*)self->style) == Py_True);
-    self->dateFmt = Py_NewRef(dateFmt);
+    if (Formatter_setDateFmt(self, dateFmt, nullptr) < 0)
+        return -1;
 
-    if (dateFmt != Py_None) {
-        self->dateFmtStr = PyUnicode_AsUTF8(self->dateFmt);
-        if (self->dateFmtStr == nullptr) {
+    if (!Formatter_CheckExact(GET_PICOLOGGING_STATE(self), self)) {
+        // Subclasses can set converter as a class attribute, as with logging.Formatter.
+        PyObject* converter = PyObject_GetAttr((PyObject*)self, self->_const_converter);
+        if (converter == nullptr)
+            return -1;
+        int ret = Formatter_setConverter(self, converter, nullptr);
+        Py_DECREF(converter);
+        if (ret < 0)
             return -1;
-        }
-    } else {
-        self->dateFmtStr = nullptr;
     }
 
     if (validate){
@@ -84,34 +431,21 @@ int Formatter_init(Formatter *self, PyObject *args, PyObject *kwds){
 }
 
 PyObject* Formatter_format(Formatter *self, PyObject *record){
-    if (LogRecord_CheckExact(record) || LogRecord_Check(record)){
+    picologging_state* state = GET_PICOLOGGING_STATE(self);
+    if (LogRecord_CheckExact(state, record) || LogRecord_Check(state, record)){
         LogRecord* logRecord = (LogRecord*)record;
         if (LogRecord_writeMessage(logRecord) == -1){
             return nullptr;
         }
         if (self->usesTime){
-            PyObject * asctime = Py_None;
-            double createdInt;
-            int createdFrac = std::modf(logRecord->created, &createdInt) * 1e3;
-            std::time_t created = static_cast<std::time_t>(createdInt);
-            std::tm *ct = localtime(&created);
-            if (self->dateFmt != Py_None){
-                char buf[100];
-                size_t len = strftime(buf, sizeof(buf), self->dateFmtStr, ct);
-                asctime = PyUnicode_FromStringAndSize(buf, len);
-            } else {
-                char buf[100];
-                size_t len = strftime(buf, sizeof(buf), "%F %T" , ct);
-                len += snprintf(buf + len, sizeof(buf) - len, ",%03d", createdFrac);
-                asctime = PyUnicode_FromStringAndSize(buf, len);
-            }
-
-            Py_XDECREF(logRecord->asctime);
-            logRecord->asctime = asctime;
+            PyObject* asctime = Formatter_asctime(self, logRecord);
+            if (asctime == nullptr)
+                return nullptr;
+            Py_XSETREF(logRecord->asctime, asctime);
         }
 
         PyObject* result = nullptr;
-        if (FormatStyle_CheckExact(self->style)){
+        if (FormatStyle_CheckExact(state, self->style)){
             result = FormatStyle_format((FormatStyle*)self->style, record);
         } else {
             result = PyObject_CallMethod_ONEARG(self->style, self->_const_format, record);
@@ -124,54 +458,9 @@ PyObject* Formatter_format(Formatter *self, PyObject *record){
                 PyErr_Format(PyExc_TypeError, "LogRecord.excInfo must be a tuple.");
                 return nullptr;
             }
-            PyObject* mod = PICOLOGGING_MODULE(); // borrowed reference
-            PyObject* modDict = PyModule_GetDict(mod); // borrowed reference
-            PyObject* print_exception = Py_NewRef(PyDict_GetItemString(modDict, "print_exception"));
-            PyObject* sio_cls = Py_NewRef(PyDict_GetItemString(modDict, "StringIO"));
-            PyObject* sio = PyObject_CallFunctionObjArgs(sio_cls, NULL);
-            if (sio == nullptr){
-                Py_XDECREF(sio_cls);
-                Py_XDECREF(print_exception);
-                return nullptr; // Got exception in StringIO.__init__()
-            }
-            // TODO: Validate length of logRecord->excInfo is >=3
-            if (PyObject_CallFunctionObjArgs(
-                print_exception,
-                PyTuple_GetItem(logRecord->excInfo, 0), 
-                PyTuple_GetItem(logRecord->excInfo, 1), 
-                PyTuple_GetItem(logRecord->excInfo, 2), 
-                Py_None,
-                sio,
-                NULL) == nullptr)
-            {
-                Py_XDECREF(sio);
-                Py_XDECREF(sio_cls);
-                Py_XDECREF(print_exception);
-                return nullptr; // Got exception in print_exception()
-            }
-            PyObject* s = PyObject_CallMethod_NOARGS(sio, self->_const_getvalue);
-            if (s == nullptr){
-                Py_XDECREF(sio);
-                Py_XDECREF(sio_cls);
-                Py_XDECREF(print_exception);
-                return nullptr; // Got exception in StringIO.getvalue()
-            }
-            
-            if (PyObject_CallMethod_NOARGS(sio, self->_const_close) == nullptr){
-                Py_DECREF(s);
-                Py_XDECREF(sio);
-                Py_XDECREF(sio_cls);
-                Py_XDECREF(print_exception);
-                return nullptr; // Got exception in StringIO.close()
-            }
-            Py_DECREF(sio);
-            Py_DECREF(sio_cls);
-            Py_DECREF(print_exception);
-            if (PYUNICODE_ENDSWITH(s, self->_const_line_break)){
-                PyObject* s2 = PyUnicode_Substring(s, 0, PyUnicode_GetLength(s) - 1);
-                Py_DECREF(s);
-                s = s2;
-            }
+            PyObject* s = formatException(state, logRecord->excInfo);
+            if (s == nullptr)
+                return nullptr;
             Py_XDECREF(logRecord->excText);
             logRecord->excText = s; // Use borrowed ref
         }
@@ -183,6 +472,10 @@ PyObject* Formatter_format(Formatter *self, PyObject *record){
             PyUnicode_Append(&result, logRecord->excText);
             if (result == nullptr) return nullptr;
         }
+        if (LogRecord_writeStackInfo(logRecord) == -1){
+            Py_DECREF(result);
+            return nullptr;
+        }
         if (logRecord->stackInfo != Py_None && logRecord->stackInfo != Py_False ) {
             if (PyUnicode_Check(logRecord->stackInfo) ) {
                 if (PyUnicode_GET_LENGTH(logRecord->stackInfo) > 0) {
@@ -215,7 +508,7 @@ PyObject* Formatter_format(Formatter *self, PyObject *record){
 }
 
 PyObject* Formatter_usesTime(Formatter *self) {
-    if (FormatStyle_CheckExact(self->style)){
+    if (FormatStyle_CheckExact(GET_PICOLOGGING_STATE(self), self->style)){
         return FormatStyle_usesTime((FormatStyle*)self->style);
     } else {
         return PyObject_CallMethod_NOARGS(self->style, self->_const_usesTime);
@@ -232,51 +525,7 @@ PyObject* Formatter_formatStack(Formatter *self, PyObject *stackInfo) {
 }
 
 PyObject* Formatter_formatException(Formatter *self, PyObject *excInfo) {
-    PyObject* mod = PICOLOGGING_MODULE(); // borrowed reference
-    PyObject* modDict = PyModule_GetDict(mod); // borrowed reference
-    PyObject* print_exception = PyDict_GetItemString(modDict, "print_exception"); // PyDict_GetItemString returns a borrowed reference
-    Py_XINCREF(print_exception);
-    PyObject* sio_cls = PyDict_GetItemString(modDict, "StringIO");
-    Py_XINCREF(sio_cls);
-    PyObject* sio = PyObject_CallFunctionObjArgs(sio_cls, NULL);
-
-    if (sio == nullptr){
-        Py_XDECREF(sio_cls);
-        Py_XDECREF(print_exception);
-        return nullptr; // Got exception in StringIO.__init__()
-    }
-    if (PyObject_CallFunctionObjArgs(
-        print_exception,
-        PyTuple_GetItem(excInfo, 0), 
-        PyTuple_GetItem(excInfo, 1), 
-        PyTuple_GetItem(excInfo, 2), 
-        Py_None,
-        sio,
-        NULL) == nullptr)
-    {
-        Py_XDECREF(sio_cls);
-        Py_XDECREF(print_exception);
-        return nullptr; // Got exception in print_exception()
-    }
-    PyObject* s = PyObject_CallMethod_NOARGS(sio, self->_const_getvalue);
-
-    if (s == nullptr){
-        Py_XDECREF(sio);
-        Py_XDECREF(sio_cls);
-        Py_XDECREF(print_exception);
-        return nullptr; // Got exception in StringIO.getvalue()
-    }
-    
-    PyObject_CallMethod_NOARGS(sio, self->_const_close);
-    Py_DECREF(sio);
-    Py_DECREF(sio_cls);
-    Py_DECREF(print_exception);
-    if (PYUNICODE_ENDSWITH(s, self->_const_line_break)){
-        PyObject* s2 = PyUnicode_Substring(s, 0, PyUnicode_GetLength(s) - 1);
-        Py_DECREF(s);
-        s = s2;
-    }
-    return s;
+    return formatException(GET_PICOLOGGING_STATE(self), excInfo);
 }
 
 PyObject* Formatter_repr(Formatter *self)
@@ -290,11 +539,15 @@ PyObject* Formatter_dealloc(Formatter *self) {
     Py_CLEAR(self->dateFmt);
     Py_CLEAR(self->style);
     Py_CLEAR(self->_const_line_break);
-    Py_CLEAR(self->_const_close);
-    Py_CLEAR(self->_const_getvalue);
     Py_CLEAR(self->_const_usesTime);
     Py_CLEAR(self->_const_format);
-    Py_TYPE(self)->tp_free((PyObject*)self);
+    Py_CLEAR(self->converter);
+    Py_CLEAR(self->cache.asctime);
+    delete self->cacheLock;
+    Py_CLEAR(self->_const_converter);
+    PyTypeObject* type = Py_TYPE(self);
+    type->tp_free((PyObject*)self);
+    Py_DECREF_HEAPTYPE(type);
     return NULL;
 }
 
@@ -310,48 +563,32 @@ static PyMethodDef Formatter_methods[] = {
 static PyMemberDef Formatter_members[] = {
     {"_fmt", T_OBJECT_EX, offsetof(Formatter, fmt), 0, "Format string"},
     {"_style", T_OBJECT_EX, offsetof(Formatter, style), 0, "String style formatter"},
-    {"datefmt", T_OBJECT_EX, offsetof(Formatter, dateFmt), 0, "Date format string"},
     {NULL}
 };
 
-PyTypeObject FormatterType = {
-    PyObject_HEAD_INIT(NULL)
-    "picologging.Formatter",                    /* tp_name */
-    sizeof(Formatter),                          /* tp_basicsize */
-    0,                                          /* tp_itemsize */
-    (destructor)Formatter_dealloc,              /* tp_dealloc */
-    0,                                          /* tp_vectorcall_offset */
-    0,                                          /* tp_getattr */
-    0,                                          /* tp_setattr */
-    0,                                          /* tp_as_async */
-    (reprfunc)Formatter_repr,                   /* tp_repr */
-    0,                                          /* tp_as_number */
-    0,                                          /* tp_as_sequence */
-    0,                                          /* tp_as_mapping */
-    0,                                          /* tp_hash */
-    0,                                          /* tp_call */
-    0,                                          /* tp_str */
-    PyObject_GenericGetAttr,                    /* tp_getattro */
-    PyObject_GenericSetAttr,                    /* tp_setattro */
-    0,                                          /* tp_as_buffer */
-    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE ,  /* tp_flags */
-    PyDoc_STR("Formatter for log records."),    /* tp_doc */
-    0,                                          /* tp_traverse */
-    0,                                          /* tp_clear */
-    0,                                          /* tp_richcompare */
-    0,                                          /* tp_weaklistoffset */
-    0,                                          /* tp_iter */
-    0,                                          /* tp_iternext */
-    Formatter_methods,                          /* tp_methods */
-    Formatter_members,                          /* tp_members */
-    0,                                          /* tp_getset */
-    0,                                          /* tp_base */
-    0,                                          /* tp_dict */
-    0,                                          /* tp_descr_get */
-    0,                                          /* tp_descr_set */
-    0,                                          /* tp_dictoffset */
-    (initproc)Formatter_init,                   /* tp_init */
-    0,                                          /* tp_alloc */
-    Formatter_new,                          /* tp_new */
-    PyObject_Del,                               /* tp_free */
+static PyGetSetDef Formatter_getset[] = {
+    {"datefmt", (getter)Formatter_getDateFmt, (setter)Formatter_setDateFmt, "Date format string, or the name of a native timestamp format", NULL},
+    {"converter", (getter)Formatter_getConverter, (setter)Formatter_setConverter, "Function converting record.created to a time.struct_time", NULL},
+    {NULL}
+};
+
+static PyType_Slot Formatter_slots[] = {
+    {Py_tp_dealloc, (void*)Formatter_dealloc},
+    {Py_tp_repr, (void*)Formatter_repr},
+    {Py_tp_doc, (void*)PyDoc_STR("Formatter for log records.")},
+    {Py_tp_methods, Formatter_methods},
+    {Py_tp_members, Formatter_members},
+    {Py_tp_getset, Formatter_getset},
+    {Py_tp_init, (void*)Formatter_init},
+    {Py_tp_new, (void*)Formatter_new},
+    {Py_tp_free, (void*)PyObject_Del},
+    {0, NULL}
+};
+
+PyType_Spec FormatterType_spec = {
+    "picologging.Formatter",
+    sizeof(Formatter),
+    0,
+    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE | Py_TPFLAGS_IMMUTABLETYPE,
+    Formatter_slots,
 };
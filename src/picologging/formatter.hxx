@@ -1,11 +1,40 @@
 #include <Python.h>
 #include <structmember.h>
 #include <cstddef>
+#include <mutex>
 #include "compat.hxx"
 
 #ifndef PICOLOGGING_FORMATTER_H
 #define PICOLOGGING_FORMATTER_H
 
+// How asctime is rendered, picked from datefmt when it's assigned.
+enum DateFormat {
+    DateFormat_Default,         // "%Y-%m-%d %H:%M:%S,mmm"
+    DateFormat_Strftime,        // any datefmt that isn't one of the names below
+    DateFormat_Iso8601,         // "iso8601": 2024-05-01T12:30:45.123+02:00
+    DateFormat_Rfc3339Micro,    // "rfc3339_micro": 2024-05-01T12:30:45.123456+02:00
+    DateFormat_Rfc3339Nano,     // "rfc3339_nano": 2024-05-01T12:30:45.123456789+02:00
+    DateFormat_EpochSeconds,    // "epoch": 1714559445
+    DateFormat_EpochMillis,     // "epoch_millis": 1714559445123
+    DateFormat_EpochNanos,      // "epoch_nanos": 1714559445123456789
+};
+
+// Everything in asctime but the sub-second digits only changes once a second.
+typedef struct {
+    long long second;
+    char prefix[32];
+    size_t prefixLen;
+    char offset[8];
+    size_t offsetLen;
+    PyObject *asctime; // DateFormat_Strftime only
+} AsctimeCache;
+
+enum TimeConverter {
+    Converter_Localtime,
+    Converter_Gmtime,
+    Converter_Custom,           // called with record.created, must return a time.struct_time
+};
+
 typedef struct {
     PyObject_HEAD
     PyObject *fmt;
@@ -13,11 +42,18 @@ typedef struct {
     PyObject *style;
     bool usesTime;
     const char* dateFmtStr;
+    DateFormat dateFormat;
+    bool utc; // the datefmt name ends in "_utc", the converter is ignored
+    PyObject *converter;
+    TimeConverter converterKind;
+    AsctimeCache cache;
+    // Guards cache between threads formatting with the same formatter, never
+    // held while calling into Python.
+    std::mutex *cacheLock;
     PyObject *_const_line_break;
-    PyObject *_const_close;
-    PyObject *_const_getvalue;
     PyObject *_const_usesTime;
     PyObject *_const_format;
+    PyObject *_const_converter;
 } Formatter;
 
 int Formatter_init(Formatter *self, PyObject *args, PyObject *kwds);
@@ -27,8 +63,8 @@ PyObject* Formatter_usesTime(Formatter *self);
 PyObject* Formatter_formatMessage(Formatter *self, PyObject *record);
 PyObject* Formatter_formatStack(Formatter *self, PyObject *stackInfo);
 
-extern PyTypeObject FormatterType;
-#define Formatter_CheckExact(op) Py_IS_TYPE(op, &FormatterType)
+extern PyType_Spec FormatterType_spec;
+#define Formatter_CheckExact(state, op) Py_IS_TYPE(op, (state)->FormatterType)
 
 
 #endif // PICOLOGGING_FORMATTER_H
\ No newline at end of file
@@ -0,0 +1,237 @@
+#include "framecache.hxx"
+#include <frameobject.h>
+#include <chrono>
+#include <sys/stat.h>
+#include "picologging.hxx"
+#include "compat.hxx"
+
+static inline PyObject* getCode(PyTracebackObject* tb){
+#if PY_VERSION_HEX >= 0x03090000
+    return (PyObject*)PyFrame_GetCode(tb->tb_frame);
+#else
+    return Py_NewRef(tb->tb_frame->f_code);
+#endif
+}
+
+static inline void entryClear(FrameCacheEntry* entry){
+    Py_CLEAR(entry->code);
+    Py_CLEAR(entry->text);
+    Py_CLEAR(entry->filename);
+    Py_CLEAR(entry->name);
+}
+
+static inline bool operator==(const FileStamp& a, const FileStamp& b){
+    return a.mtime == b.mtime && a.size == b.size;
+}
+
+static FileStamp statSource(PyObject* filename){
+    FileStamp stamp = {-1, -1};
+    if (!PyUnicode_Check(filename))
+        return stamp;
+#ifdef _WIN32
+    wchar_t* wide = PyUnicode_AsWideCharString(filename, nullptr);
+    if (wide == nullptr){
+        PyErr_Clear();
+        return stamp;
+    }
+    struct _stat64 st;
+    if (_wstat64(wide, &st) == 0)
+        stamp = {(long long)st.st_mtime * 1000000000LL, (long long)st.st_size};
+    PyMem_Free(wide);
+#else
+    PyObject* encoded = PyUnicode_EncodeFSDefault(filename);
+    if (encoded == nullptr){
+        PyErr_Clear();
+        return stamp;
+    }
+    struct stat st;
+    if (stat(PyBytes_AS_STRING(encoded), &st) == 0){
+#if defined(__APPLE__)
+        stamp.mtime = (long long)st.st_mtimespec.tv_sec * 1000000000LL + st.st_mtimespec.tv_nsec;
+#else
+        stamp.mtime = (long long)st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+#endif
+        stamp.size = (long long)st.st_size;
+    }
+    Py_DECREF(encoded);
+#endif
+    return stamp;
+}
+
+CapturedStack::~CapturedStack(){
+    for (auto& frame : frames){
+        Py_CLEAR(frame.code);
+    }
+}
+
+FrameCache::FrameCache(picologging_state* state) :
+    cache(FRAMECACHE_SIZE, FrameCacheEntry{nullptr, 0, false, {-1, -1}, nullptr, nullptr, nullptr, 0}),
+    checked(FRAMECACHE_SIZE, 0),
+    state(state) {}
+
+static int joinFrames(PyObject* frames, FrameCacheEntry* entry){
+    PyObject* empty = PyUnicode_New(0, 0);
+    entry->text = PyUnicode_Join(empty, frames);
+    Py_DECREF(empty);
+    return entry->text == nullptr ? -1 : 0;
+}
+
+/**
+ * Render a single traceback entry with the traceback module, so source
+ * lookup and the position markers of newer versions match the stdlib.
+ */
+static int renderTracebackFrame(picologging_state* state, PyObject* tb, FrameCacheEntry* entry){
+    PyObject* extract_tb = state->g_extract_tb; // borrowed reference
+    if (extract_tb == nullptr){
+        PyErr_SetString(PyExc_RuntimeError, "traceback.extract_tb is not available.");
+        return -1;
+    }
+    PyObject* limit = PyLong_FromLong(1);
+    PyObject* summary = PyObject_CallFunctionObjArgs(extract_tb, tb, limit, NULL);
+    Py_DECREF(limit);
+    if (summary == nullptr)
+        return -1;
+    PyObject* frames = PyObject_CallMethod(summary, "format", NULL);
+    PyObject* frameSummary = frames != nullptr ? PySequence_GetItem(summary, 0) : nullptr;
+    Py_DECREF(summary);
+    if (frameSummary == nullptr){
+        Py_XDECREF(frames);
+        return -1;
+    }
+    int ret = joinFrames(frames, entry);
+    Py_DECREF(frames);
+    entry->filename = PyObject_GetAttrString(frameSummary, "filename");
+    entry->name = PyObject_GetAttrString(frameSummary, "name");
+    PyObject* lineno = PyObject_GetAttrString(frameSummary, "lineno");
+    Py_DECREF(frameSummary);
+    if (ret < 0 || entry->filename == nullptr || entry->name == nullptr || lineno == nullptr){
+        Py_XDECREF(lineno);
+        return -1;
+    }
+    entry->lineno = lineno == Py_None ? -1 : (int)PyLong_AsLong(lineno);
+    Py_DECREF(lineno);
+    return PyErr_Occurred() ? -1 : 0;
+}
+
+/**
+ * Render a frame of a call stack the way traceback.print_stack() does,
+ * through traceback.format_list() so the layout matches the stdlib.
+ */
+static int renderStackFrame(picologging_state* state, PyObject* code, int lasti, FrameCacheEntry* entry){
+    PyObject* format_list = state->g_format_list; // borrowed reference
+    if (format_list == nullptr || state->g_checkcache == nullptr){
+        PyErr_SetString(PyExc_RuntimeError, "traceback.format_list is not available.");
+        return -1;
+    }
+    PyCodeObject* co = (PyCodeObject*)code;
+    entry->filename = Py_NewRef(co->co_filename);
+    entry->name = Py_NewRef(co->co_name);
+    entry->lineno = PyCode_Addr2Line(co, lasti);
+    // format_list() reads the line through linecache, drop a stale copy first
+    // as traceback.extract_stack() does.
+    PyObject* checked = PyObject_CallFunctionObjArgs(state->g_checkcache, entry->filename, NULL);
+    if (checked == nullptr)
+        return -1;
+    Py_DECREF(checked);
+    PyObject* frames = Py_BuildValue("[(OiOO)]", entry->filename, entry->lineno, entry->name, Py_None);
+    if (frames == nullptr)
+        return -1;
+    PyObject* formatted = PyObject_CallFunctionObjArgs(format_list, frames, NULL);
+    Py_DECREF(frames);
+    if (formatted == nullptr)
+        return -1;
+    int ret = joinFrames(formatted, entry);
+    Py_DECREF(formatted);
+    return ret;
+}
+
+static inline void entryCopy(const FrameCacheEntry& slot, FrameCacheEntry* entry){
+    *entry = FrameCacheEntry{
+        Py_NewRef(slot.code),
+        slot.lasti,
+        slot.stack,
+        slot.source,
+        Py_NewRef(slot.text),
+        Py_NewRef(slot.filename),
+        Py_NewRef(slot.name),
+        slot.lineno
+    };
+}
+
+static inline bool sameKey(const FrameCacheEntry& slot, PyObject* code, int lasti, bool stack){
+    return slot.code == code && slot.lasti == lasti && slot.stack == stack;
+}
+
+int FrameCache::lookupKey(PyObject* code, int lasti, bool stack, PyObject* tb, FrameCacheEntry* entry){
+    size_t index = (((size_t)code >> 4) ^ ((size_t)lasti * 0x9e3779b9) ^ (size_t)stack) & (FRAMECACHE_SIZE - 1);
+    long long now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+
+    bool found = false;
+    FileStamp cached;
+    {
+        std::lock_guard<std::mutex> guard(mutex);
+        FrameCacheEntry& slot = cache[index];
+        if (sameKey(slot, code, lasti, stack)){
+            if (now - checked[index] < FRAMECACHE_RECHECK_NS){
+                entryCopy(slot, entry);
+                return 0;
+            }
+            found = true;
+            cached = slot.source;
+        }
+    }
+
+    // The source file is only looked at again once the entry is old enough.
+    FileStamp source = statSource(((PyCodeObject*)code)->co_filename);
+    if (found && source == cached){
+        std::lock_guard<std::mutex> guard(mutex);
+        FrameCacheEntry& slot = cache[index];
+        if (sameKey(slot, code, lasti, stack) && slot.source == source){
+            checked[index] = now;
+            entryCopy(slot, entry);
+            return 0;
+        }
+    }
+
+    *entry = FrameCacheEntry{Py_NewRef(code), lasti, stack, source, nullptr, nullptr, nullptr, 0};
+    int ret = stack ? renderStackFrame(state, code, lasti, entry) : renderTracebackFrame(state, tb, entry);
+    if (ret < 0){
+        entryClear(entry);
+        return -1;
+    }
+
+    // The slot may have been replaced while the traceback module was running.
+    FrameCacheEntry old;
+    {
+        std::lock_guard<std::mutex> guard(mutex);
+        FrameCacheEntry& current = cache[index];
+        old = current;
+        entryCopy(*entry, &current);
+        checked[index] = now;
+    }
+    entryClear(&old);
+    return 0;
+}
+
+int FrameCache::lookup(PyObject* tb, FrameCacheEntry* entry){
+    PyTracebackObject* traceback = (PyTracebackObject*)tb;
+    PyObject* code = getCode(traceback);
+    int ret = lookupKey(code, traceback->tb_lasti, false, tb, entry);
+    Py_DECREF(code);
+    return ret;
+}
+
+int FrameCache::lookupStack(const CapturedFrame& frame, FrameCacheEntry* entry){
+    return lookupKey(frame.code, frame.lasti, true, nullptr, entry);
+}
+
+void FrameCache::clear(){
+    for (auto& entry : cache){
+        entryClear(&entry);
+    }
+}
+
+FrameCache::~FrameCache(){
+    clear();
+}
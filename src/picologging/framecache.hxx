@@ -0,0 +1,77 @@
+#include <Python.h>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+#ifndef PICOLOGGING_FRAMECACHE_H
+#define PICOLOGGING_FRAMECACHE_H
+
+// Number of rendered frames kept, must be a power of two.
+#define FRAMECACHE_SIZE 512
+// How long an entry is used before its source file is checked for changes.
+#define FRAMECACHE_RECHECK_NS 1000000000LL
+
+struct picologging_state;
+
+// Modification time and size of a source file, both -1 when it can't be read.
+typedef struct {
+    long long mtime;
+    long long size;
+} FileStamp;
+
+typedef struct {
+    PyObject* code; // Strong reference, keeps the identity of the key stable
+    int lasti;
+    bool stack; // Rendered for a stack, never shows position markers
+    FileStamp source; // Source file when the text was rendered
+    PyObject* text; // '  File "...", line N, in name\n    source\n', empty if hidden
+    PyObject* filename;
+    PyObject* name;
+    int lineno;
+} FrameCacheEntry;
+
+typedef struct {
+    PyObject* code;
+    int lasti;
+} CapturedFrame;
+
+/**
+ * Frames of a call stack captured at log time, oldest first. Only the code
+ * objects are kept, so the frames and their locals are not kept alive.
+ */
+class CapturedStack {
+public:
+    std::vector<CapturedFrame> frames;
+    ~CapturedStack();
+};
+
+/**
+ * Direct-mapped cache of rendered traceback entries keyed by
+ * (code object, last instruction), so the source line lookup and
+ * formatting of a frame is only paid once per call site. Like
+ * linecache.checkcache(), the source file is checked for changes, at most
+ * once every FRAMECACHE_RECHECK_NS per entry, and the entry is rendered
+ * again when the file was modified.
+ */
+class FrameCache {
+    std::vector<FrameCacheEntry> cache;
+    std::vector<long long> checked; // Steady clock time each slot's source was last checked
+    std::mutex mutex; // Guards the slots, never held while rendering
+    picologging_state* state; // Module owning the cache, for the traceback functions
+    int lookupKey(PyObject* code, int lasti, bool stack, PyObject* tb, FrameCacheEntry* entry);
+public:
+    explicit FrameCache(picologging_state* state);
+    /**
+     * Fill `entry` with new references to the rendered text of the
+     * traceback entry `tb`. Returns -1 with an exception set on failure.
+     */
+    int lookup(PyObject* tb, FrameCacheEntry* entry);
+    /**
+     * Same as lookup() for a frame captured from a call stack.
+     */
+    int lookupStack(const CapturedFrame& frame, FrameCacheEntry* entry);
+    void clear();
+    ~FrameCache();
+};
+
+#endif // PICOLOGGING_FRAMECACHE_H
@@ -1,16 +1,50 @@
 #include <mutex>
+#include <unordered_map>
+#include <vector>
 
 #include "handler.hxx"
 #include "picologging.hxx"
+#include "compat.hxx"
 #include "formatter.hxx"
 #include "streamhandler.hxx"
+#include "deduplicationhandler.hxx"
+#include "binaryhandler.hxx"
+#include "flightrecorder.hxx"
+#include "bufferinghandler.hxx"
+#include "contexthandler.hxx"
+#include "sysloghandler.hxx"
+#include "journalhandler.hxx"
+#include "sharedmemoryhandler.hxx"
+
+std::atomic<bool> g_handlerStatsEnabled{false};
+
+void Handler_freeRegistry(picologging_state* state) {
+    if (state->g_handlers == nullptr)
+        return;
+    for (auto& entry : state->g_handlers->handlers)
+        Py_DECREF(entry.second);
+    delete state->g_handlers;
+    state->g_handlers = nullptr;
+}
 
 PyObject* Handler_new(PyTypeObject* type, PyObject* args, PyObject* kwds)
 {
-    Handler* self = (Handler*)FiltererType.tp_new(type, args, kwds);
+    Handler* self = (Handler*)Filterer_new(type, args, kwds);
     if (self != NULL)
     {
+        HandlerRegistry* registry = picologging_typeState(type)->g_handlers;
         self->lock = new std::recursive_mutex();
+        self->stats = new HandlerStats();
+        self->weakreflist = nullptr;
+        PyObject* ref = PyWeakref_NewRef((PyObject*)self, nullptr);
+        if (ref == nullptr) {
+            PyErr_Clear(); // Only stats() misses the handler
+        } else if (registry == nullptr) {
+            Py_DECREF(ref);
+        } else {
+            std::lock_guard<std::mutex> guard(registry->mutex);
+            registry->handlers.emplace(self, ref);
+        }
         self->_const_emit = PyUnicode_FromString("emit");
         self->_const_format = PyUnicode_FromString("format");
         self->name = Py_None;
@@ -20,7 +54,7 @@ PyObject* Handler_new(PyTypeObject* type, PyObject* args, PyObject* kwds)
 }
 
 int Handler_init(Handler *self, PyObject *args, PyObject *kwds){
-    if (FiltererType.tp_init((PyObject *) self, args, kwds) < 0)
+    if (Filterer_init((Filterer*)self, args, kwds) < 0)
         return -1;
     PyObject *name = Py_None;
     unsigned short level = LOG_LEVEL_NOTSET;
@@ -34,12 +68,28 @@ int Handler_init(Handler *self, PyObject *args, PyObject *kwds){
 }
 
 PyObject* Handler_dealloc(Handler *self) {
+    // Subclasses have already cleared their own fields. The refcount is zero, so the
+    // weak reference stopped resolving then and stats() can't revive the handler.
+    if (self->weakreflist != nullptr)
+        PyObject_ClearWeakRefs((PyObject*)self);
+    PyObject* ref = nullptr;
+    HandlerRegistry* registry = GET_PICOLOGGING_STATE(self)->g_handlers;
+    if (registry != nullptr) {
+        std::lock_guard<std::mutex> guard(registry->mutex);
+        auto entry = registry->handlers.find(self);
+        if (entry != registry->handlers.end()) {
+            ref = entry->second;
+            registry->handlers.erase(entry);
+        }
+    }
+    Py_XDECREF(ref);
     Py_CLEAR(self->name);
     Py_CLEAR(self->formatter);
     Py_CLEAR(self->_const_emit);
     Py_CLEAR(self->_const_format);
     delete self->lock;
-    FiltererType.tp_dealloc((PyObject *)self);
+    delete self->stats;
+    Filterer_dealloc((Filterer*)self);
     return nullptr;
 }
 
@@ -49,26 +99,68 @@ PyObject* Handler_emit(Handler *self, PyObject *record){
     return NULL;
 }
 
+static inline void recordEmit(Handler *self, bool ok, uint64_t elapsed) {
+    HandlerStats* stats = self->stats;
+    (ok ? stats->emitted : stats->errors).fetch_add(1, std::memory_order_relaxed);
+    stats->emitTime.fetch_add(elapsed, std::memory_order_relaxed);
+    uint64_t max = stats->maxEmitTime.load(std::memory_order_relaxed);
+    while (elapsed > max && !stats->maxEmitTime.compare_exchange_weak(max, elapsed, std::memory_order_relaxed)) {}
+}
+
 PyObject* Handler_handle(Handler *self, PyObject *record) {
-    if (Filterer_filter(&self->filterer, (PyObject*)record) != Py_True)
+    bool collect = HandlerStats_enabled();
+    if (collect)
+        self->stats->handled.fetch_add(1, std::memory_order_relaxed);
+    if (Filterer_filter(&self->filterer, (PyObject*)record) != Py_True) {
+        if (collect)
+            self->stats->filtered.fetch_add(1, std::memory_order_relaxed);
         Py_RETURN_NONE;
+    }
 
+    uint64_t start = 0;
+    PyObject* result = nullptr;
     try {
-        self->lock->lock();
+        Handler_lock(self);
     } catch (const std::exception& e) {
         PyErr_Format(PyExc_RuntimeError, "Cannot acquire thread lock, %s", e.what());
         return nullptr;
     }
-    PyObject* result = nullptr;
-    if (StreamHandler_CheckExact(((PyObject*)self))){
+    // Time spent waiting for the lock is counted separately.
+    if (collect)
+        start = HandlerStats_now();
+    picologging_state* state = GET_PICOLOGGING_STATE(self);
+    if (StreamHandler_CheckExact(state, ((PyObject*)self))){
         PyObject* args[1] = {record};
         result = StreamHandler_emit((StreamHandler*)self, args, 1);
+    } else if (FlightRecorderHandler_CheckExact(state, ((PyObject*)self))){
+        // The lock keeps close() from unmapping the ring mid-write, frames from
+        // other processes are still kept apart by the shared cursor.
+        result = FlightRecorderHandler_emit((FlightRecorderHandler*)self, record);
+    } else if (ContextBufferingHandler_CheckExact(state, ((PyObject*)self))){
+        result = ContextBufferingHandler_emit((ContextBufferingHandler*)self, record);
+    } else if (DeduplicationHandler_CheckExact(state, ((PyObject*)self))){
+        result = DeduplicationHandler_emit((DeduplicationHandler*)self, record);
+    } else if (BinaryFileHandler_CheckExact(state, ((PyObject*)self))){
+        result = BinaryFileHandler_emit((BinaryFileHandler*)self, record);
+    } else if (BufferingHandler_CheckExact(state, ((PyObject*)self)) || MemoryHandler_CheckExact(state, ((PyObject*)self))){
+        result = BufferingHandler_emit((BufferingHandler*)self, record);
+    } else if (SysLogHandler_CheckExact(state, ((PyObject*)self))){
+        result = SysLogHandler_emit((SysLogHandler*)self, record);
+    } else if (JournalHandler_CheckExact(state, ((PyObject*)self))){
+        result = JournalHandler_emit((JournalHandler*)self, record);
+    } else if (SharedMemoryHandler_CheckExact(state, ((PyObject*)self))){
+        result = SharedMemoryHandler_emit((SharedMemoryHandler*)self, record);
     } else {
         result = PyObject_CallMethod_ONEARG((PyObject*)self, self->_const_emit, record);
     }
-    
     self->lock->unlock();
-    return result == nullptr ? nullptr : Py_True;
+
+    if (collect)
+        recordEmit(self, result != nullptr, HandlerStats_now() - start);
+    if (result == nullptr)
+        return nullptr;
+    Py_DECREF(result);
+    Py_RETURN_TRUE;
 }
 
 PyObject* Handler_setLevel(Handler *self, PyObject *level){
@@ -82,33 +174,46 @@ PyObject* Handler_setLevel(Handler *self, PyObject *level){
 }
 
 PyObject* Handler_format(Handler *self, PyObject *record){
-    if (self->formatter == Py_None){
-        // Lazily initialize default formatter..
-        Py_DECREF(self->formatter);
-        self->formatter = PyObject_CallFunctionObjArgs((PyObject*)&FormatterType, NULL);
-        if (self->formatter == nullptr){
-            // Reset to none if we failed to initialize
-            self->formatter = Py_None;
-            Py_INCREF(self->formatter);
-            return nullptr;
+    PyObject* formatter;
+    {
+        // format() may be called without the lock, which emitters already hold,
+        // so two threads can't both create the default formatter, and
+        // setFormatter() can't free the one in use.
+        HandlerLockGuard guard(self);
+        if (self->formatter == Py_None){
+            // Lazily initialize default formatter..
+            PyObject* created = PyObject_CallFunctionObjArgs((PyObject*)GET_PICOLOGGING_STATE(self)->FormatterType, NULL);
+            if (created == nullptr)
+                return nullptr;
+            Py_SETREF(self->formatter, created);
         }
+        formatter = Py_NewRef(self->formatter);
     }
 
-    if (Formatter_CheckExact(self->formatter)) {
-        return Formatter_format((Formatter*) self->formatter, record);
+    PyObject* result;
+    if (Formatter_CheckExact(GET_PICOLOGGING_STATE(self), formatter)) {
+        result = Formatter_format((Formatter*) formatter, record);
     } else {
-        return PyObject_CallMethod_ONEARG(self->formatter, self->_const_format, record);
+        result = PyObject_CallMethod_ONEARG(formatter, self->_const_format, record);
     }
+    Py_DECREF(formatter);
+    return result;
 }
 
 PyObject* Handler_setFormatter(Handler *self, PyObject *formatter) {
-    Py_XDECREF(self->formatter);
-    self->formatter = Py_NewRef(formatter);
+    PyObject* old;
+    {
+        // Records are formatted under the lock, don't swap it out underneath one
+        HandlerLockGuard guard(self);
+        old = self->formatter;
+        self->formatter = Py_NewRef(formatter);
+    }
+    Py_XDECREF(old);
     Py_RETURN_NONE;
 }
 
 PyObject* Handler_acquire(Handler *self){
-    self->lock->lock();
+    Handler_lock(self);
     Py_RETURN_NONE;
 }
 
@@ -122,6 +227,13 @@ PyObject* Handler_flush(Handler *self){
     Py_RETURN_NONE;
 }
 
+int Handler_checkTarget(picologging_state* state, PyObject *target) {
+    if (target == Py_None || Handler_Check(state, target) || PyObject_HasAttrString(target, "handle"))
+        return 0;
+    PyErr_Format(PyExc_TypeError, "target must be a handler or None, not %.200s", Py_TYPE(target)->tp_name);
+    return -1;
+}
+
 PyObject* Handler_close(Handler *self){
     // TODO: Decide if we want a global dictionary of handlers.
     Py_RETURN_NONE;
@@ -149,6 +261,112 @@ PyObject* Handler_createLock(Handler *self){
     Py_RETURN_NONE;
 }
 
+static PyObject* statsToDict(uint64_t handled, uint64_t filtered, uint64_t emitted, uint64_t errors,
+                             uint64_t bytesWritten, uint64_t emitTime, uint64_t maxEmitTime, uint64_t lockWaitTime) {
+    return Py_BuildValue("{s:K,s:K,s:K,s:K,s:K,s:d,s:d,s:d}",
+        "handled", (unsigned long long)handled,
+        "filtered", (unsigned long long)filtered,
+        "emitted", (unsigned long long)emitted,
+        "errors", (unsigned long long)errors,
+        "bytesWritten", (unsigned long long)bytesWritten,
+        "emitTime", emitTime / 1e9,
+        "maxEmitTime", maxEmitTime / 1e9,
+        "lockWaitTime", lockWaitTime / 1e9);
+}
+
+PyObject* Handler_stats(Handler *self) {
+    HandlerStats& stats = *self->stats;
+    return statsToDict(
+        stats.handled.load(std::memory_order_relaxed),
+        stats.filtered.load(std::memory_order_relaxed),
+        stats.emitted.load(std::memory_order_relaxed),
+        stats.errors.load(std::memory_order_relaxed),
+        stats.bytesWritten.load(std::memory_order_relaxed),
+        stats.emitTime.load(std::memory_order_relaxed),
+        stats.maxEmitTime.load(std::memory_order_relaxed),
+        stats.lockWaitTime.load(std::memory_order_relaxed));
+}
+
+PyObject* Handler_resetStats(Handler *self) {
+    HandlerStats& stats = *self->stats;
+    for (auto counter : {&stats.handled, &stats.filtered, &stats.emitted, &stats.errors,
+                         &stats.bytesWritten, &stats.emitTime, &stats.maxEmitTime, &stats.lockWaitTime})
+        counter->store(0, std::memory_order_relaxed);
+    Py_RETURN_NONE;
+}
+
+/**
+ * Totals over every live handler, with the per-handler figures under "handlers".
+ */
+PyObject* picologging_stats(PyObject *module, PyObject *Py_UNUSED(ignored)) {
+    // Take references first, building the result can run a collection that frees handlers.
+    std::vector<PyObject*> refs;
+    HandlerRegistry* registry = ((picologging_state*)PyModule_GetState(module))->g_handlers;
+    if (registry != nullptr) {
+        std::lock_guard<std::mutex> guard(registry->mutex);
+        refs.reserve(registry->handlers.size());
+        for (auto& entry : registry->handlers)
+            refs.push_back(Py_NewRef(entry.second));
+    }
+    std::vector<Handler*> handlers;
+    handlers.reserve(refs.size());
+    for (PyObject* ref : refs) {
+        PyObject* handler = nullptr;
+        // Handlers being deallocated resolve to nothing rather than being revived.
+        int ret = PyWeakref_GetRef(ref, &handler);
+        if (ret > 0)
+            handlers.push_back((Handler*)handler);
+        else if (ret < 0)
+            PyErr_Clear();
+        Py_DECREF(ref);
+    }
+    uint64_t totals[8] = {0};
+    PyObject* perHandler = PyList_New(0);
+    for (Handler* handler : handlers) {
+        HandlerStats& stats = *handler->stats;
+        uint64_t values[8] = {
+            stats.handled.load(std::memory_order_relaxed),
+            stats.filtered.load(std::memory_order_relaxed),
+            stats.emitted.load(std::memory_order_relaxed),
+            stats.errors.load(std::memory_order_relaxed),
+            stats.bytesWritten.load(std::memory_order_relaxed),
+            stats.emitTime.load(std::memory_order_relaxed),
+            stats.maxEmitTime.load(std::memory_order_relaxed),
+            stats.lockWaitTime.load(std::memory_order_relaxed),
+        };
+        for (int i = 0; i < 8; i++)
+            totals[i] = i == 6 ? std::max(totals[i], values[i]) : totals[i] + values[i];
+        if (perHandler != nullptr) {
+            PyObject* entry = statsToDict(values[0], values[1], values[2], values[3], values[4], values[5], values[6], values[7]);
+            if (entry == nullptr || PyDict_SetItemString(entry, "handler", (PyObject*)handler) < 0 ||
+                PyList_Append(perHandler, entry) < 0)
+                Py_CLEAR(perHandler);
+            Py_XDECREF(entry);
+        }
+    }
+    for (Handler* handler : handlers)
+        Py_DECREF(handler);
+    if (perHandler == nullptr)
+        return nullptr;
+    PyObject* result = statsToDict(totals[0], totals[1], totals[2], totals[3], totals[4], totals[5], totals[6], totals[7]);
+    if (result == nullptr || PyDict_SetItemString(result, "handlers", perHandler) < 0)
+        Py_CLEAR(result);
+    Py_DECREF(perHandler);
+    return result;
+}
+
+PyObject* picologging_enableStats(PyObject *module, PyObject *const *args, Py_ssize_t nargs) {
+    if (nargs > 1) {
+        PyErr_SetString(PyExc_TypeError, "enableStats() takes at most 1 argument");
+        return nullptr;
+    }
+    int enabled = 1;
+    if (nargs == 1 && (enabled = PyObject_IsTrue(args[0])) < 0)
+        return nullptr;
+    bool previous = g_handlerStatsEnabled.exchange(enabled != 0, std::memory_order_relaxed);
+    return PyBool_FromLong(previous);
+}
+
 PyObject* Handler_repr(Handler *self) {
     std::string level = _getLevelName(self->level);
     return PyUnicode_FromFormat("<%s (%s)>", _PyType_Name(Py_TYPE(self)), level.c_str());
@@ -162,6 +380,8 @@ static PyMethodDef Handler_methods[] = {
     {"format", (PyCFunction)Handler_format, METH_O, "Format a record."},
     {"acquire", (PyCFunction)Handler_acquire, METH_NOARGS, "Acquire the lock."},
     {"release", (PyCFunction)Handler_release, METH_NOARGS, "Release the lock."},
+    {"stats", (PyCFunction)Handler_stats, METH_NOARGS, "Return the counters collected for this handler."},
+    {"resetStats", (PyCFunction)Handler_resetStats, METH_NOARGS, "Reset the counters collected for this handler."},
     {"flush", (PyCFunction)Handler_flush, METH_NOARGS, "Ensure all logging output has been flushed."},
     {"close", (PyCFunction)Handler_close, METH_NOARGS, "Tidy up any resources used by the handler."},
     {"handleError", (PyCFunction)Handler_handleError, METH_O, "Handle an error during an emit()."},
@@ -175,48 +395,27 @@ static PyMemberDef Handler_members[] = {
     {"name", T_OBJECT_EX, offsetof(Handler, name), 0, "Handler name"},
     {"level", T_USHORT, offsetof(Handler, level), 0, "Handler level"},
     {"formatter", T_OBJECT_EX, offsetof(Handler, formatter), 0, "Handler formatter"},
+    {"__weaklistoffset__", T_PYSSIZET, offsetof(Handler, weakreflist), READONLY},
     {NULL}
 };
 
-PyTypeObject HandlerType = {
-    PyObject_HEAD_INIT(NULL)
-    "picologging.Handler",                    /* tp_name */
-    sizeof(Handler),                          /* tp_basicsize */
-    0,                                          /* tp_itemsize */
-    (destructor)Handler_dealloc,                /* tp_dealloc */
-    0,                                          /* tp_vectorcall_offset */
-    0,                                          /* tp_getattr */
-    0,                                          /* tp_setattr */
-    0,                                          /* tp_as_async */
-    (reprfunc)Handler_repr,                     /* tp_repr */
-    0,                                          /* tp_as_number */
-    0,                                          /* tp_as_sequence */
-    0,                                          /* tp_as_mapping */
-    0,                                          /* tp_hash */
-    0,                                          /* tp_call */
-    0,                                          /* tp_str */
-    PyObject_GenericGetAttr,                    /* tp_getattro */
-    PyObject_GenericSetAttr,                    /* tp_setattro */
-    0,                                          /* tp_as_buffer */
-    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE ,  /* tp_flags */
-    PyDoc_STR("Handler interface."),    /* tp_doc */
-    0,                                          /* tp_traverse */
-    0,                                          /* tp_clear */
-    0,                                          /* tp_richcompare */
-    0,                                          /* tp_weaklistoffset */
-    0,                                          /* tp_iter */
-    0,                                          /* tp_iternext */
-    Handler_methods,                          /* tp_methods */
-    Handler_members,                          /* tp_members */
-    0,                                          /* tp_getset */
-    0,                                          /* tp_base */
-    0,                                          /* tp_dict */
-    0,                                          /* tp_descr_get */
-    0,                                          /* tp_descr_set */
-    0,                                          /* tp_dictoffset */
-    (initproc)Handler_init,                   /* tp_init */
-    0,                                          /* tp_alloc */
-    Handler_new,                          /* tp_new */
-    PyObject_Del,                               /* tp_free */
+static PyType_Slot Handler_slots[] = {
+    {Py_tp_dealloc, (void*)Handler_dealloc},
+    {Py_tp_repr, (void*)Handler_repr},
+    {Py_tp_doc, (void*)PyDoc_STR("Handler interface.")},
+    {Py_tp_methods, Handler_methods},
+    {Py_tp_members, Handler_members},
+    {Py_tp_init, (void*)Handler_init},
+    {Py_tp_new, (void*)Handler_new},
+    {Py_tp_free, (void*)PyObject_Del},
+    {0, NULL}
+};
+
+PyType_Spec HandlerType_spec = {
+    "picologging.Handler",
+    sizeof(Handler),
+    0,
+    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE | Py_TPFLAGS_IMMUTABLETYPE,
+    Handler_slots,
 };
 
@@ -1,10 +1,43 @@
 #include <Python.h>
 #include "filterer.hxx"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
 #include <mutex>
+#include <unordered_map>
 
 #ifndef PICOLOGGING_HANDLER_H
 #define PICOLOGGING_HANDLER_H
 
+struct picologging_state;
+
+/**
+ * Runtime counters for a handler. handled and filtered are counted before the
+ * handler lock is taken, so they are relaxed atomics. Times are in nanoseconds.
+ */
+typedef struct {
+    std::atomic<uint64_t> handled{0};
+    std::atomic<uint64_t> filtered{0};
+    std::atomic<uint64_t> emitted{0};
+    std::atomic<uint64_t> errors{0};
+    std::atomic<uint64_t> bytesWritten{0};
+    std::atomic<uint64_t> emitTime{0};
+    std::atomic<uint64_t> maxEmitTime{0};
+    std::atomic<uint64_t> lockWaitTime{0};
+} HandlerStats;
+
+// Toggled by picologging.enableStats(), off by default.
+extern std::atomic<bool> g_handlerStatsEnabled;
+
+static inline bool HandlerStats_enabled() {
+    return g_handlerStatsEnabled.load(std::memory_order_relaxed);
+}
+
+static inline uint64_t HandlerStats_now() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
 typedef struct {
     Filterer filterer;
     PyObject *name;
@@ -13,8 +46,21 @@ typedef struct {
     std::recursive_mutex *lock;
     PyObject* _const_emit;
     PyObject* _const_format;
+    HandlerStats* stats;
+    PyObject* weakreflist;
 } Handler;
 
+/**
+ * A weak reference to every live handler of a module, so picologging.stats() can
+ * aggregate them without reviving one that is being deallocated.
+ */
+struct HandlerRegistry {
+    std::mutex mutex;
+    std::unordered_map<Handler*, PyObject*> handlers;
+};
+
+void Handler_freeRegistry(picologging_state* state);
+PyObject* Handler_new(PyTypeObject* type, PyObject* args, PyObject* kwds);
 int Handler_init(Handler *self, PyObject *args, PyObject *kwds);
 PyObject* Handler_dealloc(Handler *self);
 PyObject* Handler_emit(Handler *self, PyObject *record);
@@ -24,9 +70,47 @@ PyObject* Handler_setFormatter(Handler *self, PyObject *formatter);
 PyObject* Handler_format(Handler *self, PyObject *record);
 PyObject* Handler_acquire(Handler *self);
 PyObject* Handler_release(Handler *self);
+PyObject* Handler_stats(Handler *self);
+/**
+ * Check a wrapping handler's target is None or has a handle() method,
+ * raising TypeError otherwise.
+ */
+int Handler_checkTarget(picologging_state* state, PyObject *target);
+PyObject* picologging_stats(PyObject *module, PyObject *Py_UNUSED(ignored));
+PyObject* picologging_enableStats(PyObject *module, PyObject *const *args, Py_ssize_t nargs);
+
+/**
+ * Acquire the handler lock, releasing the GIL while blocked on it. The owner may
+ * have released the GIL itself (e.g. inside stream.write) and needs it back
+ * before it can unlock, so waiting with the GIL held would deadlock.
+ */
+static inline void Handler_lock(Handler *self) {
+    if (!self->lock->try_lock()) {
+        uint64_t start = HandlerStats_enabled() ? HandlerStats_now() : 0;
+        Py_BEGIN_ALLOW_THREADS
+        self->lock->lock();
+        Py_END_ALLOW_THREADS
+        if (start != 0)
+            self->stats->lockWaitTime.fetch_add(HandlerStats_now() - start, std::memory_order_relaxed);
+    }
+}
+
+static inline void Handler_addBytesWritten(Handler *self, uint64_t bytes) {
+    if (HandlerStats_enabled())
+        self->stats->bytesWritten.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+class HandlerLockGuard {
+    Handler* handler;
+public:
+    explicit HandlerLockGuard(Handler* handler) : handler(handler) { Handler_lock(handler); }
+    ~HandlerLockGuard() { handler->lock->unlock(); }
+    HandlerLockGuard(const HandlerLockGuard&) = delete;
+    HandlerLockGuard& operator=(const HandlerLockGuard&) = delete;
+};
 
-extern PyTypeObject HandlerType;
-#define Handler_CheckExact(op) Py_IS_TYPE(op, &HandlerType)
-#define Handler_Check(op) PyObject_TypeCheck(op, &HandlerType)
+extern PyType_Spec HandlerType_spec;
+#define Handler_CheckExact(state, op) Py_IS_TYPE(op, (state)->HandlerType)
+#define Handler_Check(state, op) PyObject_TypeCheck(op, (state)->HandlerType)
 
 #endif // PICOLOGGING_HANDLER_H
@@ -1,16 +1,136 @@
+import gzip
 import os
 import pickle
 import queue
 import re
+import shutil
 import socket
 import struct
 import threading
 import time
 
 import picologging
+from picologging._picologging import (  # NOQA
+    BinaryFileHandler,
+    BufferingHandler,
+    Compressor,
+    ContextBufferingHandler,
+    ContextScope,
+    DeduplicationHandler,
+    FlightRecorderHandler,
+    JournalHandler,
+    MemoryHandler,
+    SharedMemoryCollector,
+    SharedMemoryHandler,
+    SysLogHandler,
+    decodeRecords,
+    encodeRecord,
+)
 
 _MIDNIGHT = 24 * 60 * 60  # number of seconds in a day
 
+_COMPRESSION_SUFFIXES = {"gzip": ".gz", "zstd": ".zst"}
+_compressors = {}
+_compressorsLock = threading.Lock()
+
+
+class _GzipCompressor:
+    """
+    Pure Python stand-in for Compressor, used when the extension was built
+    without zlib.
+    """
+
+    method = "gzip"
+
+    def __init__(self, level):
+        self.level = 6 if level == -1 else level
+        self.lastError = None
+        self._lock = threading.Lock()
+        self._done = threading.Condition(self._lock)
+        self._jobs = None
+        self._pid = None
+        self._pending = {}  # queued or running jobs per source
+
+    @property
+    def pending(self):
+        return self._jobs.unfinished_tasks if self._jobs is not None else 0
+
+    def submit(self, source, dest):
+        with self._lock:
+            # Threads don't survive fork, a child starts its own worker.
+            if self._pid != os.getpid():
+                self._pid = os.getpid()
+                self._jobs = queue.Queue()
+                self._pending = {}
+                threading.Thread(
+                    target=self._run, args=(self._jobs,), daemon=True
+                ).start()
+            source = os.fspath(source)
+            self._pending[source] = self._pending.get(source, 0) + 1
+            self._jobs.put((source, os.fspath(dest)))
+
+    def _run(self, jobs):
+        while True:
+            source, dest = jobs.get()
+            temporary = os.path.join(
+                os.path.dirname(dest), "." + os.path.basename(dest) + ".tmp"
+            )
+            try:
+                with open(source, "rb") as src:
+                    with gzip.open(temporary, "wb", compresslevel=self.level) as dst:
+                        shutil.copyfileobj(src, dst, 128 * 1024)
+                os.replace(temporary, dest)
+                os.remove(source)
+            except OSError as e:
+                self.lastError = "%s: %s" % (source, e.strerror or e)
+                try:
+                    os.remove(temporary)
+                except OSError:
+                    pass
+            finally:
+                with self._done:
+                    if self._pending[source] == 1:
+                        del self._pending[source]
+                    else:
+                        self._pending[source] -= 1
+                    self._done.notify_all()
+                jobs.task_done()
+
+    def wait(self, timeout=None, sources=None):
+        if self._jobs is None:
+            return True
+        if sources is not None:
+            sources = [os.fspath(source) for source in sources]
+            with self._done:
+                return self._done.wait_for(
+                    lambda: not any(source in self._pending for source in sources),
+                    timeout,
+                )
+        with self._jobs.all_tasks_done:
+            return self._jobs.all_tasks_done.wait_for(
+                lambda: not self._jobs.unfinished_tasks, timeout
+            )
+
+
+def _getCompressor(method, level):
+    """
+    Return the compressor shared by all rotating handlers using this method and
+    level, so the number of concurrent compressions stays bounded.
+    """
+    if method not in _COMPRESSION_SUFFIXES:
+        raise ValueError("Unknown compression method: %r" % (method,))
+    with _compressorsLock:
+        compressor = _compressors.get((method, level))
+        if compressor is None:
+            try:
+                compressor = Compressor(method, level)
+            except ValueError:
+                if method != "gzip" or not -1 <= level <= 9:
+                    raise
+                compressor = _GzipCompressor(level)
+            _compressors[(method, level)] = compressor
+        return compressor
+
 
 class WatchedFileHandler(picologging.FileHandler):
     """
@@ -84,10 +204,27 @@ class BaseRotatingHandler(picologging.FileHandler):
     namer = None
     rotator = None
 
-    def __init__(self, filename, mode, encoding=None, delay=False):
+    def __init__(
+        self,
+        filename,
+        mode,
+        encoding=None,
+        delay=False,
+        compress=None,
+        compressLevel=-1,
+    ):
         """
-        Use the specified filename for streamed logging
+        Use the specified filename for streamed logging.
+        If compress is "gzip" or "zstd", rotated files are compressed on a
+        background thread and get a ".gz" or ".zst" suffix.
         """
+        if compress is not None:
+            self.compressor = _getCompressor(compress, compressLevel)
+            self.compressSuffix = _COMPRESSION_SUFFIXES[compress]
+        else:
+            self.compressor = None
+            self.compressSuffix = None
+        self._compressing = set()
         picologging.FileHandler.__init__(
             self, filename, mode=mode, encoding=encoding, delay=delay
         )
@@ -156,6 +293,43 @@ class BaseRotatingHandler(picologging.FileHandler):
         else:
             self.rotator(source, dest)
 
+    def compress(self, filename):
+        """
+        Queue a rotated file for compression, it is replaced by filename plus
+        compressSuffix once the compressed copy is complete.
+        """
+        if self.compressor is not None and os.path.exists(filename):
+            self.compressor.submit(filename, filename + self.compressSuffix)
+            self._compressing.add(filename)
+
+    def waitForCompression(self, timeout=None):
+        """
+        Wait for the files this handler queued to be compressed, returns False
+        if the timeout expired first. Other handlers sharing the compressor
+        are not waited for.
+        """
+        if self.compressor is None:
+            return True
+        done = self.compressor.wait(timeout, self._compressing)
+        if done:
+            self._compressing.clear()
+        return done
+
+    def backupNames(self, filename):
+        """
+        Names a backup can have on disk, before and after compression.
+        """
+        if self.compressor is None:
+            return (filename,)
+        return (filename, filename + self.compressSuffix)
+
+    def close(self):
+        """
+        Wait for rotated files to be compressed, then close the file.
+        """
+        self.waitForCompression()
+        picologging.FileHandler.close(self)
+
 
 class RotatingFileHandler(BaseRotatingHandler):
     """
@@ -164,7 +338,15 @@ class RotatingFileHandler(BaseRotatingHandler):
     """
 
     def __init__(
-        self, filename, mode="a", maxBytes=0, backupCount=0, encoding=None, delay=False
+        self,
+        filename,
+        mode="a",
+        maxBytes=0,
+        backupCount=0,
+        encoding=None,
+        delay=False,
+        compress=None,
+        compressLevel=-1,
     ):
         """
         Open the specified file and use it as the stream for logging.
@@ -182,6 +364,8 @@ class RotatingFileHandler(BaseRotatingHandler):
         exist, then they are renamed to "app.log.2", "app.log.3" etc.
         respectively.
         If maxBytes is zero, rollover never occurs.
+        If compress is "gzip" or "zstd", backups are compressed in the
+        background and named "app.log.1.gz", "app.log.2.gz" etc.
         """
         # If rotation/rollover is wanted, it doesn't make sense to use another
         # mode. If for example 'w' were specified, then if there were multiple
@@ -191,7 +375,13 @@ class RotatingFileHandler(BaseRotatingHandler):
         if maxBytes > 0:
             mode = "a"
         BaseRotatingHandler.__init__(
-            self, filename, mode, encoding=encoding, delay=delay
+            self,
+            filename,
+            mode,
+            encoding=encoding,
+            delay=delay,
+            compress=compress,
+            compressLevel=compressLevel,
         )
         self.maxBytes = maxBytes
         self.backupCount = backupCount
@@ -204,17 +394,24 @@ class RotatingFileHandler(BaseRotatingHandler):
             self.stream.close()
             self.stream = None
         if self.backupCount > 0:
+            # Backups are only shifted once the previous one has been compressed.
+            self.waitForCompression()
             for i in range(self.backupCount - 1, 0, -1):
                 sfn = self.rotation_filename("%s.%d" % (self.baseFilename, i))
                 dfn = self.rotation_filename("%s.%d" % (self.baseFilename, i + 1))
-                if os.path.exists(sfn):
-                    if os.path.exists(dfn):
-                        os.remove(dfn)
-                    os.rename(sfn, dfn)
+                sources = [n for n in self.backupNames(sfn) if os.path.exists(n)]
+                if sources:
+                    for name in self.backupNames(dfn):
+                        if os.path.exists(name):
+                            os.remove(name)
+                    for name in sources:
+                        os.rename(name, dfn + name[len(sfn) :])
             dfn = self.rotation_filename(self.baseFilename + ".1")
-            if os.path.exists(dfn):
-                os.remove(dfn)
+            for name in self.backupNames(dfn):
+                if os.path.exists(name):
+                    os.remove(name)
             self.rotate(self.baseFilename, dfn)
+            self.compress(dfn)
         if not self.delay:
             self.stream = self._open()
 
@@ -255,9 +452,17 @@ class TimedRotatingFileHandler(BaseRotatingHandler):
         delay=False,
         utc=False,
         atTime=None,
+        compress=None,
+        compressLevel=-1,
     ):
         BaseRotatingHandler.__init__(
-            self, filename, "a", encoding=encoding, delay=delay
+            self,
+            filename,
+            "a",
+            encoding=encoding,
+            delay=delay,
+            compress=compress,
+            compressLevel=compressLevel,
         )
         self.when = when.upper()
         self.backupCount = backupCount
@@ -446,6 +651,20 @@ class TimedRotatingFileHandler(BaseRotatingHandler):
                     if self.extMatch.match(part):
                         result.append(os.path.join(dir_name, file_name))
                         break
+        if self.compressor is not None:
+            # A backup briefly exists both with and without the compression
+            # suffix, count it once and delete both names.
+            backups = {}
+            for name in result:
+                if name.endswith(self.compressSuffix):
+                    key = name[: -len(self.compressSuffix)]
+                else:
+                    key = name
+                backups.setdefault(key, []).append(name)
+            if len(backups) < self.backupCount:
+                return []
+            keys = sorted(backups)[: len(backups) - self.backupCount]
+            return [name for key in keys for name in backups[key]]
         if len(result) < self.backupCount:
             result = []
         else:
@@ -482,9 +701,13 @@ class TimedRotatingFileHandler(BaseRotatingHandler):
         dfn = self.rotation_filename(
             self.baseFilename + "." + time.strftime(self.suffix, time_tuple)
         )
-        if os.path.exists(dfn):
-            os.remove(dfn)
+        # Don't delete a backup that is still being compressed.
+        self.waitForCompression()
+        for name in self.backupNames(dfn):
+            if os.path.exists(name):
+                os.remove(name)
         self.rotate(self.baseFilename, dfn)
+        self.compress(dfn)
         if self.backupCount > 0:
             for s in self.getFilesToDelete():
                 os.remove(s)
@@ -695,128 +918,69 @@ class QueueListener:
         self._thread = None
 
 
-class BufferingHandler(picologging.Handler):
-    """
-    A handler class which buffers logging records in memory. Whenever each
-    record is added to the buffer, a check is made to see if the buffer should
-    be flushed. If it should, then flush() is expected to do what's needed.
+class SharedMemoryListener(QueueListener):
     """
+    Merges the records that worker processes write with SharedMemoryHandler
+    and passes them, in timestamp order, to a list of handlers on a
+    background thread.
 
-    def __init__(self, capacity):
-        """
-        Initialize the handler with the buffer size.
-        """
-        picologging.Handler.__init__(self)
-        self.capacity = capacity
-        self.buffer = []
-
-    def emit(self, record):
-        """
-        Emit a record.
-        Append the record and call flush() if criteria is met.
-        """
-        self.buffer.append(record)
-        if len(self.buffer) >= self.capacity:
-            self.flush()
-
-    def flush(self):
-        """
-        Override to implement custom flushing behaviour.
-        This version just zaps the buffer to empty.
-        """
-        self.acquire()
-        try:
-            self.buffer.clear()
-        finally:
-            self.release()
-
-    def close(self):
-        """
-        Close the handler.
-        This version just flushes and chains to the parent class' close().
-        """
-        try:
-            self.flush()
-        finally:
-            picologging.Handler.close(self)
-
-
-class MemoryHandler(BufferingHandler):
-    """
-    A handler class which buffers logging records in memory, periodically
-    flushing them to a target handler. Flushing occurs whenever the buffer
-    is full, or when an event of a certain severity or greater is seen.
+    Create the listener before forking the workers, each worker gets its own
+    ring the first time it logs. Records are copied in the wire format, they
+    are never pickled.
     """
 
     def __init__(
-        self, capacity, flushLevel=picologging.ERROR, target=None, flushOnClose=True
+        self,
+        name,
+        *handlers,
+        respect_handler_level=False,
+        slots=64,
+        size=1024 * 1024,
+        interval=0.05,
     ):
         """
-        Initialize the handler with the buffer size, the level at which
-        flushing should occur and an optional target.
-        Note that without a target being set either here or via setTarget(),
-        a MemoryHandler is no use to anyone!
-        The ``flushOnClose`` argument is ``True`` for backward compatibility
-        reasons - the old behaviour is that when the handler is closed, the
-        buffer is flushed, even if the flush level hasn't been exceeded nor the
-        capacity exceeded. To prevent this, set ``flushOnClose`` to ``False``.
+        Create the shared memory called *name* with room for *slots* worker
+        processes, each with a ring of *size* bytes. The thread polls the
+        rings every *interval* seconds while they are empty.
         """
-        BufferingHandler.__init__(self, capacity)
-        self.flushLevel = flushLevel
-        self.target = target
-        # See Issue #26559 for why this has been added
-        self.flushOnClose = flushOnClose
+        super().__init__(None, *handlers, respect_handler_level=respect_handler_level)
+        self.collector = SharedMemoryCollector(name, slots=slots, size=size)
+        self.interval = interval
+        self._stopping = threading.Event()
 
-    def setTarget(self, target):
+    def collect(self):
         """
-        Set the target handler for this handler.
+        Handle every record the workers published so far, and return how
+        many there were.
         """
-        self.acquire()
-        try:
-            self.target = target
-        finally:
-            self.release()
+        records = self.collector.collect()
+        for record in records:
+            self.handle(record)
+        return len(records)
 
-    def flush(self):
-        """
-        For a MemoryHandler, flushing means just sending the buffered
-        records to the target, if there is one. Override if you want
-        different behaviour.
-        The record buffer is also cleared by this operation.
-        """
-        self.acquire()
-        try:
-            if self.target:
-                for record in self.buffer:
-                    self.target.handle(record)
-                self.buffer.clear()
-        finally:
-            self.release()
+    def start(self):
+        self._stopping.clear()
+        super().start()
 
-    def close(self):
+    def _monitor(self):
+        while not self._stopping.is_set():
+            if not self.collect():
+                self._stopping.wait(self.interval)
+        self.collect()
+
+    def stop(self):
         """
-        Flush, if appropriately configured, set the target to None and lose the
-        buffer.
+        Stop the listener, handling the records that are still in the rings.
         """
-        try:
-            if self.flushOnClose:
-                self.flush()
-        finally:
-            self.acquire()
-            try:
-                self.target = None
-                BufferingHandler.close(self)
-            finally:
-                self.release()
+        self._stopping.set()
+        self._thread.join()
+        self._thread = None
 
-    def emit(self, record):
+    def close(self):
         """
-        Emit a record.
-        Append the record and call flush() if criteria is met.
+        Remove the shared memory, workers can no longer attach to it.
         """
-        self.buffer.append(record)
-        if (len(self.buffer) >= self.capacity) or (record.levelno >= self.flushLevel):
-            self.flush()
+        self.collector.close()
 
 
 class SocketHandler(picologging.Handler):
@@ -979,6 +1143,82 @@ class SocketHandler(picologging.Handler):
             self.release()
 
 
+class BinarySocketHandler(SocketHandler):
+    """
+    A handler class which writes logging records to a streaming socket in
+    picologging's binary wire format, batching several records per send.
+    Each record is a length-prefixed frame holding the formatted message and
+    the record attributes, use decodeRecords at the receiving end to turn
+    the received bytes back into LogRecords.
+    """
+
+    def __init__(self, host, port, batchSize=65536, flushInterval=0.5):
+        """
+        Initializes the handler with a specific host address and port.
+        Buffered records are sent once they reach *batchSize* bytes, or
+        *flushInterval* seconds after the first of them was emitted. A
+        *flushInterval* of None only sends on size, flush and close.
+        """
+        SocketHandler.__init__(self, host, port)
+        self.batchSize = batchSize
+        self.flushInterval = flushInterval
+        self.batch = bytearray()
+        self._timer = None
+        # Separate from the handler lock so the timer thread waits on the
+        # batch without holding the GIL.
+        self._batchLock = threading.Lock()
+
+    def makePickle(self, record):
+        """
+        Encodes the record as a single frame, ready for transmission across
+        the socket.
+        """
+        frame = bytearray()
+        encodeRecord(record, frame)
+        return bytes(frame)
+
+    def emit(self, record):
+        """
+        Emit a record.
+        Appends the encoded record to the batch, sending the batch when it
+        reaches batchSize. If there is an error with the socket, the batch
+        is dropped.
+        """
+        try:
+            with self._batchLock:
+                if encodeRecord(record, self.batch) >= self.batchSize:
+                    self._sendBatch()
+                elif self._timer is None and self.flushInterval is not None:
+                    self._timer = threading.Timer(self.flushInterval, self.flush)
+                    self._timer.daemon = True
+                    self._timer.start()
+        except Exception:
+            self.handleError(record)
+
+    def _sendBatch(self):
+        if self._timer is not None:
+            self._timer.cancel()
+            self._timer = None
+        if self.batch:
+            data = bytes(self.batch)
+            self.batch.clear()
+            self.send(data)
+
+    def flush(self):
+        """
+        Sends any buffered records.
+        """
+        with self._batchLock:
+            self._sendBatch()
+
+    def close(self):
+        """
+        Sends any buffered records and closes the socket.
+        """
+        self.flush()
+        SocketHandler.close(self)
+
+
 class DatagramHandler(SocketHandler):
     """
     A handler class which writes logging records, in pickle format, to
@@ -1,7 +1,8 @@
+from contextvars import ContextVar
 from datetime import datetime
 from queue import Queue, SimpleQueue
-from socket import socket
-from typing import Any, Callable, Pattern
+from socket import SocketKind, socket
+from typing import Any, Callable, Iterable, Pattern
 
 from _typeshed import StrPath
 
@@ -22,19 +23,46 @@ class WatchedFileHandler(FileHandler):
         errors: str | None = ...,
     ) -> None: ...
 
+class Compressor:
+    method: str
+    level: int
+    maxWorkers: int
+    pending: int
+    completed: int
+    lastError: str | None
+    def __init__(
+        self,
+        method: str = ...,
+        level: int = ...,
+        maxWorkers: int = ...,
+        lowPriority: bool = ...,
+    ) -> None: ...
+    def submit(self, source: StrPath, dest: StrPath) -> None: ...
+    def wait(
+        self, timeout: float | None = ..., sources: Iterable[StrPath] | None = ...
+    ) -> bool: ...
+    def close(self) -> None: ...
+
 class BaseRotatingHandler(FileHandler):
     namer: Callable[[str], str] | None
     rotator: Callable[[str, str], None] | None
+    compressor: Compressor | None
+    compressSuffix: str | None
     def __init__(
         self,
         filename: StrPath,
         mode: str,
         encoding: str | None = ...,
         delay: bool = ...,
+        compress: str | None = ...,
+        compressLevel: int = ...,
         errors: str | None = ...,
     ) -> None: ...
     def rotation_filename(self, default_name: str) -> str: ...
     def rotate(self, source: str, dest: str) -> None: ...
+    def compress(self, filename: str) -> None: ...
+    def waitForCompression(self, timeout: float | None = ...) -> bool: ...
+    def backupNames(self, filename: str) -> tuple[str, ...]: ...
 
 class RotatingFileHandler(BaseRotatingHandler):
     maxBytes: str  # undocumented
@@ -47,6 +75,8 @@ class RotatingFileHandler(BaseRotatingHandler):
         backupCount: int = ...,
         encoding: str | None = ...,
         delay: bool = ...,
+        compress: str | None = ...,
+        compressLevel: int = ...,
         errors: str | None = ...,
     ) -> None: ...
     def doRollover(self) -> None: ...
@@ -72,6 +102,8 @@ class TimedRotatingFileHandler(BaseRotatingHandler):
         delay: bool = ...,
         utc: bool = ...,
         atTime: datetime.time | None = ...,
+        compress: str | None = ...,
+        compressLevel: int = ...,
         errors: str | None = ...,
     ) -> None: ...
     def doRollover(self) -> None: ...
@@ -100,10 +132,27 @@ class QueueListener:
     def enqueue_sentinel(self) -> None: ...
     def handle(self, record: LogRecord) -> None: ...
 
+class SharedMemoryListener(QueueListener):
+    collector: SharedMemoryCollector
+    interval: float
+    def __init__(
+        self,
+        name: str,
+        *handlers: Handler,
+        respect_handler_level: bool = ...,
+        slots: int = ...,
+        size: int = ...,
+        interval: float = ...
+    ) -> None: ...
+    def collect(self) -> int: ...
+    def close(self) -> None: ...
+
 class BufferingHandler(Handler):
     capacity: int  # undocumented
+    maxBytes: int
     buffer: list[LogRecord]  # undocumented
-    def __init__(self, capacity: int) -> None: ...
+    def __init__(self, capacity: int, maxBytes: int = ...) -> None: ...
+    def shouldFlush(self, record: LogRecord) -> bool: ...
 
 class MemoryHandler(BufferingHandler):
     flushLevel: int  # undocumented
@@ -115,6 +164,7 @@ class MemoryHandler(BufferingHandler):
         flushLevel: int = ...,
         target: Handler | None = ...,
         flushOnClose: bool = ...,
+        maxBytes: int = ...,
     ) -> None: ...
     def setTarget(self, target: Handler | None) -> None: ...
 
@@ -134,5 +184,164 @@ class SocketHandler(Handler):
     def send(self, s: bytes) -> None: ...
     def createSocket(self) -> None: ...
 
+class BinarySocketHandler(SocketHandler):
+    batchSize: int
+    flushInterval: float | None
+    batch: bytearray
+    def __init__(
+        self,
+        host: str,
+        port: int | None,
+        batchSize: int = ...,
+        flushInterval: float | None = ...,
+    ) -> None: ...
+
+def encodeRecord(record: LogRecord, buffer: bytearray) -> int: ...
+def decodeRecords(
+    data: bytes | bytearray | memoryview,
+) -> tuple[list[LogRecord], int]: ...
+
 class DatagramHandler(SocketHandler):
     def makeSocket(self) -> socket: ...
+
+class SysLogHandler(Handler):
+    LOG_EMERG: int
+    LOG_ALERT: int
+    LOG_CRIT: int
+    LOG_ERR: int
+    LOG_WARNING: int
+    LOG_NOTICE: int
+    LOG_INFO: int
+    LOG_DEBUG: int
+
+    LOG_KERN: int
+    LOG_USER: int
+    LOG_MAIL: int
+    LOG_DAEMON: int
+    LOG_AUTH: int
+    LOG_SYSLOG: int
+    LOG_LPR: int
+    LOG_NEWS: int
+    LOG_UUCP: int
+    LOG_CRON: int
+    LOG_AUTHPRIV: int
+    LOG_FTP: int
+    LOG_NTP: int
+    LOG_SECURITY: int
+    LOG_CONSOLE: int
+    LOG_SOLCRON: int
+    LOG_LOCAL0: int
+    LOG_LOCAL1: int
+    LOG_LOCAL2: int
+    LOG_LOCAL3: int
+    LOG_LOCAL4: int
+    LOG_LOCAL5: int
+    LOG_LOCAL6: int
+    LOG_LOCAL7: int
+
+    address: tuple[str, int] | str
+    socket: socket | None
+    socktype: SocketKind | None
+    facility: int
+    rfc5424: bool
+    hostname: str | None
+    appname: str | None
+    ident: str
+    append_nul: bool
+    batchSize: int
+    flushInterval: float | None
+    flushLevel: int
+    def __init__(
+        self,
+        address: tuple[str, int] | str = ...,
+        facility: str | int = ...,
+        socktype: SocketKind | None = ...,
+        rfc5424: bool = ...,
+        hostname: str | None = ...,
+        appname: str | None = ...,
+        batchSize: int = ...,
+        flushInterval: float | None = ...,
+        flushLevel: int = ...,
+    ) -> None: ...
+
+class JournalHandler(Handler):
+    path: str
+    def __init__(
+        self,
+        path: StrPath = ...,
+        identifier: str | None = ...,
+        fields: dict[str, Any] | None = ...,
+    ) -> None: ...
+
+class DeduplicationHandler(Handler):
+    target: Handler | None
+    window: float
+    def __init__(
+        self,
+        target: Handler | None = ...,
+        window: float = ...,
+        capacity: int = ...,
+    ) -> None: ...
+    def setTarget(self, target: Handler | None) -> None: ...
+
+class BinaryFileHandler(Handler):
+    baseFilename: str
+    mode: str
+    def __init__(
+        self,
+        filename: StrPath,
+        mode: str = ...,
+        buffer_size: int = ...,
+    ) -> None: ...
+
+class FlightRecorderHandler(Handler):
+    baseFilename: str
+    capacity: int
+    cursor: int | None
+    wraps: int | None
+    def __init__(self, filename: StrPath, size: int = ...) -> None: ...
+
+class SharedMemoryHandler(Handler):
+    memoryName: str
+    slot: int | None
+    dropped: int
+    def __init__(self, name: str) -> None: ...
+
+class SharedMemoryCollector:
+    name: str
+    slots: int | None
+    size: int | None
+    workers: list[int]
+    dropped: int
+    def __init__(self, name: str, slots: int = ..., size: int = ...) -> None: ...
+    def collect(self) -> list[LogRecord]: ...
+    def close(self) -> None: ...
+
+class ContextScope:
+    buffer: list[LogRecord]
+    def __enter__(self) -> ContextScope: ...
+    def __exit__(self, *exc_info: Any) -> bool: ...
+    def flush(self) -> None: ...
+    def discard(self) -> None: ...
+
+class ContextBufferingHandler(Handler):
+    target: Handler | None
+    flushLevel: int
+    passLevel: int
+    capacity: int
+    maxBytes: int
+    contextvar: ContextVar[Any]
+    bufferedBytes: int
+    def __init__(
+        self,
+        target: Handler | None = ...,
+        flushLevel: int = ...,
+        passLevel: int | None = ...,
+        capacity: int = ...,
+        maxBytes: int = ...,
+        contextvar: ContextVar[Any] | None = ...,
+    ) -> None: ...
+    def scope(self) -> ContextScope: ...
+    def discard(self, key: Any) -> None: ...
+    def flushContext(self) -> None: ...
+    def setTarget(self, target: Handler | None) -> None: ...
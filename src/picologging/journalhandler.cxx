@@ -0,0 +1,421 @@
+#include <cstring>
+#include <mutex>
+
+#ifdef __linux__
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include "journalhandler.hxx"
+#include "handler.hxx"
+#include "logrecord.hxx"
+#include "compat.hxx"
+#include "picologging.hxx"
+
+#ifdef __linux__
+// Older glibc headers predate memfd_create and file sealing.
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC 0x0001U
+#define MFD_ALLOW_SEALING 0x0002U
+#endif
+#ifndef F_ADD_SEALS
+#define F_ADD_SEALS 1033
+#define F_SEAL_SEAL 0x0001
+#define F_SEAL_SHRINK 0x0002
+#define F_SEAL_GROW 0x0004
+#define F_SEAL_WRITE 0x0008
+#endif
+#endif
+
+// LogRecord attributes that are not passed on as extra fields.
+static const char* recordAttributes[] = {
+    "name", "msg", "args", "levelno", "levelname", "pathname", "filename",
+    "module", "lineno", "funcName", "created", "msecs", "relativeCreated",
+    "thread", "threadName", "processName", "process", "exc_info", "exc_text",
+    "stack_info", "message", "asctime", "taskName",
+};
+
+static bool isRecordAttribute(const char* name) {
+    for (auto attribute : recordAttributes) {
+        if (strcmp(attribute, name) == 0)
+            return true;
+    }
+    return false;
+}
+
+static inline int journalPriority(int levelno) {
+    if (levelno >= LOG_LEVEL_CRITICAL)
+        return 2;
+    if (levelno >= LOG_LEVEL_ERROR)
+        return 3;
+    if (levelno >= LOG_LEVEL_WARNING)
+        return 4;
+    if (levelno >= LOG_LEVEL_INFO)
+        return 6;
+    return 7;
+}
+
+/**
+ * Turn an attribute name into a journal field name: upper case letters,
+ * digits and underscores, not starting with a digit or underscore (fields
+ * starting with an underscore are reserved for journald). Returns false if
+ * nothing usable is left.
+ */
+static bool fieldName(const char* name, std::string& field) {
+    field.clear();
+    for (const char* c = name; *c != '\0' && field.size() < JOURNAL_MAX_FIELD_NAME; c++) {
+        if (*c >= 'a' && *c <= 'z')
+            field.push_back(*c - 'a' + 'A');
+        else if ((*c >= 'A' && *c <= 'Z') || (*c >= '0' && *c <= '9'))
+            field.push_back(*c);
+        else
+            field.push_back('_');
+    }
+    return !field.empty() && field[0] >= 'A' && field[0] <= 'Z';
+}
+
+/**
+ * Append a field in the native journal protocol. Values holding a newline
+ * are written as the name, a newline, the little-endian 64-bit length and
+ * the raw value.
+ */
+static void putField(std::string& buffer, const std::string& name, const char* value, size_t size) {
+    buffer += name;
+    if (memchr(value, '\n', size) == nullptr) {
+        buffer.push_back('=');
+    } else {
+        buffer.push_back('\n');
+        uint64_t length = size;
+        for (int i = 0; i < 8; i++)
+            buffer.push_back((char)((length >> (8 * i)) & 0xff));
+    }
+    buffer.append(value, size);
+    buffer.push_back('\n');
+}
+
+static int putObjectField(std::string& buffer, const std::string& name, PyObject* value) {
+    PyObject* str = PyUnicode_Check(value) ? Py_NewRef(value) : PyObject_Str(value);
+    if (str == nullptr)
+        return -1;
+    Py_ssize_t size;
+    const char* data = PyUnicode_AsUTF8AndSize(str, &size);
+    if (data != nullptr) {
+        putField(buffer, name, data, size);
+        Py_DECREF(str);
+        return 0;
+    }
+    PyErr_Clear();
+    PyObject* encoded = PyUnicode_AsEncodedString(str, "utf-8", "backslashreplace");
+    Py_DECREF(str);
+    if (encoded == nullptr)
+        return -1;
+    putField(buffer, name, PyBytes_AS_STRING(encoded), PyBytes_GET_SIZE(encoded));
+    Py_DECREF(encoded);
+    return 0;
+}
+
+static int putFieldsFrom(std::string& buffer, PyObject* mapping, bool skipRecordAttributes) {
+    PyObject *key, *value;
+    Py_ssize_t pos = 0;
+    std::string name;
+    while (PyDict_Next(mapping, &pos, &key, &value)) {
+        if (!PyUnicode_Check(key))
+            continue;
+        const char* attribute = PyUnicode_AsUTF8(key);
+        if (attribute == nullptr)
+            return -1;
+        if (skipRecordAttributes && isRecordAttribute(attribute))
+            continue;
+        if (!fieldName(attribute, name) || value == Py_None)
+            continue;
+        if (putObjectField(buffer, name, value) < 0)
+            return -1;
+    }
+    return 0;
+}
+
+#ifdef __linux__
+/**
+ * Entries larger than a datagram are written to a sealed memfd, and the
+ * descriptor is passed to journald instead. Called without the GIL.
+ */
+static int sendMemfd(JournalHandler* self, const struct sockaddr_un* address, socklen_t addressSize) {
+#ifdef SYS_memfd_create
+    int memfd = (int)syscall(SYS_memfd_create, "picologging-journal", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (memfd < 0)
+        return -1;
+    const char* data = self->buffer->data();
+    size_t remaining = self->buffer->size();
+    while (remaining > 0) {
+        ssize_t written = write(memfd, data, remaining);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            close(memfd);
+            return -1;
+        }
+        data += written;
+        remaining -= written;
+    }
+    if (fcntl(memfd, F_ADD_SEALS, F_SEAL_SEAL | F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE) < 0) {
+        close(memfd);
+        return -1;
+    }
+    union {
+        struct cmsghdr header;
+        char space[CMSG_SPACE(sizeof(int))];
+    } control;
+    memset(&control, 0, sizeof(control));
+    struct msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_name = (void*)address;
+    message.msg_namelen = addressSize;
+    message.msg_control = &control;
+    message.msg_controllen = sizeof(control);
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&message);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &memfd, sizeof(int));
+    ssize_t sent;
+    do {
+        sent = sendmsg(self->fd, &message, MSG_NOSIGNAL);
+    } while (sent < 0 && errno == EINTR);
+    int error = errno;
+    close(memfd);
+    errno = error;
+    return sent < 0 ? -1 : 0;
+#else
+    errno = EMSGSIZE;
+    return -1;
+#endif
+}
+
+static int sendEntry(JournalHandler* self) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    memcpy(address.sun_path, PyBytes_AS_STRING(self->path), PyBytes_GET_SIZE(self->path));
+    socklen_t addressSize = (socklen_t)(offsetof(struct sockaddr_un, sun_path) + PyBytes_GET_SIZE(self->path) + 1);
+
+    // journald may be slow to drain its socket, don't stall other threads meanwhile.
+    // The entry buffer is guarded by the handler lock.
+    ssize_t sent;
+    int error = 0;
+    Py_BEGIN_ALLOW_THREADS
+    do {
+        sent = sendto(self->fd, self->buffer->data(), self->buffer->size(), MSG_NOSIGNAL,
+            (struct sockaddr*)&address, addressSize);
+    } while (sent < 0 && errno == EINTR);
+    if (sent < 0 && (errno == EMSGSIZE || errno == ENOBUFS))
+        sent = sendMemfd(self, &address, addressSize);
+    if (sent < 0)
+        error = errno;
+    Py_END_ALLOW_THREADS
+    if (sent < 0) {
+        errno = error;
+        PyErr_SetFromErrnoWithFilenameObject(PyExc_OSError, self->path);
+        return -1;
+    }
+    Handler_addBytesWritten(&self->handler, self->buffer->size());
+    return 0;
+}
+#endif
+
+PyObject* JournalHandler_new(PyTypeObject* type, PyObject* args, PyObject* kwds)
+{
+    JournalHandler* self = (JournalHandler*)Handler_new(type, args, kwds);
+    if (self != NULL)
+    {
+        self->path = Py_NewRef(Py_None);
+        self->fd = -1;
+        self->defaultFields = new std::string();
+        self->buffer = new std::string();
+    }
+    return (PyObject*)self;
+}
+
+int JournalHandler_init(JournalHandler *self, PyObject *args, PyObject *kwds){
+    PyObject* noArgs = PyTuple_New(0);
+    int ret = Handler_init((Handler*)self, noArgs, nullptr);
+    Py_DECREF(noArgs);
+    if (ret < 0)
+        return -1;
+    PyObject *path = nullptr;
+    PyObject *identifier = Py_None;
+    PyObject *fields = Py_None;
+    static const char *kwlist[] = {"path", "identifier", "fields", NULL};
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|OOO", const_cast<char**>(kwlist), &path, &identifier, &fields)){
+        return -1;
+    }
+#ifdef __linux__
+    PyObject* encodedPath = nullptr;
+    if (path == nullptr) {
+        encodedPath = PyBytes_FromString(JOURNAL_SOCKET_PATH);
+        if (encodedPath == nullptr)
+            return -1;
+    } else if (!PyUnicode_FSConverter(path, &encodedPath)) {
+        return -1;
+    }
+    if ((size_t)PyBytes_GET_SIZE(encodedPath) >= sizeof(((struct sockaddr_un*)nullptr)->sun_path)) {
+        PyErr_Format(PyExc_ValueError, "socket path is too long: %R", encodedPath);
+        Py_DECREF(encodedPath);
+        return -1;
+    }
+    Py_SETREF(self->path, encodedPath);
+
+    self->defaultFields->clear();
+    if (identifier != Py_None && putObjectField(*self->defaultFields, "SYSLOG_IDENTIFIER", identifier) < 0)
+        return -1;
+    if (fields != Py_None) {
+        if (!PyDict_Check(fields)) {
+            PyErr_SetString(PyExc_TypeError, "fields must be a dict");
+            return -1;
+        }
+        if (putFieldsFrom(*self->defaultFields, fields, false) < 0)
+            return -1;
+    }
+
+    if (self->fd < 0) {
+        self->fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+        if (self->fd < 0) {
+            PyErr_SetFromErrno(PyExc_OSError);
+            return -1;
+        }
+    }
+    return 0;
+#else
+    PyErr_SetString(PyExc_NotImplementedError, "JournalHandler is only available on Linux");
+    return -1;
+#endif
+}
+
+PyObject* JournalHandler_dealloc(JournalHandler *self) {
+#ifdef __linux__
+    if (self->fd >= 0)
+        close(self->fd);
+#endif
+    Py_CLEAR(self->path);
+    delete self->defaultFields;
+    delete self->buffer;
+    Handler_dealloc((Handler*)self);
+    return nullptr;
+}
+
+PyObject* JournalHandler_emit(JournalHandler* self, PyObject* record){
+#ifdef __linux__
+    if (self->fd < 0) {
+        PyErr_SetString(PyExc_ValueError, "I/O operation on closed socket");
+        return nullptr;
+    }
+    PyObject* msg = Handler_format(&self->handler, record);
+    if (msg == nullptr)
+        return nullptr;
+    std::string& buffer = *self->buffer;
+    buffer.clear();
+    int ret = putObjectField(buffer, "MESSAGE", msg);
+    Py_DECREF(msg);
+    if (ret < 0)
+        return nullptr;
+
+    if (LogRecord_Check(GET_PICOLOGGING_STATE(self), record)) {
+        LogRecord* logRecord = (LogRecord*)record;
+        buffer += "PRIORITY=";
+        buffer.push_back((char)('0' + journalPriority(logRecord->levelno)));
+        buffer += "\nCODE_LINE=";
+        buffer += std::to_string(logRecord->lineno);
+        buffer.push_back('\n');
+        if (putObjectField(buffer, "LOGGER", logRecord->name) < 0 ||
+            putObjectField(buffer, "CODE_FILE", logRecord->pathname) < 0 ||
+            (logRecord->funcName != Py_None && putObjectField(buffer, "CODE_FUNC", logRecord->funcName) < 0) ||
+            (logRecord->threadName != Py_None && putObjectField(buffer, "THREAD_NAME", logRecord->threadName) < 0) ||
+            (logRecord->processName != Py_None && putObjectField(buffer, "PROCESS_NAME", logRecord->processName) < 0))
+            return nullptr;
+        // Attributes added through `extra` or setattr live in the instance dict.
+        if (logRecord->dict != nullptr && putFieldsFrom(buffer, logRecord->dict, true) < 0)
+            return nullptr;
+    } else {
+        // Records from other logging implementations only get a message and priority.
+        PyObject* levelno = PyObject_GetAttrString(record, "levelno");
+        if (levelno == nullptr)
+            return nullptr;
+        long value = PyLong_AsLong(levelno);
+        Py_DECREF(levelno);
+        if (value == -1 && PyErr_Occurred())
+            return nullptr;
+        buffer += "PRIORITY=";
+        buffer.push_back((char)('0' + journalPriority((int)value)));
+        buffer.push_back('\n');
+    }
+    buffer += *self->defaultFields;
+
+    if (sendEntry(self) < 0)
+        return nullptr;
+    Py_RETURN_NONE;
+#else
+    PyErr_SetString(PyExc_NotImplementedError, "JournalHandler is only available on Linux");
+    return nullptr;
+#endif
+}
+
+PyObject* JournalHandler_close(JournalHandler* self){
+    HandlerLockGuard guard(&self->handler);
+#ifdef __linux__
+    if (self->fd >= 0) {
+        close(self->fd);
+        self->fd = -1;
+    }
+#endif
+    Py_RETURN_NONE;
+}
+
+PyObject* JournalHandler_getPath(JournalHandler* self, void* closure){
+    if (self->path == Py_None)
+        Py_RETURN_NONE;
+    return PyUnicode_DecodeFSDefaultAndSize(PyBytes_AS_STRING(self->path), PyBytes_GET_SIZE(self->path));
+}
+
+PyObject* JournalHandler_repr(JournalHandler *self)
+{
+    std::string level = _getLevelName(self->handler.level);
+    return PyUnicode_FromFormat("<%s %R (%s)>",
+        _PyType_Name(Py_TYPE(self)),
+        self->path,
+        level.c_str());
+}
+
+static PyMethodDef JournalHandler_methods[] = {
+    {"emit", (PyCFunction)JournalHandler_emit, METH_O, "Send a record to the journal."},
+    {"close", (PyCFunction)JournalHandler_close, METH_NOARGS, "Close the socket."},
+    {NULL}
+};
+
+static PyGetSetDef JournalHandler_getset[] = {
+    {"path", (getter)JournalHandler_getPath, nullptr, "Path of the journal socket"},
+    {NULL}
+};
+
+static PyType_Slot JournalHandler_slots[] = {
+    {Py_tp_dealloc, (void*)JournalHandler_dealloc},
+    {Py_tp_repr, (void*)JournalHandler_repr},
+    {Py_tp_doc, (void*)PyDoc_STR("Handler which sends records with structured fields to the systemd journal.")},
+    {Py_tp_methods, JournalHandler_methods},
+    {Py_tp_getset, JournalHandler_getset},
+    {Py_tp_init, (void*)JournalHandler_init},
+    {Py_tp_new, (void*)JournalHandler_new},
+    {Py_tp_free, (void*)PyObject_Del},
+    {0, NULL}
+};
+
+PyType_Spec JournalHandlerType_spec = {
+    "picologging.handlers.JournalHandler",
+    sizeof(JournalHandler),
+    0,
+    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE | Py_TPFLAGS_IMMUTABLETYPE,
+    JournalHandler_slots,
+};
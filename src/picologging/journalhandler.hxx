@@ -0,0 +1,25 @@
+#include <Python.h>
+#include <string>
+#include "handler.hxx"
+
+#ifndef PICOLOGGING_JOURNALHANDLER_H
+#define PICOLOGGING_JOURNALHANDLER_H
+
+#define JOURNAL_SOCKET_PATH "/run/systemd/journal/socket"
+// journald rejects field names longer than this.
+#define JOURNAL_MAX_FIELD_NAME 64
+
+typedef struct {
+    Handler handler;
+    PyObject* path;
+    int fd;
+    std::string* defaultFields; // Serialized SYSLOG_IDENTIFIER and user supplied fields
+    std::string* buffer;        // Reused for every entry, guarded by the handler lock
+} JournalHandler;
+
+PyObject* JournalHandler_emit(JournalHandler* self, PyObject* record);
+
+extern PyType_Spec JournalHandlerType_spec;
+#define JournalHandler_CheckExact(state, op) Py_IS_TYPE(op, (state)->JournalHandlerType)
+
+#endif // PICOLOGGING_JOURNALHANDLER_H
@@ -0,0 +1,124 @@
+#include "lazy.hxx"
+#include "compat.hxx"
+
+static Lazy* Lazy_alloc(PyTypeObject* type, PyObject* func) {
+    if (!PyCallable_Check(func)) {
+        PyErr_SetString(PyExc_TypeError, "lazy() argument must be callable");
+        return nullptr;
+    }
+    Lazy* self = (Lazy*)type->tp_alloc(type, 0);
+    if (self == nullptr)
+        return nullptr;
+    self->func = Py_NewRef(func);
+    return self;
+}
+
+PyObject* Lazy_new(PyTypeObject* type, PyObject* args, PyObject* kwds)
+{
+    if (PyTuple_GET_SIZE(args) < 1) {
+        PyErr_SetString(PyExc_TypeError, "lazy() requires a callable");
+        return nullptr;
+    }
+    Lazy* self = Lazy_alloc(type, PyTuple_GET_ITEM(args, 0));
+    if (self == nullptr)
+        return nullptr;
+    self->args = PyTuple_GetSlice(args, 1, PyTuple_GET_SIZE(args));
+    self->kwargs = kwds != nullptr && PyDict_GET_SIZE(kwds) > 0 ? PyDict_Copy(kwds) : nullptr;
+    if (self->args == nullptr || (kwds != nullptr && PyDict_GET_SIZE(kwds) > 0 && self->kwargs == nullptr)) {
+        Py_DECREF(self);
+        return nullptr;
+    }
+    return (PyObject*)self;
+}
+
+#if PY_VERSION_HEX >= 0x03090000
+/**
+ * lazy(...) is created for every logging call, including the ones below
+ * the logger's level, so it is built without the tuple/dict of tp_new.
+ */
+PyObject* Lazy_vectorcall(PyObject* type, PyObject* const* args, size_t nargsf, PyObject* kwnames)
+{
+    Py_ssize_t nargs = PyVectorcall_NARGS(nargsf);
+    if (nargs < 1) {
+        PyErr_SetString(PyExc_TypeError, "lazy() requires a callable");
+        return nullptr;
+    }
+    Lazy* self = Lazy_alloc((PyTypeObject*)type, args[0]);
+    if (self == nullptr)
+        return nullptr;
+    self->args = PyTuple_New(nargs - 1);
+    if (self->args == nullptr) {
+        Py_DECREF(self);
+        return nullptr;
+    }
+    for (Py_ssize_t i = 1; i < nargs; i++)
+        PyTuple_SET_ITEM(self->args, i - 1, Py_NewRef(args[i]));
+    if (kwnames != nullptr && PyTuple_GET_SIZE(kwnames) > 0) {
+        self->kwargs = PyDict_New();
+        if (self->kwargs == nullptr) {
+            Py_DECREF(self);
+            return nullptr;
+        }
+        for (Py_ssize_t i = 0; i < PyTuple_GET_SIZE(kwnames); i++) {
+            if (PyDict_SetItem(self->kwargs, PyTuple_GET_ITEM(kwnames, i), args[nargs + i]) < 0) {
+                Py_DECREF(self);
+                return nullptr;
+            }
+        }
+    }
+    return (PyObject*)self;
+}
+#endif
+
+PyObject* Lazy_dealloc(Lazy *self) {
+    Py_CLEAR(self->func);
+    Py_CLEAR(self->args);
+    Py_CLEAR(self->kwargs);
+    PyTypeObject* type = Py_TYPE(self);
+    type->tp_free((PyObject*)self);
+    Py_DECREF_HEAPTYPE(type);
+    return nullptr;
+}
+
+PyObject* Lazy_evaluate(Lazy *self) {
+    return PyObject_Call(self->func, self->args, self->kwargs);
+}
+
+// Only reached when the value is formatted outside of LogRecord, e.g. nested in a list argument.
+PyObject* Lazy_str(Lazy *self) {
+    PyObject* value = Lazy_evaluate(self);
+    if (value == nullptr)
+        return nullptr;
+    PyObject* str = PyObject_Str(value);
+    Py_DECREF(value);
+    return str;
+}
+
+PyObject* Lazy_repr(Lazy *self) {
+    return PyUnicode_FromFormat("<lazy %R>", self->func);
+}
+
+static PyMemberDef Lazy_members[] = {
+    {"func", T_OBJECT_EX, offsetof(Lazy, func), READONLY, "Callable computing the value"},
+    {"args", T_OBJECT_EX, offsetof(Lazy, args), READONLY, "Positional arguments for func"},
+    {NULL}
+};
+
+static PyType_Slot Lazy_slots[] = {
+    {Py_tp_dealloc, (void*)Lazy_dealloc},
+    {Py_tp_repr, (void*)Lazy_repr},
+    {Py_tp_str, (void*)Lazy_str},
+    {Py_tp_doc, (void*)PyDoc_STR("lazy(func, /, *args, **kwargs)\n\nA log argument computed by func(*args, **kwargs) only when the message is rendered.")},
+    {Py_tp_members, Lazy_members},
+    {Py_tp_new, (void*)Lazy_new},
+    {Py_tp_free, (void*)PyObject_Del},
+    {0, NULL}
+};
+
+PyType_Spec LazyType_spec = {
+    "picologging.lazy",
+    sizeof(Lazy),
+    0,
+    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_IMMUTABLETYPE,
+    Lazy_slots,
+};
@@ -0,0 +1,27 @@
+#include <Python.h>
+#include <structmember.h>
+#include "compat.hxx"
+
+#ifndef PICOLOGGING_LAZY_H
+#define PICOLOGGING_LAZY_H
+
+/**
+ * A log argument that is only computed when the message is rendered,
+ * func(*args, **kwargs) is called in place of the argument.
+ */
+typedef struct {
+    PyObject_HEAD
+    PyObject *func;
+    PyObject *args;
+    PyObject *kwargs;
+} Lazy;
+
+PyObject* Lazy_evaluate(Lazy *self);
+#if PY_VERSION_HEX >= 0x03090000
+PyObject* Lazy_vectorcall(PyObject* type, PyObject* const* args, size_t nargsf, PyObject* kwnames);
+#endif
+
+extern PyType_Spec LazyType_spec;
+#define Lazy_CheckExact(state, op) Py_IS_TYPE(op, (state)->LazyType)
+
+#endif // PICOLOGGING_LAZY_H
@@ -5,11 +5,17 @@
 #include "picologging.hxx"
 #include "filterer.hxx"
 #include "handler.hxx"
+#include "tracebackformat.hxx"
+#include <mutex>
+
+// Serializes level changes, which walk and update a whole subtree of loggers.
+// Logging calls only read the atomic flags and never take it.
+static std::mutex g_levelsMutex;
 
 int findEffectiveLevelFromParents(Logger* self) {
     PyObject* logger = (PyObject*)self;
     while (logger != Py_None) {
-        if (!Logger_CheckExact(logger)) {
+        if (!Logger_Check(GET_PICOLOGGING_STATE(self), logger)) {
             PyErr_SetString(PyExc_TypeError, "logger is not a picologging.Logger");
             return -1;
         }
@@ -23,30 +29,33 @@ int findEffectiveLevelFromParents(Logger* self) {
 }
 
 void setEnabledBasedOnEffectiveLevel(Logger* logger) {
-    logger->enabledForDebug = false;
-    logger->enabledForInfo = false;
-    logger->enabledForWarning = false;
-    logger->enabledForError = false;
-    logger->enabledForCritical = false;
-    switch (logger->effective_level){
+    bool debug = false, info = false, warning = false, error = false, critical = false;
+    switch (logger->effective_level.load(std::memory_order_relaxed)){
         case LOG_LEVEL_DEBUG:
-            logger->enabledForDebug = true;
+            debug = true;
         case LOG_LEVEL_INFO:
-            logger->enabledForInfo = true;
+            info = true;
         case LOG_LEVEL_WARNING:
-            logger->enabledForWarning = true;
+            warning = true;
         case LOG_LEVEL_ERROR:
-            logger->enabledForError = true;
+            error = true;
         case LOG_LEVEL_CRITICAL:
-            logger->enabledForCritical = true;
-    }
+            critical = true;
+    }
+    // Each flag is stored once, so a concurrent call never sees a level that
+    // is neither the old nor the new one.
+    logger->enabledForDebug.store(debug, std::memory_order_relaxed);
+    logger->enabledForInfo.store(info, std::memory_order_relaxed);
+    logger->enabledForWarning.store(warning, std::memory_order_relaxed);
+    logger->enabledForError.store(error, std::memory_order_relaxed);
+    logger->enabledForCritical.store(critical, std::memory_order_relaxed);
 }
 
 void setEffectiveLevelOfChildren(Logger* logger, unsigned short level) {
     for (int i = 0; i < PyList_GET_SIZE(logger->children); i++) {
         PyObject *child_logger = PyList_GET_ITEM(logger->children, i); // borrowed ref
         if (((Logger*)child_logger)->level == LOG_LEVEL_NOTSET) {
-            ((Logger*)child_logger)->effective_level = level;
+            ((Logger*)child_logger)->effective_level.store(level, std::memory_order_relaxed);
             setEnabledBasedOnEffectiveLevel((Logger*)child_logger);
             setEffectiveLevelOfChildren((Logger*)child_logger, level);
         }
@@ -55,7 +64,7 @@ void setEffectiveLevelOfChildren(Logger* logger, unsigned short level) {
 
 PyObject* Logger_new(PyTypeObject* type, PyObject* args, PyObject* kwds)
 {
-    Logger* self = (Logger*)FiltererType.tp_new(type, args, kwds);
+    Logger* self = (Logger*)Filterer_new(type, args, kwds);
     if (self != NULL)
     {
         self->name = Py_NewRef(Py_None);
@@ -71,9 +80,10 @@ PyObject* Logger_new(PyTypeObject* type, PyObject* args, PyObject* kwds)
             return nullptr;
         }
         self->disabled = false;
+        self->clock = Clock_Default;
         self->manager = Py_NewRef(Py_None);
         
-        self->_fallback_handler = (StreamHandler*)PyObject_CallFunctionObjArgs((PyObject *)&StreamHandlerType, NULL);
+        self->_fallback_handler = (StreamHandler*)PyObject_CallFunctionObjArgs((PyObject *)picologging_typeState(type)->StreamHandlerType, NULL);
         if (self->_fallback_handler == nullptr){
             Py_CLEAR(self->name);
             Py_CLEAR(self->parent);
@@ -87,16 +97,13 @@ PyObject* Logger_new(PyTypeObject* type, PyObject* args, PyObject* kwds)
         self->_const_exc_info = PyUnicode_FromString("exc_info");
         self->_const_extra = PyUnicode_FromString("extra");
         self->_const_stack_info = PyUnicode_FromString("stack_info");
-        self->_const_line_break = PyUnicode_FromString("\n");
-        self->_const_getvalue = PyUnicode_FromString("getvalue");
-        self->_const_close = PyUnicode_FromString("close");
     }
     return (PyObject*)self;
 }
 
 int Logger_init(Logger *self, PyObject *args, PyObject *kwds)
 {
-    if (FiltererType.tp_init((PyObject *) self, args, kwds) < 0)
+    if (Filterer_init((Filterer*)self, args, kwds) < 0)
         return -1;
 
     PyObject *name = NULL;
@@ -106,8 +113,9 @@ int Logger_init(Logger *self, PyObject *args, PyObject *kwds)
         return -1;
     
     self->name = Py_NewRef(name);
+    std::lock_guard<std::mutex> guard(g_levelsMutex);
     self->level = level;
-    self->effective_level = findEffectiveLevelFromParents(self);
+    self->effective_level.store(findEffectiveLevelFromParents(self), std::memory_order_relaxed);
     setEnabledBasedOnEffectiveLevel(self);
     
     return 0;
@@ -125,11 +133,8 @@ PyObject* Logger_dealloc(Logger *self) {
     Py_CLEAR(self->_const_exc_info);
     Py_CLEAR(self->_const_extra);
     Py_CLEAR(self->_const_stack_info);
-    Py_CLEAR(self->_const_line_break);
-    Py_CLEAR(self->_const_getvalue);
-    Py_CLEAR(self->_const_close);
     Py_CLEAR(self->_fallback_handler);
-    FiltererType.tp_dealloc((PyObject *)self);
+    Filterer_dealloc((Filterer*)self);
     return NULL;
 }
 
@@ -139,23 +144,26 @@ PyObject* Logger_repr(Logger *self) {
 }
 
 PyObject* Logger_setLevel(Logger *self, PyObject *level) {
+    unsigned short levelValue;
     if (PyLong_Check(level)) {
-        self->level = (unsigned short)PyLong_AsUnsignedLongMask(level);
+        levelValue = (unsigned short)PyLong_AsUnsignedLongMask(level);
     }
     else if (PyUnicode_Check(level)){
-        short levelValue = getLevelByName(PyUnicode_AsUTF8(level));
-        if (levelValue < 0) {
+        short namedLevel = getLevelByName(PyUnicode_AsUTF8(level));
+        if (namedLevel < 0) {
             PyErr_Format(PyExc_ValueError, "Invalid level value: %U", level);
             return nullptr;
         }
-        self->level = levelValue;
+        levelValue = namedLevel;
     } else {
         PyErr_SetString(PyExc_TypeError, "level must be an integer");
         return NULL;
     }
-    self->effective_level = self->level;
+    std::lock_guard<std::mutex> guard(g_levelsMutex);
+    self->level = levelValue;
+    self->effective_level.store(levelValue, std::memory_order_relaxed);
     setEnabledBasedOnEffectiveLevel(self);
-    setEffectiveLevelOfChildren(self, self->level);
+    setEffectiveLevelOfChildren(self, levelValue);
     Py_RETURN_NONE;
 }
 
@@ -185,64 +193,23 @@ LogRecord* Logger_logMessageAsRecord(Logger* self, unsigned short level, PyObjec
     long lineno = f != nullptr ? PyFrame_GETLINENO(f) : 0;
     PyObject *co_name = f != nullptr ? PyFrame_GETCODE(f)->co_name : self->_const_unknown;
 
+    // Only the frames are captured here, the text is rendered when a formatter needs it.
+    CapturedStack* stack = nullptr;
     if (stack_info == Py_True){
-        PyObject* mod = PICOLOGGING_MODULE(); // borrowed reference
-        PyObject* modDict = PyModule_GetDict(mod); // borrowed reference
-        PyObject* print_stack = PyDict_GetItemString(modDict, "print_stack"); // PyDict_GetItemString returns a borrowed reference
-        if (print_stack == nullptr){
-            PyErr_SetString(PyExc_RuntimeError, "Could not get print_stack");
-            return nullptr;
-        }
-        Py_XINCREF(print_stack);
-        PyObject* sio_cls = PyDict_GetItemString(modDict, "StringIO");
-        Py_XINCREF(sio_cls);
-        PyObject* sio = PyObject_CallFunctionObjArgs(sio_cls, NULL);
-        if (sio == nullptr){
-            Py_XDECREF(sio_cls);
-            Py_XDECREF(print_stack);
-            return nullptr; // Got exception in StringIO.__init__()
-        }
-        PyObject* printStackResult = PyObject_CallFunctionObjArgs(
-            print_stack,
-            Py_None,
-            Py_None,
-            sio,
-            NULL);
-        if (printStackResult == nullptr)
-        {
-            Py_XDECREF(sio_cls);
-            Py_XDECREF(print_stack);
-            return nullptr; // Got exception in print_stack()
-        }
-        Py_DECREF(printStackResult);
-        PyObject* s = PyObject_CallMethod_NOARGS(sio, self->_const_getvalue);
-        if (s == nullptr){
-            Py_XDECREF(sio);
-            Py_XDECREF(sio_cls);
-            Py_XDECREF(print_stack);
-            return nullptr; // Got exception in StringIO.getvalue()
-        }
-        
-        Py_XDECREF(PyObject_CallMethod_NOARGS(sio, self->_const_close));
-        Py_DECREF(sio);
-        Py_DECREF(sio_cls);
-        Py_DECREF(print_stack);
-        if (PYUNICODE_ENDSWITH(s, self->_const_line_break)){
-            PyObject* s2 = PyUnicode_Substring(s, 0, PyUnicode_GetLength(s) - 1);
-            Py_DECREF(s);
-            s = s2;
-        }
-        stack_info = s;
+        stack = captureStack(frame);
+        stack_info = Py_None;
     }
 
-    LogRecord* record = (LogRecord*) (&LogRecordType)->tp_alloc(&LogRecordType, 0);
+    PyTypeObject* recordType = GET_PICOLOGGING_STATE(self)->LogRecordType;
+    LogRecord* record = (LogRecord*) recordType->tp_alloc(recordType, 0);
     if (record == NULL)
     {
+        delete stack;
         PyErr_NoMemory();
         return nullptr;
     }
 
-    return LogRecord_create(
+    record = LogRecord_create(
         record,
         self->name,
         msg,
@@ -252,8 +219,15 @@ LogRecord* Logger_logMessageAsRecord(Logger* self, unsigned short level, PyObjec
         lineno,
         exc_info,
         co_name,
-        stack_info
+        stack_info,
+        self->clock
     );
+    if (record == nullptr){
+        delete stack;
+        return nullptr;
+    }
+    record->stackFrames = stack;
+    return record;
 }
 
 inline PyObject* PyArg_GetKeyword(PyObject *const *args, Py_ssize_t npargs, PyObject *kwnames, PyObject* keyword){
@@ -267,7 +241,7 @@ inline PyObject* PyArg_GetKeyword(PyObject *const *args, Py_ssize_t npargs, PyOb
     return nullptr;
 }
 
-PyObject* Logger_logAndHandle(Logger *self, PyObject *const *args, Py_ssize_t nfargs, PyObject *kwnames, unsigned short level){
+PyObject* Logger_logAndHandle(Logger *self, PyObject *const *args, Py_ssize_t nfargs, PyObject *kwnames, unsigned short level, PyObject *context, bool mergeExtra, bool excInfo){
     if (PyVectorcall_NARGS(nfargs) == 0) {
         PyErr_SetString(PyExc_TypeError, "log requires a message argument");
         return nullptr;
@@ -282,85 +256,112 @@ PyObject* Logger_logAndHandle(Logger *self, PyObject *const *args, Py_ssize_t nf
         Py_INCREF(args[i]);
     }
     PyObject* exc_info = kwnames != nullptr ? PyArg_GetKeyword(args, npargs, kwnames, self->_const_exc_info) : nullptr;
-    if (exc_info == nullptr){
+    if (exc_info == nullptr)
+        exc_info = excInfo ? Py_True : Py_None;
+    int hasExcInfo = PyObject_IsTrue(exc_info);
+    if (hasExcInfo < 0) {
+        Py_DECREF(args_);
+        return nullptr;
+    }
+    if (!hasExcInfo){
         exc_info = Py_NewRef(Py_None);
-    } else {
-        if (PyExceptionInstance_Check(exc_info)){
-            PyObject * unpackedExcInfo = PyTuple_New(3);
-            PyObject * excType = (PyObject*)Py_TYPE(exc_info);
-            PyTuple_SET_ITEM(unpackedExcInfo, 0, excType);
-            Py_INCREF(excType);
-            PyTuple_SET_ITEM(unpackedExcInfo, 1, exc_info);
-            Py_INCREF(exc_info);
-            PyObject* traceback = PyObject_GetAttrString(exc_info, "__traceback__");
-            PyTuple_SET_ITEM(unpackedExcInfo, 2, traceback);
-            Py_INCREF(traceback);
-            exc_info = unpackedExcInfo;
-        } else if (!PyTuple_CheckExact(exc_info)){ // Probably Py_TRUE, fetch current exception as tuple
-            PyObject * unpackedExcInfo = PyTuple_New(3);
-            PyErr_GetExcInfo(&PyTuple_GET_ITEM(unpackedExcInfo, 0), &PyTuple_GET_ITEM(unpackedExcInfo, 1), &PyTuple_GET_ITEM(unpackedExcInfo, 2));
-            exc_info = unpackedExcInfo;
-        }
+    } else if (PyExceptionInstance_Check(exc_info)){
+        PyObject* traceback = PyException_GetTraceback(exc_info);
+        exc_info = PyTuple_Pack(3, (PyObject*)Py_TYPE(exc_info), exc_info, traceback != nullptr ? traceback : Py_None);
+        Py_XDECREF(traceback);
+    } else if (PyTuple_Check(exc_info)){
+        Py_INCREF(exc_info);
+    } else { // Probably Py_True, fetch current exception as tuple
+        exc_info = PyTuple_New(3);
+        if (exc_info != nullptr)
+            PyErr_GetExcInfo(&PyTuple_GET_ITEM(exc_info, 0), &PyTuple_GET_ITEM(exc_info, 1), &PyTuple_GET_ITEM(exc_info, 2));
+    }
+    if (exc_info == nullptr) {
+        Py_DECREF(args_);
+        return nullptr;
     }
+    // The keyword argument is only a borrowed reference
     PyObject* extra = kwnames != nullptr ? PyArg_GetKeyword(args, npargs, kwnames, self->_const_extra) : nullptr;
-    if (extra == nullptr){
-        extra = Py_NewRef(Py_None);
-    }
     PyObject* stack_info = kwnames != nullptr ? PyArg_GetKeyword(args, npargs, kwnames, self->_const_stack_info) : nullptr;
     if (stack_info == nullptr){
         stack_info = Py_NewRef(Py_False);
+    } else {
+        Py_INCREF(stack_info);
     }
     LogRecord *record = Logger_logMessageAsRecord(
-        self, level, msg, args_, exc_info, extra, stack_info, 1);
+        self, level, msg, args_, exc_info, Py_None, stack_info, 1);
 
     Py_DECREF(args_);
     Py_DECREF(exc_info);
-    Py_DECREF(extra);
     Py_DECREF(stack_info);
     if (record == nullptr)
         return nullptr;
 
+    // An adapter's context replaces the call's extra unless it asked for them to be merged
+    if (context != nullptr && LogRecord_addExtra(record, context) < 0){
+        Py_DECREF(record);
+        return nullptr;
+    }
+    if (extra != nullptr && (context == nullptr || mergeExtra) && LogRecord_addExtra(record, extra) < 0){
+        Py_DECREF(record);
+        return nullptr;
+    }
+
     if (Filterer_filter(&self->filterer, (PyObject*)record) != Py_True) {
         Py_DECREF(record);
         Py_RETURN_NONE;
     }
     
+    picologging_state* state = GET_PICOLOGGING_STATE(self);
     int found = 0;
     Logger* cur = self;
     bool has_parent = true;
     while (has_parent){
-        for (int i = 0; i < PyList_GET_SIZE(cur->handlers) ; i++){
+        for (Py_ssize_t i = 0; i < PyList_GET_SIZE(cur->handlers) ; i++){
+            // A strong reference, handlers can be removed while this one runs
+            PyObject* handler = PyList_GETITEMREF(cur->handlers, i);
+            if (handler == nullptr){ // Removed by another thread
+                PyErr_Clear();
+                break;
+            }
             found ++;
-            PyObject* handler = PyList_GET_ITEM(cur->handlers, i); // borrowed
-            if (Handler_CheckExact(handler) || Handler_Check(handler)){
+            if (Handler_CheckExact(state, handler) || Handler_Check(state, handler)){
                 if (record->levelno >= ((Handler*)handler)->level){
-                    if (Handler_handle((Handler*)handler, (PyObject*)record) == nullptr){
+                    PyObject* result = Handler_handle((Handler*)handler, (PyObject*)record);
+                    if (result == nullptr){
+                        Py_DECREF(handler);
                         Py_DECREF(record);
                         return nullptr;
                     }
+                    Py_DECREF(result);
                 }
             } else {
                 PyObject* handlerLevel = PyObject_GetAttr(handler, self->_const_level);
                 if (handlerLevel == nullptr){
+                    Py_DECREF(handler);
                     Py_DECREF(record);
                     PyErr_SetString(PyExc_TypeError, "Handler has no level attribute");
                     return nullptr;
                 }
                 
                 if (record->levelno >= PyLong_AsLong(handlerLevel)){
-                    if (PyObject_CallMethod_ONEARG(handler, self->_const_handle, (PyObject*)record) == nullptr){
+                    PyObject* result = PyObject_CallMethod_ONEARG(handler, self->_const_handle, (PyObject*)record);
+                    if (result == nullptr){
                         Py_DECREF(handlerLevel);
+                        Py_DECREF(handler);
                         Py_DECREF(record);
                         return nullptr;
                     }
+                    Py_DECREF(result);
                 }
                 Py_DECREF(handlerLevel);
             }
+            Py_DECREF(handler);
         }
         if (!cur->propagate || cur->parent == Py_None) {
             has_parent = false;
         } else {
-            if (!Logger_CheckExact(cur->parent))
+            if (!Logger_CheckExact(state, cur->parent))
             {
                 Py_DECREF(record);
                 PyErr_SetString(PyExc_TypeError, "Logger's parent is not an instance of picologging.Logger");
@@ -371,10 +372,12 @@ PyObject* Logger_logAndHandle(Logger *self, PyObject *const *args, Py_ssize_t nf
     }
     if (found == 0){
         if (record->levelno >= ((Handler*)self->_fallback_handler)->level){
-            if (Handler_handle((Handler*)self->_fallback_handler, (PyObject*)record) == nullptr){
+            PyObject* result = Handler_handle((Handler*)self->_fallback_handler, (PyObject*)record);
+            if (result == nullptr){
                 Py_DECREF(record);
                 return nullptr;
             }
+            Py_DECREF(result);
         }
     }
     Py_DECREF(record);
@@ -382,7 +385,7 @@ PyObject* Logger_logAndHandle(Logger *self, PyObject *const *args, Py_ssize_t nf
 }
 
 PyObject* Logger_debug(Logger *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
-    if (self->disabled || !self->enabledForDebug) {
+    if (self->disabled || !self->enabledForDebug.load(std::memory_order_relaxed)) {
         Py_RETURN_NONE;
     }
 
@@ -394,7 +397,7 @@ PyObject* Logger_debug(Logger *self, PyObject *const *args, Py_ssize_t nargs, Py
 }
 
 PyObject* Logger_info(Logger *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames){
-    if (self->disabled || !self->enabledForInfo) {
+    if (self->disabled || !self->enabledForInfo.load(std::memory_order_relaxed)) {
         Py_RETURN_NONE;
     }
 
@@ -405,7 +408,7 @@ PyObject* Logger_info(Logger *self, PyObject *const *args, Py_ssize_t nargs, PyO
     return Logger_logAndHandle(self, args, nargs, kwnames, LOG_LEVEL_INFO);
 }
 PyObject* Logger_warning(Logger *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames){
-    if (self->disabled || !self->enabledForWarning) {
+    if (self->disabled || !self->enabledForWarning.load(std::memory_order_relaxed)) {
         Py_RETURN_NONE;
     }
 
@@ -421,7 +424,7 @@ PyObject* Logger_fatal(Logger *self, PyObject *const *args, Py_ssize_t nargs, Py
 }
 
 PyObject* Logger_error(Logger *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames){
-    if (self->disabled || !self->enabledForError) {
+    if (self->disabled || !self->enabledForError.load(std::memory_order_relaxed)) {
         Py_RETURN_NONE;
     }
 
@@ -433,7 +436,7 @@ PyObject* Logger_error(Logger *self, PyObject *const *args, Py_ssize_t nargs, Py
 }
 
 PyObject* Logger_critical(Logger *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames){
-    if (self->disabled || !self->enabledForCritical) {
+    if (self->disabled || !self->enabledForCritical.load(std::memory_order_relaxed)) {
         Py_RETURN_NONE;
     }
 
@@ -445,31 +448,15 @@ PyObject* Logger_critical(Logger *self, PyObject *const *args, Py_ssize_t nargs,
 }
 
 PyObject* Logger_exception(Logger *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames){
-    if (self->disabled || !self->enabledForError) {
+    if (self->disabled || !self->enabledForError.load(std::memory_order_relaxed)) {
         Py_RETURN_NONE;
     }
-    if (kwnames == nullptr){
-        kwnames = Py_BuildValue("(O)", self->_const_exc_info);
-    } else {
-        _PyTuple_Resize(&kwnames, PyTuple_GET_SIZE(kwnames) + 1);
-        PyTuple_SET_ITEM(kwnames, PyTuple_GET_SIZE(kwnames) - 1, self->_const_exc_info);
-        Py_INCREF(self->_const_exc_info); // Add extra ref for kwnames tuple
-        Py_INCREF(kwnames); // Add extra ref for kwnames tuple (gets decrefed at the end of this function)
-    }
 
-    // Push True to the end of args
-    PyObject** args_ = (PyObject**)PyMem_Malloc((PyVectorcall_NARGS(nargs) + 1) * sizeof(PyObject*));
-    if (args_ == nullptr)
+    if (PyVectorcall_NARGS(nargs) < 1) {
+        PyErr_SetString(PyExc_TypeError, "exception() requires 1 positional argument");
         return nullptr;
-    for (int i = 0; i < PyVectorcall_NARGS(nargs); i++) {
-        args_[i] = args[i];
     }
-    args_[PyVectorcall_NARGS(nargs)] = Py_True;
-    
-    PyObject* result = Logger_logAndHandle(self, args_, nargs, kwnames, LOG_LEVEL_ERROR);
-    Py_XDECREF(kwnames);
-    PyMem_Free(args_);
-    return result;
+    return Logger_logAndHandle(self, args, nargs, kwnames, LOG_LEVEL_ERROR, nullptr, false, true);
 }
 
 PyObject* Logger_log(Logger *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames){
@@ -483,40 +470,64 @@ PyObject* Logger_log(Logger *self, PyObject *const *args, Py_ssize_t nargs, PyOb
     }
     unsigned short level = PyLong_AsUnsignedLongMask(args[0]);
 
-    if (self->disabled || (self->effective_level > level)) {
+    if (self->disabled || (self->effective_level.load(std::memory_order_relaxed) > level)) {
         Py_RETURN_NONE;
     }
 
-    PyObject** args_ = (PyObject**)PyMem_Malloc((nargs - 1) * sizeof(PyObject*));
-    if (args_ == nullptr)
-        return nullptr;
-    for (int i = 1; i < PyVectorcall_NARGS(nargs); i++) {
-        args_[i - 1] = args[i];
-    }
-
-    PyObject* result = Logger_logAndHandle(self, args_, nargs - 1, kwnames, level);
-    PyMem_Free(args_);
-    return result;
+    // Keyword values follow the positional ones, so skipping the level keeps them in place
+    return Logger_logAndHandle(self, args + 1, PyVectorcall_NARGS(nargs) - 1, kwnames, level);
 }
 
 PyObject* Logger_addHandler(Logger *self, PyObject *handler) {
-    if (PySequence_Contains(self->handlers, handler)) {
-        Py_RETURN_NONE;
-    }
-    PyList_Append(self->handlers, handler);
+    int ret = 0;
+    // Makes the check and the append one step when two threads add the same handler
+    Py_BEGIN_CRITICAL_SECTION(self);
+    ret = PySequence_Contains(self->handlers, handler);
+    if (ret == 0)
+        ret = PyList_Append(self->handlers, handler);
+    Py_END_CRITICAL_SECTION();
+    if (ret < 0)
+        return nullptr;
     Py_RETURN_NONE;
 }
 
 PyObject* Logger_removeHandler(Logger *self, PyObject *handler) {
-    if (PySequence_Contains(self->handlers, handler)) {
-        PyObject* remove = PyUnicode_FromString("remove");
-        PyObject* result = PyObject_CallMethod_ONEARG(self->handlers, remove, handler);
-        Py_DECREF(remove);
-        return result;
+    int ret = 0;
+    Py_BEGIN_CRITICAL_SECTION(self);
+    Py_ssize_t index = PySequence_Index(self->handlers, handler);
+    if (index >= 0) {
+        ret = PySequence_DelItem(self->handlers, index);
+    } else if (PyErr_ExceptionMatches(PyExc_ValueError)) {
+        PyErr_Clear();
+    } else {
+        ret = -1;
     }
+    Py_END_CRITICAL_SECTION();
+    if (ret < 0)
+        return nullptr;
     Py_RETURN_NONE;
 }
 
+/**
+ * Assigning handlers replaces the items of the logger's list rather than the
+ * list, so logging calls iterating over it never see it freed.
+ */
+static PyObject *
+Logger_get_handlers(Logger *self, void *closure)
+{
+    return Py_NewRef(self->handlers);
+}
+
+static int
+Logger_set_handlers(Logger *self, PyObject *value, void *Py_UNUSED(ignored))
+{
+    if (value == nullptr) {
+        PyErr_SetString(PyExc_TypeError, "Cannot delete handlers");
+        return -1;
+    }
+    return PyList_SetSlice(self->handlers, 0, PY_SSIZE_T_MAX, value);
+}
+
 static PyObject *
 Logger_get_parent(Logger *self, void *closure)
 {
@@ -533,19 +544,23 @@ Logger_set_parent(Logger *self, PyObject *value, void *Py_UNUSED(ignored))
         PyErr_SetString(PyExc_TypeError, "Cannot delete parent");
         return -1;
     }
-    if (!Logger_Check(value)) {
+    if (!Logger_Check(GET_PICOLOGGING_STATE(self), value)) {
         PyErr_Format(PyExc_TypeError, "parent must be a Logger, not %s", Py_TYPE(value)->tp_name);
         return -1;
     }
-    Py_XINCREF(value);
-    Py_XDECREF(self->parent);
-    self->parent = value;
-    if (PySequence_Contains(((Logger*)self->parent)->children, (PyObject*)self) == 0){
-        PyList_Append(((Logger*)self->parent)->children, (PyObject*)self);
-    }
+    // The children list and the old parent's dealloc can run Python code, so
+    // they are updated before taking the levels mutex.
+    PyObject* children = ((Logger*)value)->children;
+    int contains = PySequence_Contains(children, (PyObject*)self);
+    if (contains < 0 || (contains == 0 && PyList_Append(children, (PyObject*)self) < 0))
+        return -1;
+    PyObject* oldParent = self->parent;
+    self->parent = Py_NewRef(value);
+    Py_XDECREF(oldParent);
 
     // Rescan parent levels.
-    self->effective_level = findEffectiveLevelFromParents(self);
+    std::lock_guard<std::mutex> guard(g_levelsMutex);
+    self->effective_level.store(findEffectiveLevelFromParents(self), std::memory_order_relaxed);
     setEnabledBasedOnEffectiveLevel(self);
     return 0;
 }
@@ -555,7 +570,7 @@ PyObject* Logger_isEnabledFor(Logger *self, PyObject *level) {
         PyErr_SetString(PyExc_TypeError, "level must be an integer");
         return NULL;
     }
-    if (self->disabled || (unsigned short)PyLong_AsUnsignedLongMask(level) < self->effective_level) {
+    if (self->disabled || (unsigned short)PyLong_AsUnsignedLongMask(level) < self->effective_level.load(std::memory_order_relaxed)) {
         Py_RETURN_FALSE;
     }
     Py_RETURN_TRUE;
@@ -583,59 +598,65 @@ static PyMemberDef Logger_members[] = {
     {"name", T_OBJECT_EX, offsetof(Logger, name), 0, "Logger name"},
     {"level", T_USHORT, offsetof(Logger, level), 0, "Logger level"},
     {"propagate", T_BOOL, offsetof(Logger, propagate), 0, "Logger propagate"},
-    {"handlers", T_OBJECT_EX, offsetof(Logger, handlers), 0, "Logger handlers"},
     {"disabled", T_BOOL, offsetof(Logger, disabled), 0, "Logger disabled"},
     {"manager", T_OBJECT_EX, offsetof(Logger, manager), 0, "Logger manager"},
     {NULL}
 };
 
+static PyObject*
+Logger_get_clock(Logger *self, void *closure)
+{
+    return Clock_name(self->clock);
+}
+
+static int
+Logger_set_clock(Logger *self, PyObject *value, void *Py_UNUSED(ignored))
+{
+    if (value == nullptr) {
+        PyErr_SetString(PyExc_TypeError, "Cannot delete clock");
+        return -1;
+    }
+    RecordClock clock;
+    if (Clock_fromName(value, &clock) < 0)
+        return -1;
+    self->clock = clock;
+    return 0;
+}
+
 static PyGetSetDef Logger_getsets[] = {
     {"parent",
      (getter)Logger_get_parent,
      (setter)Logger_set_parent,
      "Logger parent"},
+    {"handlers",
+     (getter)Logger_get_handlers,
+     (setter)Logger_set_handlers,
+     "Logger handlers"},
+    {"clock",
+     (getter)Logger_get_clock,
+     (setter)Logger_set_clock,
+     "Clock the logger's records are timestamped with, None uses the one set with picologging.setClock()"},
     {NULL, NULL, NULL, NULL }  /* sentinel */
 };
 
-PyTypeObject LoggerType = {
-    PyObject_HEAD_INIT(NULL)
-    "picologging.Logger",                    /* tp_name */
-    sizeof(Logger),                          /* tp_basicsize */
-    0,                                          /* tp_itemsize */
-    (destructor)Logger_dealloc,                /* tp_dealloc */
-    0,                                          /* tp_vectorcall_offset */
-    0,                                          /* tp_getattr */
-    0,                                          /* tp_setattr */
-    0,                                          /* tp_as_async */
-    (reprfunc)Logger_repr,                      /* tp_repr */
-    0,                                          /* tp_as_number */
-    0,                                          /* tp_as_sequence */
-    0,                                          /* tp_as_mapping */
-    0,                                          /* tp_hash */
-    0,                                          /* tp_call */
-    0,                                          /* tp_str */
-    PyObject_GenericGetAttr,                    /* tp_getattro */
-    PyObject_GenericSetAttr,                    /* tp_setattro */
-    0,                                          /* tp_as_buffer */
-    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE ,  /* tp_flags */
-    PyDoc_STR("Logging interface."),    /* tp_doc */
-    0,                                          /* tp_traverse */
-    0,                                          /* tp_clear */
-    0,                                          /* tp_richcompare */
-    0,                                          /* tp_weaklistoffset */
-    0,                                          /* tp_iter */
-    0,                                          /* tp_iternext */
-    Logger_methods,                             /* tp_methods */
-    Logger_members,                             /* tp_members */
-    Logger_getsets,                             /* tp_getset */
-    0,                                          /* tp_base */
-    0,                                          /* tp_dict */
-    0,                                          /* tp_descr_get */
-    0,                                          /* tp_descr_set */
-    0,                                          /* tp_dictoffset */
-    (initproc)Logger_init,                      /* tp_init */
-    0,                                          /* tp_alloc */
-    Logger_new,                                 /* tp_new */
-    PyObject_Del,                               /* tp_free */
+static PyType_Slot Logger_slots[] = {
+    {Py_tp_dealloc, (void*)Logger_dealloc},
+    {Py_tp_repr, (void*)Logger_repr},
+    {Py_tp_doc, (void*)PyDoc_STR("Logging interface.")},
+    {Py_tp_methods, Logger_methods},
+    {Py_tp_members, Logger_members},
+    {Py_tp_getset, Logger_getsets},
+    {Py_tp_init, (void*)Logger_init},
+    {Py_tp_new, (void*)Logger_new},
+    {Py_tp_free, (void*)PyObject_Del},
+    {0, NULL}
+};
+
+PyType_Spec LoggerType_spec = {
+    "picologging.Logger",
+    sizeof(Logger),
+    0,
+    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE | Py_TPFLAGS_IMMUTABLETYPE,
+    Logger_slots,
 };
 
@@ -4,6 +4,7 @@
 #include "compat.hxx"
 #include "logrecord.hxx"
 #include "filterer.hxx"
+#include <atomic>
 #include <unordered_map>
 #include "streamhandler.hxx"
 
@@ -14,18 +15,20 @@ typedef struct LoggerT {
     Filterer filterer;
     PyObject *name;
     unsigned short level;
-    unsigned short effective_level;
+    // Read on every call without a lock, written when levels are changed.
+    std::atomic<unsigned short> effective_level;
     PyObject *parent;
     PyObject *children;
     bool propagate;
     PyObject *handlers;
     PyObject *manager;
     bool disabled;
-    bool enabledForCritical = false;
-    bool enabledForError = false;
-    bool enabledForWarning = false;
-    bool enabledForInfo = false;
-    bool enabledForDebug = false;
+    std::atomic<bool> enabledForCritical;
+    std::atomic<bool> enabledForError;
+    std::atomic<bool> enabledForWarning;
+    std::atomic<bool> enabledForInfo;
+    std::atomic<bool> enabledForDebug;
+    RecordClock clock; // Clock_Default follows picologging.setClock()
 
     // Constant strings.
     PyObject* _const_handle;
@@ -34,9 +37,6 @@ typedef struct LoggerT {
     PyObject* _const_exc_info;
     PyObject* _const_extra;
     PyObject* _const_stack_info;
-    PyObject* _const_line_break;
-    PyObject* _const_close;
-    PyObject* _const_getvalue;
 
     StreamHandler* _fallback_handler;
 } Logger ;
@@ -48,7 +48,10 @@ PyObject* Logger_dealloc(Logger *self);
 PyObject* Logger_addHandler(Logger *self, PyObject *handler);
 PyObject* Logger_isEnabledFor(Logger *self, PyObject *level);
 
-PyObject* Logger_logAndHandle(Logger *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames, unsigned short level);
+// context is a LoggerAdapter's validated extra dict (or None), it replaces the call's
+// extra unless mergeExtra is set. excInfo makes exc_info default to True.
+PyObject* Logger_logAndHandle(Logger *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames, unsigned short level,
+    PyObject *context = nullptr, bool mergeExtra = false, bool excInfo = false);
 PyObject* Logger_debug(Logger *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames);
 PyObject* Logger_info(Logger *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames);
 PyObject* Logger_warning(Logger *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames);
@@ -60,8 +63,8 @@ PyObject* Logger_log(Logger *self, PyObject *const *args, Py_ssize_t nargs, PyOb
 
 LogRecord* Logger_logMessageAsRecord(Logger* self, unsigned short level, PyObject *msg, PyObject *args, PyObject * exc_info, PyObject *extra, PyObject *stack_info, int stacklevel=1);
 
-extern PyTypeObject LoggerType;
-#define Logger_CheckExact(op) Py_IS_TYPE(op, &LoggerType)
-#define Logger_Check(op) PyObject_TypeCheck(op, &LoggerType)
+extern PyType_Spec LoggerType_spec;
+#define Logger_CheckExact(state, op) Py_IS_TYPE(op, (state)->LoggerType)
+#define Logger_Check(state, op) PyObject_TypeCheck(op, (state)->LoggerType)
 
 #endif // PICOLOGGING_LOGGER_H
\ No newline at end of file
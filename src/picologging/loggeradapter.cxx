@@ -0,0 +1,424 @@
+#include "loggeradapter.hxx"
+#include "logger.hxx"
+#include "logrecord.hxx"
+#include "compat.hxx"
+#include "picologging.hxx"
+
+/**
+ * Anything with isEnabledFor() and log() can be adapted, picologging Loggers
+ * take the fast path.
+ */
+static int LoggerAdapter_checkLogger(picologging_state* state, PyObject* logger) {
+    if (Logger_Check(state, logger))
+        return 0;
+    if (PyObject_HasAttrString(logger, "isEnabledFor") && PyObject_HasAttrString(logger, "log"))
+        return 0;
+    PyErr_Format(PyExc_TypeError, "logger must be a Logger, not %.200s", Py_TYPE(logger)->tp_name);
+    return -1;
+}
+
+/**
+ * Copy extra into a new dict and check none of its keys clash with the
+ * record's attributes, so a bad key is reported when it's assigned. The
+ * copy can still be changed through `extra`, records check it again.
+ */
+static PyObject* LoggerAdapter_freezeExtra(picologging_state* state, PyObject* extra) {
+    if (extra == nullptr || extra == Py_None)
+        return Py_NewRef(Py_None);
+    PyObject* frozen = PyDict_New();
+    if (frozen == nullptr)
+        return nullptr;
+    if (PyDict_Merge(frozen, extra, 1) < 0) {
+        Py_DECREF(frozen);
+        return nullptr;
+    }
+    PyObject *key, *value;
+    Py_ssize_t pos = 0;
+    while (PyDict_Next(frozen, &pos, &key, &value)) {
+        if (LogRecord_checkExtraKey(state, key) < 0) {
+            Py_DECREF(frozen);
+            return nullptr;
+        }
+    }
+    return frozen;
+}
+
+static bool LoggerAdapter_isEnabledForLevel(Logger* logger, unsigned short level) {
+    if (logger->disabled)
+        return false;
+    switch (level) {
+        case LOG_LEVEL_DEBUG:
+            return logger->enabledForDebug.load(std::memory_order_relaxed);
+        case LOG_LEVEL_INFO:
+            return logger->enabledForInfo.load(std::memory_order_relaxed);
+        case LOG_LEVEL_WARNING:
+            return logger->enabledForWarning.load(std::memory_order_relaxed);
+        case LOG_LEVEL_ERROR:
+            return logger->enabledForError.load(std::memory_order_relaxed);
+        case LOG_LEVEL_CRITICAL:
+            return logger->enabledForCritical.load(std::memory_order_relaxed);
+        default:
+            return logger->effective_level.load(std::memory_order_relaxed) <= level;
+    }
+}
+
+PyObject* LoggerAdapter_new(PyTypeObject* type, PyObject* args, PyObject* kwds)
+{
+    LoggerAdapter* self = (LoggerAdapter*)type->tp_alloc(type, 0);
+    if (self != NULL)
+    {
+        self->logger = Py_NewRef(Py_None);
+        self->extra = Py_NewRef(Py_None);
+        self->mergeExtra = false;
+        self->_const_extra = PyUnicode_FromString("extra");
+        self->_const_exc_info = PyUnicode_FromString("exc_info");
+        self->_const_process = PyUnicode_FromString("process");
+        self->_const_log = PyUnicode_FromString("log");
+        self->_const_isEnabledFor = PyUnicode_FromString("isEnabledFor");
+
+        // Subclasses only pay for the Python call when they replace process()
+        self->overridesProcess = false;
+        PyTypeObject* baseType = picologging_typeState(type)->LoggerAdapterType;
+        if (type != baseType) {
+            PyObject* base = PyObject_GetAttr((PyObject*)baseType, self->_const_process);
+            PyObject* own = PyObject_GetAttr((PyObject*)type, self->_const_process);
+            self->overridesProcess = base != own;
+            Py_XDECREF(base);
+            Py_XDECREF(own);
+            if (PyErr_Occurred()) {
+                Py_DECREF(self);
+                return nullptr;
+            }
+        }
+    }
+    return (PyObject*)self;
+}
+
+int LoggerAdapter_init(LoggerAdapter *self, PyObject *args, PyObject *kwds)
+{
+    PyObject *logger = nullptr, *extra = Py_None;
+    int mergeExtra = 0;
+    static const char *kwlist[] = {"logger", "extra", "merge_extra", NULL};
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|Op", const_cast<char**>(kwlist), &logger, &extra, &mergeExtra))
+        return -1;
+
+    if (LoggerAdapter_checkLogger(GET_PICOLOGGING_STATE(self), logger) < 0)
+        return -1;
+    PyObject* frozen = LoggerAdapter_freezeExtra(GET_PICOLOGGING_STATE(self), extra);
+    if (frozen == nullptr)
+        return -1;
+    Py_XSETREF(self->extra, frozen);
+    Py_XSETREF(self->logger, Py_NewRef(logger));
+    self->mergeExtra = mergeExtra;
+    return 0;
+}
+
+PyObject* LoggerAdapter_dealloc(LoggerAdapter *self) {
+    Py_CLEAR(self->logger);
+    Py_CLEAR(self->extra);
+    Py_CLEAR(self->_const_extra);
+    Py_CLEAR(self->_const_exc_info);
+    Py_CLEAR(self->_const_process);
+    Py_CLEAR(self->_const_log);
+    Py_CLEAR(self->_const_isEnabledFor);
+    PyTypeObject* type = Py_TYPE(self);
+    type->tp_free((PyObject*)self);
+    Py_DECREF_HEAPTYPE(type);
+    return NULL;
+}
+
+PyObject* LoggerAdapter_repr(LoggerAdapter *self) {
+    PyObject* name = PyObject_GetAttrString(self->logger, "name");
+    if (name == nullptr)
+        return nullptr;
+    PyObject* level = PyObject_CallMethod(self->logger, "getEffectiveLevel", NULL);
+    if (level == nullptr) {
+        Py_DECREF(name);
+        return nullptr;
+    }
+    std::string levelName = _getLevelName((short)PyLong_AsLong(level));
+    PyObject* repr = PyUnicode_FromFormat("<LoggerAdapter %S (%s)>", name, levelName.c_str());
+    Py_DECREF(level);
+    Py_DECREF(name);
+    return repr;
+}
+
+/**
+ * The default process(), sets kwargs["extra"] to the adapter's extra, or
+ * to the merged dict when merge_extra was given. kwargs is changed in place.
+ */
+static int LoggerAdapter_processKwargs(LoggerAdapter *self, PyObject *kwargs) {
+    PyObject* extra = nullptr;
+    PyObject* callExtra = PyDict_GetItemWithError(kwargs, self->_const_extra);
+    if (callExtra == nullptr && PyErr_Occurred())
+        return -1;
+    if (self->mergeExtra && callExtra != nullptr && callExtra != Py_None) {
+        extra = self->extra == Py_None ? PyDict_New() : PyDict_Copy(self->extra);
+        if (extra != nullptr && PyDict_Merge(extra, callExtra, 1) < 0)
+            Py_CLEAR(extra);
+    } else {
+        extra = self->extra == Py_None ? Py_NewRef(Py_None) : PyDict_Copy(self->extra);
+    }
+    if (extra == nullptr)
+        return -1;
+    int ret = PyDict_SetItem(kwargs, self->_const_extra, extra);
+    Py_DECREF(extra);
+    return ret;
+}
+
+PyObject* LoggerAdapter_process(LoggerAdapter *self, PyObject *const *args, Py_ssize_t nargs) {
+    if (nargs != 2) {
+        PyErr_SetString(PyExc_TypeError, "process() requires 2 positional arguments");
+        return nullptr;
+    }
+    if (!PyDict_Check(args[1])) {
+        PyErr_SetString(PyExc_TypeError, "kwargs must be a dict");
+        return nullptr;
+    }
+    if (LoggerAdapter_processKwargs(self, args[1]) < 0)
+        return nullptr;
+    return PyTuple_Pack(2, args[0], args[1]);
+}
+
+/**
+ * Slow path, used when a subclass overrides process() or the wrapped logger
+ * isn't a picologging Logger: process() sees the call's keyword arguments as
+ * a dict and the result is passed on to logger.log().
+ */
+static PyObject* LoggerAdapter_callLog(LoggerAdapter *self, unsigned short level, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames, bool excInfo) {
+    PyObject* kwargs = PyDict_New();
+    if (kwargs == nullptr)
+        return nullptr;
+    Py_ssize_t nkwargs = kwnames != nullptr ? PyTuple_GET_SIZE(kwnames) : 0;
+    for (Py_ssize_t i = 0; i < nkwargs; i++) {
+        if (PyDict_SetItem(kwargs, PyTuple_GET_ITEM(kwnames, i), args[nargs + i]) < 0) {
+            Py_DECREF(kwargs);
+            return nullptr;
+        }
+    }
+    if (excInfo && PyDict_SetDefault(kwargs, self->_const_exc_info, Py_True) == nullptr) {
+        Py_DECREF(kwargs);
+        return nullptr;
+    }
+
+    PyObject* processed;
+    if (self->overridesProcess) {
+        processed = PyObject_CallMethodObjArgs((PyObject*)self, self->_const_process, args[0], kwargs, NULL);
+    } else {
+        processed = LoggerAdapter_processKwargs(self, kwargs) < 0 ? nullptr : PyTuple_Pack(2, args[0], kwargs);
+    }
+    Py_DECREF(kwargs);
+    if (processed == nullptr)
+        return nullptr;
+    if (!PyTuple_Check(processed) || PyTuple_GET_SIZE(processed) != 2) {
+        Py_DECREF(processed);
+        PyErr_SetString(PyExc_TypeError, "process() must return a (msg, kwargs) tuple");
+        return nullptr;
+    }
+
+    PyObject* callKwargs = PyTuple_GET_ITEM(processed, 1);
+    PyObject* callArgs = PyTuple_New(nargs + 1);
+    if (callArgs == nullptr) {
+        Py_DECREF(processed);
+        return nullptr;
+    }
+    PyTuple_SET_ITEM(callArgs, 0, PyLong_FromLong(level));
+    PyTuple_SET_ITEM(callArgs, 1, Py_NewRef(PyTuple_GET_ITEM(processed, 0)));
+    for (Py_ssize_t i = 1; i < nargs; i++)
+        PyTuple_SET_ITEM(callArgs, i + 1, Py_NewRef(args[i]));
+
+    PyObject* result = nullptr;
+    PyObject* log = PyObject_GetAttr(self->logger, self->_const_log);
+    if (log != nullptr && PyTuple_GET_ITEM(callArgs, 0) != nullptr) {
+        result = PyObject_Call(log, callArgs, callKwargs == Py_None ? nullptr : callKwargs);
+    }
+    Py_XDECREF(log);
+    Py_DECREF(callArgs);
+    Py_DECREF(processed);
+    return result;
+}
+
+static PyObject* LoggerAdapter_logAtLevel(LoggerAdapter *self, unsigned short level, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames, bool excInfo, const char* method) {
+    nargs = PyVectorcall_NARGS(nargs);
+    if (nargs < 1) {
+        PyErr_Format(PyExc_TypeError, "%s() requires 1 positional argument", method);
+        return nullptr;
+    }
+    if (Logger_Check(GET_PICOLOGGING_STATE(self), self->logger)) {
+        Logger* logger = (Logger*)self->logger;
+        if (!LoggerAdapter_isEnabledForLevel(logger, level))
+            Py_RETURN_NONE;
+        if (!self->overridesProcess) {
+            // A handler may assign another logger to the adapter while this one is logging
+            Py_INCREF(logger);
+            PyObject* result = Logger_logAndHandle(logger, args, nargs, kwnames, level, self->extra, self->mergeExtra, excInfo);
+            Py_DECREF(logger);
+            return result;
+        }
+    } else {
+        PyObject* enabled = PyObject_CallMethod(self->logger, "isEnabledFor", "H", level);
+        if (enabled == nullptr)
+            return nullptr;
+        int isEnabled = PyObject_IsTrue(enabled);
+        Py_DECREF(enabled);
+        if (isEnabled < 0)
+            return nullptr;
+        if (!isEnabled)
+            Py_RETURN_NONE;
+    }
+    return LoggerAdapter_callLog(self, level, args, nargs, kwnames, excInfo);
+}
+
+PyObject* LoggerAdapter_debug(LoggerAdapter *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
+    return LoggerAdapter_logAtLevel(self, LOG_LEVEL_DEBUG, args, nargs, kwnames, false, "debug");
+}
+
+PyObject* LoggerAdapter_info(LoggerAdapter *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
+    return LoggerAdapter_logAtLevel(self, LOG_LEVEL_INFO, args, nargs, kwnames, false, "info");
+}
+
+PyObject* LoggerAdapter_warning(LoggerAdapter *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
+    return LoggerAdapter_logAtLevel(self, LOG_LEVEL_WARNING, args, nargs, kwnames, false, "warning");
+}
+
+PyObject* LoggerAdapter_error(LoggerAdapter *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
+    return LoggerAdapter_logAtLevel(self, LOG_LEVEL_ERROR, args, nargs, kwnames, false, "error");
+}
+
+PyObject* LoggerAdapter_exception(LoggerAdapter *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
+    return LoggerAdapter_logAtLevel(self, LOG_LEVEL_ERROR, args, nargs, kwnames, true, "exception");
+}
+
+PyObject* LoggerAdapter_critical(LoggerAdapter *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
+    return LoggerAdapter_logAtLevel(self, LOG_LEVEL_CRITICAL, args, nargs, kwnames, false, "critical");
+}
+
+PyObject* LoggerAdapter_log(LoggerAdapter *self, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames) {
+    if (PyVectorcall_NARGS(nargs) < 2){
+        PyErr_SetString(PyExc_TypeError, "log() requires at least 2 positional arguments");
+        return nullptr;
+    }
+    if (!PyLong_Check(args[0])){
+        PyErr_SetString(PyExc_TypeError, "log() requires a level argument");
+        return nullptr;
+    }
+    unsigned short level = PyLong_AsUnsignedLongMask(args[0]);
+    return LoggerAdapter_logAtLevel(self, level, args + 1, PyVectorcall_NARGS(nargs) - 1, kwnames, false, "log");
+}
+
+PyObject* LoggerAdapter_isEnabledFor(LoggerAdapter *self, PyObject *level) {
+    return PyObject_CallMethodObjArgs(self->logger, self->_const_isEnabledFor, level, NULL);
+}
+
+PyObject* LoggerAdapter_setLevel(LoggerAdapter *self, PyObject *level) {
+    return PyObject_CallMethod(self->logger, "setLevel", "O", level);
+}
+
+PyObject* LoggerAdapter_getEffectiveLevel(LoggerAdapter *self) {
+    return PyObject_CallMethod(self->logger, "getEffectiveLevel", NULL);
+}
+
+PyObject* LoggerAdapter_getExtra(LoggerAdapter *self, void *closure) {
+    return Py_NewRef(self->extra);
+}
+
+int LoggerAdapter_setExtra(LoggerAdapter *self, PyObject *value, void *closure) {
+    if (value == nullptr) {
+        PyErr_SetString(PyExc_AttributeError, "Cannot delete extra");
+        return -1;
+    }
+    PyObject* frozen = LoggerAdapter_freezeExtra(GET_PICOLOGGING_STATE(self), value);
+    if (frozen == nullptr)
+        return -1;
+    Py_XSETREF(self->extra, frozen);
+    return 0;
+}
+
+PyObject* LoggerAdapter_getLogger(LoggerAdapter *self, void *closure) {
+    return Py_NewRef(self->logger);
+}
+
+int LoggerAdapter_setLogger(LoggerAdapter *self, PyObject *value, void *closure) {
+    if (value == nullptr) {
+        PyErr_SetString(PyExc_AttributeError, "Cannot delete logger");
+        return -1;
+    }
+    if (LoggerAdapter_checkLogger(GET_PICOLOGGING_STATE(self), value) < 0)
+        return -1;
+    Py_SETREF(self->logger, Py_NewRef(value));
+    return 0;
+}
+
+PyObject* LoggerAdapter_getName(LoggerAdapter *self, void *closure) {
+    return PyObject_GetAttrString(self->logger, "name");
+}
+
+PyObject* LoggerAdapter_getManager(LoggerAdapter *self, void *closure) {
+    return PyObject_GetAttrString(self->logger, "manager");
+}
+
+int LoggerAdapter_setManager(LoggerAdapter *self, PyObject *value, void *closure) {
+    return PyObject_SetAttrString(self->logger, "manager", value);
+}
+
+static PyMethodDef LoggerAdapter_methods[] = {
+    {"process", (PyCFunction)LoggerAdapter_process, METH_FASTCALL, "Add the adapter's extra to the keyword arguments of a logging call."},
+    {"setLevel", (PyCFunction)LoggerAdapter_setLevel, METH_O, "Set the level of the underlying logger."},
+    {"getEffectiveLevel", (PyCFunction)LoggerAdapter_getEffectiveLevel, METH_NOARGS, "Get the effective level of the underlying logger."},
+    {"isEnabledFor", (PyCFunction)LoggerAdapter_isEnabledFor, METH_O, "Check if the underlying logger is enabled for this level."},
+    // Logging methods
+    {"debug", (PyCFunction)LoggerAdapter_debug, METH_FASTCALL | METH_KEYWORDS, "Log a message at level DEBUG."},
+    {"info", (PyCFunction)LoggerAdapter_info, METH_FASTCALL | METH_KEYWORDS, "Log a message at level INFO."},
+    {"warning", (PyCFunction)LoggerAdapter_warning, METH_FASTCALL | METH_KEYWORDS, "Log a message at level WARNING."},
+    {"error", (PyCFunction)LoggerAdapter_error, METH_FASTCALL | METH_KEYWORDS, "Log a message at level ERROR."},
+    {"exception", (PyCFunction)LoggerAdapter_exception, METH_FASTCALL | METH_KEYWORDS, "Log a message at level ERROR with exception information."},
+    {"critical", (PyCFunction)LoggerAdapter_critical, METH_FASTCALL | METH_KEYWORDS, "Log a message at level CRITICAL."},
+    {"log", (PyCFunction)LoggerAdapter_log, METH_FASTCALL | METH_KEYWORDS, "Log a message at the specified level."},
+    {NULL}
+};
+
+static PyMemberDef LoggerAdapter_members[] = {
+    {"merge_extra", T_BOOL, offsetof(LoggerAdapter, mergeExtra), 0, "Merge the call's extra with the adapter's"},
+    {NULL}
+};
+
+static PyGetSetDef LoggerAdapter_getsets[] = {
+    {"extra",
+     (getter)LoggerAdapter_getExtra,
+     (setter)LoggerAdapter_setExtra,
+     "Context added to every record, a copy taken when it's assigned and changed in place"},
+    {"logger",
+     (getter)LoggerAdapter_getLogger,
+     (setter)LoggerAdapter_setLogger,
+     "Underlying logger"},
+    {"name",
+     (getter)LoggerAdapter_getName,
+     nullptr,
+     "Name of the underlying logger"},
+    {"manager",
+     (getter)LoggerAdapter_getManager,
+     (setter)LoggerAdapter_setManager,
+     "Manager of the underlying logger"},
+    {NULL, NULL, NULL, NULL }  /* sentinel */
+};
+
+static PyType_Slot LoggerAdapter_slots[] = {
+    {Py_tp_dealloc, (void*)LoggerAdapter_dealloc},
+    {Py_tp_repr, (void*)LoggerAdapter_repr},
+    {Py_tp_doc, (void*)PyDoc_STR("Adds contextual information to the records of a logger.")},
+    {Py_tp_methods, LoggerAdapter_methods},
+    {Py_tp_members, LoggerAdapter_members},
+    {Py_tp_getset, LoggerAdapter_getsets},
+    {Py_tp_init, (void*)LoggerAdapter_init},
+    {Py_tp_new, (void*)LoggerAdapter_new},
+    {Py_tp_free, (void*)PyObject_Del},
+    {0, NULL}
+};
+
+PyType_Spec LoggerAdapterType_spec = {
+    "picologging.LoggerAdapter",
+    sizeof(LoggerAdapter),
+    0,
+    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE | Py_TPFLAGS_IMMUTABLETYPE,
+    LoggerAdapter_slots,
+};
@@ -0,0 +1,30 @@
+#include <Python.h>
+#include <structmember.h>
+#include "compat.hxx"
+#include "logger.hxx"
+
+#ifndef PICOLOGGING_LOGGERADAPTER_H
+#define PICOLOGGING_LOGGERADAPTER_H
+
+typedef struct {
+    PyObject_HEAD
+    PyObject *logger;
+    // Snapshot of the extra mapping taken when it's assigned, its keys are already validated.
+    PyObject *extra;
+    bool mergeExtra;
+    // Set when a subclass defines process(), which then runs for every call.
+    bool overridesProcess;
+
+    // Constant strings.
+    PyObject* _const_extra;
+    PyObject* _const_exc_info;
+    PyObject* _const_process;
+    PyObject* _const_log;
+    PyObject* _const_isEnabledFor;
+} LoggerAdapter;
+
+extern PyType_Spec LoggerAdapterType_spec;
+#define LoggerAdapter_CheckExact(state, op) Py_IS_TYPE(op, (state)->LoggerAdapterType)
+#define LoggerAdapter_Check(state, op) PyObject_TypeCheck(op, (state)->LoggerAdapterType)
+
+#endif // PICOLOGGING_LOGGERADAPTER_H
@@ -1,26 +1,54 @@
 #include <thread>
 #include <filesystem>
+#include <cmath>
 #include "logrecord.hxx"
 #include "compat.hxx"
 #include "picologging.hxx"
+#include "tracebackformat.hxx"
+#include "lazy.hxx"
 
 namespace fs = std::filesystem;
-_PyTime_t startTime = current_time();
+// relativeCreated is measured from here, in the same units as createdNanos
+static const long long startTime = Clock_now(Clock_Realtime);
 
-static PyObject*
-_PyFloat_FromPyTime(_PyTime_t t)
+long long LogRecord_startTime() {
+    return startTime;
+}
+
+double LogRecord_created(LogRecord *self)
 {
-    double d = _PyTime_AsSecondsDouble(t);
-    return PyFloat_FromDouble(d);
+    if (!(self->timeFields & LogRecord_HasCreated)) {
+        self->created = (double)self->createdNanos / 1e9;
+        self->timeFields |= LogRecord_HasCreated;
+    }
+    return self->created;
 }
 
-_PyTime_t current_time()
+long LogRecord_msecs(LogRecord *self)
 {
-    _PyTime_t t;
-    if (_PyTime_GetSystemClockWithInfo(&t, NULL) < 0) {
-        return -1;
+    if (!(self->timeFields & LogRecord_HasMsecs)) {
+        // Rounded up, as _PyTime_AsMilliseconds(..., _PyTime_ROUND_CEILING) did
+        long long millis = self->createdNanos / 1000000;
+        if (millis * 1000000 < self->createdNanos)
+            millis++;
+        self->msecs = (long)millis;
+        self->timeFields |= LogRecord_HasMsecs;
     }
-    return t;
+    return self->msecs;
+}
+
+PyObject* LogRecord_relativeCreated(LogRecord *self)
+{
+    if (self->relativeCreated == nullptr)
+        self->relativeCreated = PyFloat_FromDouble((double)(self->createdNanos - startTime) / 1e6);
+    return self->relativeCreated;
+}
+
+void LogRecord_setCreated(LogRecord *self, double created)
+{
+    self->created = created;
+    self->createdNanos = std::llround(created * 1e9);
+    self->timeFields |= LogRecord_HasCreated;
 }
 
 PyObject* LogRecord_new(PyTypeObject* type, PyObject *initargs, PyObject *kwds)
@@ -52,7 +80,86 @@ PyObject* LogRecord_new(PyTypeObject* type, PyObject *initargs, PyObject *kwds)
     return (PyObject*)LogRecord_create(self, name, msg, args, levelno, pathname, lineno, exc_info, funcname, sinfo);
 }
 
-LogRecord* LogRecord_create(LogRecord* self, PyObject* name, PyObject* msg, PyObject* args, int levelno, PyObject* pathname, int lineno, PyObject* exc_info, PyObject* funcname, PyObject* sinfo) {
+#if PY_VERSION_HEX >= 0x03090000
+static const char* const LogRecord_kwlist[] = {
+    "name", "level", "pathname", "lineno", "msg", "args", "exc_info", "func", "sinfo"};
+#define LOGRECORD_NARGS 9
+#define LOGRECORD_REQUIRED 7
+
+static bool LogRecord_asInt(PyObject* value, int* result)
+{
+    long v = PyLong_AsLong(value);
+    if (v == -1 && PyErr_Occurred())
+        return false;
+    if (v > INT_MAX || v < INT_MIN) {
+        PyErr_SetString(PyExc_OverflowError, "signed integer is out of range for a C int");
+        return false;
+    }
+    *result = (int)v;
+    return true;
+}
+
+/**
+ * Vectorcall entry point for LogRecord(...), binds the arguments straight
+ * from the caller's stack instead of packing them into a tuple and dict
+ * for PyArg_ParseTupleAndKeywords. Only used for the exact type,
+ * subclasses go through tp_new and tp_init.
+ */
+PyObject* LogRecord_vectorcall(PyObject* type, PyObject* const* args, size_t nargsf, PyObject* kwnames)
+{
+    Py_ssize_t nargs = PyVectorcall_NARGS(nargsf);
+    PyObject* values[LOGRECORD_NARGS] = {nullptr};
+    int levelno, lineno;
+
+    if (nargs > LOGRECORD_NARGS) {
+        PyErr_Format(PyExc_TypeError, "LogRecord() takes at most %d arguments (%zd given)", LOGRECORD_NARGS, nargs);
+        return nullptr;
+    }
+    for (Py_ssize_t i = 0; i < nargs; i++)
+        values[i] = args[i];
+
+    if (kwnames != nullptr) {
+        Py_ssize_t nkwargs = PyTuple_GET_SIZE(kwnames);
+        for (Py_ssize_t i = 0; i < nkwargs; i++) {
+            PyObject* key = PyTuple_GET_ITEM(kwnames, i);
+            int index = 0;
+            while (index < LOGRECORD_NARGS && PyUnicode_CompareWithASCIIString(key, LogRecord_kwlist[index]) != 0)
+                index++;
+            if (index == LOGRECORD_NARGS) {
+                PyErr_Format(PyExc_TypeError, "'%U' is an invalid keyword argument for LogRecord()", key);
+                return nullptr;
+            }
+            if (values[index] != nullptr) {
+                PyErr_Format(PyExc_TypeError, "argument for LogRecord() given by name ('%s') and position (%d)",
+                    LogRecord_kwlist[index], index + 1);
+                return nullptr;
+            }
+            values[index] = args[nargs + i];
+        }
+    }
+
+    for (int i = 0; i < LOGRECORD_REQUIRED; i++) {
+        if (values[i] == nullptr) {
+            PyErr_Format(PyExc_TypeError, "LogRecord() missing required argument '%s' (pos %d)", LogRecord_kwlist[i], i + 1);
+            return nullptr;
+        }
+    }
+    if (!LogRecord_asInt(values[1], &levelno) || !LogRecord_asInt(values[3], &lineno))
+        return nullptr;
+
+    PyTypeObject* tp = (PyTypeObject*)type;
+    LogRecord* self = (LogRecord*)tp->tp_alloc(tp, 0);
+    if (self == NULL)
+    {
+        PyErr_NoMemory();
+        return NULL;
+    }
+    return (PyObject*)LogRecord_create(self, values[0], values[4], values[5], levelno, values[2], lineno, values[6],
+        values[7], values[8]);
+}
+#endif
+
+LogRecord* LogRecord_create(LogRecord* self, PyObject* name, PyObject* msg, PyObject* args, int levelno, PyObject* pathname, int lineno, PyObject* exc_info, PyObject* funcname, PyObject* sinfo, RecordClock clock) {
     self->name = Py_NewRef(name);
     self->msg = Py_NewRef(msg);
 
@@ -81,7 +188,7 @@ LogRecord* LogRecord_create(LogRecord* self, PyObject* name, PyObject* msg, PyOb
 
     self->levelno = levelno;
 
-    picologging_state *state = GET_PICOLOGGING_STATE();
+    picologging_state *state = GET_PICOLOGGING_STATE(self);
     PyObject* levelname = nullptr;
     switch (levelno) {
         case LOG_LEVEL_CRITICAL:
@@ -112,9 +219,11 @@ LogRecord* LogRecord_create(LogRecord* self, PyObject* name, PyObject* msg, PyOb
 
 #ifdef PICOLOGGING_CACHE_FILEPATH
     if (state && state->g_filepathCache != nullptr) {
-        auto filepath = state->g_filepathCache->lookup(pathname);
-        self->filename = Py_NewRef(filepath.filename);
-        self->module = Py_NewRef(filepath.module);
+        FilepathCacheEntry filepath;
+        if (state->g_filepathCache->lookup(pathname, &filepath) < 0)
+            goto error;
+        self->filename = filepath.filename;
+        self->module = filepath.module;
     } else {
         // Manual lookup - TODO Raise warning?
         fs::path fs_path = fs::path(PyUnicode_AsUTF8(pathname));
@@ -149,21 +258,18 @@ LogRecord* LogRecord_create(LogRecord* self, PyObject* name, PyObject* msg, PyOb
     } else {
         self->stackInfo = Py_NewRef(Py_None);
     }
-    
+    self->stackFrames = nullptr;
+
     self->lineno = lineno;
     if (funcname != NULL){
         self->funcName = Py_NewRef(funcname);
     } else {
         self->funcName = Py_NewRef(Py_None);
     }
-    _PyTime_t ctime = current_time();
-    if (ctime == -1){
-        goto error;
-    }
-
-    self->created = _PyTime_AsSecondsDouble(ctime);
-    self->msecs = _PyTime_AsMilliseconds(ctime, _PyTime_ROUND_CEILING);
-    self->relativeCreated = _PyFloat_FromPyTime((ctime - startTime) * 1000);    
+    // created, msecs and relativeCreated are only computed if they're read
+    self->createdNanos = Clock_now(clock);
+    self->timeFields = 0;
+    self->relativeCreated = nullptr;
     self->thread = PyThread_get_thread_ident(); // Only supported in Python 3.7+, if big demand for 3.6 patch this out for the old API.
     // TODO #2 : See if there is a performant way to get the thread name.
     self->threadName = Py_NewRef(Py_None);
@@ -175,22 +281,22 @@ LogRecord* LogRecord_create(LogRecord* self, PyObject* name, PyObject* msg, PyOb
     return self;
 
 error:
-    Py_XDECREF(self->name);
-    Py_XDECREF(self->msg);
-    Py_XDECREF(self->args);
-    Py_XDECREF(self->levelname);
-    Py_XDECREF(self->pathname);
-    Py_XDECREF(self->filename);
-    Py_XDECREF(self->module);
-    Py_XDECREF(self->funcName);
-    Py_XDECREF(self->relativeCreated);
-    Py_XDECREF(self->threadName);
-    Py_XDECREF(self->processName);
-    Py_XDECREF(self->excInfo);
-    Py_XDECREF(self->excText);
-    Py_XDECREF(self->stackInfo);
-    Py_XDECREF(self->message);
-    Py_XDECREF(self->asctime);
+    Py_CLEAR(self->name);
+    Py_CLEAR(self->msg);
+    Py_CLEAR(self->args);
+    Py_CLEAR(self->levelname);
+    Py_CLEAR(self->pathname);
+    Py_CLEAR(self->filename);
+    Py_CLEAR(self->module);
+    Py_CLEAR(self->funcName);
+    Py_CLEAR(self->relativeCreated);
+    Py_CLEAR(self->threadName);
+    Py_CLEAR(self->processName);
+    Py_CLEAR(self->excInfo);
+    Py_CLEAR(self->excText);
+    Py_CLEAR(self->stackInfo);
+    Py_CLEAR(self->message);
+    Py_CLEAR(self->asctime);
     if (!PyErr_Occurred()) {
         PyErr_Format(PyExc_ValueError, "Could not create LogRecord, unknown error.");
     }
@@ -213,10 +319,14 @@ PyObject* LogRecord_dealloc(LogRecord *self)
     Py_CLEAR(self->excInfo);
     Py_CLEAR(self->excText);
     Py_CLEAR(self->stackInfo);
+    delete self->stackFrames;
+    self->stackFrames = nullptr;
     Py_CLEAR(self->message);
     Py_CLEAR(self->asctime);
     Py_CLEAR(self->dict);
-    ((PyObject*)self)->ob_type->tp_free((PyObject*)self);
+    PyTypeObject* type = Py_TYPE(self);
+    type->tp_free((PyObject*)self);
+    Py_DECREF_HEAPTYPE(type);
     return nullptr;
 }
 
@@ -225,9 +335,88 @@ int LogRecord_init(LogRecord *self, PyObject *args, PyObject *kwds)
     return 0;
 }
 
+/**
+ * Resolve the lazy() values of a single mapping argument into a copy, the
+ * caller's dict is left untouched.
+ */
+static int resolveMappingArgs(LogRecord *self)
+{
+    PyObject *key, *value;
+    Py_ssize_t pos = 0;
+    bool found = false;
+    picologging_state* state = GET_PICOLOGGING_STATE(self);
+    while (!found && PyDict_Next(self->args, &pos, &key, &value))
+        found = Lazy_CheckExact(state, value);
+    if (!found)
+        return 0;
+
+    PyObject* resolved = PyDict_Copy(self->args);
+    if (resolved == nullptr) {
+        self->argsResolved = false;
+        return -1;
+    }
+    // Walk the copy, user code run by the callables can't reach it. Replacing
+    // the value of an existing key doesn't disturb the iteration.
+    pos = 0;
+    while (PyDict_Next(resolved, &pos, &key, &value)) {
+        if (!Lazy_CheckExact(state, value))
+            continue;
+        PyObject* result = Lazy_evaluate((Lazy*)value);
+        if (result == nullptr || PyDict_SetItem(resolved, key, result) < 0) {
+            Py_XDECREF(result);
+            Py_DECREF(resolved);
+            self->argsResolved = false;
+            return -1;
+        }
+        Py_DECREF(result);
+    }
+    Py_SETREF(self->args, resolved);
+    return 0;
+}
+
+/**
+ * Replace lazy() arguments with their values, once per record so every
+ * handler formats the same values.
+ */
+int LogRecord_resolveArgs(LogRecord *self)
+{
+    if (self->argsResolved || !self->hasArgs)
+        return 0;
+    self->argsResolved = true;
+    if (PyDict_Check(self->args))
+        return resolveMappingArgs(self);
+    if (!PyTuple_CheckExact(self->args))
+        return 0;
+    picologging_state* state = GET_PICOLOGGING_STATE(self);
+    Py_ssize_t size = PyTuple_GET_SIZE(self->args);
+    Py_ssize_t first = 0;
+    while (first < size && !Lazy_CheckExact(state, PyTuple_GET_ITEM(self->args, first)))
+        first++;
+    if (first == size)
+        return 0;
+
+    PyObject* resolved = PyTuple_New(size);
+    if (resolved == nullptr)
+        return -1;
+    for (Py_ssize_t i = 0; i < size; i++) {
+        PyObject* arg = PyTuple_GET_ITEM(self->args, i);
+        PyObject* value = i >= first && Lazy_CheckExact(state, arg) ? Lazy_evaluate((Lazy*)arg) : Py_NewRef(arg);
+        if (value == nullptr) {
+            Py_DECREF(resolved);
+            self->argsResolved = false;
+            return -1;
+        }
+        PyTuple_SET_ITEM(resolved, i, value);
+    }
+    Py_SETREF(self->args, resolved);
+    return 0;
+}
+
 int LogRecord_writeMessage(LogRecord *self)
 {
     PyObject *msg = nullptr;
+    if (LogRecord_resolveArgs(self) == -1)
+        return -1;
     PyObject *args = self->args;
 
     if (PyUnicode_Check(self->msg)){
@@ -257,6 +446,94 @@ int LogRecord_writeMessage(LogRecord *self)
     }
 }
 
+/**
+ * Render the stack captured by the logger into the stack_info attribute.
+ */
+int LogRecord_writeStackInfo(LogRecord *self)
+{
+    if (self->stackFrames == nullptr)
+        return 0;
+    PyObject* stackInfo = formatStack(GET_PICOLOGGING_STATE(self), self->stackFrames);
+    if (stackInfo == nullptr)
+        return -1;
+    Py_SETREF(self->stackInfo, stackInfo);
+    delete self->stackFrames;
+    self->stackFrames = nullptr;
+    return 0;
+}
+
+PyObject* LogRecord_getStackInfo(LogRecord *self, void *closure)
+{
+    if (LogRecord_writeStackInfo(self) == -1)
+        return nullptr;
+    return Py_NewRef(self->stackInfo);
+}
+
+int LogRecord_setStackInfo(LogRecord *self, PyObject *value, void *closure)
+{
+    if (value == nullptr){
+        PyErr_SetString(PyExc_AttributeError, "Cannot delete stack_info");
+        return -1;
+    }
+    delete self->stackFrames;
+    self->stackFrames = nullptr;
+    Py_SETREF(self->stackInfo, Py_NewRef(value));
+    return 0;
+}
+
+PyObject* LogRecord_getCreated(LogRecord *self, void *closure)
+{
+    return PyFloat_FromDouble(LogRecord_created(self));
+}
+
+int LogRecord_setCreatedAttr(LogRecord *self, PyObject *value, void *closure)
+{
+    if (value == nullptr){
+        PyErr_SetString(PyExc_AttributeError, "Cannot delete created");
+        return -1;
+    }
+    double created = PyFloat_AsDouble(value);
+    if (created == -1.0 && PyErr_Occurred())
+        return -1;
+    LogRecord_setCreated(self, created);
+    return 0;
+}
+
+PyObject* LogRecord_getMsecs(LogRecord *self, void *closure)
+{
+    return PyLong_FromLong(LogRecord_msecs(self));
+}
+
+int LogRecord_setMsecs(LogRecord *self, PyObject *value, void *closure)
+{
+    if (value == nullptr){
+        PyErr_SetString(PyExc_AttributeError, "Cannot delete msecs");
+        return -1;
+    }
+    long msecs = PyLong_AsLong(value);
+    if (msecs == -1 && PyErr_Occurred())
+        return -1;
+    self->msecs = msecs;
+    self->timeFields |= LogRecord_HasMsecs;
+    return 0;
+}
+
+PyObject* LogRecord_getRelativeCreated(LogRecord *self, void *closure)
+{
+    PyObject* relativeCreated = LogRecord_relativeCreated(self);
+    return relativeCreated == nullptr ? nullptr : Py_NewRef(relativeCreated);
+}
+
+int LogRecord_setRelativeCreated(LogRecord *self, PyObject *value, void *closure)
+{
+    if (value == nullptr){
+        PyErr_SetString(PyExc_AttributeError, "Cannot delete relativeCreated");
+        return -1;
+    }
+    Py_XSETREF(self->relativeCreated, Py_NewRef(value));
+    return 0;
+}
+
 /**
  * Update the message attribute of the object and return the field
  */
@@ -269,6 +546,8 @@ PyObject* LogRecord_getMessage(LogRecord *self)
 
 PyObject* LogRecordLogRecord_getnewargs(LogRecord *self)
 {
+    if (LogRecord_writeStackInfo(self) == -1)
+        return nullptr;
     return Py_BuildValue("OlOlOOOOO", self->name, self->levelno, self->pathname, self->lineno,  self->msg, self->args, self->excInfo, self->funcName, self->stackInfo);
 }
 
@@ -282,9 +561,69 @@ PyObject* LogRecord_repr(LogRecord *self)
             self->msg);
 }
 
+/**
+ * Raise KeyError when an `extra` key would shadow one of the record's own
+ * attributes, the same rule as logging.Logger.makeRecord.
+ */
+int LogRecord_checkExtraKey(picologging_state *state, PyObject *key)
+{
+    if (!PyUnicode_Check(key))
+        return 0;
+    int found = PyObject_HasAttr((PyObject*)state->LogRecordType, key);
+    if (found) {
+        PyErr_Format(PyExc_KeyError, "Attempt to overwrite %R in LogRecord", key);
+        return -1;
+    }
+    return 0;
+}
+
+int LogRecord_addExtra(LogRecord *self, PyObject *extra)
+{
+    if (extra == Py_None)
+        return 0;
+    picologging_state* state = GET_PICOLOGGING_STATE(self);
+    if (PyDict_CheckExact(extra) && self->dict == nullptr) {
+        PyObject *key, *value;
+        Py_ssize_t pos = 0;
+        while (PyDict_Next(extra, &pos, &key, &value)) {
+            if (LogRecord_checkExtraKey(state, key) < 0)
+                return -1;
+        }
+        self->dict = PyDict_Copy(extra);
+        return self->dict == nullptr ? -1 : 0;
+    }
+    PyObject* items = PyMapping_Items(extra);
+    if (items == nullptr)
+        return -1;
+    PyObject* dict = PyObject_GenericGetDict((PyObject*)self, nullptr);
+    if (dict == nullptr) {
+        Py_DECREF(items);
+        return -1;
+    }
+    int ret = 0;
+    for (Py_ssize_t i = 0; i < PyList_GET_SIZE(items) && ret == 0; i++) {
+        PyObject* item = PyList_GET_ITEM(items, i);
+        if (!PyTuple_Check(item) || PyTuple_GET_SIZE(item) != 2) {
+            PyErr_SetString(PyExc_TypeError, "extra items must be (key, value) pairs");
+            ret = -1;
+            break;
+        }
+        PyObject* key = PyTuple_GET_ITEM(item, 0);
+        if (LogRecord_checkExtraKey(state, key) < 0)
+            ret = -1;
+        else
+            ret = PyDict_SetItem(dict, key, PyTuple_GET_ITEM(item, 1));
+    }
+    Py_DECREF(dict);
+    Py_DECREF(items);
+    return ret;
+}
+
 PyObject *
 LogRecord_getDict(PyObject *obj, void *context)
 {
+    if (LogRecord_writeStackInfo((LogRecord*)obj) == -1)
+        return nullptr;
     PyObject* dict = PyObject_GenericGetDict(obj, context);
     PyDict_SetItemString(dict, "name", ((LogRecord*)obj)->name);
     PyDict_SetItemString(dict, "msg", ((LogRecord*)obj)->msg);
@@ -304,15 +643,20 @@ LogRecord_getDict(PyObject *obj, void *context)
     PyDict_SetItemString(dict, "lineno", lineno); 
     Py_DECREF(lineno);
 
-    PyObject *created = PyFloat_FromDouble(((LogRecord*)obj)->created);
+    PyObject *created = PyFloat_FromDouble(LogRecord_created((LogRecord*)obj));
     PyDict_SetItemString(dict, "created", created);
     Py_DECREF(created);
 
-    PyObject *msecs = PyLong_FromLong(((LogRecord*)obj)->msecs);
+    PyObject *msecs = PyLong_FromLong(LogRecord_msecs((LogRecord*)obj));
     PyDict_SetItemString(dict, "msecs", msecs);
     Py_DECREF(msecs);
 
-    PyDict_SetItemString(dict, "relativeCreated", ((LogRecord*)obj)->relativeCreated);
+    PyObject *relativeCreated = LogRecord_relativeCreated((LogRecord*)obj);
+    if (relativeCreated == nullptr) {
+        Py_DECREF(dict);
+        return nullptr;
+    }
+    PyDict_SetItemString(dict, "relativeCreated", relativeCreated);
 
     PyObject *thread = PyLong_FromUnsignedLong(((LogRecord*)obj)->thread);
     PyDict_SetItemString(dict, "thread", thread);
@@ -344,18 +688,15 @@ static PyMemberDef LogRecord_members[] = {
     {"module", T_OBJECT_EX, offsetof(LogRecord, module), 0, "Module name"},
     {"lineno", T_INT, offsetof(LogRecord, lineno), 0, "Line number"},
     {"funcName", T_OBJECT_EX, offsetof(LogRecord, funcName), 0, "Function name"},
-    {"created", T_DOUBLE, offsetof(LogRecord, created), 0, "Created"},
-    {"msecs", T_LONG, offsetof(LogRecord, msecs), 0, "Milliseconds"},
-    {"relativeCreated", T_OBJECT_EX, offsetof(LogRecord, relativeCreated), 0, "Relative created"},
     {"thread", T_ULONG, offsetof(LogRecord, thread), 0, "Thread"},
     {"threadName", T_OBJECT_EX, offsetof(LogRecord, threadName), 0, "Thread name"},
     {"processName", T_OBJECT_EX, offsetof(LogRecord, processName), 0, "Process name"},
     {"process", T_INT, offsetof(LogRecord, process), 0, "Process"},
     {"exc_info", T_OBJECT_EX, offsetof(LogRecord, excInfo), 0, "Exception info"},
     {"exc_text", T_OBJECT_EX, offsetof(LogRecord, excText), 0, "Exception text"},
-    {"stack_info", T_OBJECT_EX, offsetof(LogRecord, stackInfo), 0, "Stack info"},
     {"message", T_OBJECT_EX, offsetof(LogRecord, message), 0, "Message"},
     {"asctime", T_OBJECT_EX, offsetof(LogRecord, asctime), 0, "Asctime"},
+    {"__dictoffset__", T_PYSSIZET, offsetof(LogRecord, dict), READONLY},
     {NULL}
 };
 
@@ -367,47 +708,30 @@ static PyMethodDef LogRecord_methods[] = {
 
 static PyGetSetDef LogRecord_getset[] = {
     {"__dict__", LogRecord_getDict, PyObject_GenericSetDict},
+    {"stack_info", (getter)LogRecord_getStackInfo, (setter)LogRecord_setStackInfo, "Stack info"},
+    {"created", (getter)LogRecord_getCreated, (setter)LogRecord_setCreatedAttr, "Created"},
+    {"msecs", (getter)LogRecord_getMsecs, (setter)LogRecord_setMsecs, "Milliseconds"},
+    {"relativeCreated", (getter)LogRecord_getRelativeCreated, (setter)LogRecord_setRelativeCreated, "Relative created"},
     {NULL}
 };
 
-PyTypeObject LogRecordType = {
-    PyObject_HEAD_INIT(NULL)
-    "picologging.LogRecord",                    /* tp_name */
-    sizeof(LogRecord),                          /* tp_basicsize */
-    0,                                          /* tp_itemsize */
-    (destructor)LogRecord_dealloc,              /* tp_dealloc */
-    0,                                          /* tp_vectorcall_offset */
-    0,                                          /* tp_getattr */
-    0,                                          /* tp_setattr */
-    0,                                          /* tp_as_async */
-    (reprfunc)LogRecord_repr,                   /* tp_repr */
-    0,                                          /* tp_as_number */
-    0,                                          /* tp_as_sequence */
-    0,                                          /* tp_as_mapping */
-    0,                                          /* tp_hash */
-    0,                                          /* tp_call */
-    0,                                          /* tp_str */
-    PyObject_GenericGetAttr,                    /* tp_getattro */
-    PyObject_GenericSetAttr,                    /* tp_setattro */
-    0,                                          /* tp_as_buffer */
-    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE,  /* tp_flags */
-    PyDoc_STR("LogRecord objects are used to hold information about log events."),  /* tp_doc */
-    0,                                          /* tp_traverse */
-    0,                                          /* tp_clear */
-    0,                                          /* tp_richcompare */
-    0,                                          /* tp_weaklistoffset */
-    0,                                          /* tp_iter */
-    0,                                          /* tp_iternext */
-    LogRecord_methods,                          /* tp_methods */
-    LogRecord_members,                          /* tp_members */
-    LogRecord_getset,                           /* tp_getset */
-    0,                                          /* tp_base */
-    0,                                          /* tp_dict */
-    0,                                          /* tp_descr_get */
-    0,                                          /* tp_descr_set */
-    offsetof(LogRecord, dict),                  /* tp_dictoffset */
-    (initproc)LogRecord_init,                   /* tp_init */
-    0,                                          /* tp_alloc */
-    LogRecord_new,                              /* tp_new */
-    PyObject_Del,                               /* tp_free */
+static PyType_Slot LogRecord_slots[] = {
+    {Py_tp_dealloc, (void*)LogRecord_dealloc},
+    {Py_tp_repr, (void*)LogRecord_repr},
+    {Py_tp_doc, (void*)PyDoc_STR("LogRecord objects are used to hold information about log events.")},
+    {Py_tp_methods, LogRecord_methods},
+    {Py_tp_members, LogRecord_members},
+    {Py_tp_getset, LogRecord_getset},
+    {Py_tp_init, (void*)LogRecord_init},
+    {Py_tp_new, (void*)LogRecord_new},
+    {Py_tp_free, (void*)PyObject_Del},
+    {0, NULL}
+};
+
+PyType_Spec LogRecordType_spec = {
+    "picologging.LogRecord",
+    sizeof(LogRecord),
+    0,
+    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE | Py_TPFLAGS_IMMUTABLETYPE,
+    LogRecord_slots,
 };
\ No newline at end of file
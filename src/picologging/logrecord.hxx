@@ -3,6 +3,10 @@
 #include <cstddef>
 #include <vector>
 #include "compat.hxx"
+#include "framecache.hxx"
+#include "clock.hxx"
+
+struct picologging_state;
 
 #ifndef PICOLOGGING_LOGRECORD_H
 #define PICOLOGGING_LOGRECORD_H
@@ -19,9 +23,13 @@ typedef struct {
     PyObject *module;
     int lineno;
     PyObject *funcName;
+    long long createdNanos; // Nanoseconds since the epoch, read from the record's clock
+    // created, msecs and relativeCreated are derived from createdNanos when first read,
+    // use the LogRecord_created()... accessors rather than the fields.
     double created;
     long msecs;
     PyObject *relativeCreated;
+    unsigned char timeFields; // LogRecord_HasCreated | LogRecord_HasMsecs
     unsigned long thread;
     PyObject *threadName;
     int process;
@@ -29,24 +37,41 @@ typedef struct {
     PyObject *excInfo;
     PyObject *excText;
     PyObject *stackInfo;
+    CapturedStack *stackFrames; // Rendered into stackInfo on first access
     PyObject *message;
     bool hasArgs;
+    bool argsResolved; // lazy() arguments in args have been replaced by their values
     PyObject *asctime;
     PyObject *dict;
 } LogRecord;
 
 int LogRecord_init(LogRecord *self, PyObject *args, PyObject *kwds);
-LogRecord* LogRecord_create(LogRecord* self, PyObject* name, PyObject* msg, PyObject* args, int levelno, PyObject* pathname, int lineno, PyObject* exc_info, PyObject* funcname, PyObject* sinfo) ;
+long long LogRecord_startTime(); // Base of relativeCreated, in nanoseconds
+LogRecord* LogRecord_create(LogRecord* self, PyObject* name, PyObject* msg, PyObject* args, int levelno, PyObject* pathname, int lineno, PyObject* exc_info, PyObject* funcname, PyObject* sinfo, RecordClock clock = Clock_Default) ;
 PyObject* LogRecord_dealloc(LogRecord *self);
+#if PY_VERSION_HEX >= 0x03090000
+PyObject* LogRecord_vectorcall(PyObject* type, PyObject* const* args, size_t nargsf, PyObject* kwnames);
+#endif
+int LogRecord_resolveArgs(LogRecord *self);
 int LogRecord_writeMessage(LogRecord *self);
+int LogRecord_writeStackInfo(LogRecord *self);
 PyObject* LogRecord_getMessage(LogRecord *self);
 PyObject* LogRecord_repr(LogRecord *self);
+int LogRecord_checkExtraKey(picologging_state *state, PyObject *key);
+// Copy extra's items into the record's __dict__, raising KeyError for keys that clash with its attributes.
+int LogRecord_addExtra(LogRecord *self, PyObject *extra);
 PyObject* LogRecord_getDict(PyObject *, void *);
-_PyTime_t current_time();
+#define LogRecord_HasCreated 1
+#define LogRecord_HasMsecs 2
+double LogRecord_created(LogRecord *self);
+long LogRecord_msecs(LogRecord *self);
+PyObject* LogRecord_relativeCreated(LogRecord *self); // Borrowed reference
+// Assigning created also moves createdNanos, which the Formatter renders.
+void LogRecord_setCreated(LogRecord *self, double created);
 
 
-extern PyTypeObject LogRecordType;
-#define LogRecord_CheckExact(op) Py_IS_TYPE(op, &LogRecordType)
-#define LogRecord_Check(op) PyObject_TypeCheck(op, &LogRecordType)
+extern PyType_Spec LogRecordType_spec;
+#define LogRecord_CheckExact(state, op) Py_IS_TYPE(op, (state)->LogRecordType)
+#define LogRecord_Check(state, op) PyObject_TypeCheck(op, (state)->LogRecordType)
 
 #endif // PICOLOGGING_LOGRECORD_H
\ No newline at end of file
@@ -1,26 +1,78 @@
 #include <string>
 #include <Python.h>
 #include "filepathcache.hxx"
+#include "framecache.hxx"
 
 #ifndef PICOLOGGING_H
 #define PICOLOGGING_H
 
-typedef struct {
+struct HandlerRegistry;
+
+typedef struct picologging_state {
   FilepathCache* g_filepathCache;
+  FrameCache* g_frameCache;
   PyObject* g_const_CRITICAL;
   PyObject* g_const_ERROR;
   PyObject* g_const_WARNING;
   PyObject* g_const_INFO;
   PyObject* g_const_DEBUG;
   PyObject* g_const_NOTSET;
+  PyObject* g_default_fmt;
+  // Looked up once when the module is executed
+  PyObject* g_print_exception;
+  PyObject* g_format_list;
+  PyObject* g_extract_tb;
+  PyObject* g_checkcache; // linecache.checkcache
+  PyObject* g_StringIO;
+  // Heap types, one set per module so each interpreter gets its own
+  PyTypeObject* FiltererType;
+  PyTypeObject* LogRecordType;
+  PyTypeObject* LazyType;
+  PyTypeObject* FormatStyleType;
+  PyTypeObject* FormatterType;
+  PyTypeObject* LoggerType;
+  PyTypeObject* LoggerAdapterType;
+  PyTypeObject* HandlerType;
+  PyTypeObject* StreamHandlerType;
+  PyTypeObject* BufferingHandlerType;
+  PyTypeObject* MemoryHandlerType;
+  PyTypeObject* ContextBufferingHandlerType;
+  PyTypeObject* ContextScopeType;
+  PyTypeObject* DeduplicationHandlerType;
+  PyTypeObject* BinaryFileHandlerType;
+  PyTypeObject* CompressorType;
+  PyTypeObject* FlightRecorderHandlerType;
+  PyTypeObject* JournalHandlerType;
+  PyTypeObject* SharedMemoryHandlerType;
+  PyTypeObject* SharedMemoryCollectorType;
+  PyTypeObject* SysLogHandlerType;
+  HandlerRegistry* g_handlers; // Live handlers, for picologging.stats()
 } picologging_state;
 
 extern struct PyModuleDef _picologging_module;
 std::string _getLevelName(short);
 short getLevelByName(std::string levelName);
 
-#define PICOLOGGING_MODULE() PyState_FindModule(&_picologging_module)
-#define GET_PICOLOGGING_STATE() (picologging_state *)PyModule_GetState(PICOLOGGING_MODULE())
+// Slow path of picologging_typeState, walks the MRO of a subclass
+picologging_state* picologging_findTypeState(PyTypeObject* type);
+
+/**
+ * State of the module that created type, which must be one of the module's
+ * types or a subclass of one. The fields are NULL once the module has been
+ * cleared.
+ */
+static inline picologging_state* picologging_typeState(PyTypeObject* type) {
+#if PY_VERSION_HEX >= 0x03090000 // Python 3.9.0
+  // The module's own types point straight at it, only subclasses need the MRO walk
+  if (type->tp_flags & Py_TPFLAGS_HEAPTYPE) {
+    PyObject* module = ((PyHeapTypeObject*)type)->ht_module;
+    if (module != NULL && PyModule_GetDef(module) == &_picologging_module)
+      return (picologging_state*)PyModule_GetState(module);
+  }
+#endif
+  return picologging_findTypeState(type);
+}
+#define GET_PICOLOGGING_STATE(op) picologging_typeState(Py_TYPE(op))
 
 #define LOG_LEVEL_CRITICAL 50
 #define LOG_LEVEL_ERROR 40
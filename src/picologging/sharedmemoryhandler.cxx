@@ -0,0 +1,767 @@
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "sharedmemoryhandler.hxx"
+#include "handler.hxx"
+#include "logrecord.hxx"
+#include "wireformat.hxx"
+#include "compat.hxx"
+#include "picologging.hxx"
+
+// Slot states, ring positions and drop counters are shared with other processes.
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "Shared memory rings and slots need lock-free 64-bit atomics");
+
+#ifndef _WIN32
+
+static inline uint64_t alignFrame(uint64_t size) {
+    return (size + SHAREDMEMORY_ALIGNMENT - 1) & ~(uint64_t)(SHAREDMEMORY_ALIGNMENT - 1);
+}
+
+static inline char* ringData(SharedMemoryRingHeader* header) {
+    return (char*)header + SHAREDMEMORY_RING_HEADER_SIZE;
+}
+
+static inline SharedMemorySlot* registrySlots(SharedMemoryRegistryHeader* registry) {
+    return (SharedMemorySlot*)((char*)registry + SHAREDMEMORY_REGISTRY_HEADER_SIZE);
+}
+
+static inline size_t registrySize(uint32_t slots) {
+    return SHAREDMEMORY_REGISTRY_HEADER_SIZE + (size_t)slots * sizeof(SharedMemorySlot);
+}
+
+static std::string ringName(const std::string& shmName, long slot) {
+    return shmName + "." + std::to_string(slot);
+}
+
+/**
+ * Copy `size` bytes to the absolute position `pos`, wrapping around the end of the ring.
+ */
+static inline void ringWrite(char* ring, uint64_t capacity, uint64_t pos, const char* data, uint64_t size) {
+    uint64_t offset = pos % capacity;
+    uint64_t first = capacity - offset < size ? capacity - offset : size;
+    memcpy(ring + offset, data, first);
+    if (first < size)
+        memcpy(ring, data + first, size - first);
+}
+
+static inline void ringRead(const char* ring, uint64_t capacity, uint64_t pos, void* data, uint64_t size) {
+    uint64_t offset = pos % capacity;
+    uint64_t first = capacity - offset < size ? capacity - offset : size;
+    memcpy(data, ring + offset, first);
+    if (first < size)
+        memcpy((char*)data + first, ring, size - first);
+}
+
+/**
+ * Map the shared memory segment `name`, creating it with `size` bytes when
+ * `create` is set, otherwise mapping it whole. Returns nullptr with errno set.
+ */
+static void* openSegment(const std::string& name, bool create, size_t size, size_t* mappedSize) {
+    int fd = shm_open(name.c_str(), create ? O_RDWR | O_CREAT | O_EXCL : O_RDWR, 0600);
+    if (fd < 0)
+        return nullptr;
+    if (create) {
+        if (ftruncate(fd, (off_t)size) != 0) {
+            int error = errno;
+            close(fd);
+            shm_unlink(name.c_str());
+            errno = error;
+            return nullptr;
+        }
+    } else {
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            int error = errno;
+            close(fd);
+            errno = error;
+            return nullptr;
+        }
+        size = (size_t)st.st_size;
+    }
+    void* view = size == 0 ? MAP_FAILED : mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    int error = size == 0 ? EINVAL : errno;
+    close(fd);
+    if (view == MAP_FAILED) {
+        if (create)
+            shm_unlink(name.c_str());
+        errno = error;
+        return nullptr;
+    }
+    *mappedSize = size;
+    return view;
+}
+
+/**
+ * EPERM counts as alive: the pid exists but belongs to another user. Workers
+ * normally run as the collector's user, so that means the worker died and its
+ * pid was reused by someone else's process. Its slot is then only freed once
+ * that process exits too, or when the collector is closed.
+ */
+static bool processAlive(int32_t pid) {
+    return kill((pid_t)pid, 0) == 0 || errno != ESRCH;
+}
+
+static int checkName(PyObject* name, std::string& shmName) {
+    Py_ssize_t size = 0;
+    const char* utf8 = PyUnicode_AsUTF8AndSize(name, &size);
+    if (utf8 == nullptr)
+        return -1;
+    if (size == 0 || strchr(utf8, '/') != nullptr || strlen(utf8) != (size_t)size) {
+        PyErr_Format(PyExc_ValueError, "invalid shared memory name %R", name);
+        return -1;
+    }
+    shmName.assign("/");
+    shmName.append(utf8, (size_t)size);
+    return 0;
+}
+
+/**
+ * Unmap the registry and ring. The slot is only marked closed by the
+ * process that claimed it, a forked child just drops the parent's mappings.
+ */
+static void detach(SharedMemoryHandler* self, bool release) {
+    if (release && self->registry != nullptr && self->slot >= 0)
+        registrySlots(self->registry)[self->slot].word.store(
+            SharedMemorySlot_word(SharedMemorySlot_Closed, (int32_t)self->pid), std::memory_order_release);
+    if (self->ring != nullptr)
+        munmap(self->ring, self->ringSize);
+    if (self->registry != nullptr)
+        munmap(self->registry, self->registrySize);
+    self->ring = nullptr;
+    self->ringSize = 0;
+    self->registry = nullptr;
+    self->registrySize = 0;
+    self->slot = -1;
+    self->pid = 0;
+}
+
+/**
+ * Claim a free slot and create its ring. Leaves `slot` at -1 when every slot
+ * is taken, the caller counts the record as dropped and tries again next time.
+ */
+static int claim(SharedMemoryHandler* self) {
+    SharedMemoryRegistryHeader* registry = self->registry;
+    SharedMemorySlot* slots = registrySlots(registry);
+    for (uint32_t i = 0; i < registry->slots; i++) {
+        uint64_t expected = SharedMemorySlot_word(SharedMemorySlot_Free, 0);
+        uint64_t claimed = SharedMemorySlot_word(SharedMemorySlot_Claimed, (int32_t)self->pid);
+        if (!slots[i].word.compare_exchange_strong(expected, claimed, std::memory_order_acq_rel))
+            continue;
+
+        // A ring left behind by a crashed worker is replaced, not reused.
+        std::string name = ringName(*self->shmName, i);
+        shm_unlink(name.c_str());
+        uint64_t capacity = registry->ringCapacity;
+        size_t ringSize = 0;
+        void* view = openSegment(name, true, SHAREDMEMORY_RING_HEADER_SIZE + capacity, &ringSize);
+        if (view == nullptr) {
+            PyErr_SetFromErrnoWithFilename(PyExc_OSError, name.c_str());
+            slots[i].word.store(SharedMemorySlot_word(SharedMemorySlot_Free, 0), std::memory_order_release);
+            return -1;
+        }
+        SharedMemoryRingHeader* ring = (SharedMemoryRingHeader*)view;
+        ring->capacity = capacity;
+        ring->pid = (int32_t)self->pid;
+        ring->head.store(0, std::memory_order_relaxed);
+        ring->tail.store(0, std::memory_order_relaxed);
+        ring->dropped.store(0, std::memory_order_relaxed);
+        memcpy(ring->magic, SHAREDMEMORY_MAGIC, SHAREDMEMORY_MAGIC_SIZE);
+        self->ring = ring;
+        self->ringSize = ringSize;
+        self->slot = (long)i;
+        // Publishing the slot last means the collector only ever maps complete rings.
+        slots[i].word.store(SharedMemorySlot_word(SharedMemorySlot_Ready, (int32_t)self->pid), std::memory_order_release);
+        return 0;
+    }
+    return 0;
+}
+
+static int attach(SharedMemoryHandler* self, long pid) {
+    size_t size = 0;
+    void* view = openSegment(*self->shmName, false, 0, &size);
+    if (view == nullptr) {
+        PyErr_SetFromErrnoWithFilename(PyExc_OSError, self->shmName->c_str());
+        return -1;
+    }
+    SharedMemoryRegistryHeader* registry = (SharedMemoryRegistryHeader*)view;
+    if (size < SHAREDMEMORY_REGISTRY_HEADER_SIZE ||
+        memcmp(registry->magic, SHAREDMEMORY_MAGIC, SHAREDMEMORY_MAGIC_SIZE) != 0 ||
+        registry->headerSize != SHAREDMEMORY_REGISTRY_HEADER_SIZE ||
+        size < registrySize(registry->slots)) {
+        munmap(view, size);
+        PyErr_Format(PyExc_ValueError, "%R is not a shared memory log collector", self->name);
+        return -1;
+    }
+    self->registry = registry;
+    self->registrySize = size;
+    self->pid = pid;
+    return claim(self);
+}
+
+#endif
+
+PyObject* SharedMemoryHandler_new(PyTypeObject* type, PyObject* args, PyObject* kwds)
+{
+    SharedMemoryHandler* self = (SharedMemoryHandler*)Handler_new(type, args, kwds);
+    if (self != NULL)
+    {
+        self->name = Py_NewRef(Py_None);
+        self->shmName = new std::string();
+        self->pid = 0;
+        self->registry = nullptr;
+        self->registrySize = 0;
+        self->slot = -1;
+        self->ring = nullptr;
+        self->ringSize = 0;
+        self->buffer = new std::string();
+        self->closed = false;
+    }
+    return (PyObject*)self;
+}
+
+int SharedMemoryHandler_init(SharedMemoryHandler *self, PyObject *args, PyObject *kwds){
+    PyObject* noArgs = PyTuple_New(0);
+    int ret = Handler_init((Handler*)self, noArgs, nullptr);
+    Py_DECREF(noArgs);
+    if (ret < 0)
+        return -1;
+    PyObject *name = nullptr;
+    static const char *kwlist[] = {"name", NULL};
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "U", const_cast<char**>(kwlist), &name)){
+        return -1;
+    }
+#ifndef _WIN32
+    if (checkName(name, *self->shmName) < 0)
+        return -1;
+    // The registry is only opened by the first emit, so the handler can be
+    // configured before the collector exists or before workers fork.
+    detach(self, self->pid == (long)getpid());
+    self->closed = false;
+    Py_SETREF(self->name, Py_NewRef(name));
+    return 0;
+#else
+    PyErr_SetString(PyExc_NotImplementedError, "SharedMemoryHandler requires POSIX shared memory");
+    return -1;
+#endif
+}
+
+PyObject* SharedMemoryHandler_dealloc(SharedMemoryHandler *self) {
+#ifndef _WIN32
+    detach(self, self->pid == (long)getpid());
+#endif
+    Py_CLEAR(self->name);
+    delete self->shmName;
+    delete self->buffer;
+    Handler_dealloc((Handler*)self);
+    return nullptr;
+}
+
+PyObject* SharedMemoryHandler_emit(SharedMemoryHandler* self, PyObject* record){
+#ifndef _WIN32
+    if (self->closed || self->shmName->empty()) {
+        PyErr_SetString(PyExc_ValueError, "I/O operation on closed handler");
+        return nullptr;
+    }
+    if (!LogRecord_Check(GET_PICOLOGGING_STATE(self), record)) {
+        PyErr_SetString(PyExc_TypeError, "SharedMemoryHandler can only emit picologging.LogRecord");
+        return nullptr;
+    }
+    long pid = (long)getpid();
+    if (self->pid != pid) {
+        // Rings are per process, a forked child claims its own slot.
+        detach(self, false);
+        if (attach(self, pid) < 0) {
+            detach(self, true);
+            return nullptr;
+        }
+    } else if (self->slot < 0 && claim(self) < 0) {
+        return nullptr;
+    }
+    if (self->slot < 0) {
+        self->registry->dropped.fetch_add(1, std::memory_order_relaxed);
+        Py_RETURN_NONE;
+    }
+
+    // The frame header is written over the space in front of the wire format's own length prefix.
+    std::string& buffer = *self->buffer;
+    buffer.assign(SHAREDMEMORY_FRAME_HEADER_SIZE - 4, '\0');
+    if (WireFormat_encode((LogRecord*)record, buffer) < 0)
+        return nullptr;
+    uint32_t length = (uint32_t)(buffer.size() - SHAREDMEMORY_FRAME_HEADER_SIZE);
+    uint64_t created = (uint64_t)((LogRecord*)record)->createdNanos;
+    memcpy(&buffer[0], &length, sizeof(length));
+    memcpy(&buffer[sizeof(length)], &created, sizeof(created));
+
+    SharedMemoryRingHeader* ring = self->ring;
+    uint64_t capacity = ring->capacity;
+    uint64_t frameSize = alignFrame(buffer.size());
+    uint64_t head = ring->head.load(std::memory_order_relaxed);
+    uint64_t tail = ring->tail.load(std::memory_order_acquire);
+    // A full ring drops the record rather than blocking the worker on the collector.
+    if (frameSize > capacity / 2 || head + frameSize - tail > capacity) {
+        ring->dropped.fetch_add(1, std::memory_order_relaxed);
+        Py_RETURN_NONE;
+    }
+    ringWrite(ringData(ring), capacity, head, buffer.data(), buffer.size());
+    ring->head.store(head + frameSize, std::memory_order_release);
+    Py_RETURN_NONE;
+#else
+    PyErr_SetString(PyExc_NotImplementedError, "SharedMemoryHandler requires POSIX shared memory");
+    return nullptr;
+#endif
+}
+
+PyObject* SharedMemoryHandler_close(SharedMemoryHandler* self){
+    HandlerLockGuard guard(&self->handler);
+#ifndef _WIN32
+    detach(self, self->pid == (long)getpid());
+#endif
+    self->closed = true;
+    Py_RETURN_NONE;
+}
+
+PyObject* SharedMemoryHandler_getSlot(SharedMemoryHandler* self, void* closure){
+#ifndef _WIN32
+    if (self->slot >= 0 && self->pid == (long)getpid())
+        return PyLong_FromLong(self->slot);
+#endif
+    Py_RETURN_NONE;
+}
+
+PyObject* SharedMemoryHandler_getDropped(SharedMemoryHandler* self, void* closure){
+#ifndef _WIN32
+    if (self->ring != nullptr && self->pid == (long)getpid())
+        return PyLong_FromUnsignedLongLong(self->ring->dropped.load(std::memory_order_relaxed));
+#endif
+    return PyLong_FromLong(0);
+}
+
+PyObject* SharedMemoryHandler_repr(SharedMemoryHandler *self)
+{
+    std::string level = _getLevelName(self->handler.level);
+    return PyUnicode_FromFormat("<%s %R (%s)>",
+        _PyType_Name(Py_TYPE(self)),
+        self->name,
+        level.c_str());
+}
+
+static PyMethodDef SharedMemoryHandler_methods[] = {
+    {"emit", (PyCFunction)SharedMemoryHandler_emit, METH_O, "Copy an encoded record into this process' ring."},
+    {"close", (PyCFunction)SharedMemoryHandler_close, METH_NOARGS, "Release the ring to the collector."},
+    {NULL}
+};
+
+static PyMemberDef SharedMemoryHandler_members[] = {
+    {"memoryName", T_OBJECT_EX, offsetof(SharedMemoryHandler, name), READONLY, "Name of the collector's shared memory"},
+    {NULL}
+};
+
+static PyGetSetDef SharedMemoryHandler_getset[] = {
+    {"slot", (getter)SharedMemoryHandler_getSlot, nullptr, "Registry slot claimed by this process, None before the first record", nullptr},
+    {"dropped", (getter)SharedMemoryHandler_getDropped, nullptr, "Records from this process dropped because the ring was full", nullptr},
+    {NULL}
+};
+
+static PyType_Slot SharedMemoryHandler_slots[] = {
+    {Py_tp_dealloc, (void*)SharedMemoryHandler_dealloc},
+    {Py_tp_repr, (void*)SharedMemoryHandler_repr},
+    {Py_tp_doc, (void*)PyDoc_STR("Handler which writes records into a per-process ring in shared memory, read by a SharedMemoryCollector.")},
+    {Py_tp_methods, SharedMemoryHandler_methods},
+    {Py_tp_members, SharedMemoryHandler_members},
+    {Py_tp_getset, SharedMemoryHandler_getset},
+    {Py_tp_init, (void*)SharedMemoryHandler_init},
+    {Py_tp_new, (void*)SharedMemoryHandler_new},
+    {Py_tp_free, (void*)PyObject_Del},
+    {0, NULL}
+};
+
+PyType_Spec SharedMemoryHandlerType_spec = {
+    "picologging.handlers.SharedMemoryHandler",
+    sizeof(SharedMemoryHandler),
+    0,
+    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE | Py_TPFLAGS_IMMUTABLETYPE,
+    SharedMemoryHandler_slots,
+};
+
+#ifndef _WIN32
+
+typedef struct {
+    uint64_t created;
+    PyObject* record;
+} CollectedRecord;
+
+static void unmapRing(SharedMemoryCollectorRing& ring) {
+    if (ring.header != nullptr)
+        munmap(ring.header, ring.size);
+    ring.header = nullptr;
+    ring.size = 0;
+    ring.pid = 0;
+}
+
+static int mapRing(SharedMemoryCollector* self, long slot, int32_t pid) {
+    SharedMemoryCollectorRing& ring = (*self->rings)[slot];
+    size_t size = 0;
+    void* view = openSegment(ringName(*self->shmName, slot), false, 0, &size);
+    if (view == nullptr)
+        return -1;
+    SharedMemoryRingHeader* header = (SharedMemoryRingHeader*)view;
+    // The capacity is checked against the mapping, the worker can't make the collector read past it.
+    if (size <= SHAREDMEMORY_RING_HEADER_SIZE ||
+        memcmp(header->magic, SHAREDMEMORY_MAGIC, SHAREDMEMORY_MAGIC_SIZE) != 0 ||
+        header->capacity != size - SHAREDMEMORY_RING_HEADER_SIZE) {
+        munmap(view, size);
+        errno = EINVAL;
+        return -1;
+    }
+    ring.header = header;
+    ring.size = size;
+    ring.pid = pid;
+    return 0;
+}
+
+/**
+ * Decode every frame published so far and hand the space back to the worker.
+ * A frame that can't be decoded means the ring was damaged, the rest of it
+ * is discarded and counted as dropped.
+ */
+static void drainRing(SharedMemoryCollector* self, SharedMemoryCollectorRing& ring,
+                      std::vector<CollectedRecord>& records, std::string& scratch) {
+    SharedMemoryRingHeader* header = ring.header;
+    const char* data = ringData(header);
+    uint64_t capacity = ring.size - SHAREDMEMORY_RING_HEADER_SIZE;
+    uint64_t tail = header->tail.load(std::memory_order_relaxed);
+    uint64_t head = header->head.load(std::memory_order_acquire);
+    if (head - tail > capacity) {
+        self->freedDropped++;
+        tail = head;
+    }
+    while (tail < head) {
+        uint32_t length;
+        uint64_t created;
+        ringRead(data, capacity, tail, &length, sizeof(length));
+        ringRead(data, capacity, tail + sizeof(length), &created, sizeof(created));
+        uint64_t frameSize = alignFrame(SHAREDMEMORY_FRAME_HEADER_SIZE + (uint64_t)length);
+        if (frameSize > head - tail) {
+            self->freedDropped++;
+            tail = head;
+            break;
+        }
+        // Frames that don't wrap are decoded in place.
+        uint64_t offset = (tail + SHAREDMEMORY_FRAME_HEADER_SIZE) % capacity;
+        const unsigned char* payload;
+        if (offset + length <= capacity) {
+            payload = (const unsigned char*)data + offset;
+        } else {
+            scratch.resize(length);
+            ringRead(data, capacity, tail + SHAREDMEMORY_FRAME_HEADER_SIZE, &scratch[0], length);
+            payload = (const unsigned char*)scratch.data();
+        }
+        PyObject* record = WireFormat_decode(GET_PICOLOGGING_STATE(self), payload, length);
+        if (record == nullptr) {
+            PyErr_Clear();
+            self->freedDropped++;
+            tail = head;
+            break;
+        }
+        records.push_back({created, record});
+        tail += frameSize;
+    }
+    // Releasing the tail lets the worker reuse the space.
+    header->tail.store(tail, std::memory_order_release);
+}
+
+static void freeSlot(SharedMemoryCollector* self, long slot) {
+    SharedMemoryCollectorRing& ring = (*self->rings)[slot];
+    if (ring.header != nullptr)
+        self->freedDropped += ring.header->dropped.load(std::memory_order_relaxed);
+    unmapRing(ring);
+    shm_unlink(ringName(*self->shmName, slot).c_str());
+    SharedMemorySlot& entry = registrySlots(self->registry)[slot];
+    entry.word.store(SharedMemorySlot_word(SharedMemorySlot_Free, 0), std::memory_order_release);
+}
+
+static void closeSegments(SharedMemoryCollector* self) {
+    if (self->registry == nullptr)
+        return;
+    bool owner = self->ownerPid == (long)getpid();
+    SharedMemorySlot* slots = registrySlots(self->registry);
+    for (uint32_t i = 0; i < self->registry->slots; i++) {
+        unmapRing((*self->rings)[i]);
+        if (owner && SharedMemorySlot_state(slots[i].word.load(std::memory_order_acquire)) != SharedMemorySlot_Free)
+            shm_unlink(ringName(*self->shmName, i).c_str());
+    }
+    if (owner)
+        shm_unlink(self->shmName->c_str());
+    munmap(self->registry, self->registrySize);
+    self->registry = nullptr;
+    self->registrySize = 0;
+    self->rings->clear();
+}
+
+#endif
+
+PyObject* SharedMemoryCollector_new(PyTypeObject* type, PyObject* args, PyObject* kwds)
+{
+    SharedMemoryCollector* self = (SharedMemoryCollector*)type->tp_alloc(type, 0);
+    if (self != NULL)
+    {
+        self->name = Py_NewRef(Py_None);
+        self->shmName = new std::string();
+        self->ownerPid = 0;
+        self->registry = nullptr;
+        self->registrySize = 0;
+        self->rings = new std::vector<SharedMemoryCollectorRing>();
+        self->freedDropped = 0;
+    }
+    return (PyObject*)self;
+}
+
+int SharedMemoryCollector_init(SharedMemoryCollector *self, PyObject *args, PyObject *kwds){
+    PyObject *name = nullptr;
+    Py_ssize_t slots = 64;
+    long long size = 1024 * 1024;
+    static const char *kwlist[] = {"name", "slots", "size", NULL};
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "U|nL", const_cast<char**>(kwlist), &name, &slots, &size)){
+        return -1;
+    }
+#ifndef _WIN32
+    if (slots < 1 || slots > SHAREDMEMORY_MAX_SLOTS) {
+        PyErr_Format(PyExc_ValueError, "slots must be between 1 and %d", SHAREDMEMORY_MAX_SLOTS);
+        return -1;
+    }
+    if (size < SHAREDMEMORY_MIN_CAPACITY || size > (long long)PY_SSIZE_T_MAX - SHAREDMEMORY_RING_HEADER_SIZE) {
+        PyErr_Format(PyExc_ValueError, "size must be between %d and %zd bytes",
+                     SHAREDMEMORY_MIN_CAPACITY, PY_SSIZE_T_MAX - SHAREDMEMORY_RING_HEADER_SIZE);
+        return -1;
+    }
+    std::string shmName;
+    if (checkName(name, shmName) < 0)
+        return -1;
+    closeSegments(self);
+    *self->shmName = shmName;
+
+    // Segments left behind by a collector that crashed are replaced.
+    shm_unlink(shmName.c_str());
+    for (Py_ssize_t i = 0; i < slots; i++)
+        shm_unlink(ringName(shmName, (long)i).c_str());
+    size_t mappedSize = 0;
+    void* view = openSegment(shmName, true, registrySize((uint32_t)slots), &mappedSize);
+    if (view == nullptr) {
+        PyErr_SetFromErrnoWithFilename(PyExc_OSError, shmName.c_str());
+        return -1;
+    }
+    // ftruncate zero-fills the segment, so every slot starts out free.
+    SharedMemoryRegistryHeader* registry = (SharedMemoryRegistryHeader*)view;
+    registry->headerSize = SHAREDMEMORY_REGISTRY_HEADER_SIZE;
+    registry->slots = (uint32_t)slots;
+    registry->ringCapacity = (uint64_t)size & ~(uint64_t)(SHAREDMEMORY_ALIGNMENT - 1);
+    registry->dropped.store(0, std::memory_order_relaxed);
+    // The magic goes last so workers never see a half-initialised registry.
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(registry->magic, SHAREDMEMORY_MAGIC, SHAREDMEMORY_MAGIC_SIZE);
+
+    self->registry = registry;
+    self->registrySize = mappedSize;
+    self->rings->assign((size_t)slots, SharedMemoryCollectorRing{nullptr, 0, 0});
+    self->ownerPid = (long)getpid();
+    self->freedDropped = 0;
+    Py_SETREF(self->name, Py_NewRef(name));
+    return 0;
+#else
+    PyErr_SetString(PyExc_NotImplementedError, "SharedMemoryCollector requires POSIX shared memory");
+    return -1;
+#endif
+}
+
+PyObject* SharedMemoryCollector_dealloc(SharedMemoryCollector *self) {
+#ifndef _WIN32
+    closeSegments(self);
+#endif
+    Py_CLEAR(self->name);
+    delete self->shmName;
+    delete self->rings;
+    PyTypeObject* type = Py_TYPE(self);
+    type->tp_free((PyObject*)self);
+    Py_DECREF_HEAPTYPE(type);
+    return nullptr;
+}
+
+/**
+ * Drain every ring and return the records in timestamp order. Rings of
+ * workers that closed their handler or died are drained one last time and
+ * their slots freed for new workers.
+ */
+PyObject* SharedMemoryCollector_collect(SharedMemoryCollector *self, PyObject *Py_UNUSED(ignored)){
+#ifndef _WIN32
+    if (self->registry == nullptr) {
+        PyErr_SetString(PyExc_ValueError, "SharedMemoryCollector is closed");
+        return nullptr;
+    }
+    std::vector<CollectedRecord> records;
+    std::string scratch;
+    SharedMemorySlot* slots = registrySlots(self->registry);
+    for (uint32_t i = 0; i < self->registry->slots; i++) {
+        uint64_t word = slots[i].word.load(std::memory_order_acquire);
+        uint32_t state = SharedMemorySlot_state(word);
+        if (state == SharedMemorySlot_Free)
+            continue;
+        int32_t pid = SharedMemorySlot_pid(word);
+        // Checked before draining, so every frame a dead worker published is read.
+        bool finished = state == SharedMemorySlot_Closed || !processAlive(pid);
+        if (state == SharedMemorySlot_Claimed) {
+            // The worker died while creating its ring.
+            if (finished)
+                freeSlot(self, i);
+            continue;
+        }
+        SharedMemoryCollectorRing& ring = (*self->rings)[i];
+        if (ring.header != nullptr && ring.pid != pid)
+            unmapRing(ring);
+        if (ring.header == nullptr && mapRing(self, i, pid) < 0) {
+            if (finished) {
+                freeSlot(self, i);
+                continue;
+            }
+            for (auto& collected : records)
+                Py_DECREF(collected.record);
+            return PyErr_SetFromErrnoWithFilename(PyExc_OSError, ringName(*self->shmName, i).c_str());
+        }
+        drainRing(self, ring, records, scratch);
+        if (finished)
+            freeSlot(self, i);
+    }
+
+    // Each ring is already in order, a stable sort keeps records with equal timestamps in ring order.
+    std::stable_sort(records.begin(), records.end(), [](const CollectedRecord& a, const CollectedRecord& b) {
+        return a.created < b.created;
+    });
+    PyObject* result = PyList_New((Py_ssize_t)records.size());
+    if (result == nullptr) {
+        for (auto& collected : records)
+            Py_DECREF(collected.record);
+        return nullptr;
+    }
+    for (size_t i = 0; i < records.size(); i++)
+        PyList_SET_ITEM(result, (Py_ssize_t)i, records[i].record);
+    return result;
+#else
+    PyErr_SetString(PyExc_NotImplementedError, "SharedMemoryCollector requires POSIX shared memory");
+    return nullptr;
+#endif
+}
+
+PyObject* SharedMemoryCollector_close(SharedMemoryCollector *self, PyObject *Py_UNUSED(ignored)){
+#ifndef _WIN32
+    closeSegments(self);
+#endif
+    Py_RETURN_NONE;
+}
+
+PyObject* SharedMemoryCollector_getSlots(SharedMemoryCollector *self, void* closure){
+#ifndef _WIN32
+    if (self->registry != nullptr)
+        return PyLong_FromUnsignedLong(self->registry->slots);
+#endif
+    Py_RETURN_NONE;
+}
+
+PyObject* SharedMemoryCollector_getSize(SharedMemoryCollector *self, void* closure){
+#ifndef _WIN32
+    if (self->registry != nullptr)
+        return PyLong_FromUnsignedLongLong(self->registry->ringCapacity);
+#endif
+    Py_RETURN_NONE;
+}
+
+PyObject* SharedMemoryCollector_getWorkers(SharedMemoryCollector *self, void* closure){
+    PyObject* workers = PyList_New(0);
+    if (workers == nullptr)
+        return nullptr;
+#ifndef _WIN32
+    if (self->registry == nullptr)
+        return workers;
+    SharedMemorySlot* slots = registrySlots(self->registry);
+    for (uint32_t i = 0; i < self->registry->slots; i++) {
+        uint64_t word = slots[i].word.load(std::memory_order_acquire);
+        if (SharedMemorySlot_state(word) != SharedMemorySlot_Ready)
+            continue;
+        PyObject* pid = PyLong_FromLong(SharedMemorySlot_pid(word));
+        if (pid == nullptr || PyList_Append(workers, pid) < 0) {
+            Py_XDECREF(pid);
+            Py_DECREF(workers);
+            return nullptr;
+        }
+        Py_DECREF(pid);
+    }
+#endif
+    return workers;
+}
+
+PyObject* SharedMemoryCollector_getDropped(SharedMemoryCollector *self, void* closure){
+    uint64_t dropped = self->freedDropped;
+#ifndef _WIN32
+    if (self->registry != nullptr) {
+        dropped += self->registry->dropped.load(std::memory_order_relaxed);
+        for (auto& ring : *self->rings) {
+            if (ring.header != nullptr)
+                dropped += ring.header->dropped.load(std::memory_order_relaxed);
+        }
+    }
+#endif
+    return PyLong_FromUnsignedLongLong(dropped);
+}
+
+PyObject* SharedMemoryCollector_repr(SharedMemoryCollector *self)
+{
+    return PyUnicode_FromFormat("<%s %R>", _PyType_Name(Py_TYPE(self)), self->name);
+}
+
+static PyMethodDef SharedMemoryCollector_methods[] = {
+    {"collect", (PyCFunction)SharedMemoryCollector_collect, METH_NOARGS, "Return the records published by every worker, in timestamp order."},
+    {"close", (PyCFunction)SharedMemoryCollector_close, METH_NOARGS, "Unmap the rings and remove the shared memory."},
+    {NULL}
+};
+
+static PyMemberDef SharedMemoryCollector_members[] = {
+    {"name", T_OBJECT_EX, offsetof(SharedMemoryCollector, name), READONLY, "Name of the shared memory"},
+    {NULL}
+};
+
+static PyGetSetDef SharedMemoryCollector_getset[] = {
+    {"slots", (getter)SharedMemoryCollector_getSlots, nullptr, "Maximum number of worker processes", nullptr},
+    {"size", (getter)SharedMemoryCollector_getSize, nullptr, "Size of each worker's ring in bytes", nullptr},
+    {"workers", (getter)SharedMemoryCollector_getWorkers, nullptr, "Process ids of the workers with a ring", nullptr},
+    {"dropped", (getter)SharedMemoryCollector_getDropped, nullptr, "Records dropped by workers because a ring or every slot was full", nullptr},
+    {NULL}
+};
+
+static PyType_Slot SharedMemoryCollector_slots[] = {
+    {Py_tp_dealloc, (void*)SharedMemoryCollector_dealloc},
+    {Py_tp_repr, (void*)SharedMemoryCollector_repr},
+    {Py_tp_doc, (void*)PyDoc_STR("SharedMemoryCollector(name, slots=64, size=1048576)\n\nCreates the shared memory that SharedMemoryHandler writes to and merges the records of every worker.")},
+    {Py_tp_methods, SharedMemoryCollector_methods},
+    {Py_tp_members, SharedMemoryCollector_members},
+    {Py_tp_getset, SharedMemoryCollector_getset},
+    {Py_tp_init, (void*)SharedMemoryCollector_init},
+    {Py_tp_new, (void*)SharedMemoryCollector_new},
+    {Py_tp_free, (void*)PyObject_Del},
+    {0, NULL}
+};
+
+PyType_Spec SharedMemoryCollectorType_spec = {
+    "picologging.handlers.SharedMemoryCollector",
+    sizeof(SharedMemoryCollector),
+    0,
+    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_IMMUTABLETYPE,
+    SharedMemoryCollector_slots,
+};
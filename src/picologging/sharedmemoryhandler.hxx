@@ -0,0 +1,117 @@
+#include <Python.h>
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "handler.hxx"
+
+#ifndef PICOLOGGING_SHAREDMEMORYHANDLER_H
+#define PICOLOGGING_SHAREDMEMORYHANDLER_H
+
+#define SHAREDMEMORY_MAGIC "PLOGSM\x00\x01"
+#define SHAREDMEMORY_MAGIC_SIZE 8
+#define SHAREDMEMORY_REGISTRY_HEADER_SIZE 64
+#define SHAREDMEMORY_RING_HEADER_SIZE 256
+// Every frame starts with its length (u32) and the record's creation time in nanoseconds (u64).
+#define SHAREDMEMORY_FRAME_HEADER_SIZE 12
+#define SHAREDMEMORY_ALIGNMENT 8
+#define SHAREDMEMORY_MIN_CAPACITY 4096
+#define SHAREDMEMORY_MAX_SLOTS 4096
+
+enum SharedMemorySlotState {
+    SharedMemorySlot_Free = 0,
+    SharedMemorySlot_Claimed,   // A worker is creating its ring
+    SharedMemorySlot_Ready,     // The ring is published, the collector may map it
+    SharedMemorySlot_Closed,    // The worker closed its handler, the ring is drained then freed
+};
+
+/**
+ * Start of the registry segment created by the collector, followed by
+ * `slots` SharedMemorySlot entries. Workers claim a slot, then create the
+ * ring named after it.
+ */
+typedef struct {
+    char magic[SHAREDMEMORY_MAGIC_SIZE];
+    uint32_t headerSize;
+    uint32_t slots;
+    uint64_t ringCapacity;
+    std::atomic<uint64_t> dropped; // Records from workers that found no free slot
+} SharedMemoryRegistryHeader;
+
+/**
+ * A slot's state and owner pid share one word, so a worker claims a slot and
+ * records its pid in a single compare-and-swap. A worker dying mid-claim
+ * always leaves a pid the collector can check.
+ */
+typedef struct {
+    std::atomic<uint64_t> word;
+} SharedMemorySlot;
+
+static inline uint64_t SharedMemorySlot_word(uint32_t state, int32_t pid) {
+    return ((uint64_t)(uint32_t)pid << 32) | state;
+}
+
+static inline uint32_t SharedMemorySlot_state(uint64_t word) {
+    return (uint32_t)word;
+}
+
+static inline int32_t SharedMemorySlot_pid(uint64_t word) {
+    return (int32_t)(uint32_t)(word >> 32);
+}
+
+/**
+ * Start of a worker's ring, followed by `capacity` bytes of frames. Each ring
+ * has one producer (the worker, under its handler lock) and one consumer (the
+ * collector). `head` and `tail` are the total number of bytes ever written
+ * and consumed, kept on separate cache lines.
+ */
+typedef struct {
+    char magic[SHAREDMEMORY_MAGIC_SIZE];
+    uint64_t capacity;
+    int32_t pid;
+    alignas(64) std::atomic<uint64_t> head;
+    alignas(64) std::atomic<uint64_t> tail;
+    alignas(64) std::atomic<uint64_t> dropped; // Records that did not fit
+} SharedMemoryRingHeader;
+
+static_assert(sizeof(SharedMemoryRegistryHeader) <= SHAREDMEMORY_REGISTRY_HEADER_SIZE, "Shared memory registry header too large");
+static_assert(sizeof(SharedMemoryRingHeader) <= SHAREDMEMORY_RING_HEADER_SIZE, "Shared memory ring header too large");
+
+typedef struct {
+    Handler handler;
+    PyObject* name;
+    std::string* shmName;
+    long pid;                           // Process the mappings below belong to, 0 when detached
+    SharedMemoryRegistryHeader* registry;
+    size_t registrySize;
+    long slot;                          // Claimed slot, -1 when none
+    SharedMemoryRingHeader* ring;
+    size_t ringSize;
+    std::string* buffer;                // Reused for every record, guarded by the handler lock
+    bool closed;
+} SharedMemoryHandler;
+
+typedef struct {
+    SharedMemoryRingHeader* header;
+    size_t size;
+    int32_t pid;
+} SharedMemoryCollectorRing;
+
+typedef struct {
+    PyObject_HEAD
+    PyObject* name;
+    std::string* shmName;
+    long ownerPid;                      // Only the creating process unlinks the segments
+    SharedMemoryRegistryHeader* registry;
+    size_t registrySize;
+    std::vector<SharedMemoryCollectorRing>* rings;
+    uint64_t freedDropped;              // Drops counted by rings that were already freed
+} SharedMemoryCollector;
+
+PyObject* SharedMemoryHandler_emit(SharedMemoryHandler* self, PyObject* record);
+
+extern PyType_Spec SharedMemoryHandlerType_spec;
+extern PyType_Spec SharedMemoryCollectorType_spec;
+#define SharedMemoryHandler_CheckExact(state, op) Py_IS_TYPE(op, (state)->SharedMemoryHandlerType)
+
+#endif // PICOLOGGING_SHAREDMEMORYHANDLER_H
@@ -1,4 +1,10 @@
+#include <cerrno>
+#include <cstring>
 #include <mutex>
+#ifndef _WIN32
+#include <poll.h>
+#include <unistd.h>
+#endif
 
 #include "streamhandler.hxx"
 #include "handler.hxx"
@@ -7,20 +13,108 @@
 
 PyObject* StreamHandler_new(PyTypeObject* type, PyObject* args, PyObject* kwds)
 {
-    StreamHandler* self = (StreamHandler*)HandlerType.tp_new(type, args, kwds);
+    StreamHandler* self = (StreamHandler*)Handler_new(type, args, kwds);
     if (self != NULL)
     {
         self->terminator = PyUnicode_FromString("\n");
         self->_const_write = PyUnicode_FromString("write");
         self->_const_flush = PyUnicode_FromString("flush");
-        self->stream = Py_None;
+        self->_const_closed = PyUnicode_FromString("closed");
+        self->stream = Py_NewRef(Py_None);
         self->stream_has_flush = false;
+        // Off by default: the stream's newline translation is invisible from
+        // here, so bypassing it could change what ends up in the file.
+        self->directWrite = false;
+        self->fd = -1;
+        self->asciiOnly = false;
     }
     return (PyObject*)self;
 }
 
+#ifndef _WIN32
+// Encodings that write ASCII text as the same bytes, records in them are written directly when they're ASCII.
+// These are the names codecs.lookup() normalizes to.
+static const char* const ascii_compatible[] = {"ascii", "iso8859-1", "cp1252", nullptr};
+
+/**
+ * The codec name of the stream's encoding, so aliases such as "UTF8" or
+ * "utf_8" compare equal. Returns a new reference or NULL without an exception.
+ */
+static PyObject* codecName(PyObject* stream) {
+    PyObject* encoding = PyObject_GetAttrString(stream, "encoding");
+    PyObject* codecs = encoding != nullptr ? PyImport_ImportModule("codecs") : nullptr;
+    PyObject* info = codecs != nullptr ? PyObject_CallMethod(codecs, "lookup", "O", encoding) : nullptr;
+    PyObject* name = info != nullptr ? PyObject_GetAttrString(info, "name") : nullptr;
+    Py_XDECREF(info);
+    Py_XDECREF(codecs);
+    Py_XDECREF(encoding);
+    if (name == nullptr || !PyUnicode_Check(name)) {
+        Py_XDECREF(name);
+        PyErr_Clear();
+        return nullptr;
+    }
+    return name;
+}
+#endif
+
+/**
+ * Decide whether records can be written straight to the stream's file
+ * descriptor. Only plain text files in UTF-8, or in an ASCII compatible
+ * encoding for ASCII records, qualify: the encoded message is then exactly
+ * what the stream would have written. Subclasses of TextIOWrapper may
+ * override write(), so they always go through the stream. Text already
+ * written through the stream is flushed here, once, rather than per record.
+ */
+static void updateFd(StreamHandler* self) {
+    self->fd = -1;
+    self->asciiOnly = false;
+#ifndef _WIN32
+    if (!self->directWrite || strcmp(Py_TYPE(self->stream)->tp_name, "_io.TextIOWrapper") != 0)
+        return;
+    PyObject* codec = codecName(self->stream);
+    if (codec == nullptr)
+        return;
+    const char* name = PyUnicode_AsUTF8(codec);
+    bool utf8 = name != nullptr && strcmp(name, "utf-8") == 0;
+    bool asciiOnly = false;
+    for (int i = 0; !utf8 && name != nullptr && ascii_compatible[i] != nullptr; i++)
+        asciiOnly = asciiOnly || strcmp(name, ascii_compatible[i]) == 0;
+    Py_DECREF(codec);
+    if (!utf8 && !asciiOnly) {
+        PyErr_Clear();
+        return;
+    }
+    PyObject* fileno = PyObject_CallMethod(self->stream, "fileno", nullptr);
+    if (fileno == nullptr) {
+        PyErr_Clear();
+        return;
+    }
+    int fd = PyLong_Check(fileno) ? PyLong_AsLong(fileno) : -1;
+    Py_DECREF(fileno);
+    if (fd < 0) {
+        PyErr_Clear();
+        return;
+    }
+    // Direct writes skip the stream's buffer, send out what it holds first.
+    PyObject* result = PyObject_CallMethod_NOARGS(self->stream, self->_const_flush);
+    if (result == nullptr) {
+        PyErr_Clear();
+        return;
+    }
+    Py_DECREF(result);
+    self->fd = fd;
+    self->asciiOnly = asciiOnly;
+#endif
+}
+
+static void setStream(StreamHandler* self, PyObject* stream) {
+    Py_SETREF(self->stream, Py_NewRef(stream));
+    self->stream_has_flush = (PyObject_HasAttr(self->stream, self->_const_flush) == 1);
+    updateFd(self);
+}
+
 int StreamHandler_init(StreamHandler *self, PyObject *args, PyObject *kwds){
-    if (HandlerType.tp_init((PyObject *) self, args, kwds) < 0)
+    if (Handler_init((Handler*)self, args, kwds) < 0)
         return -1;
     PyObject *stream = NULL;
     static const char *kwlist[] = {"stream", NULL};
@@ -30,8 +124,7 @@ int StreamHandler_init(StreamHandler *self, PyObject *args, PyObject *kwds){
     if (stream == NULL || stream == Py_None){
         stream = PySys_GetObject("stderr");
     }
-    self->stream = Py_NewRef(stream);
-    self->stream_has_flush = (PyObject_HasAttr(self->stream, self->_const_flush) == 1);
+    setStream(self, stream);
     return 0;
 }
 
@@ -40,20 +133,106 @@ PyObject* StreamHandler_dealloc(StreamHandler *self) {
     Py_CLEAR(self->terminator);
     Py_CLEAR(self->_const_write);
     Py_CLEAR(self->_const_flush);
-    HandlerType.tp_dealloc((PyObject *)self);
+    Py_CLEAR(self->_const_closed);
+    Handler_dealloc((Handler*)self);
     return nullptr;
 }
 
 PyObject* flush (StreamHandler* self){
     if (!self->stream_has_flush)
         Py_RETURN_NONE;
-    Handler_acquire(&self->handler);
+    HandlerLockGuard guard(&self->handler);
     PyObject* result = PyObject_CallMethod_NOARGS(self->stream, self->_const_flush);
     Py_XDECREF(result);
-    Handler_release(&self->handler);
     Py_RETURN_NONE;
 }
 
+/**
+ * Size of the text once encoded as UTF-8, without encoding it. Streams may use
+ * another encoding, this is what bytesWritten reports for text streams.
+ */
+static uint64_t utf8Length(PyObject* text) {
+    Py_ssize_t length = PyUnicode_GET_LENGTH(text);
+    if (PyUnicode_IS_ASCII(text))
+        return (uint64_t)length;
+    int kind = PyUnicode_KIND(text);
+    const void* data = PyUnicode_DATA(text);
+    uint64_t size = 0;
+    for (Py_ssize_t i = 0; i < length; i++) {
+        Py_UCS4 c = PyUnicode_READ(kind, data, i);
+        size += c < 0x80 ? 1 : c < 0x800 ? 2 : c < 0x10000 ? 3 : 4;
+    }
+    return size;
+}
+
+/**
+ * Write the message to the stream's file descriptor without holding the GIL.
+ * Returns 1 if the message can't be encoded this way and should go through
+ * the stream instead, 0 on success and -1 with an exception set on error.
+ *
+ * The record and its terminator go out in one write(2), so on a pipe lines up
+ * to PIPE_BUF bytes are never interleaved with other processes' writes.
+ */
+static int writeDirect(StreamHandler* self, PyObject* msg) {
+#ifdef _WIN32
+    return 1;
+#else
+    if (self->asciiOnly && !PyUnicode_IS_ASCII(msg))
+        return 1;
+    Py_ssize_t size;
+    // Owned by msg, which the caller keeps alive until the write returns.
+    const char* data = PyUnicode_AsUTF8AndSize(msg, &size);
+    if (data == nullptr) { // e.g. lone surrogates, leave them to the stream's error handler
+        PyErr_Clear();
+        return 1;
+    }
+    // A closed stream's descriptor may already belong to another file.
+    PyObject* closed = PyObject_GetAttr(self->stream, self->_const_closed);
+    if (closed == nullptr)
+        return -1;
+    int isClosed = PyObject_IsTrue(closed);
+    Py_DECREF(closed);
+    if (isClosed != 0) {
+        if (isClosed > 0)
+            PyErr_SetString(PyExc_ValueError, "I/O operation on closed file.");
+        return -1;
+    }
+
+    PyObject* stream = Py_NewRef(self->stream); // Keeps the descriptor open
+    int fd = self->fd;
+    uint64_t written = (uint64_t)size;
+    int error = 0;
+    Py_BEGIN_ALLOW_THREADS
+    while (size > 0) {
+        ssize_t n = write(fd, data, (size_t)size);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                // Non-blocking descriptors (e.g. a pipe shared with an event loop), wait
+                // until it drains instead of dropping the record.
+                struct pollfd pfd = {fd, POLLOUT, 0};
+                if (poll(&pfd, 1, -1) >= 0 || errno == EINTR)
+                    continue;
+            }
+            error = errno;
+            break;
+        }
+        data += n;
+        size -= n;
+    }
+    Py_END_ALLOW_THREADS
+    Py_DECREF(stream);
+    if (error != 0) {
+        errno = error;
+        PyErr_SetFromErrno(PyExc_OSError);
+        return -1;
+    }
+    Handler_addBytesWritten(&self->handler, written);
+    return 0;
+#endif
+}
+
 PyObject* StreamHandler_emit(StreamHandler* self, PyObject* const* args, Py_ssize_t nargs){
     PyObject* writeResult = nullptr;
     if (nargs < 1){
@@ -71,12 +250,22 @@ PyObject* StreamHandler_emit(StreamHandler* self, PyObject* const* args, Py_ssiz
     if (msg == nullptr) { // PyUnicode_Append sets *pleft to null on error. Error is extremely unlikely
         goto error;
     }
+    if (self->fd >= 0) {
+        int ret = writeDirect(self, msg);
+        if (ret < 0)
+            goto error;
+        if (ret == 0) {
+            Py_DECREF(msg);
+            Py_RETURN_NONE;
+        }
+    }
     writeResult = PyObject_CallMethod_ONEARG(self->stream, self->_const_write, msg);
     if (writeResult == nullptr){
         if (!PyErr_Occurred())
             PyErr_SetString(PyExc_RuntimeError, "Cannot write to stream");
         goto error;
     }
+    Handler_addBytesWritten(&self->handler, utf8Length(msg));
     flush(self);
     Py_XDECREF(msg);
     Py_XDECREF(writeResult);
@@ -93,13 +282,10 @@ PyObject* StreamHandler_setStream(StreamHandler* self, PyObject* stream){
         Py_RETURN_NONE;
     }
     // Otherwise flush current stream
-    PyObject* result = self->stream;
+    PyObject* result = Py_NewRef(self->stream);
     flush(self);
-    Py_XDECREF(self->stream);
     // And set new stream
-    self->stream = stream;
-    Py_INCREF(self->stream);
-    self->stream_has_flush = (PyObject_HasAttr(self->stream, self->_const_flush) == 1);
+    setStream(self, stream);
     // Return previous stream (now flushed)
     return result;
 }
@@ -128,50 +314,60 @@ static PyMethodDef StreamHandler_methods[] = {
      {NULL}
 };
 
-static PyMemberDef StreamHandler_members[] = {
-    {"stream", T_OBJECT_EX, offsetof(StreamHandler, stream), 0, "Stream"},
+PyObject* StreamHandler_getStream(StreamHandler* self, void* closure) {
+    return Py_NewRef(self->stream);
+}
+
+int StreamHandler_setStreamAttr(StreamHandler* self, PyObject* value, void* closure) {
+    if (value == nullptr) {
+        PyErr_SetString(PyExc_AttributeError, "cannot delete stream");
+        return -1;
+    }
+    setStream(self, value);
+    return 0;
+}
+
+PyObject* StreamHandler_getDirectWrite(StreamHandler* self, void* closure) {
+    return PyBool_FromLong(self->directWrite);
+}
+
+int StreamHandler_setDirectWrite(StreamHandler* self, PyObject* value, void* closure) {
+    if (value == nullptr) {
+        PyErr_SetString(PyExc_AttributeError, "cannot delete directWrite");
+        return -1;
+    }
+    int enabled = PyObject_IsTrue(value);
+    if (enabled < 0)
+        return -1;
+    self->directWrite = enabled;
+    updateFd(self);
+    return 0;
+}
+
+static PyGetSetDef StreamHandler_getset[] = {
+    {"stream", (getter)StreamHandler_getStream, (setter)StreamHandler_setStreamAttr, "Stream", NULL},
+    {"directWrite", (getter)StreamHandler_getDirectWrite, (setter)StreamHandler_setDirectWrite,
+        "Write text files through their file descriptor without holding the GIL, off by default.", NULL},
     {NULL}
 };
 
-PyTypeObject StreamHandlerType = {
-    PyObject_HEAD_INIT(NULL)
-    "picologging.StreamHandler",                    /* tp_name */
-    sizeof(StreamHandler),                          /* tp_basicsize */
-    0,                                          /* tp_itemsize */
-    (destructor)StreamHandler_dealloc,                /* tp_dealloc */
-    0,                                          /* tp_vectorcall_offset */
-    0,                                          /* tp_getattr */
-    0,                                          /* tp_setattr */
-    0,                                          /* tp_as_async */
-   (reprfunc)StreamHandler_repr,                /* tp_repr */
-    0,                                          /* tp_as_number */
-    0,                                          /* tp_as_sequence */
-    0,                                          /* tp_as_mapping */
-    0,                                          /* tp_hash */
-    0,                                          /* tp_call */
-    0,                                          /* tp_str */
-    PyObject_GenericGetAttr,                    /* tp_getattro */
-    PyObject_GenericSetAttr,                    /* tp_setattro */
-    0,                                          /* tp_as_buffer */
-    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE ,  /* tp_flags */
-    PyDoc_STR("StreamHandler interface."),    /* tp_doc */
-    0,                                          /* tp_traverse */
-    0,                                          /* tp_clear */
-    0,                                          /* tp_richcompare */
-    0,                                          /* tp_weaklistoffset */
-    0,                                          /* tp_iter */
-    0,                                          /* tp_iternext */
-    StreamHandler_methods,                          /* tp_methods */
-    StreamHandler_members,                          /* tp_members */
-    0,                                          /* tp_getset */
-    0,                                          /* tp_base */
-    0,                                          /* tp_dict */
-    0,                                          /* tp_descr_get */
-    0,                                          /* tp_descr_set */
-    0,                                          /* tp_dictoffset */
-    (initproc)StreamHandler_init,                   /* tp_init */
-    0,                                          /* tp_alloc */
-    StreamHandler_new,                          /* tp_new */
-    PyObject_Del,                               /* tp_free */
+static PyType_Slot StreamHandler_slots[] = {
+    {Py_tp_dealloc, (void*)StreamHandler_dealloc},
+    {Py_tp_repr, (void*)StreamHandler_repr},
+    {Py_tp_doc, (void*)PyDoc_STR("StreamHandler interface.")},
+    {Py_tp_methods, StreamHandler_methods},
+    {Py_tp_getset, StreamHandler_getset},
+    {Py_tp_init, (void*)StreamHandler_init},
+    {Py_tp_new, (void*)StreamHandler_new},
+    {Py_tp_free, (void*)PyObject_Del},
+    {0, NULL}
+};
+
+PyType_Spec StreamHandlerType_spec = {
+    "picologging.StreamHandler",
+    sizeof(StreamHandler),
+    0,
+    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE | Py_TPFLAGS_IMMUTABLETYPE,
+    StreamHandler_slots,
 };
 
@@ -10,10 +10,14 @@ typedef struct {
     PyObject* terminator;
     PyObject* _const_write;
     PyObject* _const_flush;
+    PyObject* _const_closed;
     bool stream_has_flush;
+    bool directWrite;
+    int fd; // File descriptor written to directly, or -1 to write through the stream
+    bool asciiOnly; // The stream's encoding only matches UTF-8 for ASCII text
 } StreamHandler;
 PyObject* StreamHandler_emit(StreamHandler* self, PyObject* const* args, Py_ssize_t nargs);
 
-extern PyTypeObject StreamHandlerType;
-#define StreamHandler_CheckExact(op) Py_IS_TYPE(op, &StreamHandlerType)
+extern PyType_Spec StreamHandlerType_spec;
+#define StreamHandler_CheckExact(state, op) Py_IS_TYPE(op, (state)->StreamHandlerType)
 #endif // PICOLOGGING_STREAMHANDLER_H
\ No newline at end of file
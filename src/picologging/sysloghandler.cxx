@@ -0,0 +1,704 @@
+#include <cstring>
+#include <ctime>
+#include <mutex>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#else
+#include <process.h>
+#define getpid _getpid
+#endif
+
+#include "sysloghandler.hxx"
+#include "handler.hxx"
+#include "logrecord.hxx"
+#include "compat.hxx"
+#include "picologging.hxx"
+
+typedef struct {
+    const char* constant;
+    const char* name;
+    int value;
+} SysLogName;
+
+static const SysLogName priorityNames[] = {
+    {"LOG_EMERG", "emerg", 0},
+    {"LOG_ALERT", "alert", 1},
+    {"LOG_CRIT", "crit", 2},
+    {"LOG_ERR", "err", 3},
+    {"LOG_WARNING", "warning", 4},
+    {"LOG_NOTICE", "notice", 5},
+    {"LOG_INFO", "info", 6},
+    {"LOG_DEBUG", "debug", 7},
+};
+
+static const SysLogName facilityNames[] = {
+    {"LOG_KERN", "kern", 0},
+    {"LOG_USER", "user", 1},
+    {"LOG_MAIL", "mail", 2},
+    {"LOG_DAEMON", "daemon", 3},
+    {"LOG_AUTH", "auth", 4},
+    {"LOG_SYSLOG", "syslog", 5},
+    {"LOG_LPR", "lpr", 6},
+    {"LOG_NEWS", "news", 7},
+    {"LOG_UUCP", "uucp", 8},
+    {"LOG_CRON", "cron", 9},
+    {"LOG_AUTHPRIV", "authpriv", 10},
+    {"LOG_FTP", "ftp", 11},
+    {"LOG_NTP", "ntp", 12},
+    {"LOG_SECURITY", "security", 13},
+    {"LOG_CONSOLE", "console", 14},
+    {"LOG_SOLCRON", "solaris-cron", 15},
+    {"LOG_LOCAL0", "local0", 16},
+    {"LOG_LOCAL1", "local1", 17},
+    {"LOG_LOCAL2", "local2", 18},
+    {"LOG_LOCAL3", "local3", 19},
+    {"LOG_LOCAL4", "local4", 20},
+    {"LOG_LOCAL5", "local5", 21},
+    {"LOG_LOCAL6", "local6", 22},
+    {"LOG_LOCAL7", "local7", 23},
+};
+
+// Syslog severity of DEBUG, INFO, WARNING, ERROR and CRITICAL records.
+static const int severities[SYSLOG_SEVERITIES] = {7, 6, 4, 3, 2};
+
+static inline int severityIndex(int levelno) {
+    if (levelno >= LOG_LEVEL_CRITICAL)
+        return 4;
+    if (levelno >= LOG_LEVEL_ERROR)
+        return 3;
+    if (levelno >= LOG_LEVEL_WARNING)
+        return 2;
+    if (levelno >= LOG_LEVEL_INFO)
+        return 1;
+    return 0;
+}
+
+static int appendText(std::string& buffer, PyObject* value) {
+    PyObject* str = PyUnicode_Check(value) ? Py_NewRef(value) : PyObject_Str(value);
+    if (str == nullptr)
+        return -1;
+    Py_ssize_t size;
+    const char* data = PyUnicode_AsUTF8AndSize(str, &size);
+    if (data != nullptr) {
+        buffer.append(data, size);
+        Py_DECREF(str);
+        return 0;
+    }
+    PyErr_Clear();
+    PyObject* encoded = PyUnicode_AsEncodedString(str, "utf-8", "backslashreplace");
+    Py_DECREF(str);
+    if (encoded == nullptr)
+        return -1;
+    buffer.append(PyBytes_AS_STRING(encoded), PyBytes_GET_SIZE(encoded));
+    Py_DECREF(encoded);
+    return 0;
+}
+
+/**
+ * Append an RFC 5424 header field, using the NILVALUE for missing values.
+ */
+static int appendField(std::string& buffer, PyObject* value) {
+    if (value == Py_None || (PyUnicode_Check(value) && PyUnicode_GET_LENGTH(value) == 0)) {
+        buffer.push_back('-');
+        return 0;
+    }
+    return appendText(buffer, value);
+}
+
+static void appendTimestamp(std::string& buffer, double created) {
+    time_t seconds = (time_t)created;
+    long micros = (long)((created - (double)seconds) * 1e6);
+    struct tm utc;
+#ifdef _WIN32
+    gmtime_s(&utc, &seconds);
+#else
+    gmtime_r(&seconds, &utc);
+#endif
+    char timestamp[40];
+    int size = snprintf(timestamp, sizeof(timestamp), "%04d-%02d-%02dT%02d:%02d:%02d.%06ldZ",
+        utc.tm_year + 1900, utc.tm_mon + 1, utc.tm_mday, utc.tm_hour, utc.tm_min, utc.tm_sec, micros);
+    buffer.append(timestamp, size);
+}
+
+/**
+ * Precompute everything in the header that only depends on the severity,
+ * so emitting a record only appends the per-record fields and message.
+ */
+static int buildPrefixes(SysLogHandler* self) {
+    for (int i = 0; i < SYSLOG_SEVERITIES; i++) {
+        std::string& prefix = self->prefixes[i];
+        prefix = "<" + std::to_string((self->facility << 3) | severities[i]) + ">";
+        if (self->rfc5424) {
+            prefix += "1 ";
+        } else if (self->ident != Py_None && appendText(prefix, self->ident) < 0) {
+            return -1;
+        }
+    }
+    self->fields->assign(" ");
+    if (appendField(*self->fields, self->hostname) < 0)
+        return -1;
+    self->fields->push_back(' ');
+    if (appendField(*self->fields, self->appname) < 0)
+        return -1;
+    self->fields->push_back(' ');
+    return 0;
+}
+
+static int lookupFacility(PyObject* facility, int* value) {
+    if (PyLong_Check(facility)) {
+        *value = (int)PyLong_AsLong(facility);
+        if (*value == -1 && PyErr_Occurred())
+            return -1;
+    } else if (PyUnicode_Check(facility)) {
+        const char* name = PyUnicode_AsUTF8(facility);
+        if (name == nullptr)
+            return -1;
+        *value = -1;
+        for (auto& entry : facilityNames) {
+            if (strcmp(entry.name, name) == 0)
+                *value = entry.value;
+        }
+        if (*value == -1) {
+            PyErr_Format(PyExc_ValueError, "unknown syslog facility '%s'", name);
+            return -1;
+        }
+    } else {
+        PyErr_SetString(PyExc_TypeError, "facility must be an integer or a facility name");
+        return -1;
+    }
+    if (*value < 0 || *value > 23) {
+        PyErr_SetString(PyExc_ValueError, "facility must be between 0 and 23");
+        return -1;
+    }
+    return 0;
+}
+
+static PyObject* connectSocket(PyObject* socketModule, PyObject* family, PyObject* type, PyObject* proto, PyObject* address) {
+    PyObject* sock = PyObject_CallMethod(socketModule, "socket", "OOO", family, type, proto);
+    if (sock == nullptr)
+        return nullptr;
+    PyObject* result = PyObject_CallMethod(sock, "connect", "(O)", address);
+    if (result == nullptr) {
+        PyObject *type, *value, *traceback;
+        PyErr_Fetch(&type, &value, &traceback);
+        Py_XDECREF(PyObject_CallMethod(sock, "close", nullptr));
+        Py_DECREF(sock);
+        PyErr_Restore(type, value, traceback);
+        return nullptr;
+    }
+    Py_DECREF(result);
+    return sock;
+}
+
+/**
+ * Open the socket the way logging.handlers.SysLogHandler does: a string
+ * address is a Unix socket, trying a datagram socket before a stream one
+ * unless socktype is given, and a (host, port) pair is resolved with
+ * getaddrinfo. Datagram sockets are connected too, so batches can be sent
+ * without a destination address.
+ */
+static int openSocket(SysLogHandler* self) {
+    PyObject* socketModule = PyImport_ImportModule("socket");
+    if (socketModule == nullptr)
+        return -1;
+    PyObject* dgram = PyObject_GetAttrString(socketModule, "SOCK_DGRAM");
+    PyObject* streamType = PyObject_GetAttrString(socketModule, "SOCK_STREAM");
+    PyObject* sock = nullptr;
+    PyObject* zero = PyLong_FromLong(0);
+    if (dgram == nullptr || streamType == nullptr || zero == nullptr)
+        goto done;
+
+    if (PyUnicode_Check(self->address)) {
+        PyObject* family = PyObject_GetAttrString(socketModule, "AF_UNIX");
+        if (family == nullptr)
+            goto done;
+        if (self->socktype == Py_None) {
+            sock = connectSocket(socketModule, family, dgram, zero, self->address);
+            if (sock == nullptr && PyErr_ExceptionMatches(PyExc_OSError)) {
+                PyErr_Clear();
+                sock = connectSocket(socketModule, family, streamType, zero, self->address);
+            }
+        } else {
+            sock = connectSocket(socketModule, family, self->socktype, zero, self->address);
+        }
+        Py_DECREF(family);
+        self->unixSocket = true;
+    } else {
+        PyObject *host, *port;
+        if (!PyArg_ParseTuple(self->address, "OO;address must be a path or a (host, port) tuple", &host, &port))
+            goto done;
+        PyObject* infos = PyObject_CallMethod(socketModule, "getaddrinfo", "OOOO", host, port, zero,
+            self->socktype == Py_None ? dgram : self->socktype);
+        if (infos == nullptr)
+            goto done;
+        if (!PyList_Check(infos) || PyList_GET_SIZE(infos) == 0) {
+            Py_DECREF(infos);
+            PyErr_SetString(PyExc_OSError, "getaddrinfo returns an empty list");
+            goto done;
+        }
+        for (Py_ssize_t i = 0; i < PyList_GET_SIZE(infos) && sock == nullptr; i++) {
+            PyObject *family, *type, *proto, *canonname, *sockaddr;
+            if (!PyArg_ParseTuple(PyList_GET_ITEM(infos, i), "OOOOO", &family, &type, &proto, &canonname, &sockaddr))
+                break;
+            PyErr_Clear();
+            sock = connectSocket(socketModule, family, type, proto, sockaddr);
+        }
+        Py_DECREF(infos);
+        self->unixSocket = false;
+    }
+    if (sock != nullptr) {
+        PyObject* type = PyObject_GetAttrString(sock, "type");
+        PyObject* fileno = PyObject_CallMethod(sock, "fileno", nullptr);
+        if (type == nullptr || fileno == nullptr) {
+            Py_XDECREF(type);
+            Py_XDECREF(fileno);
+            Py_CLEAR(sock);
+            goto done;
+        }
+        self->stream = PyObject_RichCompareBool(type, streamType, Py_EQ) == 1;
+        self->fd = (int)PyLong_AsLong(fileno);
+        Py_DECREF(type);
+        Py_DECREF(fileno);
+        Py_SETREF(self->socket, sock);
+    }
+
+done:
+    Py_XDECREF(dgram);
+    Py_XDECREF(streamType);
+    Py_XDECREF(zero);
+    Py_DECREF(socketModule);
+    return self->socket == Py_None ? -1 : 0;
+}
+
+static void closeSocket(SysLogHandler* self) {
+    if (self->socket == Py_None)
+        return;
+    PyObject* result = PyObject_CallMethod(self->socket, "close", nullptr);
+    if (result == nullptr)
+        PyErr_Clear();
+    Py_XDECREF(result);
+    Py_SETREF(self->socket, Py_NewRef(Py_None));
+    self->fd = -1;
+}
+
+#ifndef _WIN32
+/**
+ * Write the pending datagrams from index `sent`, with one sendmmsg call per
+ * batch where available. Returns 0 or the errno of the failed write. The GIL
+ * is released while writing, the pending batch is guarded by the handler lock.
+ */
+static int writeDatagrams(SysLogHandler* self, size_t& sent) {
+    std::vector<std::string>& pending = *self->pending;
+    int fd = self->fd;
+    int error = 0;
+#ifdef __linux__
+    size_t count = pending.size() - sent;
+    std::vector<struct mmsghdr> messages(count);
+    std::vector<struct iovec> iovecs(count);
+    for (size_t i = 0; i < count; i++) {
+        iovecs[i].iov_base = (void*)pending[sent + i].data();
+        iovecs[i].iov_len = pending[sent + i].size();
+        memset(&messages[i], 0, sizeof(struct mmsghdr));
+        messages[i].msg_hdr.msg_iov = &iovecs[i];
+        messages[i].msg_hdr.msg_iovlen = 1;
+    }
+    size_t offset = 0;
+    Py_BEGIN_ALLOW_THREADS
+    while (offset < count) {
+        int written = sendmmsg(fd, messages.data() + offset, (unsigned int)(count - offset), 0);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            error = errno;
+            break;
+        }
+        offset += written;
+        sent += written;
+    }
+    Py_END_ALLOW_THREADS
+#else
+    Py_BEGIN_ALLOW_THREADS
+    while (sent < pending.size()) {
+        if (send(fd, pending[sent].data(), pending[sent].size(), 0) < 0) {
+            if (errno == EINTR)
+                continue;
+            error = errno;
+            break;
+        }
+        sent++;
+    }
+    Py_END_ALLOW_THREADS
+#endif
+    return error;
+}
+#endif
+
+static void cancelTimer(SysLogHandler* self) {
+    if (self->timer == Py_None)
+        return;
+    PyObject* result = PyObject_CallMethod(self->timer, "cancel", nullptr);
+    if (result == nullptr)
+        PyErr_Clear();
+    Py_XDECREF(result);
+    // The timer holds the bound flush method, dropping it breaks the cycle.
+    Py_SETREF(self->timer, Py_NewRef(Py_None));
+}
+
+/**
+ * Start a threading.Timer that flushes the partial batch after flushInterval.
+ */
+static int startTimer(SysLogHandler* self) {
+    PyObject* threading = PyImport_ImportModule("threading");
+    if (threading == nullptr)
+        return -1;
+    PyObject* flush = PyObject_GetAttrString((PyObject*)self, "flush");
+    if (flush == nullptr) {
+        Py_DECREF(threading);
+        return -1;
+    }
+    PyObject* timer = PyObject_CallMethod(threading, "Timer", "OO", self->flushInterval, flush);
+    Py_DECREF(flush);
+    Py_DECREF(threading);
+    if (timer == nullptr)
+        return -1;
+    PyObject* result = nullptr;
+    if (PyObject_SetAttrString(timer, "daemon", Py_True) == 0)
+        result = PyObject_CallMethod(timer, "start", nullptr);
+    if (result == nullptr) {
+        Py_DECREF(timer);
+        return -1;
+    }
+    Py_DECREF(result);
+    Py_SETREF(self->timer, timer);
+    return 0;
+}
+
+static int sendPending(SysLogHandler* self) {
+    std::vector<std::string>& pending = *self->pending;
+    cancelTimer(self);
+    if (pending.empty())
+        return 0;
+    if (self->socket == Py_None) {
+        pending.clear();
+        PyErr_SetString(PyExc_ValueError, "I/O operation on closed socket");
+        return -1;
+    }
+    int ret = 0;
+    if (self->stream) {
+        std::string data;
+        for (auto& datagram : pending)
+            data += datagram;
+        PyObject* result = PyObject_CallMethod(self->socket, "sendall", "y#", data.data(), (Py_ssize_t)data.size());
+        ret = result == nullptr ? -1 : 0;
+        Py_XDECREF(result);
+    } else {
+#ifdef _WIN32
+        for (auto& datagram : pending) {
+            PyObject* result = PyObject_CallMethod(self->socket, "send", "y#", datagram.data(), (Py_ssize_t)datagram.size());
+            if (result == nullptr) {
+                ret = -1;
+                break;
+            }
+            Py_DECREF(result);
+        }
+#else
+        size_t sent = 0;
+        int error = writeDatagrams(self, sent);
+        if (error != 0 && self->unixSocket) {
+            // The syslog daemon may have restarted, reconnect once and carry on.
+            PyObject* result = PyObject_CallMethod(self->socket, "connect", "(O)", self->address);
+            if (result != nullptr) {
+                Py_DECREF(result);
+                error = writeDatagrams(self, sent);
+            } else {
+                PyErr_Clear();
+            }
+        }
+        // An unconnected UDP socket silently drops datagrams nobody listens for, keep that behaviour.
+        if (error == ECONNREFUSED && !self->unixSocket)
+            error = 0;
+        if (error != 0) {
+            errno = error;
+            PyErr_SetFromErrno(PyExc_OSError);
+            ret = -1;
+        }
+#endif
+    }
+    if (ret == 0) {
+        uint64_t bytes = 0;
+        for (auto& datagram : pending)
+            bytes += datagram.size();
+        Handler_addBytesWritten(&self->handler, bytes);
+    }
+    pending.clear();
+    return ret;
+}
+
+int SysLogHandler_addConstants(PyTypeObject* type) {
+    for (auto& entry : priorityNames) {
+        PyObject* value = PyLong_FromLong(entry.value);
+        if (value == nullptr || PyDict_SetItemString(type->tp_dict, entry.constant, value) < 0) {
+            Py_XDECREF(value);
+            return -1;
+        }
+        Py_DECREF(value);
+    }
+    for (auto& entry : facilityNames) {
+        PyObject* value = PyLong_FromLong(entry.value);
+        if (value == nullptr || PyDict_SetItemString(type->tp_dict, entry.constant, value) < 0) {
+            Py_XDECREF(value);
+            return -1;
+        }
+        Py_DECREF(value);
+    }
+    PyType_Modified(type);
+    return 0;
+}
+
+PyObject* SysLogHandler_new(PyTypeObject* type, PyObject* args, PyObject* kwds)
+{
+    SysLogHandler* self = (SysLogHandler*)Handler_new(type, args, kwds);
+    if (self != NULL)
+    {
+        self->address = Py_NewRef(Py_None);
+        self->socket = Py_NewRef(Py_None);
+        self->socktype = Py_NewRef(Py_None);
+        self->fd = -1;
+        self->stream = false;
+        self->unixSocket = false;
+        self->facility = 1;
+        self->rfc5424 = 0;
+        self->appendNul = 1;
+        self->ident = PyUnicode_FromString("");
+        self->hostname = Py_NewRef(Py_None);
+        self->appname = Py_NewRef(Py_None);
+        self->batchSize = 1;
+        self->flushInterval = PyFloat_FromDouble(0.5);
+        self->flushLevel = LOG_LEVEL_ERROR;
+        self->timer = Py_NewRef(Py_None);
+        self->prefixes = new std::string[SYSLOG_SEVERITIES];
+        self->fields = new std::string();
+        self->pending = new std::vector<std::string>();
+    }
+    return (PyObject*)self;
+}
+
+int SysLogHandler_init(SysLogHandler *self, PyObject *args, PyObject *kwds){
+    PyObject* noArgs = PyTuple_New(0);
+    int ret = Handler_init((Handler*)self, noArgs, nullptr);
+    Py_DECREF(noArgs);
+    if (ret < 0)
+        return -1;
+    PyObject *address = nullptr;
+    PyObject *facility = nullptr;
+    PyObject *socktype = Py_None;
+    int rfc5424 = 0;
+    PyObject *hostname = Py_None;
+    PyObject *appname = Py_None;
+    Py_ssize_t batchSize = 1;
+    PyObject *flushInterval = nullptr;
+    int flushLevel = LOG_LEVEL_ERROR;
+    static const char *kwlist[] = {"address", "facility", "socktype", "rfc5424", "hostname", "appname", "batchSize", "flushInterval", "flushLevel", NULL};
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|OOOpOOnOi", const_cast<char**>(kwlist),
+            &address, &facility, &socktype, &rfc5424, &hostname, &appname, &batchSize, &flushInterval, &flushLevel)){
+        return -1;
+    }
+    if (batchSize < 1) {
+        PyErr_SetString(PyExc_ValueError, "batchSize must be at least 1");
+        return -1;
+    }
+    if (flushInterval != nullptr && flushInterval != Py_None) {
+        double interval = PyFloat_AsDouble(flushInterval);
+        if (interval == -1.0 && PyErr_Occurred())
+            return -1;
+        if (!(interval > 0)) {
+            PyErr_SetString(PyExc_ValueError, "flushInterval must be positive or None");
+            return -1;
+        }
+    }
+    int facilityValue = 1;
+    if (facility != nullptr && lookupFacility(facility, &facilityValue) < 0)
+        return -1;
+    if (address == nullptr) {
+        address = Py_BuildValue("(si)", "localhost", SYSLOG_UDP_PORT);
+        if (address == nullptr)
+            return -1;
+    } else {
+        Py_INCREF(address);
+    }
+    Py_SETREF(self->address, address);
+    Py_SETREF(self->socktype, Py_NewRef(socktype));
+    Py_SETREF(self->hostname, Py_NewRef(hostname));
+    Py_SETREF(self->appname, Py_NewRef(appname));
+    self->facility = facilityValue;
+    self->rfc5424 = rfc5424 ? 1 : 0;
+    self->batchSize = batchSize;
+    if (flushInterval != nullptr)
+        Py_SETREF(self->flushInterval, Py_NewRef(flushInterval));
+    self->flushLevel = flushLevel;
+    self->pending->reserve(batchSize);
+    if (buildPrefixes(self) < 0)
+        return -1;
+    closeSocket(self);
+    return openSocket(self);
+}
+
+PyObject* SysLogHandler_dealloc(SysLogHandler *self) {
+    closeSocket(self);
+    Py_CLEAR(self->timer);
+    Py_CLEAR(self->flushInterval);
+    Py_CLEAR(self->address);
+    Py_CLEAR(self->socket);
+    Py_CLEAR(self->socktype);
+    Py_CLEAR(self->ident);
+    Py_CLEAR(self->hostname);
+    Py_CLEAR(self->appname);
+    delete[] self->prefixes;
+    delete self->fields;
+    delete self->pending;
+    Handler_dealloc((Handler*)self);
+    return nullptr;
+}
+
+PyObject* SysLogHandler_emit(SysLogHandler* self, PyObject* record){
+    int levelno;
+    double created;
+    int process;
+    if (LogRecord_Check(GET_PICOLOGGING_STATE(self), record)) {
+        LogRecord* logRecord = (LogRecord*)record;
+        levelno = logRecord->levelno;
+        created = LogRecord_created(logRecord);
+        process = logRecord->process;
+    } else {
+        PyObject* value = PyObject_GetAttrString(record, "levelno");
+        if (value == nullptr)
+            return nullptr;
+        levelno = (int)PyLong_AsLong(value);
+        Py_DECREF(value);
+        if (levelno == -1 && PyErr_Occurred())
+            return nullptr;
+        created = (double)time(nullptr);
+        process = getpid();
+    }
+
+    PyObject* msg = Handler_format(&self->handler, record);
+    if (msg == nullptr)
+        return nullptr;
+    std::string datagram(self->prefixes[severityIndex(levelno)]);
+    if (self->rfc5424) {
+        appendTimestamp(datagram, created);
+        datagram += *self->fields;
+        datagram += std::to_string(process);
+        datagram += " - - ";
+    }
+    int ret = appendText(datagram, msg);
+    Py_DECREF(msg);
+    if (ret < 0)
+        return nullptr;
+    if (self->appendNul)
+        datagram.push_back('\0');
+    self->pending->push_back(std::move(datagram));
+    if ((Py_ssize_t)self->pending->size() >= self->batchSize || levelno >= self->flushLevel) {
+        if (sendPending(self) < 0)
+            return nullptr;
+    } else if (self->timer == Py_None && self->flushInterval != nullptr && self->flushInterval != Py_None) {
+        if (startTimer(self) < 0)
+            return nullptr;
+    }
+    Py_RETURN_NONE;
+}
+
+PyObject* SysLogHandler_flush(SysLogHandler* self){
+    HandlerLockGuard guard(&self->handler);
+    if (sendPending(self) < 0)
+        return nullptr;
+    Py_RETURN_NONE;
+}
+
+PyObject* SysLogHandler_close(SysLogHandler* self){
+    HandlerLockGuard guard(&self->handler);
+    int ret = sendPending(self);
+    closeSocket(self);
+    if (ret < 0)
+        return nullptr;
+    Py_RETURN_NONE;
+}
+
+PyObject* SysLogHandler_getIdent(SysLogHandler* self, void* closure){
+    return Py_NewRef(self->ident);
+}
+
+int SysLogHandler_setIdent(SysLogHandler* self, PyObject* value, void* closure){
+    if (value == nullptr) {
+        PyErr_SetString(PyExc_TypeError, "cannot delete ident");
+        return -1;
+    }
+    HandlerLockGuard guard(&self->handler);
+    Py_SETREF(self->ident, Py_NewRef(value));
+    return buildPrefixes(self);
+}
+
+PyObject* SysLogHandler_getFacility(SysLogHandler* self, void* closure){
+    return PyLong_FromLong(self->facility);
+}
+
+PyObject* SysLogHandler_repr(SysLogHandler *self)
+{
+    std::string level = _getLevelName(self->handler.level);
+    return PyUnicode_FromFormat("<%s %R (%s)>",
+        _PyType_Name(Py_TYPE(self)),
+        self->address,
+        level.c_str());
+}
+
+static PyMethodDef SysLogHandler_methods[] = {
+    {"emit", (PyCFunction)SysLogHandler_emit, METH_O, "Emit a record."},
+    {"flush", (PyCFunction)SysLogHandler_flush, METH_NOARGS, "Send the pending batch of messages."},
+    {"close", (PyCFunction)SysLogHandler_close, METH_NOARGS, "Send the pending batch of messages and close the socket."},
+    {NULL}
+};
+
+static PyMemberDef SysLogHandler_members[] = {
+    {"address", T_OBJECT_EX, offsetof(SysLogHandler, address), READONLY, "Syslog address"},
+    {"socket", T_OBJECT_EX, offsetof(SysLogHandler, socket), READONLY, "Connected socket"},
+    {"socktype", T_OBJECT_EX, offsetof(SysLogHandler, socktype), READONLY, "Requested socket type"},
+    {"rfc5424", T_BOOL, offsetof(SysLogHandler, rfc5424), READONLY, "Use RFC 5424 framing"},
+    {"hostname", T_OBJECT_EX, offsetof(SysLogHandler, hostname), READONLY, "RFC 5424 HOSTNAME field"},
+    {"appname", T_OBJECT_EX, offsetof(SysLogHandler, appname), READONLY, "RFC 5424 APP-NAME field"},
+    {"append_nul", T_BOOL, offsetof(SysLogHandler, appendNul), 0, "Terminate each message with a NUL byte"},
+    {"batchSize", T_PYSSIZET, offsetof(SysLogHandler, batchSize), 0, "Number of messages sent together"},
+    {"flushInterval", T_OBJECT_EX, offsetof(SysLogHandler, flushInterval), READONLY, "Seconds a partial batch waits before it is sent"},
+    {"flushLevel", T_INT, offsetof(SysLogHandler, flushLevel), 0, "Level at which the batch is sent immediately"},
+    {NULL}
+};
+
+static PyGetSetDef SysLogHandler_getset[] = {
+    {"ident", (getter)SysLogHandler_getIdent, (setter)SysLogHandler_setIdent, "Prefix of every RFC 3164 message"},
+    {"facility", (getter)SysLogHandler_getFacility, nullptr, "Syslog facility"},
+    {NULL}
+};
+
+static PyType_Slot SysLogHandler_slots[] = {
+    {Py_tp_dealloc, (void*)SysLogHandler_dealloc},
+    {Py_tp_repr, (void*)SysLogHandler_repr},
+    {Py_tp_doc, (void*)PyDoc_STR("Handler which sends records to a syslog daemon over a Unix or UDP socket.")},
+    {Py_tp_methods, SysLogHandler_methods},
+    {Py_tp_members, SysLogHandler_members},
+    {Py_tp_getset, SysLogHandler_getset},
+    {Py_tp_init, (void*)SysLogHandler_init},
+    {Py_tp_new, (void*)SysLogHandler_new},
+    {Py_tp_free, (void*)PyObject_Del},
+    {0, NULL}
+};
+
+PyType_Spec SysLogHandlerType_spec = {
+    "picologging.handlers.SysLogHandler",
+    sizeof(SysLogHandler),
+    0,
+    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE | Py_TPFLAGS_IMMUTABLETYPE,
+    SysLogHandler_slots,
+};
@@ -0,0 +1,42 @@
+#include <Python.h>
+#include <string>
+#include <vector>
+#include "handler.hxx"
+
+#ifndef PICOLOGGING_SYSLOGHANDLER_H
+#define PICOLOGGING_SYSLOGHANDLER_H
+
+#define SYSLOG_UDP_PORT 514
+// DEBUG, INFO, WARNING, ERROR and CRITICAL each get a precomputed header.
+#define SYSLOG_SEVERITIES 5
+
+typedef struct {
+    Handler handler;
+    PyObject* address;
+    PyObject* socket;  // Python socket object, owns the descriptor
+    PyObject* socktype;
+    int fd;
+    bool stream;
+    bool unixSocket;
+    int facility;
+    char rfc5424;
+    char appendNul;
+    PyObject* ident;
+    PyObject* hostname;
+    PyObject* appname;
+    Py_ssize_t batchSize;
+    PyObject* flushInterval; // Seconds a partial batch may wait, None to wait for flush or close
+    int flushLevel;          // Records at or above this level send the batch straight away
+    PyObject* timer;         // threading.Timer flushing the partial batch, or None
+    std::string* prefixes; // Header up to the timestamp (RFC 5424) or message (RFC 3164), per severity
+    std::string* fields;   // RFC 5424 " HOSTNAME APP-NAME "
+    std::vector<std::string>* pending;
+} SysLogHandler;
+
+PyObject* SysLogHandler_emit(SysLogHandler* self, PyObject* record);
+int SysLogHandler_addConstants(PyTypeObject* type);
+
+extern PyType_Spec SysLogHandlerType_spec;
+#define SysLogHandler_CheckExact(state, op) Py_IS_TYPE(op, (state)->SysLogHandlerType)
+
+#endif // PICOLOGGING_SYSLOGHANDLER_H
@@ -0,0 +1,603 @@
+#include <deque>
+#include <string>
+#include <unordered_set>
+#include <vector>
+#include "tracebackformat.hxx"
+#include "framecache.hxx"
+#include "picologging.hxx"
+#include "compat.hxx"
+
+// Mirrors the constants of the traceback module.
+#define RECURSIVE_CUTOFF 3
+#define MAX_GROUP_WIDTH 15
+#define MAX_GROUP_DEPTH 10
+
+static const char* CAUSE_MESSAGE =
+    "\nThe above exception was the direct cause of the following exception:\n\n";
+static const char* CONTEXT_MESSAGE =
+    "\nDuring handling of the above exception, another exception occurred:\n\n";
+
+#define RENDER_ERROR -1
+#define RENDER_OK 0
+#define RENDER_UNSUPPORTED 1
+
+typedef struct ExceptionNode {
+    PyObject* value;
+    PyObject* traceback;
+    struct ExceptionNode* cause;
+    struct ExceptionNode* context;
+    std::vector<struct ExceptionNode*> exceptions;
+    bool isGroup;
+} ExceptionNode;
+
+/**
+ * The chain of exceptions reachable through __cause__, __context__ and
+ * exception groups, built in the same order as traceback.TracebackException
+ * so the same exceptions are skipped as already seen.
+ */
+class ExceptionTree {
+    std::deque<ExceptionNode> nodes;
+    std::unordered_set<PyObject*> seen;
+public:
+    bool isSeen(PyObject* value) { return seen.count(value) > 0; }
+    ExceptionNode* add(PyObject* value, PyObject* traceback){
+        seen.insert(value);
+        nodes.push_back(ExceptionNode{Py_NewRef(value), Py_NewRef(traceback), nullptr, nullptr, {}, false});
+        return &nodes.back();
+    }
+    ~ExceptionTree(){
+        for (auto& node : nodes){
+            Py_CLEAR(node.value);
+            Py_CLEAR(node.traceback);
+        }
+    }
+};
+
+typedef struct {
+    PyObject* output;
+    FrameCache* frameCache;
+    int groupDepth;
+    bool needClose;
+} RenderContext;
+
+static inline bool isGroup(PyObject* value){
+#if PY_VERSION_HEX >= 0x030b0000
+    return PyObject_TypeCheck(value, (PyTypeObject*)PyExc_BaseExceptionGroup);
+#else
+    return false;
+#endif
+}
+
+/**
+ * Check that the exception only needs the plain "Type: message" rendering.
+ * Returns RENDER_UNSUPPORTED for anything the traceback module decorates.
+ */
+static int checkSupported(PyObject* value){
+    if (!PyExceptionInstance_Check(value))
+        return RENDER_UNSUPPORTED;
+    if (PyObject_TypeCheck(value, (PyTypeObject*)PyExc_SyntaxError))
+        return RENDER_UNSUPPORTED;
+#if PY_VERSION_HEX >= 0x030c0000
+    // Name suggestions are computed by the traceback module.
+    if (PyObject_TypeCheck(value, (PyTypeObject*)PyExc_NameError) ||
+        PyObject_TypeCheck(value, (PyTypeObject*)PyExc_AttributeError) ||
+        PyObject_TypeCheck(value, (PyTypeObject*)PyExc_ImportError))
+        return RENDER_UNSUPPORTED;
+#endif
+#if PY_VERSION_HEX >= 0x030b0000
+    PyObject* notes = PyObject_GetAttrString(value, "__notes__");
+    if (notes == nullptr){
+        bool missing = PyErr_ExceptionMatches(PyExc_AttributeError);
+        PyErr_Clear();
+        return missing ? RENDER_OK : RENDER_UNSUPPORTED;
+    }
+    Py_DECREF(notes);
+    if (notes != Py_None)
+        return RENDER_UNSUPPORTED;
+#endif
+    return RENDER_OK;
+}
+
+static ExceptionNode* addChained(ExceptionTree& tree, PyObject* value){
+    PyObject* traceback = PyException_GetTraceback(value);
+    ExceptionNode* node = tree.add(value, traceback != nullptr ? traceback : Py_None);
+    Py_XDECREF(traceback);
+    return node;
+}
+
+static ExceptionNode* addCause(ExceptionTree& tree, ExceptionNode* node){
+    PyObject* cause = PyException_GetCause(node->value);
+    ExceptionNode* result = nullptr;
+    if (cause != nullptr && PyExceptionInstance_Check(cause) && !tree.isSeen(cause))
+        result = addChained(tree, cause);
+    Py_XDECREF(cause);
+    return result;
+}
+
+static ExceptionNode* addContext(ExceptionTree& tree, ExceptionNode* node){
+    PyObject* context = PyException_GetContext(node->value);
+    ExceptionNode* result = nullptr;
+    if (context != nullptr && PyExceptionInstance_Check(context) && !tree.isSeen(context))
+        result = addChained(tree, context);
+    Py_XDECREF(context);
+    return result;
+}
+
+static inline bool suppressContext(ExceptionNode* node){
+    return ((PyBaseExceptionObject*)node->value)->suppress_context != 0;
+}
+
+static int buildTree(ExceptionTree& tree, ExceptionNode* root){
+#if PY_VERSION_HEX >= 0x030a0000
+    // Compact mode, as used by print_exception() since 3.10.
+    std::vector<ExceptionNode*> queue{root};
+    while (!queue.empty()){
+        ExceptionNode* node = queue.back();
+        queue.pop_back();
+        int supported = checkSupported(node->value);
+        if (supported != RENDER_OK)
+            return supported;
+        node->cause = addCause(tree, node);
+        if (node->cause == nullptr && !suppressContext(node))
+            node->context = addContext(tree, node);
+        if (isGroup(node->value)){
+            node->isGroup = true;
+            PyObject* exceptions = PyObject_GetAttrString(node->value, "exceptions");
+            if (exceptions == nullptr)
+                return RENDER_ERROR;
+            if (!PyTuple_Check(exceptions)){
+                Py_DECREF(exceptions);
+                return RENDER_UNSUPPORTED;
+            }
+            for (Py_ssize_t i = 0; i < PyTuple_GET_SIZE(exceptions); i++){
+                PyObject* exc = PyTuple_GET_ITEM(exceptions, i);
+                if (!PyExceptionInstance_Check(exc)){
+                    Py_DECREF(exceptions);
+                    return RENDER_UNSUPPORTED;
+                }
+                node->exceptions.push_back(addChained(tree, exc));
+            }
+            Py_DECREF(exceptions);
+        }
+        if (node->cause != nullptr)
+            queue.push_back(node->cause);
+        if (node->context != nullptr)
+            queue.push_back(node->context);
+        queue.insert(queue.end(), node->exceptions.begin(), node->exceptions.end());
+    }
+#else
+    // Depth first, causes before contexts, as the recursive constructor does.
+    std::vector<std::pair<ExceptionNode*, bool>> stack{{root, false}};
+    while (!stack.empty()){
+        ExceptionNode* node = stack.back().first;
+        bool causeDone = stack.back().second;
+        stack.pop_back();
+        if (!causeDone){
+            int supported = checkSupported(node->value);
+            if (supported != RENDER_OK)
+                return supported;
+            node->cause = addCause(tree, node);
+            stack.push_back({node, true});
+            if (node->cause != nullptr)
+                stack.push_back({node->cause, false});
+        } else {
+            node->context = addContext(tree, node);
+            if (node->context != nullptr)
+                stack.push_back({node->context, false});
+        }
+    }
+#endif
+    return RENDER_OK;
+}
+
+/**
+ * Append text to the output, indenting every line inside exception groups
+ * the way textwrap.indent() does in traceback._ExceptionPrintContext.emit().
+ */
+static int emit(RenderContext* ctx, PyObject* text, char margin = '|'){
+    if (ctx->groupDepth == 0)
+        return PyList_Append(ctx->output, text);
+    std::string prefix(2 * ctx->groupDepth, ' ');
+    prefix += margin;
+    prefix += ' ';
+    PyObject* lines = PyUnicode_Splitlines(text, 1);
+    if (lines == nullptr)
+        return -1;
+    for (Py_ssize_t i = 0; i < PyList_GET_SIZE(lines); i++){
+        PyObject* line = PyUnicode_FromFormat("%s%U", prefix.c_str(), PyList_GET_ITEM(lines, i));
+        if (line == nullptr || PyList_Append(ctx->output, line) < 0){
+            Py_XDECREF(line);
+            Py_DECREF(lines);
+            return -1;
+        }
+        Py_DECREF(line);
+    }
+    Py_DECREF(lines);
+    return 0;
+}
+
+static int emitString(RenderContext* ctx, PyObject* text, char margin = '|'){
+    if (text == nullptr)
+        return -1;
+    int ret = emit(ctx, text, margin);
+    Py_DECREF(text);
+    return ret;
+}
+
+static int appendString(RenderContext* ctx, PyObject* text){
+    if (text == nullptr)
+        return -1;
+    int ret = PyList_Append(ctx->output, text);
+    Py_DECREF(text);
+    return ret;
+}
+
+static int emitRepeated(RenderContext* ctx, long count){
+    return emitString(ctx, PyUnicode_FromFormat(
+        "  [Previous line repeated %ld more time%s]\n", count, count > 1 ? "s" : ""));
+}
+
+static int sameFrame(FrameCacheEntry& last, FrameCacheEntry& frame){
+    if (last.filename == nullptr || last.lineno != frame.lineno)
+        return 0;
+    int eq = PyObject_RichCompareBool(last.filename, frame.filename, Py_EQ);
+    if (eq != 1)
+        return eq;
+    return PyObject_RichCompareBool(last.name, frame.name, Py_EQ);
+}
+
+static inline void releaseFrame(FrameCacheEntry& frame){
+    Py_CLEAR(frame.code);
+    Py_CLEAR(frame.text);
+    Py_CLEAR(frame.filename);
+    Py_CLEAR(frame.name);
+}
+
+/**
+ * Render a sequence of frames, collapsing recursion like
+ * traceback.StackSummary.format(). `next` fills the next cache entry and
+ * returns 1, or returns 0 at the end and -1 on error.
+ */
+template <typename NextFrame>
+static int emitFrameEntries(RenderContext* ctx, NextFrame next){
+    FrameCacheEntry last = {nullptr, 0, false, {-1, -1}, nullptr, nullptr, nullptr, 0};
+    long count = 0;
+    int ret = 0;
+    FrameCacheEntry frame;
+    while ((ret = next(&frame)) > 0){
+        ret = 0;
+        if (PyUnicode_GET_LENGTH(frame.text) == 0){
+            releaseFrame(frame);
+            continue;
+        }
+        int same = sameFrame(last, frame);
+        if (same < 0){
+            releaseFrame(frame);
+            ret = -1;
+            break;
+        }
+        if (!same){
+            if (count > RECURSIVE_CUTOFF && emitRepeated(ctx, count - RECURSIVE_CUTOFF) < 0){
+                releaseFrame(frame);
+                ret = -1;
+                break;
+            }
+            count = 0;
+        }
+        count++;
+        if (count <= RECURSIVE_CUTOFF && emit(ctx, frame.text) < 0){
+            releaseFrame(frame);
+            ret = -1;
+            break;
+        }
+        releaseFrame(last);
+        last = frame;
+    }
+    releaseFrame(last);
+    if (ret == 0 && count > RECURSIVE_CUTOFF)
+        ret = emitRepeated(ctx, count - RECURSIVE_CUTOFF);
+    return ret;
+}
+
+static int emitFrames(RenderContext* ctx, PyObject* tb){
+    return emitFrameEntries(ctx, [&](FrameCacheEntry* frame){
+        if (tb == nullptr || tb == Py_None)
+            return 0;
+        if (ctx->frameCache->lookup(tb, frame) < 0)
+            return -1;
+        tb = (PyObject*)((PyTracebackObject*)tb)->tb_next;
+        return 1;
+    });
+}
+
+static int emitExceptionOnly(RenderContext* ctx, ExceptionNode* node){
+    PyObject* type = (PyObject*)Py_TYPE(node->value);
+    PyObject* module = PyObject_GetAttrString(type, "__module__");
+    if (module == nullptr)
+        return RENDER_ERROR;
+    if (!PyUnicode_Check(module)){
+        Py_DECREF(module);
+        return RENDER_UNSUPPORTED;
+    }
+    PyObject* qualname = PyObject_GetAttrString(type, "__qualname__");
+    if (qualname == nullptr){
+        Py_DECREF(module);
+        return RENDER_ERROR;
+    }
+    PyObject* stype;
+    if (PyUnicode_CompareWithASCIIString(module, "__main__") == 0 ||
+        PyUnicode_CompareWithASCIIString(module, "builtins") == 0){
+        stype = Py_NewRef(qualname);
+    } else {
+        stype = PyUnicode_FromFormat("%U.%U", module, qualname);
+    }
+    Py_DECREF(module);
+    Py_DECREF(qualname);
+    if (stype == nullptr)
+        return RENDER_ERROR;
+
+    PyObject* str = PyObject_Str(node->value);
+    if (str == nullptr){
+        // The placeholder for a failing __str__ differs between versions.
+        PyErr_Clear();
+        Py_DECREF(stype);
+        return RENDER_UNSUPPORTED;
+    }
+    PyObject* line = PyUnicode_GET_LENGTH(str) == 0 ?
+        PyUnicode_FromFormat("%U\n", stype) :
+        PyUnicode_FromFormat("%U: %U\n", stype, str);
+    Py_DECREF(stype);
+    Py_DECREF(str);
+    return emitString(ctx, line) < 0 ? RENDER_ERROR : RENDER_OK;
+}
+
+static int render(RenderContext* ctx, ExceptionNode* node){
+    std::vector<std::pair<const char*, ExceptionNode*>> output;
+    for (ExceptionNode* exc = node; exc != nullptr; ){
+        if (exc->cause != nullptr){
+            output.push_back({CAUSE_MESSAGE, exc});
+            exc = exc->cause;
+        } else if (exc->context != nullptr && !suppressContext(exc)){
+            output.push_back({CONTEXT_MESSAGE, exc});
+            exc = exc->context;
+        } else {
+            output.push_back({nullptr, exc});
+            exc = nullptr;
+        }
+    }
+
+    int ret;
+    for (auto it = output.rbegin(); it != output.rend(); ++it){
+        const char* msg = it->first;
+        ExceptionNode* exc = it->second;
+        if (msg != nullptr && emitString(ctx, PyUnicode_FromString(msg)) < 0)
+            return RENDER_ERROR;
+        if (!exc->isGroup){
+            if (exc->traceback != Py_None){
+                if (emitString(ctx, PyUnicode_FromString("Traceback (most recent call last):\n")) < 0 ||
+                    emitFrames(ctx, exc->traceback) < 0)
+                    return RENDER_ERROR;
+            }
+            if ((ret = emitExceptionOnly(ctx, exc)) != RENDER_OK)
+                return ret;
+        } else if (ctx->groupDepth > MAX_GROUP_DEPTH){
+            if (emitString(ctx, PyUnicode_FromFormat("... (max_group_depth is %d)\n", MAX_GROUP_DEPTH)) < 0)
+                return RENDER_ERROR;
+        } else {
+            bool isTopLevel = ctx->groupDepth == 0;
+            if (isTopLevel)
+                ctx->groupDepth++;
+            if (exc->traceback != Py_None){
+                if (emitString(ctx, PyUnicode_FromString("Exception Group Traceback (most recent call last):\n"),
+                               isTopLevel ? '+' : '|') < 0 ||
+                    emitFrames(ctx, exc->traceback) < 0)
+                    return RENDER_ERROR;
+            }
+            if ((ret = emitExceptionOnly(ctx, exc)) != RENDER_OK)
+                return ret;
+
+            size_t count = exc->exceptions.size();
+            size_t n = count <= MAX_GROUP_WIDTH ? count : MAX_GROUP_WIDTH + 1;
+            ctx->needClose = false;
+            for (size_t i = 0; i < n; i++){
+                bool lastExc = i == n - 1;
+                if (lastExc)
+                    ctx->needClose = true;
+                bool truncated = i >= MAX_GROUP_WIDTH;
+                std::string indent(2 * ctx->groupDepth, ' ');
+                std::string title = truncated ? "..." : std::to_string(i + 1);
+                if (appendString(ctx, PyUnicode_FromFormat("%s%s+---------------- %s ----------------\n",
+                        indent.c_str(), i == 0 ? "+-" : "  ", title.c_str())) < 0)
+                    return RENDER_ERROR;
+                ctx->groupDepth++;
+                if (!truncated){
+                    if ((ret = render(ctx, exc->exceptions[i])) != RENDER_OK)
+                        return ret;
+                } else {
+                    size_t remaining = count - MAX_GROUP_WIDTH;
+                    if (emitString(ctx, PyUnicode_FromFormat("and %zu more exception%s\n",
+                            remaining, remaining > 1 ? "s" : "")) < 0)
+                        return RENDER_ERROR;
+                }
+                if (lastExc && ctx->needClose){
+                    std::string closeIndent(2 * ctx->groupDepth, ' ');
+                    if (appendString(ctx, PyUnicode_FromFormat("%s+------------------------------------\n",
+                            closeIndent.c_str())) < 0)
+                        return RENDER_ERROR;
+                    ctx->needClose = false;
+                }
+                ctx->groupDepth--;
+            }
+            if (isTopLevel)
+                ctx->groupDepth = 0;
+        }
+    }
+    return RENDER_OK;
+}
+
+static PyObject* renderNative(picologging_state* state, PyObject* value, PyObject* tb, int* status){
+    *status = RENDER_UNSUPPORTED;
+    if (PySys_GetObject("tracebacklimit") != nullptr)
+        return nullptr;
+    if (tb != Py_None && !PyTraceBack_Check(tb))
+        return nullptr;
+    if (!PyExceptionInstance_Check(value))
+        return nullptr;
+
+    // Without the frame cache (module being torn down), leave it to the traceback module.
+    if (state->g_frameCache == nullptr)
+        return nullptr;
+
+    ExceptionTree tree;
+    ExceptionNode* root = tree.add(value, tb);
+    if ((*status = buildTree(tree, root)) != RENDER_OK)
+        return nullptr;
+
+    RenderContext ctx = {PyList_New(0), state->g_frameCache, 0, false};
+    if (ctx.output == nullptr){
+        *status = RENDER_ERROR;
+        return nullptr;
+    }
+    if ((*status = render(&ctx, root)) != RENDER_OK){
+        Py_DECREF(ctx.output);
+        return nullptr;
+    }
+    PyObject* empty = PyUnicode_New(0, 0);
+    PyObject* result = PyUnicode_Join(empty, ctx.output);
+    Py_DECREF(empty);
+    Py_DECREF(ctx.output);
+    if (result == nullptr)
+        *status = RENDER_ERROR;
+    return result;
+}
+
+/**
+ * Render through traceback.print_exception() into an io.StringIO.
+ */
+static PyObject* renderWithTracebackModule(picologging_state* state, PyObject* excInfo){
+    PyObject* print_exception = state->g_print_exception; // borrowed reference
+    PyObject* sio_cls = state->g_StringIO; // borrowed reference
+    if (print_exception == nullptr || sio_cls == nullptr){
+        PyErr_SetString(PyExc_RuntimeError, "traceback.print_exception is not available.");
+        return nullptr;
+    }
+    PyObject* sio = PyObject_CallFunctionObjArgs(sio_cls, NULL);
+    if (sio == nullptr)
+        return nullptr; // Got exception in StringIO.__init__()
+    PyObject* ret = PyObject_CallFunctionObjArgs(
+        print_exception,
+        PyTuple_GET_ITEM(excInfo, 0),
+        PyTuple_GET_ITEM(excInfo, 1),
+        PyTuple_GET_ITEM(excInfo, 2),
+        Py_None,
+        sio,
+        NULL);
+    if (ret == nullptr){
+        Py_DECREF(sio);
+        return nullptr; // Got exception in print_exception()
+    }
+    Py_DECREF(ret);
+    PyObject* s = PyObject_CallMethod(sio, "getvalue", NULL);
+    if (s == nullptr){
+        Py_DECREF(sio);
+        return nullptr; // Got exception in StringIO.getvalue()
+    }
+    ret = PyObject_CallMethod(sio, "close", NULL);
+    Py_DECREF(sio);
+    if (ret == nullptr){
+        Py_DECREF(s);
+        return nullptr; // Got exception in StringIO.close()
+    }
+    Py_DECREF(ret);
+    return s;
+}
+
+PyObject* formatException(picologging_state* state, PyObject* excInfo){
+    if (!PyTuple_Check(excInfo) || PyTuple_GET_SIZE(excInfo) < 3){
+        PyErr_SetString(PyExc_TypeError, "exc_info must be a tuple of (type, value, traceback).");
+        return nullptr;
+    }
+    int status;
+    PyObject* s = renderNative(state, PyTuple_GET_ITEM(excInfo, 1), PyTuple_GET_ITEM(excInfo, 2), &status);
+    if (status == RENDER_ERROR)
+        return nullptr;
+    if (status == RENDER_UNSUPPORTED)
+        s = renderWithTracebackModule(state, excInfo);
+    if (s == nullptr)
+        return nullptr;
+
+    Py_ssize_t length = PyUnicode_GET_LENGTH(s);
+    if (length > 0 && PyUnicode_READ_CHAR(s, length - 1) == '\n'){
+        PyObject* s2 = PyUnicode_Substring(s, 0, length - 1);
+        Py_DECREF(s);
+        s = s2;
+    }
+    return s;
+}
+
+CapturedStack* captureStack(PyFrameObject* frame){
+    CapturedStack* stack = new CapturedStack();
+#if PY_VERSION_HEX >= 0x030b0000
+    Py_XINCREF(frame);
+    while (frame != nullptr){
+        stack->frames.push_back({(PyObject*)PyFrame_GetCode(frame), PyFrame_GETLASTI(frame)});
+        PyFrameObject* back = PyFrame_GetBack(frame);
+        Py_DECREF(frame);
+        frame = back;
+    }
+#else
+    for (PyFrameObject* f = frame; f != nullptr; f = f->f_back){
+        stack->frames.push_back({Py_NewRef(f->f_code), PyFrame_GETLASTI(f)});
+    }
+#endif
+    return stack;
+}
+
+PyObject* formatStack(picologging_state* state, const CapturedStack* stack){
+    if (state->g_frameCache == nullptr){
+        PyErr_SetString(PyExc_RuntimeError, "picologging frame cache is not available.");
+        return nullptr;
+    }
+    RenderContext ctx = {PyList_New(0), state->g_frameCache, 0, false};
+    if (ctx.output == nullptr)
+        return nullptr;
+    // Captured innermost first, printed oldest first. sys.tracebacklimit keeps
+    // the innermost frames, or the outermost ones when it is negative.
+    auto begin = stack->frames.rbegin(), end = stack->frames.rend();
+    PyObject* limit = PySys_GetObject("tracebacklimit"); // borrowed reference
+    if (limit != nullptr && PyLong_Check(limit)){
+        long n = PyLong_AsLong(limit);
+        if (n == -1 && PyErr_Occurred()){
+            Py_DECREF(ctx.output);
+            return nullptr;
+        }
+        long size = (long)stack->frames.size();
+        if (n >= 0 && n < size)
+            begin = end - n;
+        else if (n < 0 && -n < size)
+            end = begin + (-n);
+    }
+    auto it = begin;
+    if (emitFrameEntries(&ctx, [&](FrameCacheEntry* frame){
+            if (it == end)
+                return 0;
+            return ctx.frameCache->lookupStack(*it++, frame) < 0 ? -1 : 1;
+        }) < 0){
+        Py_DECREF(ctx.output);
+        return nullptr;
+    }
+    PyObject* empty = PyUnicode_New(0, 0);
+    PyObject* result = PyUnicode_Join(empty, ctx.output);
+    Py_DECREF(empty);
+    Py_DECREF(ctx.output);
+    if (result == nullptr)
+        return nullptr;
+
+    Py_ssize_t length = PyUnicode_GET_LENGTH(result);
+    if (length > 0 && PyUnicode_READ_CHAR(result, length - 1) == '\n'){
+        PyObject* s = PyUnicode_Substring(result, 0, length - 1);
+        Py_DECREF(result);
+        result = s;
+    }
+    return result;
+}
@@ -0,0 +1,29 @@
+#include <Python.h>
+#include <frameobject.h>
+#include "framecache.hxx"
+
+#ifndef PICOLOGGING_TRACEBACKFORMAT_H
+#define PICOLOGGING_TRACEBACKFORMAT_H
+
+struct picologging_state;
+
+/**
+ * Render an exc_info tuple the way traceback.print_exception() does,
+ * without the trailing line break. Frames are rendered natively through the
+ * frame cache; exceptions the native renderer does not cover (syntax errors,
+ * notes, name suggestions, sys.tracebacklimit) go through the traceback module.
+ */
+PyObject* formatException(picologging_state* state, PyObject* excInfo);
+
+/**
+ * Capture the code objects and instruction offsets of `frame` and its callers.
+ */
+CapturedStack* captureStack(PyFrameObject* frame);
+
+/**
+ * Render a captured stack the way traceback.print_stack() does, without the
+ * trailing line break.
+ */
+PyObject* formatStack(picologging_state* state, const CapturedStack* stack);
+
+#endif // PICOLOGGING_TRACEBACKFORMAT_H
@@ -0,0 +1,312 @@
+#include <cstring>
+
+#include "wireformat.hxx"
+#include "logrecord.hxx"
+#include "tracebackformat.hxx"
+#include "compat.hxx"
+#include "picologging.hxx"
+
+static inline void putUint32(std::string& buffer, uint32_t value) {
+    char bytes[4] = {(char)(value >> 24), (char)(value >> 16), (char)(value >> 8), (char)value};
+    buffer.append(bytes, 4);
+}
+
+static inline void putUint64(std::string& buffer, uint64_t value) {
+    putUint32(buffer, (uint32_t)(value >> 32));
+    putUint32(buffer, (uint32_t)value);
+}
+
+static inline void putDouble(std::string& buffer, double value) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    putUint64(buffer, bits);
+}
+
+/**
+ * Write a length-prefixed UTF-8 string, or the None marker. Non-string
+ * values are written as their str(), lone surrogates with "surrogatepass".
+ */
+static int putString(std::string& buffer, PyObject* value) {
+    if (value == Py_None) {
+        putUint32(buffer, WIREFORMAT_NONE);
+        return 0;
+    }
+    PyObject* str = PyUnicode_Check(value) ? Py_NewRef(value) : PyObject_Str(value);
+    if (str == nullptr)
+        return -1;
+    PyObject* encoded = nullptr;
+    Py_ssize_t size;
+    const char* data = PyUnicode_AsUTF8AndSize(str, &size);
+    if (data == nullptr) {
+        PyErr_Clear();
+        encoded = PyUnicode_AsEncodedString(str, "utf-8", "surrogatepass");
+        if (encoded == nullptr) {
+            Py_DECREF(str);
+            return -1;
+        }
+        data = PyBytes_AS_STRING(encoded);
+        size = PyBytes_GET_SIZE(encoded);
+    }
+    putUint32(buffer, (uint32_t)size);
+    buffer.append(data, size);
+    Py_XDECREF(encoded);
+    Py_DECREF(str);
+    return 0;
+}
+
+int WireFormat_encode(LogRecord* record, std::string& buffer) {
+    size_t mark = buffer.size();
+    if (LogRecord_writeMessage(record) == -1 || LogRecord_writeStackInfo(record) == -1)
+        return -1;
+    if (record->excInfo != Py_None && record->excInfo != Py_False && record->excText == Py_None) {
+        PyObject* excText = formatException(GET_PICOLOGGING_STATE(record), record->excInfo);
+        if (excText == nullptr)
+            return -1;
+        Py_SETREF(record->excText, excText);
+    }
+    PyObject* relativeCreatedValue = LogRecord_relativeCreated(record);
+    if (relativeCreatedValue == nullptr)
+        return -1;
+    double relativeCreated = PyFloat_AsDouble(relativeCreatedValue);
+    if (relativeCreated == -1.0 && PyErr_Occurred())
+        return -1;
+
+    putUint32(buffer, 0); // Frame length, patched below
+    buffer.push_back((char)WIREFORMAT_VERSION);
+    if (putString(buffer, record->name) < 0 ||
+        putString(buffer, record->message) < 0)
+        goto error;
+    putUint32(buffer, (uint32_t)record->levelno);
+    if (putString(buffer, record->pathname) < 0 ||
+        putString(buffer, record->filename) < 0 ||
+        putString(buffer, record->module) < 0 ||
+        putString(buffer, record->funcName) < 0)
+        goto error;
+    putUint32(buffer, (uint32_t)record->lineno);
+    putDouble(buffer, LogRecord_created(record));
+    putUint64(buffer, (uint64_t)LogRecord_msecs(record));
+    putDouble(buffer, relativeCreated);
+    putUint64(buffer, (uint64_t)record->thread);
+    if (putString(buffer, record->threadName) < 0)
+        goto error;
+    putUint32(buffer, (uint32_t)record->process);
+    if (putString(buffer, record->processName) < 0 ||
+        putString(buffer, record->excText) < 0 ||
+        putString(buffer, record->stackInfo == Py_False ? Py_None : record->stackInfo) < 0)
+        goto error;
+
+    {
+        size_t length = buffer.size() - mark - 4;
+        if (length > WIREFORMAT_MAX_FRAME) {
+            PyErr_Format(PyExc_ValueError, "record of %zu bytes exceeds the maximum frame size", length);
+            goto error;
+        }
+        unsigned char* header = (unsigned char*)&buffer[mark];
+        header[0] = (unsigned char)(length >> 24);
+        header[1] = (unsigned char)(length >> 16);
+        header[2] = (unsigned char)(length >> 8);
+        header[3] = (unsigned char)length;
+    }
+    return 0;
+
+error:
+    buffer.resize(mark);
+    return -1;
+}
+
+PyObject* encodeRecord(PyObject* module, PyObject* args) {
+    PyObject* record = nullptr;
+    PyObject* target = nullptr;
+    if (!PyArg_ParseTuple(args, "OO!", &record, &PyByteArray_Type, &target))
+        return nullptr;
+    if (!LogRecord_Check((picologging_state*)PyModule_GetState(module), record)) {
+        PyErr_Format(PyExc_TypeError, "expected a LogRecord, got %s", Py_TYPE(record)->tp_name);
+        return nullptr;
+    }
+    std::string frame;
+    if (WireFormat_encode((LogRecord*)record, frame) < 0)
+        return nullptr;
+    Py_ssize_t offset = PyByteArray_GET_SIZE(target);
+    if (PyByteArray_Resize(target, offset + (Py_ssize_t)frame.size()) < 0)
+        return nullptr;
+    memcpy(PyByteArray_AS_STRING(target) + offset, frame.data(), frame.size());
+    return PyLong_FromSsize_t(PyByteArray_GET_SIZE(target));
+}
+
+class FrameReader {
+    const unsigned char* data;
+    size_t size;
+    size_t offset = 0;
+public:
+    FrameReader(const unsigned char* data, size_t size) : data(data), size(size) {}
+
+    bool done() const { return offset == size; }
+
+    int uint32(uint32_t* value) {
+        if (size - offset < 4)
+            return truncated();
+        const unsigned char* p = data + offset;
+        *value = ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+        offset += 4;
+        return 0;
+    }
+
+    int uint64(uint64_t* value) {
+        uint32_t high, low;
+        if (uint32(&high) < 0 || uint32(&low) < 0)
+            return -1;
+        *value = ((uint64_t)high << 32) | low;
+        return 0;
+    }
+
+    int float64(double* value) {
+        uint64_t bits;
+        if (uint64(&bits) < 0)
+            return -1;
+        memcpy(value, &bits, sizeof(bits));
+        return 0;
+    }
+
+    PyObject* string() {
+        uint32_t length;
+        if (uint32(&length) < 0)
+            return nullptr;
+        if (length == WIREFORMAT_NONE)
+            return Py_NewRef(Py_None);
+        if (size - offset < length) {
+            truncated();
+            return nullptr;
+        }
+        PyObject* value = PyUnicode_DecodeUTF8((const char*)data + offset, length, "surrogatepass");
+        offset += length;
+        return value;
+    }
+
+    int truncated() {
+        PyErr_SetString(PyExc_ValueError, "malformed log record frame");
+        return -1;
+    }
+};
+
+/**
+ * Build a record from one frame payload, restoring the attributes that
+ * LogRecord_create would otherwise take from the receiving process.
+ */
+PyObject* WireFormat_decode(picologging_state* state, const unsigned char* data, size_t size) {
+    PyObject *name = nullptr, *msg = nullptr, *pathname = nullptr, *filename = nullptr;
+    PyObject *module = nullptr, *funcName = nullptr, *threadName = nullptr;
+    PyObject *processName = nullptr, *excText = nullptr, *stackInfo = nullptr;
+    PyObject* relativeCreated = nullptr;
+    LogRecord* record = nullptr;
+    uint32_t levelno, lineno, process;
+    uint64_t msecs, thread;
+    double created, relative;
+
+    if (size < 1 || data[0] != WIREFORMAT_VERSION) {
+        PyErr_Format(PyExc_ValueError, "unsupported log record frame version %d", size < 1 ? -1 : (int)data[0]);
+        return nullptr;
+    }
+    FrameReader reader(data + 1, size - 1);
+    if ((name = reader.string()) == nullptr ||
+        (msg = reader.string()) == nullptr ||
+        reader.uint32(&levelno) < 0 ||
+        (pathname = reader.string()) == nullptr ||
+        (filename = reader.string()) == nullptr ||
+        (module = reader.string()) == nullptr ||
+        (funcName = reader.string()) == nullptr ||
+        reader.uint32(&lineno) < 0 ||
+        reader.float64(&created) < 0 ||
+        reader.uint64(&msecs) < 0 ||
+        reader.float64(&relative) < 0 ||
+        reader.uint64(&thread) < 0 ||
+        (threadName = reader.string()) == nullptr ||
+        reader.uint32(&process) < 0 ||
+        (processName = reader.string()) == nullptr ||
+        (excText = reader.string()) == nullptr ||
+        (stackInfo = reader.string()) == nullptr)
+        goto done;
+    if (!reader.done()) {
+        reader.truncated();
+        goto done;
+    }
+    if (!PyUnicode_Check(name) || !PyUnicode_Check(msg) || !PyUnicode_Check(pathname)) {
+        reader.truncated();
+        goto done;
+    }
+    if ((relativeCreated = PyFloat_FromDouble(relative)) == nullptr)
+        goto done;
+
+    record = (LogRecord*)state->LogRecordType->tp_alloc(state->LogRecordType, 0);
+    if (record == nullptr)
+        goto done;
+    if (LogRecord_create(record, name, msg, Py_None, (int)levelno, pathname, (int)lineno, Py_None, funcName, stackInfo) == nullptr) {
+        Py_CLEAR(record);
+        goto done;
+    }
+    Py_SETREF(record->filename, Py_NewRef(filename));
+    Py_SETREF(record->module, Py_NewRef(module));
+    Py_XSETREF(record->relativeCreated, Py_NewRef(relativeCreated));
+    Py_SETREF(record->threadName, Py_NewRef(threadName));
+    Py_SETREF(record->processName, Py_NewRef(processName));
+    Py_SETREF(record->excText, Py_NewRef(excText));
+    Py_SETREF(record->message, Py_NewRef(msg));
+    LogRecord_setCreated(record, created);
+    record->msecs = (long)msecs;
+    record->timeFields |= LogRecord_HasMsecs;
+    record->thread = (unsigned long)thread;
+    record->process = (int)process;
+
+done:
+    Py_XDECREF(name);
+    Py_XDECREF(msg);
+    Py_XDECREF(pathname);
+    Py_XDECREF(filename);
+    Py_XDECREF(module);
+    Py_XDECREF(funcName);
+    Py_XDECREF(threadName);
+    Py_XDECREF(processName);
+    Py_XDECREF(excText);
+    Py_XDECREF(stackInfo);
+    Py_XDECREF(relativeCreated);
+    return (PyObject*)record;
+}
+
+PyObject* decodeRecords(PyObject* module, PyObject* data) {
+    Py_buffer view;
+    if (PyObject_GetBuffer(data, &view, PyBUF_SIMPLE) < 0)
+        return nullptr;
+    const unsigned char* bytes = (const unsigned char*)view.buf;
+    size_t size = (size_t)view.len;
+    size_t offset = 0;
+    PyObject* records = PyList_New(0);
+    if (records == nullptr) {
+        PyBuffer_Release(&view);
+        return nullptr;
+    }
+    // Decode every complete frame, a trailing partial frame is left for the caller.
+    while (size - offset >= 4) {
+        const unsigned char* p = bytes + offset;
+        size_t length = ((size_t)p[0] << 24) | ((size_t)p[1] << 16) | ((size_t)p[2] << 8) | (size_t)p[3];
+        if (length > WIREFORMAT_MAX_FRAME) {
+            PyErr_Format(PyExc_ValueError, "log record frame of %zu bytes exceeds the maximum frame size", length);
+            goto error;
+        }
+        if (size - offset - 4 < length)
+            break;
+        PyObject* record = WireFormat_decode((picologging_state*)PyModule_GetState(module), p + 4, length);
+        if (record == nullptr)
+            goto error;
+        int ret = PyList_Append(records, record);
+        Py_DECREF(record);
+        if (ret < 0)
+            goto error;
+        offset += 4 + length;
+    }
+    PyBuffer_Release(&view);
+    return Py_BuildValue("(Nn)", records, (Py_ssize_t)offset);
+
+error:
+    PyBuffer_Release(&view);
+    Py_DECREF(records);
+    return nullptr;
+}
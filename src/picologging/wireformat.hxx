@@ -0,0 +1,29 @@
+#include <Python.h>
+#include <string>
+#include "logrecord.hxx"
+
+#ifndef PICOLOGGING_WIREFORMAT_H
+#define PICOLOGGING_WIREFORMAT_H
+
+/**
+ * Binary framing for sending records over a stream socket. Each frame is a
+ * big-endian u32 payload length, followed by the payload:
+ *
+ *   u8 version, name, msg (formatted), i32 levelno, pathname, filename,
+ *   module, funcName, i32 lineno, f64 created, i64 msecs, f64 relativeCreated,
+ *   u64 thread, threadName, i32 process, processName, exc_text, stack_info
+ *
+ * Strings are a big-endian u32 length and UTF-8 data, 0xFFFFFFFF for None.
+ */
+#define WIREFORMAT_VERSION 1
+#define WIREFORMAT_NONE 0xFFFFFFFFu
+#define WIREFORMAT_MAX_FRAME (64 * 1024 * 1024)
+
+int WireFormat_encode(LogRecord* record, std::string& buffer);
+// Decode one frame payload, without its length prefix, into a new LogRecord.
+PyObject* WireFormat_decode(picologging_state* state, const unsigned char* data, size_t size);
+
+PyObject* encodeRecord(PyObject* module, PyObject* args);
+PyObject* decodeRecords(PyObject* module, PyObject* data);
+
+#endif // PICOLOGGING_WIREFORMAT_H
@@ -0,0 +1,277 @@
+import os
+import struct
+import sys
+
+import pytest
+from utils import filter_gc
+
+import picologging
+from picologging.decode import DecodeError, decode, iter_records, main
+from picologging.handlers import BinaryFileHandler
+
+
+def _read_records(path):
+    with open(path, "rb") as f:
+        return list(iter_records(f.read()))
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_templated_args_roundtrip(tmp_path):
+    path = tmp_path / "log.plog"
+    handler = BinaryFileHandler(path)
+    logger = picologging.Logger("test", picologging.DEBUG)
+    logger.addHandler(handler)
+    for i in range(3):
+        logger.info("n=%d f=%.1f s=%s none=%s flag=%s", i, 1.5, "x", None, True)
+    handler.close()
+
+    records = _read_records(path)
+    assert [r.getMessage() for r in records] == [
+        f"n={i} f=1.5 s=x none=None flag=True" for i in range(3)
+    ]
+    assert records[0].args == (0, 1.5, "x", None, True)
+    assert records[0].name == "test"
+    assert records[0].levelno == picologging.INFO
+    assert records[0].created <= records[2].created
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_templates_are_written_once(tmp_path):
+    path = tmp_path / "log.plog"
+    handler = BinaryFileHandler(path)
+    logger = picologging.Logger("test", picologging.DEBUG)
+    logger.addHandler(handler)
+    for i in range(100):
+        logger.debug("a fairly long template with value %d", i)
+    handler.close()
+    with open(path, "rb") as f:
+        data = f.read()
+    assert data.count(b"a fairly long template") == 1
+    assert len(list(iter_records(data))) == 100
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_unsupported_args_are_formatted(tmp_path):
+    path = tmp_path / "log.plog"
+    handler = BinaryFileHandler(path)
+    logger = picologging.Logger("test", picologging.DEBUG)
+    logger.addHandler(handler)
+    logger.warning("list %s", [1, 2])
+    logger.warning("dict %(a)s", {"a": 1})
+    logger.warning("big %d", 2**80)
+    logger.warning(42)
+    logger.warning("plain")
+    handler.close()
+
+    assert [r.getMessage() for r in _read_records(path)] == [
+        "list [1, 2]",
+        "dict 1",
+        f"big {2**80}",
+        "42",
+        "plain",
+    ]
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_surrogates_roundtrip(tmp_path):
+    path = tmp_path / "log.plog"
+    handler = BinaryFileHandler(path)
+    logger = picologging.Logger("test", picologging.DEBUG)
+    logger.addHandler(handler)
+    logger.info("value %s", "caf\udce9")
+    handler.close()
+    assert _read_records(path)[0].getMessage() == "value caf\udce9"
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_exc_info_and_stack_info(tmp_path):
+    path = tmp_path / "log.plog"
+    handler = BinaryFileHandler(path)
+    logger = picologging.Logger("test", picologging.DEBUG)
+    logger.addHandler(handler)
+    try:
+        1 / 0
+    except ZeroDivisionError:
+        logger.exception("failed %d", 1)
+    logger.info("here", stack_info=True)
+    handler.close()
+
+    failed, here = _read_records(path)
+    assert failed.getMessage() == "failed 1"
+    assert failed.exc_text.startswith("Traceback (most recent call last):")
+    assert failed.exc_text.endswith("ZeroDivisionError: division by zero")
+    assert here.stack_info.endswith('logger.info("here", stack_info=True)')
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_records_keep_their_creation_time(tmp_path):
+    path = tmp_path / "log.plog"
+    handler = BinaryFileHandler(path)
+    early = picologging.LogRecord(
+        "test", picologging.INFO, __file__, 1, "early %d", (1,), None
+    )
+    early.created -= 3600
+    late = picologging.LogRecord(
+        "test", picologging.INFO, __file__, 1, "late %d", (2,), None
+    )
+    # Emitted out of creation order, e.g. after waiting in a queue.
+    handler.handle(late)
+    handler.handle(early)
+    handler.close()
+
+    records = _read_records(path)
+    assert [r.getMessage() for r in records] == ["late 2", "early 1"]
+    for decoded, original in zip(records, (late, early)):
+        assert decoded.created == pytest.approx(original.created, abs=1e-6)
+        assert decoded.relativeCreated == pytest.approx(
+            original.relativeCreated, abs=1e-3
+        )
+
+
+def test_decode_version_1_files():
+    data = (
+        b"PLOGBIN\x01"
+        + struct.pack("<QQ", 1_000_000_000_000_000_000, 5)
+        + b"S\x00\x04test\x07file.py\x00\x02"
+        + b"M\x03one\x28\x80\x94\xeb\xdc\x03\x00\x00"
+        + b"M\x03two\x28\x80\xca\xb5\xee\x01\x00\x00"
+    )
+    records = list(iter_records(data))
+    assert [r.getMessage() for r in records] == ["one", "two"]
+    assert [r.created for r in records] == [1e9 + 1, 1e9 + 1.5]
+    assert records[0].lineno == 1
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_append_mode_starts_new_session(tmp_path):
+    path = tmp_path / "log.plog"
+    logger = picologging.Logger("test", picologging.DEBUG)
+    for session in range(2):
+        handler = BinaryFileHandler(path)
+        logger.addHandler(handler)
+        logger.info("session %d", session)
+        logger.removeHandler(handler)
+        handler.close()
+    assert [r.getMessage() for r in _read_records(path)] == [
+        "session 0",
+        "session 1",
+    ]
+
+    handler = BinaryFileHandler(path, mode="w")
+    handler.close()
+    assert _read_records(path) == []
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_buffer_is_written_when_full(tmp_path):
+    path = tmp_path / "log.plog"
+    handler = BinaryFileHandler(path, buffer_size=0)
+    logger = picologging.Logger("test", picologging.DEBUG)
+    logger.addHandler(handler)
+    logger.info("value %d", 1)
+    assert [r.getMessage() for r in _read_records(path)] == ["value 1"]
+    handler.close()
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_emit_after_close(tmp_path):
+    handler = BinaryFileHandler(tmp_path / "log.plog")
+    handler.close()
+    record = picologging.LogRecord("test", picologging.INFO, __file__, 1, "x", (), None)
+    with pytest.raises(ValueError):
+        handler.emit(record)
+    handler.close()
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_invalid_mode(tmp_path):
+    with pytest.raises(ValueError):
+        BinaryFileHandler(tmp_path / "log.plog", mode="r")
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_repr(tmp_path):
+    path = tmp_path / "log.plog"
+    handler = BinaryFileHandler(path)
+    assert repr(handler) == f"<BinaryFileHandler {path} (NOTSET)>"
+    handler.close()
+
+
+def test_decode_command(tmp_path, capsys):
+    path = tmp_path / "log.plog"
+    handler = BinaryFileHandler(path)
+    logger = picologging.Logger("app", picologging.DEBUG)
+    logger.addHandler(handler)
+    logger.error("status %d", 500)
+    handler.close()
+
+    assert list(decode(path, "%(levelname)s:%(name)s:%(message)s")) == [
+        "ERROR:app:status 500"
+    ]
+    assert main(["--format", "%(message)s", str(path)]) == 0
+    assert capsys.readouterr().out == "status 500\n"
+
+
+@pytest.mark.skipif(sys.platform == "win32", reason="Needs RLIMIT_FSIZE")
+def test_failed_write_starts_new_session(tmp_path):
+    resource = pytest.importorskip("resource")
+    signal = pytest.importorskip("signal")
+    path = tmp_path / "log.plog"
+    pid = os.fork()
+    if pid == 0:
+        # Child: cap the file size so one batch is cut off part way through.
+        code = 1
+        try:
+            signal.signal(signal.SIGXFSZ, signal.SIG_IGN)
+            handler = BinaryFileHandler(path, buffer_size=0)
+            logger = picologging.Logger("test", picologging.DEBUG)
+            logger.addHandler(handler)
+            logger.info("first %d", 1)
+            limits = resource.getrlimit(resource.RLIMIT_FSIZE)
+            resource.setrlimit(
+                resource.RLIMIT_FSIZE, (path.stat().st_size + 10, limits[1])
+            )
+            record = picologging.LogRecord(
+                "test", picologging.INFO, __file__, 1, "lost %d", (2,), None
+            )
+            try:
+                handler.emit(record)
+            except OSError:
+                code = 2
+            resource.setrlimit(resource.RLIMIT_FSIZE, limits)
+            for i in range(3, 5):
+                logger.info("lost %d", i)
+            handler.close()
+            code = 0 if code == 2 else 3
+        finally:
+            os._exit(code)
+    _, status = os.waitpid(pid, 0)
+    assert os.WEXITSTATUS(status) == 0
+    # The templates and call site of the lost batch are defined again.
+    assert [r.getMessage() for r in _read_records(path)] == [
+        "first 1",
+        "lost 3",
+        "lost 4",
+    ]
+
+
+def test_unknown_template_is_a_decode_error(tmp_path):
+    path = tmp_path / "log.plog"
+    handler = BinaryFileHandler(path)
+    logger = picologging.Logger("test", picologging.DEBUG)
+    logger.addHandler(handler)
+    logger.info("value %d", 1)
+    handler.close()
+    data = bytearray(path.read_bytes())
+    # Point the record at a template that was never defined.
+    record = data.rindex(b"L")
+    data[record + 1] = 9
+    with pytest.raises(DecodeError, match="Unknown template 9"):
+        list(iter_records(data))
+
+
+def test_decode_invalid_file(tmp_path):
+    path = tmp_path / "log.txt"
+    path.write_bytes(b"not a log")
+    with pytest.raises(SystemExit):
+        main([str(path)])
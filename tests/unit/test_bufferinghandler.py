@@ -1,3 +1,5 @@
+import io
+
 import pytest
 from utils import filter_gc
 
@@ -50,3 +52,155 @@ def test_memory_handler_set_target(tmp_path):
     with open(log_file) as f:
         assert f.read() == "test\n"
     assert handler.buffer == []
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_buffering_handler_keeps_records_until_full():
+    logger = picologging.Logger("test", picologging.DEBUG)
+    handler = BufferingHandler(capacity=3)
+    logger.addHandler(handler)
+
+    logger.debug("one")
+    logger.debug("two")
+    assert [r.msg for r in handler.buffer] == ["one", "two"]
+    assert not handler.shouldFlush(handler.buffer[0])
+    logger.debug("three")
+    assert handler.buffer == []
+    handler.close()
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_buffering_handler_max_bytes():
+    logger = picologging.Logger("test", picologging.DEBUG)
+    handler = BufferingHandler(capacity=1000, maxBytes=1024)
+    logger.addHandler(handler)
+
+    logger.debug("small")
+    assert len(handler.buffer) == 1
+    logger.debug("%s", "x" * 2048)
+    assert handler.buffer == []
+    handler.close()
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_buffering_handler_buffer_assignment():
+    handler = BufferingHandler(capacity=10)
+    record = picologging.LogRecord("test", picologging.INFO, __file__, 1, "x", (), None)
+    handler.buffer = [record, record]
+    assert handler.buffer == [record, record]
+    handler.buffer = []
+    assert handler.buffer == []
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_buffering_handler_subclass_flush():
+    flushed = []
+
+    class CollectingHandler(BufferingHandler):
+        def flush(self):
+            flushed.extend(r.msg for r in self.buffer)
+            self.buffer = []
+
+    logger = picologging.Logger("test", picologging.DEBUG)
+    handler = CollectingHandler(capacity=2)
+    logger.addHandler(handler)
+    for i in range(5):
+        logger.debug(str(i))
+    assert flushed == ["0", "1", "2", "3"]
+    handler.close()
+    assert flushed == ["0", "1", "2", "3", "4"]
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_buffering_handler_subclass_mutates_buffer():
+    flushed = []
+
+    class CollectingHandler(BufferingHandler):
+        def flush(self):
+            flushed.append(len(self.buffer))
+            self.buffer.clear()
+
+    logger = picologging.Logger("test", picologging.DEBUG)
+    handler = CollectingHandler(capacity=3)
+    logger.addHandler(handler)
+    for i in range(7):
+        logger.debug(str(i))
+    assert flushed == [3, 3]
+    assert [r.msg for r in handler.buffer] == ["6"]
+    handler.buffer.append(handler.buffer[0])
+    handler.close()
+    assert flushed == [3, 3, 2]
+    assert handler.buffer == []
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_memory_handler_subclass_keeps_records_without_target():
+    class KeepingHandler(MemoryHandler):
+        pass
+
+    stream = io.StringIO()
+    logger = picologging.Logger("test", picologging.DEBUG)
+    handler = KeepingHandler(capacity=2)
+    logger.addHandler(handler)
+    for i in range(5):
+        logger.debug(str(i))
+    # Like the logging module, nothing is dropped until there is a target.
+    assert [r.msg for r in handler.buffer] == ["0", "1", "2", "3", "4"]
+    handler.setTarget(picologging.StreamHandler(stream))
+    handler.flush()
+    assert stream.getvalue() == "0\n1\n2\n3\n4\n"
+    assert handler.buffer == []
+    handler.close()
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_memory_handler_flush_level():
+    stream = io.StringIO()
+    target = picologging.StreamHandler(stream)
+    logger = picologging.Logger("test", picologging.DEBUG)
+    handler = MemoryHandler(capacity=100, target=target)
+    logger.addHandler(handler)
+
+    logger.debug("one")
+    logger.info("two")
+    assert stream.getvalue() == ""
+    logger.error("three")
+    assert stream.getvalue() == "one\ntwo\nthree\n"
+    assert handler.buffer == []
+    handler.close()
+    assert handler.target is None
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_memory_handler_python_target():
+    records = []
+
+    class ListHandler:
+        def handle(self, record):
+            records.append(record.msg)
+
+    logger = picologging.Logger("test", picologging.DEBUG)
+    handler = MemoryHandler(capacity=2, target=ListHandler())
+    logger.addHandler(handler)
+    logger.debug("one")
+    logger.debug("two")
+    assert records == ["one", "two"]
+    handler.close()
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_memory_handler_without_target_is_bounded():
+    logger = picologging.Logger("test", picologging.DEBUG)
+    handler = MemoryHandler(capacity=3, flushOnClose=False)
+    logger.addHandler(handler)
+    for i in range(10):
+        logger.debug(str(i))
+    assert [r.msg for r in handler.buffer] == ["7", "8", "9"]
+    handler.close()
+    assert handler.buffer == []
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_memory_handler_invalid_capacity():
+    with pytest.raises(ValueError):
+        MemoryHandler(capacity=-1)
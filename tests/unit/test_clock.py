@@ -0,0 +1,96 @@
+import logging
+import time
+
+import pytest
+from utils import filter_gc
+
+import picologging
+
+
+class RecordingHandler(picologging.Handler):
+    def __init__(self):
+        super().__init__()
+        self.records = []
+
+    def emit(self, record):
+        self.records.append(record)
+
+
+def make_record():
+    return picologging.LogRecord("test", logging.INFO, __file__, 1, "message", (), None)
+
+
+@pytest.fixture
+def restore_clock():
+    previous = picologging.getClock()
+    yield
+    picologging.setClock(previous)
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_set_clock(restore_clock):
+    assert picologging.getClock() == "realtime"
+    assert picologging.setClock("coarse") == "realtime"
+    assert picologging.getClock() == "coarse"
+    assert picologging.setClock("monotonic") == "coarse"
+    with pytest.raises(ValueError):
+        picologging.setClock("sundial")
+    with pytest.raises(ValueError):
+        picologging.setClock(1)
+    assert picologging.getClock() == "monotonic"
+
+
+@pytest.mark.parametrize("clock", ["realtime", "coarse", "monotonic"])
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_clock_timestamps(restore_clock, clock):
+    picologging.setClock(clock)
+    before = time.time()
+    record = make_record()
+    after = time.time()
+    # The coarse clock lags by up to a tick, monotonic by any wall clock change since import
+    assert before - 1 < record.created < after + 1
+    assert record.msecs == pytest.approx(record.created * 1000, abs=1)
+    assert record.relativeCreated >= 0
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_monotonic_clock_order(restore_clock):
+    picologging.setClock("monotonic")
+    created = [make_record().created for _ in range(1000)]
+    assert created == sorted(created)
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_logger_clock(restore_clock):
+    logger = picologging.Logger("test", logging.DEBUG)
+    handler = RecordingHandler()
+    logger.addHandler(handler)
+    assert logger.clock is None
+    logger.clock = "monotonic"
+    assert logger.clock == "monotonic"
+    picologging.setClock("coarse")
+    logger.info("hello")
+    assert logger.clock == "monotonic"
+    assert abs(handler.records[0].created - time.time()) < 1
+    logger.clock = None
+    assert logger.clock is None
+    with pytest.raises(ValueError):
+        logger.clock = "sundial"
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_record_time_fields_assignment():
+    record = make_record()
+    record.created = 1714559445.5
+    assert record.created == 1714559445.5
+    assert record.__dict__["created"] == 1714559445.5
+    record.msecs = 500
+    assert record.msecs == 500
+    record.relativeCreated = 12.5
+    assert record.relativeCreated == 12.5
+    formatter = picologging.Formatter("%(asctime)s", datefmt="epoch_millis")
+    assert formatter.format(record) == "1714559445500"
+    with pytest.raises(TypeError):
+        record.created = "now"
+    with pytest.raises(AttributeError):
+        del record.created
@@ -0,0 +1,212 @@
+import asyncio
+import contextvars
+import io
+import threading
+
+import pytest
+from utils import filter_gc
+
+import picologging
+from picologging.handlers import ContextBufferingHandler
+
+
+def _make_logger(**kwargs):
+    stream = io.StringIO()
+    target = picologging.StreamHandler(stream)
+    handler = ContextBufferingHandler(target, **kwargs)
+    logger = picologging.Logger("test", picologging.DEBUG)
+    logger.addHandler(handler)
+    return logger, handler, stream
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_records_outside_scope_pass_through():
+    logger, handler, stream = _make_logger()
+    logger.debug("outside")
+    assert stream.getvalue() == "outside\n"
+    handler.close()
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_successful_scope_is_discarded():
+    logger, handler, stream = _make_logger()
+    with handler.scope() as scope:
+        logger.debug("one")
+        logger.info("two")
+        assert [r.msg for r in scope.buffer] == ["one", "two"]
+        assert handler.bufferedBytes > 0
+    assert stream.getvalue() == ""
+    assert handler.bufferedBytes == 0
+    handler.close()
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_error_flushes_scope_history():
+    logger, handler, stream = _make_logger()
+    with handler.scope():
+        logger.debug("one")
+        logger.info("two")
+        logger.error("failed")
+        logger.debug("three")
+    assert stream.getvalue() == "one\ntwo\nfailed\n"
+    handler.close()
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_exception_flushes_scope_history():
+    logger, handler, stream = _make_logger()
+    with pytest.raises(ValueError):
+        with handler.scope():
+            logger.debug("before")
+            raise ValueError()
+    assert stream.getvalue() == "before\n"
+    handler.close()
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_pass_level():
+    logger, handler, stream = _make_logger(passLevel=picologging.WARNING)
+    with handler.scope():
+        logger.debug("debug")
+        logger.warning("warning")
+    assert stream.getvalue() == "warning\n"
+    handler.close()
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_scopes_are_isolated():
+    logger, handler, stream = _make_logger()
+    with handler.scope():
+        logger.debug("outer")
+        with handler.scope():
+            logger.debug("inner")
+            logger.error("inner failed")
+    assert stream.getvalue() == "inner\ninner failed\n"
+    handler.close()
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_capacity_keeps_latest_records():
+    logger, handler, stream = _make_logger(capacity=2)
+    with handler.scope():
+        for i in range(5):
+            logger.debug(str(i))
+        logger.error("failed")
+    assert stream.getvalue() == "3\n4\nfailed\n"
+    handler.close()
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_max_bytes_evicts_oldest_scope():
+    logger, handler, stream = _make_logger(maxBytes=4096)
+    first = handler.scope()
+    second = handler.scope()
+    with first:
+        logger.debug("%s", "a" * 1000)
+    first.__enter__()
+    logger.debug("%s", "a" * 1000)
+    with second:
+        for _ in range(4):
+            logger.debug("%s", "b" * 1000)
+        assert first.buffer == []
+        assert len(second.buffer) > 0
+        assert handler.bufferedBytes <= 4096
+    first.__exit__(None, None, None)
+    assert stream.getvalue() == ""
+    handler.close()
+
+
+def test_threads_share_the_memory_cap():
+    logger, handler, stream = _make_logger(maxBytes=8192)
+
+    def _requests(n):
+        for i in range(200):
+            with handler.scope():
+                logger.debug("%s", "x" * 200)
+                logger.debug("%s", "y" * 200)
+                if i % 50 == 0:
+                    logger.error("thread %d request %d failed", n, i)
+
+    threads = [threading.Thread(target=_requests, args=(n,)) for n in range(8)]
+    for thread in threads:
+        thread.start()
+    for thread in threads:
+        thread.join()
+    # Every scope has been released, whichever thread evicted it.
+    assert handler.bufferedBytes == 0
+    lines = stream.getvalue().splitlines()
+    assert sum("failed" in line for line in lines) == 8 * 4
+    handler.close()
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_context_variable_keys():
+    request_id = contextvars.ContextVar("request_id", default=None)
+    logger, handler, stream = _make_logger(contextvar=request_id)
+
+    async def request(name, fail):
+        request_id.set(name)
+        logger.debug("%s started", name)
+        await asyncio.sleep(0)
+        if fail:
+            logger.error("%s failed", name)
+        handler.discard(name)
+
+    async def main():
+        await asyncio.gather(request("a", False), request("b", True))
+
+    asyncio.run(main())
+    assert stream.getvalue() == "b started\nb failed\n"
+    assert handler.bufferedBytes == 0
+    handler.close()
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_flush_context():
+    logger, handler, stream = _make_logger()
+    with handler.scope():
+        logger.debug("one")
+        handler.flushContext()
+    assert stream.getvalue() == "one\n"
+    handler.close()
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_scope_reentry():
+    _, handler, _ = _make_logger()
+    scope = handler.scope()
+    with scope:
+        with pytest.raises(RuntimeError):
+            scope.__enter__()
+    handler.close()
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_target_attribute():
+    logger, handler, stream = _make_logger()
+    with pytest.raises(AttributeError):
+        del handler.target
+    with pytest.raises(TypeError):
+        handler.target = "stream"
+    with pytest.raises(TypeError):
+        handler.setTarget(42)
+    logger.warning("kept")
+    assert stream.getvalue() == "kept\n"
+
+    other = io.StringIO()
+    handler.target = picologging.StreamHandler(other)
+    logger.warning("moved")
+    handler.target = None
+    logger.warning("dropped")
+    assert other.getvalue() == "moved\n"
+    handler.close()
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_invalid_arguments():
+    with pytest.raises(ValueError):
+        ContextBufferingHandler(capacity=0)
+    with pytest.raises(TypeError):
+        ContextBufferingHandler(contextvar="request_id")
+    with pytest.raises(TypeError):
+        ContextBufferingHandler(target=42)
@@ -0,0 +1,161 @@
+import io
+import time
+
+import pytest
+from utils import filter_gc
+
+import picologging
+from picologging.handlers import DeduplicationHandler
+
+
+def _make_logger(window=60.0, capacity=256):
+    stream = io.StringIO()
+    target = picologging.StreamHandler(stream)
+    handler = DeduplicationHandler(target, window=window, capacity=capacity)
+    logger = picologging.Logger("test", picologging.DEBUG)
+    logger.addHandler(handler)
+    return logger, handler, stream
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_first_occurrence_passes_through():
+    logger, handler, stream = _make_logger()
+    logger.error("dependency down")
+    assert stream.getvalue() == "dependency down\n"
+    handler.close()
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_repeats_are_collapsed_until_flush():
+    logger, handler, stream = _make_logger()
+    for _ in range(10):
+        logger.error("dependency %s down", "db")
+    assert stream.getvalue() == "dependency db down\n"
+    handler.flush()
+    assert stream.getvalue() == (
+        "dependency db down\n" "dependency db down (repeated 9 times)\n"
+    )
+    handler.close()
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_distinct_records_are_not_collapsed():
+    logger, handler, stream = _make_logger()
+    logger.error("dependency down")
+    logger.error("dependency up")
+    logger.warning("dependency down")
+    other = picologging.Logger("other", picologging.DEBUG)
+    other.addHandler(handler)
+    other.error("dependency down")
+    assert stream.getvalue() == (
+        "dependency down\n"
+        "dependency up\n"
+        "dependency down\n"
+        "dependency down\n"
+    )
+    handler.close()
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_summary_emitted_when_window_closes():
+    logger, handler, stream = _make_logger(window=0.05)
+    for _ in range(3):
+        logger.error("flapping")
+    time.sleep(0.1)
+    logger.info("something else")
+    assert stream.getvalue() == (
+        "flapping\n" "flapping (repeated 2 times)\n" "something else\n"
+    )
+    for _ in range(2):
+        logger.error("flapping")
+    handler.close()
+    assert stream.getvalue().endswith("flapping\nflapping (repeated 1 times)\n")
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_summary_record_keeps_call_site():
+    records = []
+
+    class ListHandler(picologging.Handler):
+        def emit(self, record):
+            records.append(record)
+
+    handler = DeduplicationHandler(ListHandler(), window=60.0)
+    logger = picologging.Logger("test", picologging.DEBUG)
+    logger.addHandler(handler)
+    for _ in range(4):
+        logger.critical("boom")
+    handler.flush()
+    assert len(records) == 2
+    assert records[1].levelno == picologging.CRITICAL
+    assert records[1].name == "test"
+    assert records[1].lineno == records[0].lineno
+    assert records[1].getMessage() == "boom (repeated 3 times)"
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_summary_emitted_before_the_next_repeat():
+    logger, handler, stream = _make_logger(window=0.05)
+    for _ in range(3):
+        logger.error("flapping")
+    time.sleep(0.1)
+    # Nothing runs while the handler is idle, the summary is still pending.
+    assert stream.getvalue() == "flapping\n"
+    logger.error("flapping")
+    assert stream.getvalue() == (
+        "flapping\n"
+        "flapping (repeated 2 times)\n"
+        "flapping\n"
+    )
+    handler.close()
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_zero_window_is_rejected():
+    with pytest.raises(ValueError, match="window must be a positive"):
+        DeduplicationHandler(picologging.StreamHandler(io.StringIO()), window=0.0)
+    with pytest.raises(ValueError):
+        DeduplicationHandler(window=float("nan"))
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_no_target():
+    handler = DeduplicationHandler()
+    assert handler.target is None
+    assert handler.window == 1.0
+    logger = picologging.Logger("test", picologging.DEBUG)
+    logger.addHandler(handler)
+    logger.error("dropped")
+    stream = io.StringIO()
+    handler.setTarget(picologging.StreamHandler(stream))
+    logger.error("kept")
+    assert stream.getvalue() == "kept\n"
+    handler.close()
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_target_attribute():
+    logger, handler, stream = _make_logger()
+    with pytest.raises(AttributeError):
+        del handler.target
+    with pytest.raises(TypeError):
+        handler.target = "stream"
+    with pytest.raises(TypeError):
+        handler.setTarget(42)
+    logger.error("kept")
+    other = io.StringIO()
+    handler.target = picologging.StreamHandler(other)
+    logger.error("moved")
+    assert stream.getvalue() == "kept\n"
+    assert other.getvalue() == "moved\n"
+    handler.close()
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_invalid_arguments():
+    with pytest.raises(ValueError):
+        DeduplicationHandler(window=-1)
+    with pytest.raises(ValueError):
+        DeduplicationHandler(capacity=0)
+    with pytest.raises(TypeError):
+        DeduplicationHandler(target=42)
@@ -1,3 +1,4 @@
+import gzip
 import os
 import platform
 import time
@@ -8,6 +9,7 @@ from utils import filter_gc
 
 import picologging
 from picologging.handlers import (
+    Compressor,
     RotatingFileHandler,
     TimedRotatingFileHandler,
     WatchedFileHandler,
@@ -339,3 +341,159 @@ def test_timed_rotatingfilehandler_avoids_non_regular_files(tmp_path, monkeypatc
     monkeypatch.setattr(os.path, "isfile", lambda _: False)
     logger.warning("test")
     handler.close()
+
+
+def gzip_available():
+    try:
+        Compressor("gzip")
+    except ValueError:
+        return False
+    return True
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_rotatingfilehandler_compress(tmp_path):
+    log_file = tmp_path / "log.txt"
+    handler = RotatingFileHandler(log_file, maxBytes=1, backupCount=2, compress="gzip")
+    logger = picologging.Logger("test", picologging.DEBUG)
+    logger.addHandler(handler)
+
+    for i in range(5):
+        logger.warning("test %d", i)
+    handler.close()
+
+    assert sorted(os.listdir(tmp_path)) == ["log.txt", "log.txt.1.gz", "log.txt.2.gz"]
+    assert log_file.read_text() == "test 4\n"
+    for i in range(1, 3):
+        with gzip.open(tmp_path / f"log.txt.{i}.gz", "rt") as f:
+            assert f.read() == f"test {4 - i}\n"
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_rotatingfilehandler_compress_shifts_uncompressed_backups(tmp_path):
+    (tmp_path / "log.txt.1").write_text("old\n")
+    (tmp_path / "log.txt.2.gz").write_bytes(gzip.compress(b"older\n"))
+    log_file = tmp_path / "log.txt"
+    handler = RotatingFileHandler(
+        log_file, maxBytes=1, backupCount=3, compress="gzip", compressLevel=1
+    )
+    logger = picologging.Logger("test", picologging.DEBUG)
+    logger.addHandler(handler)
+
+    logger.warning("first")
+    assert handler.waitForCompression(timeout=10)
+    handler.close()
+
+    assert sorted(os.listdir(tmp_path)) == [
+        "log.txt",
+        "log.txt.1.gz",
+        "log.txt.2",
+        "log.txt.3.gz",
+    ]
+    assert log_file.read_text() == "first\n"
+    assert (tmp_path / "log.txt.2").read_text() == "old\n"
+    with gzip.open(tmp_path / "log.txt.3.gz", "rt") as f:
+        assert f.read() == "older\n"
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_timed_rotatingfilehandler_compress(tmp_path):
+    (tmp_path / "log.txt.1970-11-01_00-00-00.gz").write_bytes(gzip.compress(b""))
+    log_file = tmp_path / "log.txt"
+    handler = TimedRotatingFileHandler(
+        log_file, when="S", backupCount=1, compress="gzip"
+    )
+    logger = picologging.Logger("test", picologging.DEBUG)
+    logger.addHandler(handler)
+
+    logger.warning("test")
+    handler.rollover_at = time.time() - 1
+    logger.warning("test")
+    handler.close()
+
+    files = sorted(os.listdir(tmp_path))
+    assert len(files) == 2
+    assert files[0] == "log.txt"
+    assert files[1].endswith(".gz")
+    assert "1970" not in files[1]
+    with gzip.open(tmp_path / files[1], "rt") as f:
+        assert f.read() == "test\n"
+
+
+def test_rotatingfilehandler_compress_invalid_method(tmp_path):
+    with pytest.raises(ValueError):
+        RotatingFileHandler(tmp_path / "log.txt", compress="lzma")
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+@pytest.mark.skipif(not gzip_available(), reason="Built without zlib")
+def test_compressor(tmp_path):
+    compressor = Compressor("gzip", 9, maxWorkers=2, lowPriority=False)
+    assert compressor.method == "gzip"
+    assert compressor.level == 9
+    assert compressor.maxWorkers == 2
+    assert repr(compressor) == "<Compressor 'gzip' level=9>"
+
+    for i in range(4):
+        (tmp_path / f"file{i}").write_bytes(b"data %d\n" % i * 1000)
+        compressor.submit(tmp_path / f"file{i}", tmp_path / f"file{i}.gz")
+    assert compressor.wait(timeout=10)
+    assert compressor.pending == 0
+    assert compressor.completed == 4
+    assert compressor.lastError is None
+    assert sorted(os.listdir(tmp_path)) == [f"file{i}.gz" for i in range(4)]
+    assert gzip.decompress((tmp_path / "file3.gz").read_bytes()) == b"data 3\n" * 1000
+
+    compressor.submit(tmp_path / "missing", tmp_path / "missing.gz")
+    assert compressor.wait()
+    assert compressor.lastError.startswith(str(tmp_path / "missing"))
+    assert not (tmp_path / "missing.gz").exists()
+    assert not (tmp_path / ".missing.gz.tmp").exists()
+
+    compressor.close()
+    with pytest.raises(ValueError):
+        compressor.submit(tmp_path / "file0", tmp_path / "file0.gz")
+
+
+@pytest.mark.skipif(not gzip_available(), reason="Built without zlib")
+@pytest.mark.skipif(not hasattr(os, "mkfifo"), reason="Needs FIFOs")
+def test_rotation_does_not_wait_for_other_handlers(tmp_path):
+    compressor = Compressor("gzip", maxWorkers=2)
+    blocked = tmp_path / "blocked"
+    os.mkfifo(blocked)
+    # Opening the FIFO for reading blocks a worker until a writer shows up.
+    compressor.submit(blocked, tmp_path / "blocked.gz")
+
+    log_file = tmp_path / "log.txt"
+    handler = RotatingFileHandler(log_file, maxBytes=1, backupCount=2, compress="gzip")
+    handler.compressor = compressor
+    logger = picologging.Logger("test", picologging.DEBUG)
+    logger.addHandler(handler)
+    for i in range(3):
+        logger.warning("test %d", i)
+    assert handler.waitForCompression(timeout=10)
+    assert not compressor.wait(timeout=0.1)
+    assert compressor.wait(timeout=0, sources=[log_file.with_name("log.txt.1")])
+    assert not compressor.wait(timeout=0, sources=[blocked])
+
+    with open(blocked, "wb"):
+        pass
+    assert compressor.wait(timeout=10)
+    handler.close()
+    assert sorted(os.listdir(tmp_path)) == [
+        "blocked.gz",
+        "log.txt",
+        "log.txt.1.gz",
+        "log.txt.2.gz",
+    ]
+    compressor.close()
+
+
+def test_compressor_invalid_arguments():
+    with pytest.raises(ValueError):
+        Compressor("lzma")
+    with pytest.raises(ValueError):
+        Compressor(maxWorkers=0)
+    if gzip_available():
+        with pytest.raises(ValueError):
+            Compressor("gzip", 42)
@@ -0,0 +1,168 @@
+import multiprocessing
+import os
+import sys
+import threading
+import time
+
+import pytest
+from utils import filter_gc
+
+import picologging
+from picologging.flightrecorder import main, read
+from picologging.handlers import FlightRecorderHandler
+
+
+def _make_logger(path, size=4096):
+    handler = FlightRecorderHandler(path, size=size)
+    logger = picologging.Logger("test", picologging.DEBUG)
+    logger.addHandler(handler)
+    return logger, handler
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_records_are_kept_in_order(tmp_path):
+    path = tmp_path / "flight.rec"
+    logger, handler = _make_logger(path)
+    for i in range(5):
+        logger.debug("event %d", i)
+    assert read(path) == [f"event {i}" for i in range(5)]
+    assert handler.wraps == 0
+    handler.close()
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_oldest_records_are_overwritten(tmp_path):
+    path = tmp_path / "flight.rec"
+    logger, handler = _make_logger(path)
+    for i in range(1000):
+        logger.debug("event %d", i)
+    assert handler.wraps > 0
+    assert handler.cursor > handler.capacity
+    records = read(path)
+    assert records[-1] == "event 999"
+    first = int(records[0].split()[1])
+    assert records == [f"event {i}" for i in range(first, 1000)]
+    handler.close()
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_formatter_is_used(tmp_path):
+    path = tmp_path / "flight.rec"
+    logger, handler = _make_logger(path)
+    handler.setFormatter(picologging.Formatter("%(levelname)s:%(message)s"))
+    logger.warning("caf\xe9")
+    assert read(path) == ["WARNING:caf\xe9"]
+    handler.close()
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_oversized_records_are_truncated(tmp_path):
+    path = tmp_path / "flight.rec"
+    logger, handler = _make_logger(path)
+    logger.debug("x" * 10000)
+    logger.debug("after")
+    records = read(path)
+    assert records[-1] == "after"
+    assert all(len(r) < handler.capacity for r in records)
+    handler.close()
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_history_survives_reopen(tmp_path):
+    path = tmp_path / "flight.rec"
+    logger, handler = _make_logger(path)
+    logger.debug("before")
+    handler.close()
+    logger, handler = _make_logger(path)
+    logger.debug("after")
+    assert read(path) == ["before", "after"]
+    handler.close()
+
+    # A different size starts a new recording
+    logger, handler = _make_logger(path, size=8192)
+    assert read(path) == []
+    handler.close()
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_resize_keeps_other_mappings_valid(tmp_path):
+    path = tmp_path / "flight.rec"
+    logger, handler = _make_logger(path, size=16384)
+    logger.debug("before")
+    # The file is replaced, the first handler keeps writing to the old one.
+    other_logger, other = _make_logger(path)
+    for i in range(1000):
+        logger.debug("event %d", i)
+    other_logger.debug("resized")
+    assert read(path) == ["resized"]
+    assert os.path.getsize(path) < 16384
+    assert os.listdir(tmp_path) == ["flight.rec"]
+    handler.close()
+    other.close()
+
+
+def _crash(path):
+    logger, _ = _make_logger(path)
+    logger.debug("last words")
+    os._exit(1)
+
+
+@pytest.mark.skipif(sys.platform == "win32", reason="fork is not available")
+def test_records_survive_crash(tmp_path):
+    path = tmp_path / "flight.rec"
+    process = multiprocessing.get_context("fork").Process(target=_crash, args=(path,))
+    process.start()
+    process.join()
+    assert process.exitcode == 1
+    assert read(path) == ["last words"]
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_emit_after_close(tmp_path):
+    logger, handler = _make_logger(tmp_path / "flight.rec")
+    handler.close()
+    record = picologging.LogRecord("test", picologging.INFO, __file__, 1, "x", (), None)
+    with pytest.raises(ValueError):
+        handler.emit(record)
+    assert handler.cursor is None
+
+
+def test_close_waits_for_emit(tmp_path):
+    path = tmp_path / "flight.rec"
+    logger, handler = _make_logger(path)
+    formatting = threading.Event()
+
+    class SlowFormatter(picologging.Formatter):
+        def format(self, record):
+            formatting.set()
+            time.sleep(0.2)
+            return super().format(record)
+
+    handler.setFormatter(SlowFormatter())
+    thread = threading.Thread(target=logger.info, args=("slow",))
+    thread.start()
+    formatting.wait()
+    # Closing while the record is formatted must not unmap the ring under it.
+    handler.close()
+    thread.join()
+    assert read(path) == ["slow"]
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_invalid_size(tmp_path):
+    with pytest.raises(ValueError):
+        FlightRecorderHandler(tmp_path / "flight.rec", size=100)
+
+
+def test_reader_command(tmp_path, capsys):
+    path = tmp_path / "flight.rec"
+    logger, handler = _make_logger(path)
+    logger.info("hello")
+    handler.flush()
+    handler.close()
+    assert main([str(path)]) == 0
+    assert capsys.readouterr().out == "hello\n"
+
+    path.write_bytes(b"not a recording")
+    with pytest.raises(SystemExit):
+        main([str(path)])
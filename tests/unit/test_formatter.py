@@ -1,7 +1,9 @@
 import datetime
 import io
 import logging
+import os
 import sys
+import time
 import traceback
 from logging import Formatter as LoggingFormatter
 
@@ -340,3 +342,263 @@ def test_override_format_exception():
     assert result.endswith(
         'test_override_format_exception\n    raise Exception("error")\nException: error'
     )
+
+
+def _exc_info(func):
+    try:
+        func()
+    except BaseException:
+        return sys.exc_info()
+
+
+def _raise_chained_cause():
+    try:
+        1 / 0
+    except ZeroDivisionError as e:
+        raise ValueError("bad value") from e
+
+
+def _raise_chained_context():
+    try:
+        {}["missing"]
+    except KeyError:
+        raise RuntimeError()
+
+
+def _raise_suppressed_context():
+    try:
+        1 / 0
+    except ZeroDivisionError:
+        raise ValueError("suppressed") from None
+
+
+def _raise_recursive(depth=12):
+    if depth == 0:
+        raise Exception("bottom")
+    _raise_recursive(depth - 1)
+
+
+class CustomError(Exception):
+    pass
+
+
+def _raise_custom():
+    raise CustomError("custom\nmultiline")
+
+
+def _raise_syntax_error():
+    compile("1 +", "<string>", "exec")
+
+
+def _raise_unprintable():
+    class Unprintable(Exception):
+        def __str__(self):
+            raise TypeError("no")
+
+    raise Unprintable()
+
+
+def _raise_context_cycle():
+    a = ValueError("a")
+    b = TypeError("b")
+    a.__context__ = b
+    b.__context__ = a
+    raise a
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+@pytest.mark.parametrize(
+    "func",
+    [
+        _raise_chained_cause,
+        _raise_chained_context,
+        _raise_suppressed_context,
+        _raise_recursive,
+        _raise_custom,
+        _raise_syntax_error,
+        _raise_unprintable,
+        _raise_context_cycle,
+    ],
+)
+def test_format_exception_against_builtin(func):
+    ei = _exc_info(func)
+    expected = LoggingFormatter().formatException(ei)
+    # Second call is served from the frame cache
+    assert Formatter().formatException(ei) == expected
+    assert Formatter().formatException(ei) == expected
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_format_exception_without_traceback():
+    ei = (ValueError, ValueError("no traceback"), None)
+    assert Formatter().formatException(ei) == LoggingFormatter().formatException(ei)
+
+
+@pytest.mark.skipif(sys.version_info < (3, 11), reason="Exception groups")
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_format_exception_group_against_builtin():
+    def raise_group():
+        errors = [ValueError(i) for i in range(20)]
+        try:
+            _raise_chained_cause()
+        except ValueError as e:
+            errors.append(e)
+        raise ExceptionGroup(
+            "outer", [ExceptionGroup("inner", errors), _exc_info(_raise_custom)[1]]
+        )
+
+    ei = _exc_info(raise_group)
+    assert Formatter().formatException(ei) == LoggingFormatter().formatException(ei)
+
+
+@pytest.mark.skipif(sys.version_info < (3, 11), reason="Exception notes")
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_format_exception_with_notes():
+    def raise_with_note():
+        e = ValueError("noted")
+        e.add_note("a note")
+        raise e
+
+    ei = _exc_info(raise_with_note)
+    assert Formatter().formatException(ei) == LoggingFormatter().formatException(ei)
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_format_exception_tracebacklimit(monkeypatch):
+    monkeypatch.setattr(sys, "tracebacklimit", 2, raising=False)
+    ei = _exc_info(_raise_recursive)
+    assert Formatter().formatException(ei) == LoggingFormatter().formatException(ei)
+
+
+def make_record(created=None):
+    record = LogRecord(
+        "hello", logging.WARNING, __file__, 123, "bork bork bork", (), None
+    )
+    if created is not None:
+        record.created = created
+    return record
+
+
+@pytest.mark.parametrize(
+    "datefmt,expected",
+    [
+        ("iso8601_utc", "2024-05-01T10:30:45.500Z"),
+        ("rfc3339_micro_utc", "2024-05-01T10:30:45.500000Z"),
+        ("rfc3339_nano_utc", "2024-05-01T10:30:45.500000000Z"),
+        ("epoch", "1714559445"),
+        ("epoch_millis", "1714559445500"),
+        ("epoch_nanos", "1714559445500000000"),
+    ],
+)
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_named_datefmt_utc(datefmt, expected):
+    f = Formatter("%(asctime)s", datefmt=datefmt)
+    assert f.datefmt == datefmt
+    assert f.format(make_record(1714559445.5)) == expected
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_named_datefmt_before_epoch():
+    record = make_record(-1.5)
+    assert Formatter("%(asctime)s", "iso8601_utc").format(record) == (
+        "1969-12-31T23:59:58.500Z"
+    )
+    assert Formatter("%(asctime)s", "epoch").format(record) == "-2"
+    assert Formatter("%(asctime)s", "epoch_millis").format(record) == "-1500"
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_named_datefmt_local_offset():
+    record = make_record(1714559445.5)
+    local = datetime.datetime.fromtimestamp(1714559445.5).astimezone()
+    f = Formatter("%(asctime)s", datefmt="iso8601")
+    assert f.format(record) == local.isoformat(timespec="milliseconds")
+    micro = local.isoformat(timespec="microseconds")
+    f.datefmt = "rfc3339_micro"
+    assert f.format(record) == micro
+    f.datefmt = "rfc3339_nano"
+    assert f.format(record) == micro[:26] + "000" + micro[26:]
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_named_datefmt_captured_nanoseconds():
+    record = make_record()
+    nanos = int(Formatter("%(asctime)s", "epoch_nanos").format(record))
+    assert abs(nanos / 1e9 - record.created) < 1e-6
+    assert Formatter("%(asctime)s", "epoch_millis").format(record) == str(
+        nanos // 1_000_000
+    )
+    rendered = Formatter("%(asctime)s", "rfc3339_nano_utc").format(record)
+    assert rendered.endswith("%09dZ" % (nanos % 1_000_000_000))
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_formatter_gmtime_converter():
+    f = Formatter("%(asctime)s")
+    assert f.converter is time.localtime
+    f.converter = time.gmtime
+    assert f.format(make_record(1714559445.5)) == "2024-05-01 10:30:45,500"
+    f.datefmt = "iso8601"
+    assert f.format(make_record(1714559445.5)) == "2024-05-01T10:30:45.500Z"
+    f.datefmt = "%H:%M:%S"
+    assert f.format(make_record(1714559445.5)) == "10:30:45"
+
+    with pytest.raises(TypeError):
+        f.converter = "gmtime"
+    # Formatter is a static type, unlike logging.Formatter
+    with pytest.raises(TypeError):
+        Formatter.converter = time.gmtime
+    assert Formatter("%(asctime)s").converter is time.localtime
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_formatter_custom_converter():
+    class UTCFormatter(Formatter):
+        converter = time.gmtime
+
+    f = UTCFormatter("%(asctime)s", datefmt="iso8601")
+    assert f.format(make_record(1714559445.5)) == "2024-05-01T10:30:45.500Z"
+
+    f = Formatter("%(asctime)s", datefmt="iso8601")
+    f.converter = lambda created: time.gmtime(created + 3600)
+    assert f.format(make_record(1714559445.5)) == "2024-05-01T11:30:45.500+00:00"
+    f.converter = lambda created: created
+    with pytest.raises(TypeError):
+        f.format(make_record(1714559445.5))
+
+
+def test_frame_cache_follows_source_changes(tmp_path):
+    import picologging
+
+    path = tmp_path / "module.py"
+    source = "def fail(logger):\n    logger.info('logged', stack_info=True)\n    {}\n"
+    path.write_text(source.format("raise ValueError('old')"))
+    namespace = {}
+    exec(compile(path.read_text(), str(path), "exec"), namespace)
+
+    logger = picologging.Logger("test", level=picologging.DEBUG)
+    stream = io.StringIO()
+    logger.addHandler(picologging.StreamHandler(stream))
+
+    def render():
+        ei = _exc_info(lambda: namespace["fail"](logger))
+        return Formatter().formatException(ei), stream.getvalue()
+
+    exception, stack = render()
+    assert "raise ValueError('old')" in exception
+    assert "logger.info('logged', stack_info=True)" in stack
+
+    path.write_text(
+        source.format("raise ValueError('new one')").replace(".info", ".warning")
+    )
+    stat = path.stat()
+    os.utime(path, ns=(stat.st_atime_ns, stat.st_mtime_ns + 1_000_000_000))
+    stream.seek(0)
+    stream.truncate()
+    # Same code objects and instructions, but the file changed underneath.
+    # Cached frames look at their source file again after a second.
+    time.sleep(1.1)
+    exception, stack = render()
+    assert "raise ValueError('new one')" in exception
+    assert "raise ValueError('old')" not in exception
+    assert "logger.warning('logged', stack_info=True)" in stack
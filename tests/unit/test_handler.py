@@ -1,5 +1,7 @@
+import io
+
 import pytest
-from utils import filter_gc
+from utils import filter_gc, stats_enabled  # noqa: F401
 
 import picologging
 
@@ -147,3 +149,115 @@ def test_handler_repr():
 
     handler = picologging.Handler(level=picologging.WARNING)
     assert repr(handler) == "<Handler (WARNING)>"
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+@pytest.mark.usefixtures("stats_enabled")
+def test_handler_stats():
+    stream = io.StringIO()
+    handler = picologging.StreamHandler(stream)
+    handler.addFilter(lambda record: record.msg != "skip")
+    logger = picologging.Logger("test", picologging.DEBUG)
+    logger.addHandler(handler)
+
+    logger.info("café")
+    logger.info("skip")
+    logger.info("done")
+    stats = handler.stats()
+    assert stats["handled"] == 3
+    assert stats["filtered"] == 1
+    assert stats["emitted"] == 2
+    assert stats["errors"] == 0
+    assert stats["bytesWritten"] == len("café\ndone\n".encode())
+    assert stats["emitTime"] >= stats["maxEmitTime"] > 0
+    assert stats["lockWaitTime"] >= 0
+
+    handler.resetStats()
+    assert handler.stats()["handled"] == 0
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+@pytest.mark.usefixtures("stats_enabled")
+def test_handler_stats_errors():
+    class FailingHandler(picologging.Handler):
+        def emit(self, record):
+            raise ValueError("failed")
+
+    handler = FailingHandler()
+    record = picologging.LogRecord(
+        "test", picologging.INFO, __file__, 1, "test", (), None, None, None
+    )
+    with pytest.raises(ValueError):
+        handler.handle(record)
+    stats = handler.stats()
+    assert stats["errors"] == 1
+    assert stats["emitted"] == 0
+
+
+def test_stats_off_by_default():
+    handler = picologging.StreamHandler(io.StringIO())
+    handler.handle(
+        picologging.LogRecord("test", picologging.INFO, __file__, 1, "test", (), None)
+    )
+    assert handler.stats()["handled"] == 0
+    assert picologging.enableStats(True) is False
+    try:
+        handler.handle(
+            picologging.LogRecord(
+                "test", picologging.INFO, __file__, 1, "test", (), None
+            )
+        )
+        assert handler.stats()["handled"] == 1
+    finally:
+        picologging.enableStats(False)
+
+
+@pytest.mark.usefixtures("stats_enabled")
+def test_module_stats():
+    first = picologging.Handler()
+    second = picologging.StreamHandler(io.StringIO())
+    record = picologging.LogRecord(
+        "test", picologging.INFO, __file__, 1, "test", (), None, None, None
+    )
+    before = picologging.stats()
+    second.handle(record)
+    second.handle(record)
+    after = picologging.stats()
+    assert after["handled"] - before["handled"] == 2
+    handlers = {id(entry["handler"]): entry for entry in after["handlers"]}
+    assert handlers[id(second)]["emitted"] == 2
+    assert handlers[id(first)]["handled"] == 0
+
+    assert picologging.enableStats(False) is True
+    try:
+        second.handle(record)
+        assert second.stats()["handled"] == 2
+    finally:
+        assert picologging.enableStats() is False
+    second.handle(record)
+    assert second.stats()["handled"] == 3
+
+
+def test_module_stats_skips_handlers_being_deallocated():
+    def streamHandlers():
+        return sum(
+            type(entry["handler"]) is picologging.StreamHandler
+            for entry in picologging.stats()["handlers"]
+        )
+
+    seen = []
+
+    class Stream:
+        def write(self, text):
+            pass
+
+        def __del__(self):
+            # Runs while the handler owning the stream is being deallocated.
+            seen.append(streamHandlers())
+
+    before = streamHandlers()
+    handler = picologging.StreamHandler(Stream())
+    assert streamHandlers() == before + 1
+    del handler
+    assert seen == [before]
+    assert streamHandlers() == before
@@ -0,0 +1,171 @@
+import array
+import os
+import socket
+import struct
+import sys
+import tempfile
+import threading
+
+import pytest
+from utils import filter_gc
+
+import picologging
+from picologging.handlers import JournalHandler
+
+pytestmark = pytest.mark.skipif(
+    not sys.platform.startswith("linux"), reason="journald is Linux only"
+)
+
+
+def parse_entry(data):
+    fields = {}
+    while data:
+        line_end = data.index(b"\n")
+        line = data[:line_end]
+        if b"=" in line:
+            name, value = line.split(b"=", 1)
+            data = data[line_end + 1 :]
+        else:
+            name = line
+            (size,) = struct.unpack("<Q", data[line_end + 1 : line_end + 9])
+            value = data[line_end + 9 : line_end + 9 + size]
+            assert data[line_end + 9 + size : line_end + 10 + size] == b"\n"
+            data = data[line_end + 10 + size :]
+        fields[name.decode()] = value.decode()
+    return fields
+
+
+def receive(server):
+    fds = array.array("i")
+    data, ancdata, _, _ = server.recvmsg(1 << 16, socket.CMSG_SPACE(fds.itemsize))
+    for level, type, cmsg_data in ancdata:
+        if level == socket.SOL_SOCKET and type == socket.SCM_RIGHTS:
+            fds.frombytes(cmsg_data[: len(cmsg_data) - (len(cmsg_data) % fds.itemsize)])
+    if fds:
+        assert data == b""
+        with os.fdopen(fds[0], "rb") as f:
+            f.seek(0)
+            data = f.read()
+    return parse_entry(data)
+
+
+@pytest.fixture
+def journal():
+    path = tempfile.NamedTemporaryFile(prefix="picologging_", suffix=".sock").name
+    server = socket.socket(socket.AF_UNIX, socket.SOCK_DGRAM)
+    server.bind(path)
+    server.settimeout(5)
+    yield server, path
+    server.close()
+    os.remove(path)
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_journalhandler_fields(journal):
+    server, path = journal
+    handler = JournalHandler(path, identifier="picotest", fields={"role": "worker"})
+    assert handler.path == path
+    logger = picologging.Logger("test.journal", picologging.DEBUG)
+    logger.addHandler(handler)
+
+    logger.warning("hello %s", "journal")
+    fields = receive(server)
+    assert fields["MESSAGE"] == "hello journal"
+    assert fields["PRIORITY"] == "4"
+    assert fields["LOGGER"] == "test.journal"
+    assert fields["SYSLOG_IDENTIFIER"] == "picotest"
+    assert fields["ROLE"] == "worker"
+    assert "CODE_FILE" in fields
+    assert int(fields["CODE_LINE"]) >= 0
+    assert "CODE_FUNC" in fields
+    handler.close()
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_journalhandler_priorities(journal):
+    server, path = journal
+    handler = JournalHandler(path)
+    logger = picologging.Logger("test", picologging.DEBUG)
+    logger.addHandler(handler)
+    logger.debug("d")
+    logger.info("i")
+    logger.error("e")
+    logger.critical("c")
+    assert [receive(server)["PRIORITY"] for _ in range(4)] == ["7", "6", "3", "2"]
+    handler.close()
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_journalhandler_multiline_and_extra(journal):
+    server, path = journal
+    handler = JournalHandler(path)
+    record = picologging.LogRecord(
+        "test", picologging.ERROR, __file__, 10, "line one\nline two", None, None
+    )
+    record.request_id = 42
+    record.__dict__  # Copies the record attributes into the instance dict
+    record.skipped = None
+    handler.handle(record)
+
+    fields = receive(server)
+    assert fields["MESSAGE"] == "line one\nline two"
+    assert fields["REQUEST_ID"] == "42"
+    assert "SKIPPED" not in fields
+    assert "LEVELNO" not in fields
+    assert "MSG" not in fields
+    handler.close()
+
+
+def test_journalhandler_large_entry_uses_memfd(journal):
+    server, path = journal
+    handler = JournalHandler(path)
+    message = "x" * (4 << 20)
+    handler.handle(
+        picologging.LogRecord(
+            "test", picologging.INFO, __file__, 1, message, None, None
+        )
+    )
+    assert receive(server)["MESSAGE"] == message
+    handler.close()
+
+
+def test_journalhandler_blocked_send_releases_gil(journal):
+    server, path = journal
+    handler = JournalHandler(path)
+    count = 200
+
+    def send():
+        for i in range(count):
+            handler.handle(
+                picologging.LogRecord(
+                    "test", picologging.INFO, __file__, 1, "msg", None, None
+                )
+            )
+
+    sender = threading.Thread(target=send)
+    sender.start()
+    # journald (the server here) isn't reading, the sender blocks in sendto()
+    # while this thread keeps running.
+    sender.join(0.2)
+    assert sender.is_alive()
+    for _ in range(count):
+        assert receive(server)["MESSAGE"] == "msg"
+    sender.join()
+    handler.close()
+
+
+def test_journalhandler_errors(journal):
+    server, path = journal
+    handler = JournalHandler(path + ".missing")
+    record = picologging.LogRecord(
+        "test", picologging.INFO, __file__, 1, "msg", None, None
+    )
+    with pytest.raises(OSError):
+        handler.emit(record)
+    handler.close()
+    with pytest.raises(ValueError):
+        handler.emit(record)
+    with pytest.raises(ValueError):
+        JournalHandler("x" * 200)
+    with pytest.raises(TypeError):
+        JournalHandler(path, fields=[("a", "b")])
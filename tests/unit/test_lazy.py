@@ -0,0 +1,97 @@
+import io
+import logging
+
+import pytest
+from utils import filter_gc
+
+import picologging
+
+
+def make_logger(level=logging.DEBUG, handlers=1):
+    logger = picologging.Logger("test", level)
+    streams = [io.StringIO() for _ in range(handlers)]
+    for stream in streams:
+        logger.addHandler(picologging.StreamHandler(stream))
+    return logger, streams
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_lazy_not_called_when_disabled():
+    calls = []
+    logger, streams = make_logger(logging.INFO)
+    logger.debug("state %s", picologging.lazy(calls.append, 1))
+    assert calls == []
+    assert streams[0].getvalue() == ""
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_lazy_called_once_per_record():
+    calls = []
+
+    def expensive(value, suffix=""):
+        calls.append(value)
+        return "value-%s%s" % (value, suffix)
+
+    logger, streams = make_logger(handlers=2)
+    logger.info(
+        "state %s %r %d",
+        picologging.lazy(expensive, 1),
+        picologging.lazy(expensive, 2, suffix="!"),
+        picologging.lazy(len, "abc"),
+    )
+    assert calls == [1, 2]
+    for stream in streams:
+        assert stream.getvalue() == "state value-1 'value-2!' 3\n"
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_lazy_record_args():
+    record = picologging.LogRecord(
+        "test", logging.INFO, __file__, 1, "%s", (picologging.lazy(str, 5),), None
+    )
+    assert isinstance(record.args[0], picologging.lazy)
+    assert record.getMessage() == "5"
+    assert record.args == ("5",)
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_lazy_in_mapping_argument():
+    logger, streams = make_logger()
+    logger.info("%(state)s", {"state": picologging.lazy(str, 5)})
+    assert streams[0].getvalue() == "5\n"
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_lazy_mapping_values_resolved_once():
+    calls = []
+
+    def expensive(value):
+        calls.append(value)
+        return value * 2
+
+    logger, streams = make_logger(handlers=2)
+    args = {"a": picologging.lazy(expensive, 1), "b": picologging.lazy(expensive, 2)}
+    logger.info("%(a)r %(b)d %(a)s", args)
+    assert calls == [1, 2]
+    for stream in streams:
+        assert stream.getvalue() == "2 4 2\n"
+    # The caller's dict keeps its lazy values.
+    assert all(isinstance(value, picologging.lazy) for value in args.values())
+
+    record = picologging.LogRecord(
+        "test", logging.INFO, __file__, 1, "%(a)s", (args,), None
+    )
+    assert record.getMessage() == "2"
+    assert record.args == {"a": 2, "b": 4}
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_lazy_errors():
+    with pytest.raises(TypeError):
+        picologging.lazy()
+    with pytest.raises(TypeError):
+        picologging.lazy("not callable")
+    logger, _ = make_logger()
+    with pytest.raises(ZeroDivisionError):
+        logger.info("%s", picologging.lazy(lambda: 1 / 0))
+    assert repr(picologging.lazy(len)) == "<lazy <built-in function len>>"
@@ -1,5 +1,7 @@
 import io
 import logging
+import sys
+import traceback
 import uuid
 
 import pytest
@@ -501,6 +503,48 @@ def test_nested_frame_stack():
     assert " in f\n" in result
 
 
+class RecordingHandler(picologging.Handler):
+    def __init__(self):
+        super().__init__()
+        self.records = []
+
+    def emit(self, record):
+        self.records.append(record)
+
+
+@pytest.mark.limit_leaks("128B", filter_fn=filter_gc)
+def test_stack_info_matches_print_stack():
+    logger = picologging.Logger("test", level=picologging.DEBUG)
+    handler = RecordingHandler()
+    logger.addHandler(handler)
+
+    def recurse(depth):
+        if depth == 0:
+            _, stack = logger.info("message", stack_info=True), traceback.format_stack()
+            return stack
+        return recurse(depth - 1)
+
+    expected = "".join(recurse(8)).rstrip("\n")
+    assert handler.records[0].stack_info == expected
+    assert "[Previous line repeated" in expected
+
+
+@pytest.mark.limit_leaks("128B", filter_fn=filter_gc)
+def test_stack_info_rendered_lazily():
+    logger = picologging.Logger("test", level=picologging.DEBUG)
+    handler = RecordingHandler()
+    handler.setFormatter(picologging.Formatter("%(message)s"))
+    logger.addHandler(handler)
+
+    logger.info("first", stack_info=True)
+    logger.info("second", stack_info=True)
+    first, second = handler.records
+    first.stack_info = "custom stack"
+    assert handler.format(first) == "first\ncustom stack"
+    assert handler.format(second).startswith("second\n  File ")
+    assert second.__dict__["stack_info"] == second.stack_info
+
+
 @pytest.mark.limit_leaks("128B", filter_fn=filter_gc)
 def test_exception_object_as_exc_info():
     e = Exception("arghhh!!")
@@ -513,6 +557,68 @@ def test_exception_object_as_exc_info():
     assert "arghhh!!" in result
 
 
+@pytest.mark.limit_leaks("128B", filter_fn=filter_gc)
+def test_exception_keeps_keyword_arguments():
+    logger = picologging.Logger("test", level=picologging.DEBUG)
+    handler = RecordingHandler()
+    logger.addHandler(handler)
+    kwargs = {"stack_info": True, "extra": {"user": "bob"}}
+    try:
+        1 / 0
+    except ZeroDivisionError:
+        logger.exception("failed", **kwargs)
+        logger.exception("failed again", **kwargs)
+    assert kwargs == {"stack_info": True, "extra": {"user": "bob"}}
+    for record in handler.records:
+        assert record.exc_info[0] is ZeroDivisionError
+        assert record.stack_info is not None
+        assert record.user == "bob"
+
+
+@pytest.mark.limit_leaks("128B", filter_fn=filter_gc)
+def test_log_keeps_keyword_arguments():
+    logger = picologging.Logger("test", level=picologging.DEBUG)
+    handler = RecordingHandler()
+    logger.addHandler(handler)
+    try:
+        1 / 0
+    except ZeroDivisionError:
+        logger.log(
+            logging.INFO, "%s", "hi", exc_info=True, stack_info=True, extra={"a": 1}
+        )
+    (record,) = handler.records
+    assert record.getMessage() == "hi"
+    assert record.exc_info[0] is ZeroDivisionError
+    assert record.stack_info is not None
+    assert record.a == 1
+
+
+@pytest.mark.limit_leaks("128B", filter_fn=filter_gc)
+def test_false_exc_info_is_ignored():
+    logger = picologging.Logger("test", level=picologging.DEBUG)
+    handler = RecordingHandler()
+    logger.addHandler(handler)
+    for value in (False, None, 0, ()):
+        logger.info("message", exc_info=value)
+    assert [record.exc_info for record in handler.records] == [None] * 4
+
+
+@pytest.mark.limit_leaks("128B", filter_fn=filter_gc)
+def test_exc_info_tuple_is_not_released():
+    logger = picologging.Logger("test", level=picologging.DEBUG)
+    tmp = io.StringIO()
+    logger.addHandler(picologging.StreamHandler(tmp))
+    try:
+        raise ValueError("arghhh!!")
+    except ValueError:
+        exc_info = sys.exc_info()
+    refcount = sys.getrefcount(exc_info)
+    for _ in range(10):
+        logger.error("message", exc_info=exc_info)
+    assert sys.getrefcount(exc_info) == refcount
+    assert tmp.getvalue().count("ValueError: arghhh!!") == 10
+
+
 @pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
 def test_logger_setlevel_resets_other_levels():
     stream = io.StringIO()
@@ -757,3 +863,38 @@ def test_is_enabled_for():
 
     with pytest.raises(TypeError):
         logger.isEnabledFor("INFO")
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_assigning_handlers_keeps_list():
+    logger = picologging.Logger("test")
+    handlers = logger.handlers
+    handler = picologging.StreamHandler(io.StringIO())
+    logger.handlers = [handler]
+    assert logger.handlers is handlers
+    assert handlers == [handler]
+    logger.filters = (lambda record: False,)
+    assert len(logger.filters) == 1
+    with pytest.raises(TypeError):
+        logger.handlers = None
+
+
+def test_parent_assignment_reentered_from_children_comparison():
+    parent = picologging.Logger("parent", picologging.WARNING)
+    other = picologging.Logger("other")
+
+    class Reentrant(picologging.Logger):
+        def __eq__(self, value):
+            # Runs while the new child is looked up in parent.children.
+            if value is not other:
+                other.parent = parent
+            return False
+
+        __hash__ = picologging.Logger.__hash__
+
+    child = Reentrant("child")
+    child.parent = parent
+    logger = picologging.Logger("logger")
+    logger.parent = parent
+    assert logger.getEffectiveLevel() == picologging.WARNING
+    assert other.getEffectiveLevel() == picologging.WARNING
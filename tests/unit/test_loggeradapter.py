@@ -0,0 +1,182 @@
+import io
+import logging
+
+import pytest
+from utils import filter_gc
+
+import picologging
+
+
+def make_logger(fmt="%(levelname)s %(user)s %(message)s"):
+    stream = io.StringIO()
+    logger = picologging.Logger("test", logging.DEBUG)
+    handler = picologging.StreamHandler(stream)
+    handler.setFormatter(picologging.Formatter(fmt))
+    logger.addHandler(handler)
+    return logger, stream
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_adapter_adds_extra():
+    logger, stream = make_logger()
+    adapter = picologging.LoggerAdapter(logger, {"user": "bob"})
+    adapter.debug("debug %s", 1)
+    adapter.info("info")
+    adapter.warning("warning")
+    adapter.error("error")
+    adapter.critical("critical")
+    adapter.log(logging.INFO, "log %d", 2)
+    assert stream.getvalue() == (
+        "DEBUG bob debug 1\n"
+        "INFO bob info\n"
+        "WARNING bob warning\n"
+        "ERROR bob error\n"
+        "CRITICAL bob critical\n"
+        "INFO bob log 2\n"
+    )
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_adapter_attributes():
+    logger, _ = make_logger()
+    extra = {"user": "bob"}
+    adapter = picologging.LoggerAdapter(logger, extra)
+    assert adapter.logger is logger
+    assert adapter.name == "test"
+    assert adapter.extra == extra
+    assert adapter.merge_extra is False
+    assert repr(adapter) == "<LoggerAdapter test (DEBUG)>"
+    assert adapter.isEnabledFor(logging.DEBUG)
+    adapter.setLevel(logging.WARNING)
+    assert adapter.getEffectiveLevel() == logging.WARNING
+
+    # The adapter keeps a copy, assigning a new mapping replaces it
+    extra["user"] = "alice"
+    assert adapter.extra == {"user": "bob"}
+    adapter.extra = extra
+    assert adapter.extra == {"user": "alice"}
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_adapter_logger_attribute():
+    logger, stream = make_logger("%(name)s %(message)s")
+    other = picologging.Logger("other", logging.DEBUG)
+    other.handlers = logger.handlers
+    adapter = picologging.LoggerAdapter(logger)
+    adapter.logger = other
+    adapter.info("hello")
+    assert stream.getvalue() == "other hello\n"
+    with pytest.raises(AttributeError):
+        del adapter.logger
+    with pytest.raises(TypeError):
+        adapter.logger = None
+    with pytest.raises(TypeError):
+        picologging.LoggerAdapter("test")
+    adapter.info("still")
+    assert stream.getvalue() == "other hello\nother still\n"
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_adapter_logger_replaced_while_logging():
+    adapter = picologging.LoggerAdapter(picologging.Logger("first", logging.DEBUG))
+
+    class Replacing(picologging.Handler):
+        def emit(self, record):
+            adapter.logger = picologging.Logger("second", logging.DEBUG)
+            self.name = record.name
+
+    handler = Replacing()
+    adapter.logger.addHandler(handler)
+    adapter.info("hello")
+    assert handler.name == "first"
+    assert adapter.logger.name == "second"
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_adapter_extra_changed_in_place():
+    logger, stream = make_logger("%(user)s %(message)s")
+    adapter = picologging.LoggerAdapter(logger, {"user": "bob"})
+    adapter.extra["user"] = "alice"
+    adapter.info("hello")
+    assert stream.getvalue() == "alice hello\n"
+    adapter.extra["message"] = "bork"
+    with pytest.raises(KeyError):
+        adapter.info("bork")
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_adapter_disabled_level():
+    logger, stream = make_logger()
+    logger.setLevel(logging.WARNING)
+    adapter = picologging.LoggerAdapter(logger, {"user": "bob"})
+    adapter.debug("debug")
+    adapter.info("info")
+    adapter.log(logging.INFO, "log")
+    assert stream.getvalue() == ""
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_adapter_replaces_or_merges_call_extra():
+    logger, stream = make_logger("%(user)s %(request)s %(message)s")
+    adapter = picologging.LoggerAdapter(logger, {"user": "bob", "request": 1})
+    adapter.info("replaced", extra={"user": "alice"})
+    merging = picologging.LoggerAdapter(
+        logger, {"user": "bob", "request": 1}, merge_extra=True
+    )
+    merging.info("merged", extra={"user": "alice"})
+    assert stream.getvalue() == "bob 1 replaced\nalice 1 merged\n"
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_adapter_exception():
+    logger, stream = make_logger()
+    adapter = picologging.LoggerAdapter(logger, {"user": "bob"})
+    try:
+        1 / 0
+    except ZeroDivisionError:
+        adapter.exception("failed")
+    assert stream.getvalue().startswith("ERROR bob failed\nTraceback")
+    assert "ZeroDivisionError" in stream.getvalue()
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_adapter_invalid_extra():
+    logger, _ = make_logger()
+    with pytest.raises(KeyError):
+        picologging.LoggerAdapter(logger, {"message": "bork"})
+    with pytest.raises(KeyError):
+        logger.info("bork", extra={"levelname": "bork"})
+    with pytest.raises(TypeError):
+        picologging.LoggerAdapter(logger).info()
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_adapter_subclass_process():
+    class PrefixAdapter(picologging.LoggerAdapter):
+        def process(self, msg, kwargs):
+            msg, kwargs = super().process(msg, kwargs)
+            return "[%s] %s" % (self.extra["user"], msg), kwargs
+
+    logger, stream = make_logger()
+    PrefixAdapter(logger, {"user": "bob"}).info("hello %s", "world")
+    assert stream.getvalue() == "INFO bob [bob] hello world\n"
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_adapter_stdlib_logger():
+    stream = io.StringIO()
+    logger = logging.Logger("stdlib", logging.DEBUG)
+    handler = logging.StreamHandler(stream)
+    handler.setFormatter(logging.Formatter("%(user)s %(message)s"))
+    logger.addHandler(handler)
+    adapter = picologging.LoggerAdapter(logger, {"user": "bob"})
+    adapter.info("hello %s", "world")
+    adapter.debug("bork", extra={"user": "alice"})
+    assert stream.getvalue() == "bob hello world\nbob bork\n"
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_logger_extra():
+    logger, stream = make_logger()
+    logger.info("hello", extra={"user": "bob"})
+    assert stream.getvalue() == "INFO bob hello\n"
@@ -188,3 +188,38 @@ def test_logrecord_copy():
     assert copied_record.exc_info == record.exc_info
     assert copied_record.funcName == record.funcName
     assert copied_record.stack_info == record.stack_info
+
+
+@pytest.mark.limit_leaks("512B", filter_fn=filter_gc)
+def test_logrecord_keyword_arguments():
+    record = LogRecord(
+        "hello",
+        logging.WARNING,
+        __file__,
+        lineno=123,
+        msg="bork %s",
+        args=("boom",),
+        exc_info=None,
+        func="test",
+        sinfo="stack",
+    )
+    assert record.name == "hello"
+    assert record.levelno == logging.WARNING
+    assert record.lineno == 123
+    assert record.getMessage() == "bork boom"
+    assert record.funcName == "test"
+    assert record.stack_info == "stack"
+
+
+@pytest.mark.limit_leaks("512B", filter_fn=filter_gc)
+def test_logrecord_invalid_arguments():
+    with pytest.raises(TypeError):
+        LogRecord("hello", logging.WARNING, __file__, 123, "bork")
+    with pytest.raises(TypeError):
+        LogRecord("hello", logging.WARNING, __file__, 123, "bork", (), None, name="x")
+    with pytest.raises(TypeError):
+        LogRecord("hello", logging.WARNING, __file__, 123, "bork", (), None, bork=1)
+    with pytest.raises(TypeError):
+        LogRecord("hello", "WARNING", __file__, 123, "bork", (), None)
+    with pytest.raises(TypeError):
+        LogRecord(*range(10))
@@ -91,3 +91,39 @@ def test_format_logging_record():
     )
     record = logging.LogRecord("test", INFO, __file__, 1, "hello", (), None, None, None)
     assert perc.format(record) == "hello 20 test banana"
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+@pytest.mark.parametrize(
+    "fmt",
+    [
+        "%(message)s",
+        "%(levelname)s:%(name)s:%(message)s",
+        "%(asctime)s %(levelname)s %(name)s %(message)s",
+        "%(asctime)s - %(name)s - %(levelname)s - %(message)s",
+        "[%(levelname)s] %(message)s",
+    ],
+)
+def test_common_formats_against_builtin(fmt):
+    for name, msg in [("test", "hello"), ("tëst", "hello"), ("test", "héllo 🐍")]:
+        record = LogRecord(name, INFO, __file__, 1, msg, (), None, None, None)
+        record.message = record.getMessage()
+        record.asctime = "2024-05-01 12:30:45,123"
+        builtin = logging.makeLogRecord(
+            {"name": name, "levelname": "INFO", "levelno": INFO, "msg": msg}
+        )
+        builtin.message = builtin.getMessage()
+        builtin.asctime = record.asctime
+        assert PercentStyle(fmt).format(record) == logging.PercentStyle(fmt).format(
+            builtin
+        )
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_common_format_non_str_fields():
+    record = LogRecord(1234, INFO, __file__, 1, "hello", (), None, None, None)
+    record.message = record.getMessage()
+    assert PercentStyle("%(levelname)s:%(name)s:%(message)s").format(record) == (
+        "INFO:1234:hello"
+    )
+    assert PercentStyle("%(message)s").format(record) is record.message
@@ -171,3 +171,41 @@ def test_make_log_record():
 @pytest.mark.parametrize("encoding", ["utf-8", None])
 def test_basic_config_encoding(encoding):
     picologging.basicConfig(filename="test.txt", encoding=encoding)
+
+
+SUBINTERPRETER_CODE = (
+    "import io, picologging\n"
+    "stream = io.StringIO()\n"
+    "logger = picologging.Logger('sub', picologging.DEBUG)\n"
+    "handler = picologging.StreamHandler(stream)\n"
+    "logger.addHandler(handler)\n"
+    "logger.warning('hello %s', 'world')\n"
+    "assert stream.getvalue() == 'hello world\\n', stream.getvalue()\n"
+    "stats = picologging.stats()['handlers']\n"
+    "assert any(entry['handler'] is handler for entry in stats)\n"
+)
+
+
+def test_subinterpreter():
+    _testcapi = pytest.importorskip("_testcapi")
+    handlers = len(picologging.stats()["handlers"])
+    assert _testcapi.run_in_subinterp(SUBINTERPRETER_CODE) == 0
+    # Each interpreter has its own types and handler registry.
+    assert len(picologging.stats()["handlers"]) == handlers
+    assert picologging.getLogger("test").name == "test"
+
+
+@pytest.mark.skipif(sys.version_info < (3, 12), reason="per-interpreter GIL is 3.12+")
+def test_subinterpreter_with_own_gil():
+    support = pytest.importorskip("test.support")
+    ret = support.run_in_subinterp_with_config(
+        SUBINTERPRETER_CODE,
+        use_main_obmalloc=False,
+        allow_fork=False,
+        allow_exec=False,
+        allow_threads=True,
+        allow_daemon_threads=False,
+        check_multi_interp_extensions=True,
+        own_gil=True,
+    )
+    assert ret == 0
@@ -0,0 +1,227 @@
+import io
+import multiprocessing
+import os
+import struct
+import sys
+import threading
+import uuid
+
+import pytest
+from utils import filter_gc
+
+import picologging
+from picologging.handlers import (
+    SharedMemoryCollector,
+    SharedMemoryHandler,
+    SharedMemoryListener,
+)
+
+pytestmark = pytest.mark.skipif(
+    sys.platform == "win32", reason="POSIX shared memory is not available"
+)
+
+
+@pytest.fixture
+def name():
+    return "plog_" + uuid.uuid4().hex[:12]
+
+
+def _make_logger(name):
+    handler = SharedMemoryHandler(name)
+    logger = picologging.Logger("worker", picologging.DEBUG)
+    logger.addHandler(handler)
+    return logger, handler
+
+
+def _worker(name, count, crash=False):
+    logger, handler = _make_logger(name)
+    for i in range(count):
+        logger.info("record %d from %d", i, os.getpid())
+    if crash:
+        os._exit(1)
+    handler.close()
+
+
+def _run(target, *args):
+    process = multiprocessing.get_context("fork").Process(target=target, args=args)
+    process.start()
+    process.join()
+    return process
+
+
+def test_records_are_merged_in_timestamp_order(name):
+    collector = SharedMemoryCollector(name, slots=4, size=64 * 1024)
+    processes = [
+        multiprocessing.get_context("fork").Process(target=_worker, args=(name, 50))
+        for _ in range(3)
+    ]
+    for process in processes:
+        process.start()
+    for process in processes:
+        process.join()
+    records = collector.collect()
+    assert len(records) == 150
+    assert [r.created for r in records] == sorted(r.created for r in records)
+    for process in processes:
+        messages = [r.getMessage() for r in records if r.process == process.pid]
+        assert messages == [f"record {i} from {process.pid}" for i in range(50)]
+    # Workers closed their handler, so their slots are free again.
+    assert collector.workers == []
+    assert collector.dropped == 0
+    collector.close()
+
+
+def test_crashed_worker_slot_is_reclaimed(name):
+    collector = SharedMemoryCollector(name, slots=1, size=8192)
+    crashed = _run(_worker, name, 3, True)
+    assert crashed.exitcode == 1
+    assert collector.workers == [crashed.pid]
+    records = collector.collect()
+    assert [r.getMessage() for r in records] == [
+        f"record {i} from {crashed.pid}" for i in range(3)
+    ]
+    assert collector.workers == []
+
+    # The only slot can be claimed by the next worker.
+    process = _run(_worker, name, 2)
+    records = collector.collect()
+    assert [r.getMessage() for r in records] == [
+        f"record {i} from {process.pid}" for i in range(2)
+    ]
+    assert collector.dropped == 0
+    collector.close()
+
+
+@pytest.mark.skipif(
+    not os.path.isdir("/dev/shm"), reason="shared memory is not mapped in /dev/shm"
+)
+def test_slot_of_worker_dying_mid_claim_is_reclaimed(name):
+    collector = SharedMemoryCollector(name, slots=1, size=8192)
+    dead = _run(_worker, name, 0)
+    # Mark the slot claimed by the dead worker, as if it died before creating its ring.
+    with open(f"/dev/shm/{name}", "r+b") as registry:
+        registry.seek(64)
+        registry.write(struct.pack("<II", 1, dead.pid))
+    assert collector.collect() == []
+
+    process = _run(_worker, name, 2)
+    records = collector.collect()
+    assert [r.getMessage() for r in records] == [
+        f"record {i} from {process.pid}" for i in range(2)
+    ]
+    assert collector.dropped == 0
+    collector.close()
+
+
+def test_forked_child_claims_its_own_slot(name):
+    collector = SharedMemoryCollector(name, slots=2, size=8192)
+    logger, handler = _make_logger(name)
+    assert handler.memoryName == name
+    assert handler.slot is None
+    logger.info("parent")
+    assert handler.slot == 0
+    pid = os.fork()
+    if pid == 0:
+        # The inherited handler must not write into the parent's ring.
+        logger.info("child")
+        os._exit(0 if handler.slot == 1 else 1)
+    _, status = os.waitpid(pid, 0)
+    assert os.WEXITSTATUS(status) == 0
+    records = collector.collect()
+    assert [(r.getMessage(), r.process) for r in records] == [
+        ("parent", os.getpid()),
+        ("child", pid),
+    ]
+    assert collector.workers == [os.getpid()]
+    handler.close()
+    collector.collect()
+    assert collector.workers == []
+    collector.close()
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_full_ring_drops_records(name):
+    collector = SharedMemoryCollector(name, slots=1, size=4096)
+    logger, handler = _make_logger(name)
+    for i in range(200):
+        logger.info("record %d", i)
+    records = collector.collect()
+    assert handler.dropped > 0
+    assert len(records) + handler.dropped == 200
+    assert [r.getMessage() for r in records] == [
+        f"record {i}" for i in range(len(records))
+    ]
+    # Collecting frees the ring for new records.
+    logger.info("after")
+    assert [r.getMessage() for r in collector.collect()] == ["after"]
+    assert collector.dropped == handler.dropped
+    handler.close()
+    collector.close()
+
+
+def test_workers_without_a_slot_are_counted(name):
+    collector = SharedMemoryCollector(name, slots=1, size=8192)
+    logger, handler = _make_logger(name)
+    logger.info("parent")
+    _run(_worker, name, 3)
+    assert [r.getMessage() for r in collector.collect()] == ["parent"]
+    assert collector.dropped == 3
+    handler.close()
+    collector.close()
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_records_are_not_pickled(name):
+    collector = SharedMemoryCollector(name, slots=1, size=8192)
+    logger, handler = _make_logger(name)
+    lock = threading.Lock()
+    try:
+        1 / 0
+    except ZeroDivisionError:
+        logger.exception("holding %r", lock)
+    (record,) = collector.collect()
+    assert record.getMessage() == f"holding {lock!r}"
+    assert record.levelno == picologging.ERROR
+    assert record.name == "worker"
+    assert record.lineno > 0
+    assert "ZeroDivisionError" in record.exc_text
+    handler.close()
+    collector.close()
+
+
+def test_listener(name):
+    stream = io.StringIO()
+    target = picologging.StreamHandler(stream)
+    target.setFormatter(picologging.Formatter("%(levelname)s %(message)s"))
+    listener = SharedMemoryListener(name, target, slots=2, size=8192, interval=0.01)
+    listener.start()
+    process = _run(_worker, name, 2)
+    listener.stop()
+    listener.close()
+    assert stream.getvalue() == (
+        f"INFO record 0 from {process.pid}\nINFO record 1 from {process.pid}\n"
+    )
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_errors(name):
+    with pytest.raises(ValueError):
+        SharedMemoryCollector("a/b")
+    with pytest.raises(ValueError):
+        SharedMemoryCollector(name, slots=0)
+    with pytest.raises(ValueError):
+        SharedMemoryCollector(name, size=100)
+
+    logger, handler = _make_logger(name)
+    record = picologging.LogRecord("test", picologging.INFO, __file__, 1, "x", (), None)
+    # The collector has to exist before workers log.
+    with pytest.raises(FileNotFoundError):
+        handler.emit(record)
+    handler.close()
+    with pytest.raises(ValueError):
+        handler.emit(record)
+
+    collector = SharedMemoryCollector(name, slots=1, size=8192)
+    collector.close()
+    with pytest.raises(ValueError):
+        collector.collect()
@@ -12,9 +12,16 @@ from socketserver import (
 )
 
 import pytest
+from utils import filter_gc
 
 import picologging
-from picologging.handlers import DatagramHandler, SocketHandler
+from picologging.handlers import (
+    BinarySocketHandler,
+    DatagramHandler,
+    SocketHandler,
+    decodeRecords,
+    encodeRecord,
+)
 
 
 class ControlMixin:
@@ -79,6 +86,28 @@ class TCPServer(ControlMixin, ThreadingTCPServer):
             self.handled.release()
 
 
+class BinaryTCPServer(TCPServer):
+    def __init__(self, addr, poll_interval=0.5, bind_and_activate=True):
+        TCPServer.__init__(self, addr, poll_interval, bind_and_activate)
+        self.records = []
+        self.chunks = 0
+
+    def handle_socket(self, request):
+        conn = request.connection
+        pending = bytearray()
+        while True:
+            chunk = conn.recv(65536)
+            if not chunk:
+                break
+            self.chunks += 1
+            pending += chunk
+            records, consumed = decodeRecords(pending)
+            del pending[:consumed]
+            for record in records:
+                self.records.append(record)
+                self.handled.release()
+
+
 class UDPServer(ControlMixin, ThreadingUDPServer):
     def __init__(self, addr, poll_interval=0.5, bind_and_activate=True):
         class DelegatingUDPRequestHandler(DatagramRequestHandler):
@@ -274,3 +303,157 @@ def test_unix_datagramhandler():
     handler.close()
     server.stop()
     os.remove(address)
+
+
+def test_binary_sockethandler():
+    server = BinaryTCPServer(("localhost", 0), 0.01)
+    server.start()
+    server.ready.wait()
+
+    handler = BinarySocketHandler("localhost", server.port, flushInterval=0.05)
+    logger = picologging.getLogger("test")
+    logger.setLevel(picologging.DEBUG)
+    logger.addHandler(handler)
+
+    logger.error("test %s", "one")
+    logger.debug("test two")
+    for _ in range(2):
+        assert server.handled.acquire(timeout=5)
+
+    assert [record.getMessage() for record in server.records] == [
+        "test one",
+        "test two",
+    ]
+    record = server.records[0]
+    assert record.name == "test"
+    assert record.levelno == picologging.ERROR
+    assert record.levelname == "ERROR"
+    assert record.args is None
+    assert record.process == os.getpid()
+    assert record.thread == threading.get_ident()
+
+    logger.removeHandler(handler)
+    handler.close()
+    server.stop()
+
+
+def test_binary_sockethandler_batches_until_size():
+    server = BinaryTCPServer(("localhost", 0), 0.01)
+    server.start()
+    server.ready.wait()
+
+    handler = BinarySocketHandler(
+        "localhost", server.port, batchSize=1 << 20, flushInterval=None
+    )
+    logger = picologging.getLogger("test")
+    logger.setLevel(picologging.DEBUG)
+    logger.addHandler(handler)
+
+    for i in range(100):
+        logger.info("message %d", i)
+    assert handler.sock is None
+    assert len(handler.batch) > 0
+
+    handler.flush()
+    for _ in range(100):
+        assert server.handled.acquire(timeout=5)
+    assert not handler.batch
+    assert [record.getMessage() for record in server.records] == [
+        "message %d" % i for i in range(100)
+    ]
+
+    handler.batchSize = 1
+    logger.warning("sent immediately")
+    assert server.handled.acquire(timeout=5)
+    assert server.records[-1].getMessage() == "sent immediately"
+
+    logger.removeHandler(handler)
+    handler.close()
+    server.stop()
+
+
+def test_binary_sockethandler_close_flushes():
+    server = BinaryTCPServer(("localhost", 0), 0.01)
+    server.start()
+    server.ready.wait()
+
+    handler = BinarySocketHandler("localhost", server.port, flushInterval=60)
+    logger = picologging.getLogger("test")
+    logger.setLevel(picologging.DEBUG)
+    logger.addHandler(handler)
+    logger.info("pending")
+    logger.removeHandler(handler)
+    handler.close()
+
+    assert server.handled.acquire(timeout=5)
+    assert server.records[0].getMessage() == "pending"
+    server.stop()
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_encode_decode_roundtrip():
+    logger = picologging.Logger("roundtrip", picologging.DEBUG)
+    records = []
+
+    class Capture(picologging.Handler):
+        def emit(self, record):
+            records.append(record)
+
+    logger.addHandler(Capture())
+    try:
+        1 / 0
+    except ZeroDivisionError:
+        logger.error("failed \udcff %d", 42, exc_info=True, stack_info=True)
+    logger.info("plain")
+
+    buffer = bytearray()
+    size = encodeRecord(records[0], buffer)
+    assert size == len(buffer)
+    encodeRecord(records[1], buffer)
+
+    decoded, consumed = decodeRecords(buffer)
+    assert consumed == len(buffer)
+    assert len(decoded) == 2
+    original, record = records[0], decoded[0]
+    assert record.msg == "failed \udcff 42"
+    assert record.getMessage() == "failed \udcff 42"
+    for attr in (
+        "name",
+        "levelno",
+        "levelname",
+        "pathname",
+        "filename",
+        "module",
+        "funcName",
+        "lineno",
+        "created",
+        "msecs",
+        "relativeCreated",
+        "thread",
+        "process",
+        "exc_text",
+        "stack_info",
+    ):
+        assert getattr(record, attr) == getattr(original, attr), attr
+    assert "ZeroDivisionError" in record.exc_text
+    assert record.exc_info is None
+    assert decoded[1].exc_text is None
+    assert decoded[1].stack_info is None
+
+    # A trailing partial frame is left for the next read.
+    decoded, consumed = decodeRecords(bytes(buffer[:-3]))
+    assert len(decoded) == 1
+    assert consumed < len(buffer) - 3
+    assert decodeRecords(b"") == ([], 0)
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_decode_records_malformed():
+    with pytest.raises(ValueError):
+        decodeRecords(struct.pack(">L", 1) + b"\x09")
+    with pytest.raises(ValueError):
+        decodeRecords(struct.pack(">L", 5) + b"\x01\x00\x00\x00\x10")
+    with pytest.raises(TypeError):
+        encodeRecord(object(), bytearray())
+    with pytest.raises(TypeError):
+        encodeRecord(picologging.makeLogRecord({}), b"")
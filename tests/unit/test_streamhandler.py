@@ -1,9 +1,12 @@
 import io
 import logging
+import os
 import sys
+import threading
+import time
 
 import pytest
-from utils import filter_gc
+from utils import filter_gc, stats_enabled  # noqa: F401
 
 import picologging
 
@@ -169,3 +172,128 @@ def test_emit_subclass():
     handler = picologging.StreamHandler(stream)
     handler.emit(record)
     assert stream.getvalue() == "bork boom\n"
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+@pytest.mark.usefixtures("stats_enabled")
+def test_direct_write_keeps_stream_order(tmp_path):
+    path = tmp_path / "log.txt"
+    with open(path, "w", encoding="utf-8") as stream:
+        handler = picologging.StreamHandler(stream)
+        record = picologging.LogRecord(
+            "test", logging.INFO, __file__, 1, "café", (), None
+        )
+        stream.write("before\n")
+        # Turning direct writes on flushes what the stream holds.
+        handler.directWrite = True
+        handler.handle(record)
+        stream.write("after\n")
+        handler.flush()
+        assert handler.stats()["bytesWritten"] == len("café\n".encode())
+    assert path.read_text(encoding="utf-8") == "before\ncafé\nafter\n"
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+@pytest.mark.parametrize("encoding,directWrite", [("utf-8", False), ("latin-1", True)])
+def test_write_through_stream(tmp_path, encoding, directWrite):
+    path = tmp_path / "log.txt"
+    with open(path, "w", encoding=encoding) as stream:
+        handler = picologging.StreamHandler(stream)
+        handler.directWrite = directWrite
+        record = picologging.LogRecord(
+            "test", logging.INFO, __file__, 1, "café", (), None
+        )
+        handler.emit(record)
+    assert path.read_text(encoding=encoding) == "café\n"
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_newline_translation_by_default(tmp_path):
+    path = tmp_path / "log.txt"
+    with open(path, "w", encoding="utf-8", newline="\r\n") as stream:
+        handler = picologging.StreamHandler(stream)
+        assert not handler.directWrite
+        for msg in ("a", "b"):
+            record = picologging.LogRecord(
+                "test", logging.INFO, __file__, 1, msg, (), None
+            )
+            handler.emit(record)
+    assert path.read_bytes() == b"a\r\nb\r\n"
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_direct_write_to_closed_stream(tmp_path):
+    stream = open(tmp_path / "log.txt", "w", encoding="utf-8")
+    handler = picologging.StreamHandler(stream)
+    handler.directWrite = True
+    stream.close()
+    record = picologging.LogRecord("test", logging.INFO, __file__, 1, "test", (), None)
+    with pytest.raises(ValueError):
+        handler.emit(record)
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+@pytest.mark.parametrize("encoding", ["ascii", "latin-1", "cp1252"])
+def test_direct_write_ascii_compatible(tmp_path, encoding):
+    path = tmp_path / "log.txt"
+    messages = ["plain"] if encoding == "ascii" else ["plain", "naïve"]
+    # newline translation is only done by the stream, so it shows which records skipped it
+    with open(path, "w", encoding=encoding, newline="\r\n") as stream:
+        handler = picologging.StreamHandler(stream)
+        handler.directWrite = True
+        for msg in messages:
+            record = picologging.LogRecord(
+                "test", logging.INFO, __file__, 1, msg, (), None
+            )
+            handler.emit(record)
+    expected = "plain\n" if encoding == "ascii" else "plain\nnaïve\r\n"
+    assert path.read_bytes() == expected.encode(encoding)
+
+
+@pytest.mark.skipif(sys.platform == "win32", reason="POSIX descriptors")
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+@pytest.mark.parametrize("encoding", ["UTF8", "utf_8", "U8", "latin1", "646"])
+def test_direct_write_encoding_aliases(tmp_path, encoding):
+    path = tmp_path / "log.txt"
+    with open(path, "w", encoding=encoding, newline="\r\n") as stream:
+        handler = picologging.StreamHandler(stream)
+        handler.directWrite = True
+        record = picologging.LogRecord(
+            "test", logging.INFO, __file__, 1, "plain", (), None
+        )
+        handler.emit(record)
+    # Skipped the stream's newline translation, so it was written directly.
+    assert path.read_bytes() == b"plain\n"
+
+
+@pytest.mark.skipif(sys.platform == "win32", reason="POSIX pipes")
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_direct_write_nonblocking_pipe():
+    read_fd, write_fd = os.pipe()
+    os.set_blocking(write_fd, False)
+    received = []
+
+    def read():
+        time.sleep(0.2)  # Let the pipe fill up first
+        while True:
+            data = os.read(read_fd, 65536)
+            if not data:
+                break
+            received.append(data)
+
+    reader = threading.Thread(target=read)
+    reader.start()
+    stream = open(write_fd, "w", encoding="utf-8")
+    handler = picologging.StreamHandler(stream)
+    handler.directWrite = True
+    record = picologging.LogRecord(
+        "test", logging.INFO, __file__, 1, "x" * 1000, (), None
+    )
+    # More than a pipe holds, so writes hit EAGAIN until the reader catches up
+    for _ in range(400):
+        handler.emit(record)
+    stream.close()
+    reader.join()
+    os.close(read_fd)
+    lines = b"".join(received).split(b"\n")
+    assert lines == [b"x" * 1000] * 400 + [b""]
@@ -0,0 +1,241 @@
+import os
+import re
+import socket
+import tempfile
+import threading
+
+import pytest
+from utils import filter_gc
+
+import picologging
+from picologging.handlers import SysLogHandler
+
+unix_only = pytest.mark.skipif(
+    not hasattr(socket, "AF_UNIX"), reason="Unix sockets required"
+)
+
+
+@pytest.fixture
+def unix_server():
+    path = tempfile.NamedTemporaryFile(prefix="picologging_", suffix=".sock").name
+    server = socket.socket(socket.AF_UNIX, socket.SOCK_DGRAM)
+    server.bind(path)
+    server.settimeout(5)
+    yield server, path
+    server.close()
+    os.remove(path)
+
+
+@pytest.fixture
+def udp_server():
+    server = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    server.bind(("127.0.0.1", 0))
+    server.settimeout(5)
+    yield server, server.getsockname()
+    server.close()
+
+
+@unix_only
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_sysloghandler_unix(unix_server):
+    server, path = unix_server
+    handler = SysLogHandler(path)
+    handler.ident = "app: "
+    logger = picologging.Logger("test", picologging.DEBUG)
+    logger.addHandler(handler)
+
+    logger.debug("debug")
+    logger.info("info %d", 1)
+    logger.warning("warning")
+    logger.error("error")
+    logger.critical("critical")
+
+    assert [server.recv(1024) for _ in range(5)] == [
+        b"<15>app: debug\x00",
+        b"<14>app: info 1\x00",
+        b"<12>app: warning\x00",
+        b"<11>app: error\x00",
+        b"<10>app: critical\x00",
+    ]
+    handler.close()
+    assert handler.socket is None
+
+
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_sysloghandler_udp_facility(udp_server):
+    server, address = udp_server
+    handler = SysLogHandler(address, facility="local0")
+    handler.append_nul = False
+    handler.setFormatter(picologging.Formatter("%(name)s %(message)s"))
+    assert handler.facility == SysLogHandler.LOG_LOCAL0
+    logger = picologging.Logger("test", picologging.DEBUG)
+    logger.addHandler(handler)
+
+    logger.warning("caf\u00e9")
+    assert server.recv(1024) == "<132>test caf\u00e9".encode()
+    handler.close()
+
+
+@unix_only
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_sysloghandler_batches(unix_server):
+    server, path = unix_server
+    handler = SysLogHandler(
+        path, facility=SysLogHandler.LOG_DAEMON, batchSize=4, flushInterval=None
+    )
+    logger = picologging.Logger("test", picologging.DEBUG)
+    logger.addHandler(handler)
+
+    server.setblocking(False)
+    for i in range(3):
+        logger.info("message %d", i)
+    with pytest.raises(BlockingIOError):
+        server.recv(1024)
+
+    logger.info("message 3")
+    assert [server.recv(1024) for _ in range(4)] == [
+        b"<30>message %d\x00" % i for i in range(4)
+    ]
+
+    logger.info("pending")
+    handler.flush()
+    assert server.recv(1024) == b"<30>pending\x00"
+    logger.info("closing")
+    handler.close()
+    assert server.recv(1024) == b"<30>closing\x00"
+
+
+@unix_only
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_sysloghandler_batch_sent_on_error(unix_server):
+    server, path = unix_server
+    handler = SysLogHandler(path, batchSize=100, flushInterval=None)
+    logger = picologging.Logger("test", picologging.DEBUG)
+    logger.addHandler(handler)
+
+    logger.info("before")
+    logger.error("failed")
+    server.setblocking(False)
+    assert [server.recv(1024) for _ in range(2)] == [
+        b"<14>before\x00",
+        b"<11>failed\x00",
+    ]
+    handler.flushLevel = picologging.CRITICAL
+    logger.error("held")
+    with pytest.raises(BlockingIOError):
+        server.recv(1024)
+    handler.close()
+    assert server.recv(1024) == b"<11>held\x00"
+
+
+@unix_only
+def test_sysloghandler_batch_sent_after_interval(unix_server):
+    server, path = unix_server
+    handler = SysLogHandler(path, batchSize=100, flushInterval=0.05)
+    assert handler.flushInterval == 0.05
+    logger = picologging.Logger("test", picologging.DEBUG)
+    logger.addHandler(handler)
+
+    logger.info("first")
+    logger.info("second")
+    # Nobody flushes the handler, the timer sends the partial batch.
+    assert [server.recv(1024) for _ in range(2)] == [
+        b"<14>first\x00",
+        b"<14>second\x00",
+    ]
+    logger.info("third")
+    assert server.recv(1024) == b"<14>third\x00"
+    handler.close()
+
+
+@unix_only
+def test_sysloghandler_blocked_send_releases_gil(unix_server):
+    server, path = unix_server
+    handler = SysLogHandler(path)
+    logger = picologging.Logger("test", picologging.DEBUG)
+    logger.addHandler(handler)
+    count = 200
+    sender = threading.Thread(
+        target=lambda: [logger.info("message %d", i) for i in range(count)]
+    )
+    sender.start()
+    # The server isn't reading, so the sender ends up blocked in the kernel.
+    # This thread still runs Python code meanwhile.
+    sender.join(0.2)
+    assert sender.is_alive()
+    assert len([server.recv(1024) for _ in range(count)]) == count
+    sender.join()
+    handler.close()
+
+
+@unix_only
+@pytest.mark.limit_leaks("192B", filter_fn=filter_gc)
+def test_sysloghandler_rfc5424(unix_server):
+    server, path = unix_server
+    handler = SysLogHandler(path, rfc5424=True, hostname="host", appname="app")
+    logger = picologging.Logger("test", picologging.DEBUG)
+    logger.addHandler(handler)
+
+    logger.error("failed")
+    message = server.recv(1024)
+    match = re.fullmatch(
+        rb"<11>1 (\d{4}-\d\d-\d\dT\d\d:\d\d:\d\d\.\d{6}Z) host app (\d+) - - failed\x00",
+        message,
+    )
+    assert match is not None, message
+    assert int(match.group(2)) == os.getpid()
+    handler.close()
+
+    handler = SysLogHandler(path, rfc5424=True)
+    handler.append_nul = False
+    handler.handle(picologging.makeLogRecord({"msg": "plain", "levelno": 20}))
+    assert re.fullmatch(rb"<14>1 \S+ - - \d+ - - plain", server.recv(1024))
+    handler.close()
+
+
+@unix_only
+def test_sysloghandler_unix_reconnect():
+    path = tempfile.NamedTemporaryFile(prefix="picologging_", suffix=".sock").name
+    server = socket.socket(socket.AF_UNIX, socket.SOCK_DGRAM)
+    server.bind(path)
+    handler = SysLogHandler(path)
+    server.close()
+    os.remove(path)
+
+    # The daemon restarted, the next send reconnects to the new socket.
+    server = socket.socket(socket.AF_UNIX, socket.SOCK_DGRAM)
+    server.bind(path)
+    server.settimeout(5)
+    try:
+        handler.emit(picologging.makeLogRecord({"msg": "again", "levelno": 30}))
+        assert server.recv(1024) == b"<12>again\x00"
+    finally:
+        handler.close()
+        server.close()
+        os.remove(path)
+
+
+def test_sysloghandler_invalid_arguments():
+    with pytest.raises(ValueError):
+        SysLogHandler(("127.0.0.1", 514), facility="nope")
+    with pytest.raises(ValueError):
+        SysLogHandler(("127.0.0.1", 514), facility=99)
+    with pytest.raises(ValueError):
+        SysLogHandler(("127.0.0.1", 514), batchSize=0)
+    with pytest.raises(ValueError):
+        SysLogHandler(("127.0.0.1", 514), flushInterval=0)
+    with pytest.raises(TypeError):
+        SysLogHandler(("127.0.0.1",))
+
+
+@unix_only
+def test_sysloghandler_missing_socket():
+    path = tempfile.NamedTemporaryFile(prefix="picologging_", suffix=".sock").name
+    with pytest.raises(OSError):
+        SysLogHandler(path)
+
+
+def test_sysloghandler_repr():
+    handler = SysLogHandler(("127.0.0.1", 514))
+    assert repr(handler) == "<SysLogHandler ('127.0.0.1', 514) (NOTSET)>"
+    handler.close()
@@ -1,8 +1,9 @@
 import io
 import threading
+import time
 
 import pytest
-from utils import filter_gc
+from utils import filter_gc, stats_enabled  # noqa: F401
 
 import picologging
 from picologging import Logger, StreamHandler
@@ -23,3 +24,92 @@ def test_threaded_execution():
     t.join()
     result = tmp.getvalue()
     assert result == "from thread\n"
+
+
+def test_threads_contending_on_file_writes(tmp_path):
+    # File writes release the GIL while the handler lock is held, so threads
+    # waiting for the lock must not hold the GIL.
+    logger = Logger("test", picologging.DEBUG)
+    handler = picologging.FileHandler(tmp_path / "log.txt")
+    logger.addHandler(handler)
+
+    def _log_messages():
+        for i in range(2000):
+            logger.debug("message %d", i)
+
+    threads = [threading.Thread(target=_log_messages, daemon=True) for _ in range(4)]
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join(timeout=30)
+    assert not any(t.is_alive() for t in threads)
+    handler.close()
+    with open(tmp_path / "log.txt") as f:
+        assert len(f.readlines()) == 8000
+
+
+@pytest.mark.usefixtures("stats_enabled")
+def test_reconfiguring_while_logging():
+    logger = Logger("test", picologging.DEBUG)
+    stream = io.StringIO()
+    handler = StreamHandler(stream)
+    logger.addHandler(handler)
+    stop = threading.Event()
+
+    def _log_messages():
+        while not stop.is_set():
+            logger.info("message")
+
+    def _reconfigure():
+        for i in range(500):
+            extra = StreamHandler(io.StringIO())
+            logger.addHandler(extra)
+            logger.addFilter(lambda record: True)
+            logger.setLevel(picologging.INFO if i % 2 else picologging.DEBUG)
+            logger.removeHandler(extra)
+            logger.filters = []
+            logger.handlers = [handler]
+
+    threads = [threading.Thread(target=_log_messages, daemon=True) for _ in range(4)]
+    for t in threads:
+        t.start()
+    _reconfigure()
+    stop.set()
+    for t in threads:
+        t.join(timeout=30)
+    assert not any(t.is_alive() for t in threads)
+    # INFO is enabled at both levels, a record is never dropped mid-update
+    assert logger.handlers == [handler]
+    assert handler.stats()["emitted"] == stream.getvalue().count("message\n") > 0
+
+
+def test_formatting_from_many_threads():
+    handler = picologging.Handler()
+    barrier = threading.Barrier(8)
+    formatters = set()
+    mismatches = []
+
+    def _format(offset):
+        barrier.wait()
+        for i in range(500):
+            record = picologging.LogRecord(
+                "test", picologging.INFO, __file__, 1, "test", (), None
+            )
+            # Different threads render different seconds through one cache.
+            record.created = float(offset * 1000 + i % 3)
+            handler.format(record)
+            formatters.add(id(handler.formatter))
+            expected = time.strftime("%H:%M:%S", time.localtime(record.created))
+            if shared.format(record) != expected:
+                mismatches.append(record.created)
+
+    shared = picologging.Formatter("%(asctime)s", datefmt="%H:%M:%S")
+    threads = [threading.Thread(target=_format, args=(i,)) for i in range(8)]
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join(timeout=30)
+    assert not any(t.is_alive() for t in threads)
+    # The default formatter is created once.
+    assert len(formatters) == 1
+    assert mismatches == []
@@ -1,6 +1,19 @@
+import pytest
+
+import picologging
+
+
 def filter_gc(stack):
     for frame in stack.frames[:4]:
         if "picologging" in frame.filename and "test_" not in frame.filename:
             return True
 
     return False
+
+
+@pytest.fixture
+def stats_enabled():
+    """Turn handler statistics on for the test, they are off by default."""
+    previous = picologging.enableStats(True)
+    yield
+    picologging.enableStats(previous)